@@ -29,12 +29,18 @@
 #include <string.h>
 #include <stdint.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <assert.h>
+#include <config.h>
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 
 #include "../util/tmap_error.h"
 #include "../util/tmap_alloc.h"
 #include "../util/tmap_progress.h"
 #include "../util/tmap_definitions.h"
+#include "../util/tmap_placement.h"
 #include "../io/tmap_file.h"
 #include "tmap_bwt_gen.h"
 #include "tmap_bwt.h"
@@ -52,11 +58,38 @@ static inline void
 tmap_bwt_update_optimizations(tmap_bwt_t *bwt)
 {
   bwt->occ_interval_log2 = tmap_log2(bwt->occ_interval);
-  bwt->occ_array_16_pt2 = (bwt->occ_interval/(sizeof(uint32_t)<<3>>1) + (sizeof(tmap_bwt_int_t)>>2<<2));
+  if(TMAP_BWT_OCC_LAYOUT_LINE == bwt->occ_layout) {
+      bwt->occ_array_16_pt2 = TMAP_BWT_LINE_WORDS;
+  }
+  else {
+      bwt->occ_array_16_pt2 = (bwt->occ_interval/(sizeof(uint32_t)<<3>>1) + (sizeof(tmap_bwt_int_t)>>2<<2));
+  }
+  bwt->rank = tmap_bwt_rank_best();
+}
+
+// sets the occurrence array layout from the version id
+static inline void
+tmap_bwt_set_occ_layout(tmap_bwt_t *bwt)
+{
+  if(TMAP_VERSION_ID == bwt->version_id) {
+      bwt->occ_layout = TMAP_BWT_OCC_LAYOUT_INTERLEAVED;
+  }
+  else if(TMAP_BWT_LINE_VERSION_ID == bwt->version_id) {
+      bwt->occ_layout = TMAP_BWT_OCC_LAYOUT_LINE;
+  }
+  else {
+      tmap_error("version id did not match", Exit, ReadFileError);
+  }
 }
 
 tmap_bwt_t *
 tmap_bwt_read(const char *fn_fasta)
+{
+  return tmap_bwt_read_placed(fn_fasta, TMAP_PLACEMENT_HUGE_PAGES_NONE, TMAP_PLACEMENT_NUMA_NONE);
+}
+
+tmap_bwt_t *
+tmap_bwt_read_placed(const char *fn_fasta, int32_t huge_pages, int32_t numa)
 {
   tmap_bwt_t *bwt = NULL;
   char *fn_bwt = NULL;
@@ -72,11 +105,22 @@ tmap_bwt_read(const char *fn_fasta)
       tmap_error(NULL, Exit, ReadFileError);
   }
 
-  if(bwt->version_id != TMAP_VERSION_ID) {
-      tmap_error("version id did not match", Exit, ReadFileError);
-  }
+  tmap_bwt_set_occ_layout(bwt);
 
-  bwt->bwt = tmap_calloc(bwt->bwt_size, sizeof(tmap_bwt_int_t), "bwt->bwt");
+  if(TMAP_PLACEMENT_HUGE_PAGES_NONE == huge_pages && TMAP_PLACEMENT_NUMA_NONE == numa) {
+      if(TMAP_BWT_OCC_LAYOUT_LINE == bwt->occ_layout) {
+          // NB: each occurrence must start a cache line
+          bwt->bwt = tmap_memalign(TMAP_BWT_LINE_BYTES, bwt->bwt_size*sizeof(uint32_t), "bwt->bwt");
+      }
+      else {
+          bwt->bwt = tmap_calloc(bwt->bwt_size, sizeof(tmap_bwt_int_t), "bwt->bwt");
+      }
+  }
+  else {
+      bwt->bwt = tmap_placement_alloc(bwt->bwt_size*sizeof(uint32_t), huge_pages, numa, 0);
+      bwt->is_placed = 1;
+      bwt->huge_pages = huge_pages;
+  }
 
   if(1 != tmap_file_fread(&bwt->hash_width, sizeof(int32_t), 1, fp_bwt)
      || 1 != tmap_file_fread(&bwt->primary, sizeof(tmap_bwt_int_t), 1, fp_bwt)
@@ -86,7 +130,8 @@ tmap_bwt_read(const char *fn_fasta)
      || bwt->bwt_size != tmap_file_fread(bwt->bwt, sizeof(uint32_t), bwt->bwt_size, fp_bwt)) {
       tmap_error(NULL, Exit, ReadFileError);
   }
-  if(0 != (bwt->occ_interval % 2)) {
+  if(0 != (bwt->occ_interval % 2)
+     || (TMAP_BWT_OCC_LAYOUT_LINE == bwt->occ_layout && TMAP_BWT_LINE_OCC_INTERVAL != bwt->occ_interval)) {
       tmap_error("BWT interval not supported", Exit, OutOfRange);
   }
 
@@ -208,15 +253,18 @@ tmap_bwt_shm_num_bytes(tmap_bwt_t *bwt)
   n += 256*sizeof(uint32_t); // cnt_table[256]
   n += sizeof(int32_t); // hash_width
 
-  //variable length data
+  //variable length data, each array starting on a page boundary
+  n = __tmap_packed_align(n);
   n += sizeof(uint32_t)*bwt->bwt_size; // bwt
   for(i=1;i<=bwt->hash_width;i++) {
       uint64_t hash_length = tmap_bwt_get_hash_length(i);
+      n = __tmap_packed_align(n);
       n += sizeof(tmap_bwt_int_t)*hash_length; // hash_k[i-1]
+      n = __tmap_packed_align(n);
       n += sizeof(tmap_bwt_int_t)*hash_length; // hash_l[i-1]
   }
 
-  return n;
+  return __tmap_packed_align(n);
 }
 
 size_t
@@ -237,9 +285,7 @@ tmap_bwt_shm_read_num_bytes(const char *fn_fasta)
       tmap_error(NULL, Exit, ReadFileError);
   }
 
-  if(bwt->version_id != TMAP_VERSION_ID) {
-      tmap_error("version id did not match", Exit, ReadFileError);
-  }
+  tmap_bwt_set_occ_layout(bwt);
 
   if(1 != tmap_file_fread(&bwt->hash_width, sizeof(int32_t), 1, fp_bwt)
      || 1 != tmap_file_fread(&bwt->primary, sizeof(tmap_bwt_int_t), 1, fp_bwt)
@@ -270,6 +316,7 @@ uint8_t *
 tmap_bwt_shm_pack(tmap_bwt_t *bwt, uint8_t *buf)
 {
   uint32_t i;
+  uint8_t *start = buf;
   // fixed length data
   memcpy(buf, &bwt->version_id, sizeof(uint32_t)); buf += sizeof(uint32_t);
   memcpy(buf, &bwt->primary, sizeof(tmap_bwt_int_t)); buf += sizeof(tmap_bwt_int_t);
@@ -280,13 +327,16 @@ tmap_bwt_shm_pack(tmap_bwt_t *bwt, uint8_t *buf)
   memcpy(buf, bwt->cnt_table, 256*sizeof(uint32_t)); buf += 256*sizeof(uint32_t);
   memcpy(buf, &bwt->hash_width, sizeof(int32_t)); buf += sizeof(uint32_t);
   // variable length data
+  buf = tmap_packed_pad(start, buf);
   memcpy(buf, bwt->bwt, bwt->bwt_size*sizeof(uint32_t)); buf += bwt->bwt_size*sizeof(uint32_t);
   for(i=1;i<=bwt->hash_width;i++) {
       uint64_t hash_length = tmap_bwt_get_hash_length(i);
+      buf = tmap_packed_pad(start, buf);
       memcpy(buf, bwt->hash_k[i-1], hash_length*sizeof(tmap_bwt_int_t)); buf += hash_length*sizeof(tmap_bwt_int_t);
+      buf = tmap_packed_pad(start, buf);
       memcpy(buf, bwt->hash_l[i-1], hash_length*sizeof(tmap_bwt_int_t)); buf += hash_length*sizeof(tmap_bwt_int_t);
   }
-  return buf;
+  return tmap_packed_pad(start, buf);
 }
 
 tmap_bwt_t *
@@ -294,6 +344,7 @@ tmap_bwt_shm_unpack(uint8_t *buf)
 {
   tmap_bwt_t *bwt = NULL;
   uint32_t i;
+  uint8_t *start = buf;
 
   if(NULL == buf) return NULL;
 
@@ -309,15 +360,20 @@ tmap_bwt_shm_unpack(uint8_t *buf)
   memcpy(bwt->cnt_table, buf, 256*sizeof(uint32_t)); buf += 256*sizeof(uint32_t);
   memcpy(&bwt->hash_width, buf, sizeof(int32_t)); buf += sizeof(uint32_t);
 
+  tmap_bwt_set_occ_layout(bwt);
+
   // allocate memory 
   bwt->hash_k = tmap_calloc(bwt->hash_width, sizeof(tmap_bwt_int_t*), "bwt->hash_k");
   bwt->hash_l = tmap_calloc(bwt->hash_width, sizeof(tmap_bwt_int_t*), "bwt->hash_l");
 
   // variable length data
+  buf = start + __tmap_packed_align(buf - start);
   bwt->bwt = (uint32_t*)buf; buf += bwt->bwt_size*sizeof(uint32_t);
   for(i=1;i<=bwt->hash_width;i++) {
       uint64_t hash_length = tmap_bwt_get_hash_length(i);
+      buf = start + __tmap_packed_align(buf - start);
       bwt->hash_k[i-1] = (tmap_bwt_int_t*)buf; buf += hash_length*sizeof(tmap_bwt_int_t);
+      buf = start + __tmap_packed_align(buf - start);
       bwt->hash_l[i-1] = (tmap_bwt_int_t*)buf; buf += hash_length*sizeof(tmap_bwt_int_t);
   }
 
@@ -328,17 +384,52 @@ tmap_bwt_shm_unpack(uint8_t *buf)
   return bwt;
 }
 
+tmap_bwt_t *
+tmap_bwt_replicate(const tmap_bwt_t *bwt, int32_t huge_pages, int32_t node)
+{
+  tmap_bwt_t *replica = NULL;
+
+  replica = tmap_malloc(sizeof(tmap_bwt_t), "replica");
+  memcpy(replica, bwt, sizeof(tmap_bwt_t));
+
+  // copy the BWT string onto the node
+  replica->bwt = tmap_placement_alloc(bwt->bwt_size*sizeof(uint32_t), huge_pages, TMAP_PLACEMENT_NUMA_REPLICATE, node);
+  memcpy(replica->bwt, bwt->bwt, bwt->bwt_size*sizeof(uint32_t));
+  replica->is_placed = 1;
+  replica->huge_pages = huge_pages;
+
+  // share the hash tables
+  replica->hash_k = tmap_calloc(bwt->hash_width, sizeof(tmap_bwt_int_t*), "replica->hash_k");
+  replica->hash_l = tmap_calloc(bwt->hash_width, sizeof(tmap_bwt_int_t*), "replica->hash_l");
+  if(0 < bwt->hash_width) {
+      memcpy(replica->hash_k, bwt->hash_k, bwt->hash_width*sizeof(tmap_bwt_int_t*));
+      memcpy(replica->hash_l, bwt->hash_l, bwt->hash_width*sizeof(tmap_bwt_int_t*));
+  }
+  replica->is_shm = 1; // NB: so that only the pointer arrays are freed
+
+  return replica;
+}
+
 void 
 tmap_bwt_destroy(tmap_bwt_t *bwt)
 {
-  uint32_t i;
   if(bwt == NULL) return;
-  if(1 == bwt->is_shm) {
-      free(bwt->hash_k);
-      free(bwt->hash_l);
-      free(bwt);
+  if(1 == bwt->is_placed) {
+      tmap_placement_free(bwt->bwt, bwt->bwt_size*sizeof(uint32_t), bwt->huge_pages);
+      bwt->bwt = NULL;
   }
-  else {
+  tmap_bwt_destroy_hash(bwt);
+  if(0 == bwt->is_shm) {
+      free(bwt->bwt);
+  }
+  free(bwt);
+}
+
+void
+tmap_bwt_destroy_hash(tmap_bwt_t *bwt)
+{
+  uint32_t i;
+  if(0 == bwt->is_shm) { // otherwise the tables are in the shared buffer
       if(NULL != bwt->hash_k) {
           for(i=0;i<bwt->hash_width;i++) {
               free(bwt->hash_k[i]);
@@ -349,15 +440,15 @@ tmap_bwt_destroy(tmap_bwt_t *bwt)
               free(bwt->hash_l[i]);
           }
       }
-      free(bwt->hash_k);
-      free(bwt->hash_l);
-      free(bwt->bwt);
-      free(bwt);
   }
+  free(bwt->hash_k);
+  free(bwt->hash_l);
+  bwt->hash_k = bwt->hash_l = NULL;
+  bwt->hash_width = 0;
 }
 
 void
-tmap_bwt_update_occ_interval(tmap_bwt_t *bwt, tmap_bwt_int_t occ_interval)
+tmap_bwt_update_occ_interval(tmap_bwt_t *bwt, tmap_bwt_int_t occ_interval, uint32_t occ_layout)
 {
   tmap_bwt_int_t i, k, c[4], n_occ;
   uint32_t *buf = NULL;
@@ -368,15 +459,30 @@ tmap_bwt_update_occ_interval(tmap_bwt_t *bwt, tmap_bwt_int_t occ_interval)
   if(occ_interval < TMAP_BWT_OCC_MOD || 0 != occ_interval % TMAP_BWT_OCC_MOD) {
       tmap_bug();
   }
+  if(TMAP_BWT_OCC_LAYOUT_LINE == occ_layout && TMAP_BWT_LINE_OCC_INTERVAL != occ_interval) {
+      tmap_bug();
+  }
 
   n_occ = ((bwt->seq_len + occ_interval - 1) / occ_interval) + 1; // the number of occurrences to store, on top of the bwt string
   bwt->occ_interval = occ_interval;
-  bwt->bwt_size += n_occ * sizeof(tmap_bwt_int_t); // the new size
-  buf = tmap_calloc(bwt->bwt_size, sizeof(uint32_t), "buf"); // will be the new bwt
+  bwt->occ_layout = occ_layout;
+  if(TMAP_BWT_OCC_LAYOUT_LINE == occ_layout) {
+      // one line per occurrence, the last holding only the occurrences
+      bwt->version_id = TMAP_BWT_LINE_VERSION_ID;
+      bwt->bwt_size = n_occ * TMAP_BWT_LINE_WORDS; // the new size
+      buf = tmap_memalign(TMAP_BWT_LINE_BYTES, bwt->bwt_size * sizeof(uint32_t), "buf"); // will be the new bwt
+      memset(buf, 0, bwt->bwt_size * sizeof(uint32_t));
+  }
+  else {
+      bwt->version_id = TMAP_VERSION_ID;
+      bwt->bwt_size += n_occ * sizeof(tmap_bwt_int_t); // the new size
+      buf = tmap_calloc(bwt->bwt_size, sizeof(uint32_t), "buf"); // will be the new bwt
+  }
   c[0] = c[1] = c[2] = c[3] = 0;
   for (i = k = 0; i < bwt->seq_len; ++i) {
       // store the occurrences
       if (i % occ_interval == 0) {
+          if(TMAP_BWT_OCC_LAYOUT_LINE == occ_layout) k = (i / occ_interval) * TMAP_BWT_LINE_WORDS; // skip any padding
           memcpy(buf + k, c, sizeof(tmap_bwt_int_t) * 4); // in fact: sizeof(tmap_bwt_int_t) = 4*(sizeof(tmap_bwt_int_t)/4)
           k += sizeof(tmap_bwt_int_t);
       }
@@ -385,9 +491,18 @@ tmap_bwt_update_occ_interval(tmap_bwt_t *bwt, tmap_bwt_int_t occ_interval)
       ++c[bwt_B00(bwt, i)];
   }
   // the last element
-  memcpy(buf + k, c, sizeof(tmap_bwt_int_t) * 4);
-  if(k + sizeof(tmap_bwt_int_t) != bwt->bwt_size) {
-      tmap_error(NULL, Exit, OutOfRange);
+  if(TMAP_BWT_OCC_LAYOUT_LINE == occ_layout) {
+      if((n_occ - 1) * TMAP_BWT_LINE_WORDS < k) {
+          tmap_error(NULL, Exit, OutOfRange);
+      }
+      k = (n_occ - 1) * TMAP_BWT_LINE_WORDS;
+      memcpy(buf + k, c, sizeof(tmap_bwt_int_t) * 4);
+  }
+  else {
+      memcpy(buf + k, c, sizeof(tmap_bwt_int_t) * 4);
+      if(k + sizeof(tmap_bwt_int_t) != bwt->bwt_size) {
+          tmap_error(NULL, Exit, OutOfRange);
+      }
   }
   // update bwt
   free(bwt->bwt); bwt->bwt = buf;
@@ -409,80 +524,100 @@ tmap_bwt_gen_cnt_table(tmap_bwt_t *bwt)
 #endif
 }
 
+// fills the k-mer intervals for entries [low,high) of hash level len, where
+// each entry extends the interval of its (len-1)-mer prefix by its last base
 static void
-tmap_bwt_gen_hash_helper(tmap_bwt_t *bwt, uint32_t len)
-{
-  tmap_bwt_sint_t i;
-  tmap_bwt_sint_t n;
-  uint8_t *seq = NULL;
-  tmap_bwt_match_occ_t match_sa;
-  tmap_bwt_int_t sum = 0;
-  uint64_t hash_i = 0, low, high;
-  
-  seq = tmap_calloc(len, sizeof(uint8_t), "seq");
-
-  i = 0; // length of the current k-mer
-  hash_i = 0;
-  while(1) {
-      if(len < i) {
-          tmap_error("ABORT", Exit, OutOfRange);
+tmap_bwt_gen_hash_helper(tmap_bwt_t *bwt, uint32_t len, uint64_t low, uint64_t high)
+{
+  uint64_t i, j;
+  tmap_bwt_int_t k, l, cntk[4], cntl[4];
+  tmap_bwt_int_t *hash_k = bwt->hash_k[len-1], *hash_l = bwt->hash_l[len-1];
+
+  // one occurrence query per prefix gives the intervals for all four bases
+  for(i=low>>2;i<(high>>2);i++) {
+      if(1 == len) {
+          k = 0; l = bwt->seq_len;
       }
-      if(i == len) {
-          n = tmap_bwt_match_exact(bwt, len, seq, &match_sa);
-          bwt->hash_k[len-1][hash_i] = match_sa.k;
-          bwt->hash_l[len-1][hash_i] = match_sa.l;
-
-          if(TMAP_BWT_INT_MAX != match_sa.k && match_sa.k <= match_sa.l) {
-              sum += n;
+      else {
+          k = bwt->hash_k[len-2][i]; l = bwt->hash_l[len-2][i];
+      }
+      if(TMAP_BWT_INT_MAX == k || l < k) { // the prefix does not occur
+          for(j=0;j<4;j++) {
+              hash_k[(i<<2)+j] = TMAP_BWT_INT_MAX;
+              hash_l[(i<<2)+j] = TMAP_BWT_INT_MAX;
           }
+          continue;
+      }
+      tmap_bwt_2occ4(bwt, k-1, l, cntk, cntl);
+      for(j=0;j<4;j++) {
+          hash_k[(i<<2)+j] = bwt->L2[j] + cntk[j] + 1;
+          hash_l[(i<<2)+j] = bwt->L2[j] + cntl[j];
+      }
+  }
+}
 
-          // find the next base
-          i--;
-          while(0 <= i && 3 == seq[i]) {
-              seq[i] = 0;
-              hash_i >>= 2;
-              i--;
-          }
-          if(i < 0) break;
-          seq[i]++;
-          hash_i++;
-          i++;
+#ifdef HAVE_LIBPTHREAD
+/*! d TMAP_BWT_GEN_HASH_MIN_LENGTH
+  the minimum number of entries in a hash level for it to be filled with more than one thread
+  */
+#define TMAP_BWT_GEN_HASH_MIN_LENGTH 0x10000
+
+typedef struct {
+    tmap_bwt_t *bwt;
+    uint32_t len;
+    uint64_t low;
+    uint64_t high;
+} tmap_bwt_gen_hash_thread_data_t;
+
+static void *
+tmap_bwt_gen_hash_thread_worker(void *arg)
+{
+  tmap_bwt_gen_hash_thread_data_t *data = (tmap_bwt_gen_hash_thread_data_t*)arg;
+  tmap_bwt_gen_hash_helper(data->bwt, data->len, data->low, data->high);
+  return arg;
+}
+
+// fills hash level len, giving each thread a contiguous range of prefixes
+static void
+tmap_bwt_gen_hash_threads(tmap_bwt_t *bwt, uint32_t len, int32_t num_threads)
+{
+  int32_t i;
+  uint64_t hash_length, n;
+  pthread_attr_t attr;
+  pthread_t *threads = NULL;
+  tmap_bwt_gen_hash_thread_data_t *thread_data = NULL;
+
+  hash_length = tmap_bwt_get_hash_length(len);
+  n = ((hash_length / num_threads) + 3) & ~((uint64_t)3); // whole prefixes
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+
+  threads = tmap_calloc(num_threads, sizeof(pthread_t), "threads");
+  thread_data = tmap_calloc(num_threads, sizeof(tmap_bwt_gen_hash_thread_data_t), "thread_data");
+
+  for(i=0;i<num_threads;i++) {
+      thread_data[i].bwt = bwt;
+      thread_data[i].len = len;
+      thread_data[i].low = (i * n < hash_length) ? i * n : hash_length;
+      thread_data[i].high = ((i + 1) * n < hash_length && i < num_threads - 1) ? (i + 1) * n : hash_length;
+      if(0 != pthread_create(&threads[i], &attr, tmap_bwt_gen_hash_thread_worker, &thread_data[i])) {
+          tmap_error("error creating threads", Exit, ThreadError);
       }
-      else {
-          // check the previous hash
-          if(0 < i && (TMAP_BWT_INT_MAX == bwt->hash_k[i-1][hash_i] || bwt->hash_l[i-1][hash_i] < bwt->hash_k[i-1][hash_i])) {
-              // no need to search further
-              low = hash_i << (2 * (len - i));
-              high = (hash_i+1) << (2 * (len - i));
-              while(low < high) {
-                  bwt->hash_k[len-1][low] = TMAP_BWT_INT_MAX;
-                  bwt->hash_l[len-1][low] = TMAP_BWT_INT_MAX;
-                  low++;
-              }
-              // find the next base
-              i--;
-              while(0 <= i && 3 == seq[i]) {
-                  seq[i] = 0;
-                  hash_i >>= 2;
-                  i--;
-              }
-              if(i < 0) break;
-              seq[i]++;
-              hash_i++;
-              i++;
-          }
-          else {
-              hash_i <<= 2;
-              i++;
-          }
+  }
+  for(i=0;i<num_threads;i++) {
+      if(0 != pthread_join(threads[i], NULL)) {
+          tmap_error("error joining threads", Exit, ThreadError);
       }
   }
 
-  free(seq);
+  free(threads);
+  free(thread_data);
 }
+#endif
 
 void
-tmap_bwt_gen_hash(tmap_bwt_t *bwt, int32_t hash_width, uint32_t check_hash)
+tmap_bwt_gen_hash(tmap_bwt_t *bwt, int32_t hash_width, uint32_t check_hash, int32_t num_threads)
 {
   int32_t i;
 
@@ -493,7 +628,7 @@ tmap_bwt_gen_hash(tmap_bwt_t *bwt, int32_t hash_width, uint32_t check_hash)
       hash_width = bwt->seq_len;
   }
 
-  if(TMAP_BWT_INT_MAX <= (tmap_bwt_int_t)((1 << (2 * ((tmap_bwt_int_t)bwt->hash_width))) - 1)) {
+  if(32 <= hash_width || TMAP_BWT_INT_MAX <= (tmap_bwt_int_t)(tmap_bwt_get_hash_length(hash_width) - 1)) {
       tmap_error("Hash width is too great to fit in memory", Exit, OutOfRange);
   }
 
@@ -511,14 +646,23 @@ tmap_bwt_gen_hash(tmap_bwt_t *bwt, int32_t hash_width, uint32_t check_hash)
       bwt->hash_k[i-1] = tmap_malloc(sizeof(tmap_bwt_int_t)*hash_length, "bwt->hash_k[i-1]");
       bwt->hash_l[i-1] = tmap_malloc(sizeof(tmap_bwt_int_t)*hash_length, "bwt->hash_l[i-1]");
 
-      tmap_bwt_gen_hash_helper(bwt, i);
+#ifdef HAVE_LIBPTHREAD
+      if(1 < num_threads && TMAP_BWT_GEN_HASH_MIN_LENGTH <= hash_length) {
+          tmap_bwt_gen_hash_threads(bwt, i, num_threads);
+      }
+      else {
+          tmap_bwt_gen_hash_helper(bwt, i, 0, hash_length);
+      }
+#else
+      tmap_bwt_gen_hash_helper(bwt, i, 0, hash_length);
+#endif
       bwt->hash_width = i; // updated the hash width
   }
 
   // test the BWT hash
   if(1 == check_hash) {
       tmap_progress_print2("testing the BWT hash");
-      tmap_bwt_check_core2(bwt, bwt->hash_width, 1, 0, 1);
+      tmap_bwt_check_core2(bwt, bwt->hash_width, 1, 0, 1, num_threads);
   }
   
   tmap_progress_print2("constructed the occurrence hash for the BWT string");
@@ -597,6 +741,58 @@ __occ_aux16(uint32_t y, int c)
   return (((y + (y >> 4)) & 0xF0F0F0F) * 0x1010101) >> 24; // count
 }
 
+/*
+ * The cache-line layout: the counts of a line are followed by its four 64-bit
+ * words of bases.  The bases up to and including k are counted with one
+ * population count across all four words, masking the words after k rather
+ * than looping over them, so only the line holding k is read.
+ */
+
+// the value to xor with the bases so that those equal to c become 3
+static const uint64_t __occ_line_xor[4] = {
+    0xffffffffffffffffull, 0xaaaaaaaaaaaaaaaaull, 0x5555555555555555ull, 0x0ull
+};
+
+// the position of k within its occurrence block
+#define __occ_block_pos(bwt, k) ((uint32_t)((k) - (((k) >> (bwt)->occ_interval_log2) << (bwt)->occ_interval_log2)))
+
+#define __occ_line_word(q, i) ((uint64_t)(q)[(i)<<1]<<32 | (q)[((i)<<1)+1])
+
+static inline int32_t
+__occ_line_count(const uint32_t *q, tmap_bwt_int_t k, uint64_t x)
+{
+  uint64_t w, y, z, last;
+  int32_t j;
+
+  j = (k & (TMAP_BWT_LINE_OCC_INTERVAL-1)) >> 5; // the word holding k
+  last = ~((1ull<<((~k&31)<<1)) - 1) & 0x5555555555555555ull; // the bases up to and including k
+
+  // reduce nucleotide counting to bits counting, one bit per base, so that
+  // y holds at most three per two bits
+  w = __occ_line_word(q, 0) ^ x; y = w & (w >> 1) & ((0 < j) ? 0x5555555555555555ull : last);
+  w = __occ_line_word(q, 1) ^ x; y += w & (w >> 1) & ((1 < j) ? 0x5555555555555555ull : ((1 == j) ? last : 0ull));
+  w = __occ_line_word(q, 2) ^ x; y += w & (w >> 1) & ((2 < j) ? 0x5555555555555555ull : ((2 == j) ? last : 0ull));
+  w = __occ_line_word(q, 3) ^ x; z = w & (w >> 1) & ((3 == j) ? last : 0ull);
+
+  // count the number of 1s in y and z
+  y = (y & 0x3333333333333333ull) + (y >> 2 & 0x3333333333333333ull)
+    + (z & 0x3333333333333333ull) + (z >> 2 & 0x3333333333333333ull);
+  y = (y & 0xf0f0f0f0f0f0f0full) + (y >> 4 & 0xf0f0f0f0f0f0f0full); // at most 16 per byte
+  return y * 0x101010101010101ull >> 56;
+}
+
+// adds the counts of the bases in the line up to and including k
+static inline void
+__occ_line_count4(const uint32_t *q, tmap_bwt_int_t k, tmap_bwt_int_t cnt[4])
+{
+  int32_t n1, n2, n3;
+  n1 = __occ_line_count(q, k, __occ_line_xor[1]);
+  n2 = __occ_line_count(q, k, __occ_line_xor[2]);
+  n3 = __occ_line_count(q, k, __occ_line_xor[3]);
+  cnt[0] += (k & (TMAP_BWT_LINE_OCC_INTERVAL-1)) + 1 - n1 - n2 - n3;
+  cnt[1] += n1; cnt[2] += n2; cnt[3] += n3;
+}
+
 inline tmap_bwt_int_t 
 tmap_bwt_occ(const tmap_bwt_t *bwt, tmap_bwt_int_t k, uint8_t c)
 {
@@ -611,6 +807,13 @@ tmap_bwt_occ(const tmap_bwt_t *bwt, tmap_bwt_int_t k, uint8_t c)
   n = ((tmap_bwt_int_t*)(p = tmap_bwt_occ_intv(bwt, k)))[c];
   p += sizeof(tmap_bwt_int_t); // jump to the start of the first BWT cell
 
+  if(NULL != bwt->rank) {
+      return n + bwt->rank->count(p, __occ_block_pos(bwt, k), c);
+  }
+  if(TMAP_BWT_OCC_LAYOUT_LINE == bwt->occ_layout) {
+      return n + __occ_line_count(p, k, __occ_line_xor[c]);
+  }
+
 #ifndef TMAP_BWT_BY_16
   j = k >> 4 << 4; // divide by 16, then multiply by 16, to subtract k % 16.
   for(l = (k >> bwt->occ_interval_log2) << bwt->occ_interval_log2; l < j; l += 16, p++) {
@@ -655,6 +858,17 @@ tmap_bwt_2occ_orig(const tmap_bwt_t *bwt, tmap_bwt_int_t k, tmap_bwt_int_t l, ui
       l = _l;
       n = ((tmap_bwt_int_t*)(p = tmap_bwt_occ_intv(bwt, k)))[c];
       p += sizeof(tmap_bwt_int_t);
+      if(NULL != bwt->rank) {
+          *ok = n + bwt->rank->count(p, __occ_block_pos(bwt, k), c);
+          *ol = n + bwt->rank->count(p, __occ_block_pos(bwt, l), c);
+          return;
+      }
+      if(TMAP_BWT_OCC_LAYOUT_LINE == bwt->occ_layout) {
+          // both are in the same line
+          *ok = n + __occ_line_count(p, k, __occ_line_xor[c]);
+          *ol = n + __occ_line_count(p, l, __occ_line_xor[c]);
+          return;
+      }
       // calculate *ok
 #ifndef TMAP_BWT_BY_16
       j = k >> 4 << 4; // divide by 16, then multiply by 16, to subtract k % 16.
@@ -794,6 +1008,15 @@ tmap_bwt_occ4(const tmap_bwt_t *bwt, tmap_bwt_int_t k, tmap_bwt_int_t cnt[4])
   memcpy(cnt, p, 4 * sizeof(tmap_bwt_int_t));
   p += sizeof(tmap_bwt_int_t); // move to the first bwt cell
 
+  if(NULL != bwt->rank) {
+      bwt->rank->count4(p, __occ_block_pos(bwt, k), cnt);
+      return;
+  }
+  if(TMAP_BWT_OCC_LAYOUT_LINE == bwt->occ_layout) {
+      __occ_line_count4(p, k, cnt);
+      return;
+  }
+
 #ifndef TMAP_BWT_BY_16
   j = (k >> 4) << 4;
   for(l = (k >> bwt->occ_interval_log2) << bwt->occ_interval_log2; l < j; l += 16, ++p) {
@@ -837,6 +1060,19 @@ tmap_bwt_2occ4(const tmap_bwt_t *bwt, tmap_bwt_int_t k, tmap_bwt_int_t l, tmap_b
           p = tmap_bwt_occ_intv(bwt, k);
           memcpy(cntk, p, 4 * sizeof(tmap_bwt_int_t));
           p += sizeof(tmap_bwt_int_t);
+          if(NULL != bwt->rank) {
+              memcpy(cntl, cntk, 4 * sizeof(tmap_bwt_int_t));
+              bwt->rank->count4(p, __occ_block_pos(bwt, k), cntk);
+              bwt->rank->count4(p, __occ_block_pos(bwt, l), cntl);
+              return;
+          }
+          if(TMAP_BWT_OCC_LAYOUT_LINE == bwt->occ_layout) {
+              // both are in the same line
+              memcpy(cntl, cntk, 4 * sizeof(tmap_bwt_int_t));
+              __occ_line_count4(p, k, cntk);
+              __occ_line_count4(p, l, cntl);
+              return;
+          }
 #ifndef TMAP_BWT_BY_16
           // prepare cntk[]
           j = k >> 4 << 4;
@@ -881,13 +1117,21 @@ int
 tmap_bwt_pac2bwt_main(int argc, char *argv[])
 {
   int c, is_large = 0, occ_interval = TMAP_BWT_OCC_INTERVAL, help = 0;
-  int32_t hash_width = INT32_MAX, check_hash = 1;
-
-  while((c = getopt(argc, argv, "o:lw:vhH")) >= 0) {
+  int32_t hash_width = INT32_MAX, check_hash = 1, num_threads = 1, max_memory = 0;
+  uint32_t occ_layout = TMAP_BWT_OCC_LAYOUT_INTERLEAVED;
+  struct option options[] = {
+      {"max-memory", required_argument, 0, 'M'},
+      {0, 0, 0, 0}
+  };
+
+  while((c = getopt_long(argc, argv, "o:lLw:n:M:vhH", options, NULL)) >= 0) {
       switch(c) {
         case 'l': is_large = 1; break;
+        case 'L': occ_layout = TMAP_BWT_OCC_LAYOUT_LINE; break;
         case 'o': occ_interval = atoi(optarg); break;
         case 'w': hash_width = atoi(optarg); break;
+        case 'n': num_threads = atoi(optarg); break;
+        case 'M': max_memory = atoi(optarg); break;
         case 'v': tmap_progress_set_verbosity(1); break;
         case 'h': help = 1; break;
         case 'H': check_hash = 0; break;
@@ -895,14 +1139,24 @@ tmap_bwt_pac2bwt_main(int argc, char *argv[])
       }
   }
   if(1 != argc - optind || 1 == help) {
-      tmap_file_fprintf(tmap_file_stderr, "Usage: %s %s [-l -o INT -w INT -H -v -h] <in.fasta>\n", PACKAGE, argv[0]);
+      tmap_file_fprintf(tmap_file_stderr, "Usage: %s %s [-l -L -o INT -w INT -n INT -M INT -H -v -h] <in.fasta>\n", PACKAGE, argv[0]);
       return 1;
   }
   if(occ_interval < TMAP_BWT_OCC_MOD || 0 != (occ_interval % 2) ||  0 != (occ_interval % TMAP_BWT_OCC_MOD)) {
       tmap_error("option -o out of range", Exit, CommandLineArgument);
   }
+  if(TMAP_BWT_OCC_LAYOUT_LINE == occ_layout && TMAP_BWT_LINE_OCC_INTERVAL != occ_interval) {
+      tmap_error("option -o must be 128 with option -L", Exit, CommandLineArgument);
+  }
 
-  tmap_bwt_pac2bwt(argv[optind], is_large, occ_interval, hash_width, check_hash);
+  if(num_threads <= 0) {
+      tmap_error("option -n out of range", Exit, CommandLineArgument);
+  }
+  if(max_memory < 0) {
+      tmap_error("option -M out of range", Exit, CommandLineArgument);
+  }
+
+  tmap_bwt_pac2bwt(argv[optind], is_large, occ_interval, occ_layout, hash_width, check_hash, num_threads, (uint64_t)max_memory << 20);
 
   return 0;
 }
@@ -911,11 +1165,12 @@ int
 tmap_bwt_bwtupdate_main(int argc, char *argv[])
 {
   int c, help = 0;
-  int32_t hash_width = INT32_MAX, check_hash = 1;
+  int32_t hash_width = INT32_MAX, check_hash = 1, num_threads = 1;
 
-  while((c = getopt(argc, argv, "w:vh")) >= 0) {
+  while((c = getopt(argc, argv, "w:n:Hvh")) >= 0) {
       switch(c) {
         case 'w': hash_width = atoi(optarg); break;
+        case 'n': num_threads = atoi(optarg); break;
         case 'v': tmap_progress_set_verbosity(1); break;
         case 'h': help = 1; break;
         case 'H': check_hash = 0; break;
@@ -923,10 +1178,13 @@ tmap_bwt_bwtupdate_main(int argc, char *argv[])
       }
   }
   if(1 != argc - optind || 1 == help) {
-      tmap_file_fprintf(tmap_file_stderr, "Usage: %s %s [-w INT -H -v -h] <in.fasta>\n", PACKAGE, argv[0]);
+      tmap_file_fprintf(tmap_file_stderr, "Usage: %s %s [-w INT -n INT -H -v -h] <in.fasta>\n", PACKAGE, argv[0]);
       return 1;
   }
-  tmap_bwt_update_hash(argv[optind], hash_width, check_hash);
+  if(num_threads <= 0) {
+      tmap_error("option -n out of range", Exit, CommandLineArgument);
+  }
+  tmap_bwt_update_hash(argv[optind], hash_width, check_hash, num_threads);
 
   return 0;
 }
@@ -29,6 +29,7 @@
 
 #include <stdint.h>
 #include "../util/tmap_definitions.h"
+#include "tmap_bwt_rank.h"
 
 /*! 
   A BWT index library
@@ -56,6 +57,34 @@ typedef uint8_t ubyte_t;
 #define TMAP_BWT_HASH_WIDTH_AUTO_MIN 8
 #define TMAP_BWT_HASH_WIDTH_AUTO_MAX 12
 
+/*! 
+  the layout of the occurrence array and the BWT string
+  */
+enum {
+    TMAP_BWT_OCC_LAYOUT_INTERLEAVED = 0, /*!< the occurrences every occ_interval bases, each followed by the bases they precede */
+    TMAP_BWT_OCC_LAYOUT_LINE        = 1 /*!< one aligned cache line per occurrence, holding the occurrences and the bases they precede */
+};
+
+/*! d TMAP_BWT_LINE_BYTES
+  the number of bytes in a line of the cache-line layout
+  */
+#define TMAP_BWT_LINE_BYTES 64
+/*! d TMAP_BWT_LINE_WORDS
+  the number of 32-bit words in a line of the cache-line layout
+  */
+#define TMAP_BWT_LINE_WORDS (TMAP_BWT_LINE_BYTES >> 2)
+/*! d TMAP_BWT_LINE_OCC_INTERVAL
+  the number of bases in a line of the cache-line layout
+  @details  the four occurrences take the first 32 bytes of the line (padded
+  when 32-bit), and the 2-bit packed bases the last 32 bytes
+  */
+#define TMAP_BWT_LINE_OCC_INTERVAL 128
+/*! d TMAP_BWT_LINE_VERSION_ID
+  the version id of a BWT file stored with the cache-line layout
+  @details  differs from TMAP_VERSION_ID so that older versions refuse the file
+  */
+#define TMAP_BWT_LINE_VERSION_ID (TMAP_VERSION_ID + 1)
+
 // NB: we do not need a multi-level hash, just the highest-level hash.  We can
 // simulate the others from this one...
 /*! 
@@ -75,8 +104,12 @@ typedef struct {
     int32_t hash_width;  /*!< the k-mer that is hashed */
     uint32_t is_shm;  /*!< 1 if loaded from shared memory, 0 otherwise */
     // Not stored in the file
+    uint32_t is_placed;  /*!< 1 if the BWT string was allocated with tmap_placement_alloc, 0 otherwise */
+    int32_t huge_pages;  /*!< the page size of the BWT string if placed (TMAP_PLACEMENT_HUGE_PAGES_*) */
+    uint32_t occ_layout;  /*!< the layout of the occurrence array (TMAP_BWT_OCC_LAYOUT_*), given by the version id */
+    const tmap_bwt_rank_t *rank;  /*!< the rank kernel chosen for this host, or NULL for the scalar code */
     uint32_t occ_interval_log2; /*!< log2 value of of the the occurrence array interval */
-    uint32_t occ_array_16_pt2; /*!< equal to ((bwt)->occ_interval/(sizeof(uint32_t)<<3>>1) + (sizeof(tmap_bwt_int_t)>>2<<2))) */
+    uint32_t occ_array_16_pt2; /*!< equal to ((bwt)->occ_interval/(sizeof(uint32_t)<<3>>1) + (sizeof(tmap_bwt_int_t)>>2<<2))), or TMAP_BWT_LINE_WORDS for the cache-line layout */
 } tmap_bwt_t;
 
 /*! 
@@ -86,6 +119,27 @@ typedef struct {
 tmap_bwt_t *
 tmap_bwt_read(const char *fn_fasta);
 
+/*! 
+  @param  fn_fasta    the FASTA file name
+  @param  huge_pages  the page size of the BWT string (TMAP_PLACEMENT_HUGE_PAGES_*)
+  @param  numa        the NUMA placement of the BWT string (TMAP_PLACEMENT_NUMA_*)
+  @return             pointer to the bwt structure 
+  @details            the BWT string is read directly into the placed memory
+  */
+tmap_bwt_t *
+tmap_bwt_read_placed(const char *fn_fasta, int32_t huge_pages, int32_t numa);
+
+/*! 
+  @param  bwt         the bwt structure to replicate
+  @param  huge_pages  the page size of the copied BWT string (TMAP_PLACEMENT_HUGE_PAGES_*)
+  @param  node        the NUMA node on which to place the copied BWT string
+  @return             pointer to the replicated bwt structure 
+  @details            the hash tables are shared with the given bwt, which
+  must be destroyed after the replica
+  */
+tmap_bwt_t *
+tmap_bwt_replicate(const tmap_bwt_t *bwt, int32_t huge_pages, int32_t node);
+
 /*! 
   @param  fn_fasta  the FASTA file name
   @param  bwt       the bwt structure to write
@@ -120,6 +174,7 @@ tmap_bwt_shm_read_num_bytes(const char *fn_fasta);
   @param  bwt  the bwt structure to pack 
   @param  buf  the byte array in which to pack the bwt data
   @return      a pointer to the next unused byte in memory
+  @details     the bwt and hash arrays are aligned to TMAP_PACKED_ALIGNMENT relative to buf
   */
 uint8_t *
 tmap_bwt_shm_pack(tmap_bwt_t *bwt, uint8_t *buf);
@@ -137,12 +192,22 @@ tmap_bwt_shm_unpack(uint8_t *buf);
 void 
 tmap_bwt_destroy(tmap_bwt_t *bwt);
 
+/*! 
+  frees the occurrence hash, leaving a bwt that only counts with the occurrence array
+  @param  bwt  pointer to the bwt structure
+  */
+void 
+tmap_bwt_destroy_hash(tmap_bwt_t *bwt);
+
 /*! 
   @param  bwt           pointer to the bwt structure to update
   @param  occ_interval  the new occurrence interval
+  @param  occ_layout    the new occurrence array layout (TMAP_BWT_OCC_LAYOUT_*)
+  @details              the cache-line layout requires an occurrence interval
+  of TMAP_BWT_LINE_OCC_INTERVAL
   */
 void 
-tmap_bwt_update_occ_interval(tmap_bwt_t *bwt, tmap_bwt_int_t occ_interval);
+tmap_bwt_update_occ_interval(tmap_bwt_t *bwt, tmap_bwt_int_t occ_interval, uint32_t occ_layout);
 
 /*! 
   generates the occurrence array
@@ -153,12 +218,14 @@ tmap_bwt_gen_cnt_table(tmap_bwt_t *bwt);
 
 /*! 
   generates the occurrence hash
-  @param  bwt         pointer to the bwt structure to update 
-  @param  hash_width  the k-mer length to hash
-  @param  check_hash  1 if we are to validate the hash, zero otherwise
+  @param  bwt          pointer to the bwt structure to update 
+  @param  hash_width   the k-mer length to hash
+  @param  check_hash   1 if we are to validate the hash, zero otherwise
+  @param  num_threads  the number of threads
+  @details             each level is derived from the previous one, with one occurrence query per (k-1)-mer
   */
 void
-tmap_bwt_gen_hash(tmap_bwt_t *bwt, int32_t hash_width, uint32_t check_hash);
+tmap_bwt_gen_hash(tmap_bwt_t *bwt, int32_t hash_width, uint32_t check_hash, int32_t num_threads);
 
 /*! 
   calculates the next occurrence given the previous occurrence and the next base
@@ -239,6 +306,27 @@ tmap_bwt_2occ4(const tmap_bwt_t *bwt, tmap_bwt_int_t k, tmap_bwt_int_t l, tmap_b
   */
 #define tmap_bwt_occ_intv(b, k) ((b)->bwt + tmap_bwt_get_occ_array_i16(b, k))
 
+/*!
+  @param  b   pointer to the bwt structure
+  @param  k   the occurrence position to be passed to tmap_bwt_occ (or similar)
+  @details    issues software prefetches for the occurrence array and the bwt
+  characters used to compute the occurrence at k, so that many independent
+  occurrence look-ups can wait on memory at the same time.  Positions outside
+  the BWT (ex. TMAP_BWT_INT_MAX) are ignored.
+  */
+#ifdef __GNUC__
+#define tmap_bwt_prefetch_occ(b, k) do { \
+    tmap_bwt_int_t __k = (k); \
+    if(__k < (b)->seq_len) { \
+        if(__k >= (b)->primary) --__k; \
+        __builtin_prefetch(tmap_bwt_occ_intv(b, __k)); \
+        __builtin_prefetch(&tmap_bwt_get_bwt16(b, __k)); \
+    } \
+} while(0)
+#else
+#define tmap_bwt_prefetch_occ(b, k)
+#endif
+
 /*!  
   inverse Psi function
   @param  bwt  pointer to the bwt structure
@@ -6,18 +6,25 @@
 #include <time.h>
 #include <stdint.h>
 #include <config.h>
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 
 #include "../util/tmap_error.h"
 #include "../util/tmap_alloc.h"
 #include "../util/tmap_progress.h"
+#include "../util/tmap_rand.h"
+#include "../util/tmap_time.h"
 #include "../io/tmap_file.h"
 #include "tmap_bwt.h"
+#include "tmap_bwt_rank.h"
 #include "tmap_bwt_match.h"
 #include "tmap_bwt_check.h"
 
 //#define TMAP_BWT_CHECK_DEBUG 1
 
 #ifdef TMAP_BWT_CHECK_DEBUG 
+#include "../util/tmap_placement.h"
 #include "tmap_refseq.h"
 #include "tmap_sa.h"
 #include "tmap_index.h"
@@ -25,95 +32,203 @@
 static tmap_index_t *tmap_bwt_index;
 #endif
 
-void 
-tmap_bwt_check_core2(tmap_bwt_t *bwt, int32_t length, int32_t print_msg, int32_t print_sa, int32_t warn)
+// enumerates the i-mers in lexicographic order, and returns the number of
+// occurrences of the i-mers that occur
+static int64_t
+tmap_bwt_check_kmers(tmap_bwt_t *bwt, int32_t i, int32_t print_msg, int32_t print_sa)
 {
   uint8_t *seqs[2] = {NULL,NULL};
   char *str = NULL;
-  int32_t i, asymmetric, k, l;
+  int32_t asymmetric, k, l;
   uint64_t hash_j;
   int64_t sum, j;
   tmap_bwt_match_occ_t sa;
   tmap_bwt_int_t n[2];
 
-  for(i=1;i<=length;i++) {
-      seqs[0] = tmap_calloc(i, sizeof(uint8_t), "seqs[0]");
-      seqs[1] = tmap_calloc(i, sizeof(uint8_t), "seqs[1]");
-      str = tmap_calloc(i+1, sizeof(char), "str");
-      for(j=0;j<i;j++) {
-          seqs[1][j] = 3;
-      }
+  seqs[0] = tmap_calloc(i, sizeof(uint8_t), "seqs[0]");
+  seqs[1] = tmap_calloc(i, sizeof(uint8_t), "seqs[1]");
+  str = tmap_calloc(i+1, sizeof(char), "str");
+  for(j=0;j<i;j++) {
+      seqs[1][j] = 3;
+  }
 
-      asymmetric = 0;
-      j = 0;
-      hash_j = sum = 0;
-      while(1) {
-          if(i == j) {
-              for(k=0;k<i;k++) {
-                  seqs[1][k] = 3 - seqs[0][i-k-1];
-              }
-              for(k=0;k<2;k++) {
-                  //n[k] = tmap_bwt_match_exact(bwt, i, seqs[k], &sa);
-                  n[k] = tmap_bwt_match_exact_reverse(bwt, i, seqs[k], &sa);
-                  if(0 == k) {
-                      if(0 < n[k] && TMAP_BWT_INT_MAX != sa.k && sa.k <= sa.l) {
-                          sum += n[k];
+  asymmetric = 0;
+  j = 0;
+  hash_j = sum = 0;
+  while(1) {
+      if(i == j) {
+          for(k=0;k<i;k++) {
+              seqs[1][k] = 3 - seqs[0][i-k-1];
+          }
+          for(k=0;k<2;k++) {
+              //n[k] = tmap_bwt_match_exact(bwt, i, seqs[k], &sa);
+              n[k] = tmap_bwt_match_exact_reverse(bwt, i, seqs[k], &sa);
+              if(0 == k) {
+                  if(0 < n[k] && TMAP_BWT_INT_MAX != sa.k && sa.k <= sa.l) {
+                      sum += n[k];
+                  }
+                  if(1 == print_msg && 1 == print_sa) {
+                      for(l=0;l<i;l++) {
+                          str[l] = "ACGTN"[seqs[k][l]];
                       }
-                      if(1 == print_msg && 1 == print_sa) {
-                          for(l=0;l<i;l++) {
-                              str[l] = "ACGTN"[seqs[k][l]];
-                          }
-                          if(0 < n[k] && TMAP_BWT_INT_MAX != sa.k && sa.k <= sa.l) {
-                              tmap_progress_print2("%s\t%llu\t%llu\t%llu", str, sa.k, sa.l, n[k]);
+                      if(0 < n[k] && TMAP_BWT_INT_MAX != sa.k && sa.k <= sa.l) {
+                          tmap_progress_print2("%s\t%llu\t%llu\t%llu", str, sa.k, sa.l, n[k]);
 #ifdef TMAP_BWT_CHECK_DEBUG 
-                              while(sa.k <= sa.l) {
-                                  uint32_t seqid, pos;
-                                  uint8_t strand;
-                                  tmap_bwt_int_t pacpos = tmap_sa_pac_pos(tmap_bwt_index->sa, bwt, sa.k);
-                                  if(0 < tmap_refseq_pac2real(tmap_bwt_index->refseq, pacpos, 1, &seqid, &pos, &strand)) {
-                                      tmap_progress_print2("%s\t%llu\t%llu\t%llu\t%c%u:%u", str, sa.k, sa.l, n[k],
-                                                           "+-"[strand], seqid, pos);
-                                  }
-                                  else {
-                                      tmap_progress_print2("%s\t%llu\t%llu\t%llu\t%c%u:%u", str, sa.k, sa.l, n[k],
-                                                           '?', 0, 0);
-                                  }
-                                  sa.k++;
+                          while(sa.k <= sa.l) {
+                              uint32_t seqid, pos;
+                              uint8_t strand;
+                              tmap_bwt_int_t pacpos = tmap_sa_pac_pos(tmap_bwt_index->sa, bwt, sa.k);
+                              if(0 < tmap_refseq_pac2real(tmap_bwt_index->refseq, pacpos, 1, &seqid, &pos, &strand)) {
+                                  tmap_progress_print2("%s\t%llu\t%llu\t%llu\t%c%u:%u", str, sa.k, sa.l, n[k],
+                                                       "+-"[strand], seqid, pos);
                               }
-#endif
-                          }
-                          else {
-                              tmap_progress_print2("%s\tNA\tNA\tNA", str);
+                              else {
+                                  tmap_progress_print2("%s\t%llu\t%llu\t%llu\t%c%u:%u", str, sa.k, sa.l, n[k],
+                                                       '?', 0, 0);
+                              }
+                              sa.k++;
                           }
+#endif
+                      }
+                      else {
+                          tmap_progress_print2("%s\tNA\tNA\tNA", str);
                       }
                   }
               }
-              if(0 == asymmetric && n[0] != n[1]) {
-                  asymmetric = 1;
-                  //fprintf(stderr, "n[0]=%u n[1]=%u\n", n[0], n[1]);
-                  tmap_error("Asymmetry found", Warn, OutOfRange);
-              }
+          }
+          if(0 == asymmetric && n[0] != n[1]) {
+              asymmetric = 1;
+              //fprintf(stderr, "n[0]=%u n[1]=%u\n", n[0], n[1]);
+              tmap_error("Asymmetry found", Warn, OutOfRange);
+          }
 
+          j--;
+          while(0 <= j && 3 == seqs[0][j]) {
+              seqs[0][j] = 0;
+              hash_j >>= 2;
               j--;
-              while(0 <= j && 3 == seqs[0][j]) {
-                  seqs[0][j] = 0;
-                  hash_j >>= 2;
-                  j--;
-              }
-              if(j < 0) break;
-              seqs[0][j]++;
-              hash_j++;
-              j++;
-          }
-          else {
-              hash_j <<= 2;
-              j++;
           }
+          if(j < 0) break;
+          seqs[0][j]++;
+          hash_j++;
+          j++;
+      }
+      else {
+          hash_j <<= 2;
+          j++;
+      }
+  }
+
+  free(seqs[0]);
+  free(seqs[1]);
+  free(str);
+
+  return sum;
+}
+
+#ifdef HAVE_LIBPTHREAD
+typedef struct {
+    tmap_bwt_t *bwt;
+    int32_t len;
+    uint64_t low;
+    uint64_t high;
+    int64_t sum;
+    int32_t asymmetric;
+} tmap_bwt_check_kmers_thread_data_t;
+
+// checks the len-mers with indexes [low,high), as the k-mer hash orders them
+static void *
+tmap_bwt_check_kmers_thread_worker(void *arg)
+{
+  tmap_bwt_check_kmers_thread_data_t *data = (tmap_bwt_check_kmers_thread_data_t*)arg;
+  uint8_t seqs[2][64];
+  int32_t k, len = data->len;
+  uint64_t hash_j;
+  tmap_bwt_match_occ_t sa;
+  tmap_bwt_int_t n[2];
+
+  data->sum = 0;
+  data->asymmetric = 0;
+  for(hash_j=data->low;hash_j<data->high;hash_j++) {
+      for(k=0;k<len;k++) {
+          seqs[0][k] = (hash_j >> (2 * (len - k - 1))) & 3;
+          seqs[1][len-k-1] = 3 - seqs[0][k];
+      }
+      n[0] = tmap_bwt_match_exact_reverse(data->bwt, len, seqs[0], &sa);
+      if(0 < n[0] && TMAP_BWT_INT_MAX != sa.k && sa.k <= sa.l) {
+          data->sum += n[0];
+      }
+      n[1] = tmap_bwt_match_exact_reverse(data->bwt, len, seqs[1], &sa);
+      if(n[0] != n[1]) data->asymmetric = 1;
+  }
+
+  return arg;
+}
+
+// the threaded version of tmap_bwt_check_kmers, without printing the intervals
+static int64_t
+tmap_bwt_check_kmers_threads(tmap_bwt_t *bwt, int32_t len, int32_t num_threads)
+{
+  int32_t i, asymmetric = 0;
+  uint64_t n, num_kmers;
+  int64_t sum = 0;
+  pthread_attr_t attr;
+  pthread_t *threads = NULL;
+  tmap_bwt_check_kmers_thread_data_t *thread_data = NULL;
+
+  num_kmers = ((uint64_t)1) << (2 * len);
+  n = (num_kmers + num_threads - 1) / num_threads;
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+
+  threads = tmap_calloc(num_threads, sizeof(pthread_t), "threads");
+  thread_data = tmap_calloc(num_threads, sizeof(tmap_bwt_check_kmers_thread_data_t), "thread_data");
+
+  for(i=0;i<num_threads;i++) {
+      thread_data[i].bwt = bwt;
+      thread_data[i].len = len;
+      thread_data[i].low = (i * n < num_kmers) ? i * n : num_kmers;
+      thread_data[i].high = ((i + 1) * n < num_kmers) ? (i + 1) * n : num_kmers;
+      if(0 != pthread_create(&threads[i], &attr, tmap_bwt_check_kmers_thread_worker, &thread_data[i])) {
+          tmap_error("error creating threads", Exit, ThreadError);
+      }
+  }
+  for(i=0;i<num_threads;i++) {
+      if(0 != pthread_join(threads[i], NULL)) {
+          tmap_error("error joining threads", Exit, ThreadError);
       }
+      sum += thread_data[i].sum;
+      asymmetric |= thread_data[i].asymmetric;
+  }
+  if(1 == asymmetric) {
+      tmap_error("Asymmetry found", Warn, OutOfRange);
+  }
+
+  free(threads);
+  free(thread_data);
 
-      free(seqs[0]);
-      free(seqs[1]);
-      free(str);
+  return sum;
+}
+#endif
+
+void 
+tmap_bwt_check_core2(tmap_bwt_t *bwt, int32_t length, int32_t print_msg, int32_t print_sa, int32_t warn, int32_t num_threads)
+{
+  int32_t i;
+  int64_t sum, j;
+
+  for(i=1;i<=length;i++) {
+#ifdef HAVE_LIBPTHREAD
+      if(1 < num_threads && 0 == print_sa && i < 32) {
+          sum = tmap_bwt_check_kmers_threads(bwt, i, num_threads);
+      }
+      else {
+          sum = tmap_bwt_check_kmers(bwt, i, print_msg, print_sa);
+      }
+#else
+      sum = tmap_bwt_check_kmers(bwt, i, print_msg, print_sa);
+#endif
 
       j = (sum == (bwt->seq_len - i + 1)) ? 0 : 1; // j==1 on fail
       if(1 == print_msg) {
@@ -126,14 +241,94 @@ tmap_bwt_check_core2(tmap_bwt_t *bwt, int32_t length, int32_t print_msg, int32_t
   }
 }
 
+// the occurrences for the positions k and l, and the base c
+typedef struct {
+    tmap_bwt_int_t occ[4], occ4[4], ok, ol, cntk[4], cntl[4];
+} tmap_bwt_check_rank_t;
+
+static inline void
+tmap_bwt_check_rank_query(const tmap_bwt_t *bwt, tmap_bwt_int_t k, tmap_bwt_int_t l, uint8_t c, tmap_bwt_check_rank_t *q)
+{
+  uint8_t b;
+  for(b=0;b<4;b++) {
+      q->occ[b] = tmap_bwt_occ(bwt, k, b);
+  }
+  if(k < bwt->seq_len) tmap_bwt_occ4(bwt, k, q->occ4);
+  tmap_bwt_2occ(bwt, k, l, c, &q->ok, &q->ol);
+  if(l < bwt->seq_len) tmap_bwt_2occ4(bwt, k, l, q->cntk, q->cntl);
+}
+
+void
+tmap_bwt_check_rank(tmap_bwt_t *bwt)
+{
+  const tmap_bwt_rank_t *rank = NULL, *best = bwt->rank;
+  tmap_bwt_check_rank_t ref, test;
+  tmap_rand_t *rand = NULL;
+  tmap_bwt_int_t k, l, sum;
+  int32_t type;
+  uint8_t c;
+  double t;
+
+  rand = tmap_rand_init(13);
+
+  tmap_progress_print2("checking the rank kernels against the scalar code (%s was chosen)",
+                       (NULL == best) ? tmap_bwt_rank_name(TMAP_BWT_RANK_SCALAR) : best->name);
+  for(type=TMAP_BWT_RANK_SCALAR+1;type<TMAP_BWT_RANK_NUM;type++) {
+      if(NULL == (rank = tmap_bwt_rank_get(type))) {
+          tmap_progress_print2("%s kernel not supported on this host", tmap_bwt_rank_name(type));
+          continue;
+      }
+      // every position, with l up to two occurrence intervals after k
+      tmap_rand_reinit(rand, 13);
+      for(k=0;k<=bwt->seq_len;k++) {
+          l = k + (tmap_rand_int(rand) % (2 * bwt->occ_interval));
+          if(bwt->seq_len < l) l = bwt->seq_len;
+          c = tmap_rand_int(rand) & 3;
+          memset(&ref, 0, sizeof(tmap_bwt_check_rank_t));
+          memset(&test, 0, sizeof(tmap_bwt_check_rank_t));
+          bwt->rank = NULL;
+          tmap_bwt_check_rank_query(bwt, k, l, c, &ref);
+          bwt->rank = rank;
+          tmap_bwt_check_rank_query(bwt, k, l, c, &test);
+          if(0 != memcmp(&ref, &test, sizeof(tmap_bwt_check_rank_t))) {
+              bwt->rank = best;
+              tmap_progress_print2("%s kernel did not match at k=%llu l=%llu c=%d", rank->name, 
+                                   (unsigned long long)k, (unsigned long long)l, c);
+              tmap_error("inconsistency found in the rank kernel", Exit, OutOfRange);
+          }
+      }
+      tmap_progress_print2("%s kernel matched at all %llu positions", rank->name, (unsigned long long)(bwt->seq_len + 1));
+  }
+
+  // time each kernel
+  for(type=TMAP_BWT_RANK_SCALAR;type<TMAP_BWT_RANK_NUM;type++) {
+      rank = tmap_bwt_rank_get(type);
+      if(TMAP_BWT_RANK_SCALAR != type && NULL == rank) continue;
+      bwt->rank = rank;
+      tmap_rand_reinit(rand, 13);
+      t = tmap_time_cputime();
+      for(k=sum=0;k<bwt->seq_len;k++) {
+          l = k + (tmap_rand_int(rand) % (2 * bwt->occ_interval));
+          if(bwt->seq_len <= l) l = bwt->seq_len - 1;
+          tmap_bwt_2occ4(bwt, k, l, ref.cntk, ref.cntl);
+          sum += ref.cntk[k & 3] + ref.cntl[l & 3];
+      }
+      tmap_progress_print2("%s kernel: %.2f seconds (%llu)", tmap_bwt_rank_name(type), 
+                           tmap_time_cputime() - t, (unsigned long long)sum);
+  }
+
+  bwt->rank = best;
+  tmap_rand_destroy(rand);
+}
+
 void 
-tmap_bwt_check_core(const char *fn_fasta, int32_t length, int32_t print_sa, int32_t use_hash)
+tmap_bwt_check_core(const char *fn_fasta, int32_t length, int32_t print_sa, int32_t use_hash, int32_t num_threads)
 {
   tmap_bwt_t *bwt;
   int32_t hash_width = 0;
 
 #ifdef TMAP_BWT_CHECK_DEBUG 
-  tmap_bwt_index = tmap_index_init(fn_fasta, 0);
+  tmap_bwt_index = tmap_index_init(fn_fasta, 0, TMAP_PLACEMENT_HUGE_PAGES_NONE, TMAP_PLACEMENT_NUMA_NONE);
   bwt = tmap_bwt_index->bwt;
 #else
   bwt = tmap_bwt_read(fn_fasta);
@@ -144,7 +339,7 @@ tmap_bwt_check_core(const char *fn_fasta, int32_t length, int32_t print_sa, int3
   }
 
 
-  tmap_bwt_check_core2(bwt, length, 1, print_sa, 1);
+  tmap_bwt_check_core2(bwt, length, 1, print_sa, 1, num_threads);
 
   if(0 == use_hash) {
       bwt->hash_width = hash_width;
@@ -159,15 +354,17 @@ tmap_bwt_check_core(const char *fn_fasta, int32_t length, int32_t print_sa, int3
 int 
 tmap_bwt_check(int argc, char *argv[])
 {
-  int c, length = 12, print_sa = 0, use_hash = 0;
+  int c, length = 12, print_sa = 0, use_hash = 0, check_rank = 0, num_threads = 1;
 
   tmap_progress_set_verbosity(1); 
 
-  while ((c = getopt(argc, argv, "l:pH")) >= 0) {
+  while ((c = getopt(argc, argv, "l:pHrn:")) >= 0) {
       switch (c) {
         case 'l': length = atoi(optarg); break;
         case 'p': print_sa = 1; break;
         case 'H': use_hash = 1; break;
+        case 'r': check_rank = 1; break;
+        case 'n': num_threads = atoi(optarg); break;
         default: return 1;
       }
   }
@@ -178,9 +375,20 @@ tmap_bwt_check(int argc, char *argv[])
       tmap_file_fprintf(tmap_file_stderr, "         -l INT    the kmer length to check\n");
       tmap_file_fprintf(tmap_file_stderr, "         -p        print out the SA intervals for each kmer\n");
       tmap_file_fprintf(tmap_file_stderr, "         -H        use the hash to compute the SA intervals\n");
+      tmap_file_fprintf(tmap_file_stderr, "         -r        check the rank kernels against the scalar code instead\n");
+      tmap_file_fprintf(tmap_file_stderr, "         -n INT    the number of threads (not with -p)\n");
       tmap_file_fprintf(tmap_file_stderr, "\n");
       return 1;
   }
-  tmap_bwt_check_core(argv[optind], length, print_sa, use_hash);
+  if(1 == check_rank) {
+      tmap_bwt_t *bwt = tmap_bwt_read(argv[optind]);
+      tmap_bwt_check_rank(bwt);
+      tmap_bwt_destroy(bwt);
+      return 0;
+  }
+  if(num_threads <= 0) {
+      tmap_error("option -n out of range", Exit, CommandLineArgument);
+  }
+  tmap_bwt_check_core(argv[optind], length, print_sa, use_hash, num_threads);
   return 0;
 }
@@ -2,13 +2,30 @@
 #ifndef TMAP_BWT_CHECK_H_
 #define TMAP_BWT_CHECK_H_
 
-// TODO
+/*! 
+  checks that each k-mer occurs as often as its reverse complement, and that
+  the k-mers of each length occur as often as there are positions in the BWT
+  @param  bwt          pointer to the bwt structure
+  @param  length       the maximum k-mer length to check
+  @param  print_msg    1 to print the result for each length, 0 otherwise
+  @param  print_sa     1 to print the SA interval of each k-mer, 0 otherwise
+  @param  warn         1 to warn on an inconsistency, 0 to exit
+  @param  num_threads  the number of threads, used only when the SA intervals are not printed
+  */
 void 
-tmap_bwt_check_core2(tmap_bwt_t *bwt, int32_t length, int32_t print_msg, int32_t print_sa, int32_t warn);
+tmap_bwt_check_core2(tmap_bwt_t *bwt, int32_t length, int32_t print_msg, int32_t print_sa, int32_t warn, int32_t num_threads);
+
+/*! 
+  checks that each rank kernel this host supports gives the same occurrences
+  as the scalar code at every position, then times each kernel
+  @param  bwt  pointer to the bwt structure
+  */
+void
+tmap_bwt_check_rank(tmap_bwt_t *bwt);
 
 // TODO
 void 
-tmap_bwt_check_core(const char *fn_fasta, int32_t length, int32_t print_sa, int32_t use_hash);
+tmap_bwt_check_core(const char *fn_fasta, int32_t length, int32_t print_sa, int32_t use_hash, int32_t num_threads);
 
 // TODO
 int 
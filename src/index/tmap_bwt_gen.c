@@ -29,6 +29,10 @@
 #include <stdint.h>
 #include <time.h>
 #include <unistd.h>
+#include <config.h>
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 #include "../util/tmap_error.h"
 #include "../util/tmap_alloc.h"
 #include "../util/tmap_progress.h"
@@ -101,8 +105,41 @@ typedef struct {
     uint32_t *packedText;
     uint8_t *textBuffer;
     uint32_t *packedShift;
+    int32_t numThreads;
 } tmap_bwt_gen_inc_t;
 
+/*!
+ A range of keys to sort in one iteration
+ */
+typedef struct {
+    tmap_bwt_int_t *key;
+    tmap_bwt_int_t *seq;
+    tmap_bwt_int_t numItem;
+} tmap_bwt_gen_sort_t;
+
+#ifdef HAVE_LIBPTHREAD
+/*!
+ The ranges of keys sorted by one thread
+ */
+typedef struct {
+    tmap_bwt_gen_sort_t *ranges[ALPHABET_SIZE + 1];
+    int32_t numRanges;
+    tmap_bwt_int_t numItem;
+} tmap_bwt_gen_sort_thread_data_t;
+
+/*!
+ The major occurrence blocks generated by one thread
+ */
+typedef struct {
+    const uint32_t *bwt;
+    uint32_t *occValue;
+    tmap_bwt_int_t *occValueMajor;
+    const uint32_t *decodeTable;
+    tmap_bwt_int_t majorStart;
+    tmap_bwt_int_t majorEnd;
+} tmap_bwt_gen_occ_thread_data_t;
+#endif
+
 static tmap_bwt_int_t
 TextLengthFromBytePacked(tmap_bwt_int_t bytePackedLength, uint32_t bitPerChar,
                          uint32_t lastByteLength)
@@ -382,7 +419,8 @@ BWTCreate(const tmap_bwt_int_t textLength, uint32_t *decodeTable)
 
 tmap_bwt_gen_inc_t *
 BWTIncCreate(const tmap_bwt_int_t textLength, 
-             const uint32_t initialMaxBuildSize, const uint32_t incMaxBuildSize)
+             const uint32_t initialMaxBuildSize, const uint32_t incMaxBuildSize,
+             const uint64_t maxMemory, const int32_t numThreads)
 {
   tmap_bwt_gen_inc_t *bwtInc;
   uint32_t i, n_iter;
@@ -392,6 +430,7 @@ BWTIncCreate(const tmap_bwt_int_t textLength,
   bwtInc->bwt = BWTCreate(textLength, NULL);
   bwtInc->initialMaxBuildSize = initialMaxBuildSize;
   bwtInc->incMaxBuildSize = incMaxBuildSize;
+  bwtInc->numThreads = numThreads;
   bwtInc->cumulativeCountInCurrentBuild = tmap_calloc((ALPHABET_SIZE + 1), sizeof(tmap_bwt_int_t), "bwtInc->cumumlativeCountInCurrentBuild");
   initializeVALBIG(bwtInc->cumulativeCountInCurrentBuild, ALPHABET_SIZE + 1, 0);
 
@@ -405,9 +444,20 @@ BWTIncCreate(const tmap_bwt_int_t textLength,
   bwtInc->availableWord = BWTResidentSizeInWord(textLength) + BWTOccValueMinorSizeInWord(textLength) // minimal memory requirement
     + OCC_INTERVAL / BIT_PER_CHAR * n_iter * 2 * (sizeof(tmap_bwt_int_t) / 4) // buffer at the end of occ array 
     + incMaxBuildSize/5 * 3 * (sizeof(tmap_bwt_int_t) / 4); // space for the 3 temporary arrays in each iteration
+  if (0 < maxMemory) { // use all of the memory given, building as much text in each iteration as fits
+      bwtInc->availableWord = maxMemory / BYTES_IN_WORD;
+      bwtInc->initialMaxBuildSize = 0;
+      bwtInc->incMaxBuildSize = 0;
+      if (bwtInc->availableWord < BWTResidentSizeInWord(textLength) + BWTOccValueMinorSizeInWord(textLength) + MIN_AVAILABLE_WORD) {
+          tmap_error("the memory limit is too small to construct the BWT", Exit, OutOfRange);
+      }
+  }
   if (bwtInc->availableWord < MIN_AVAILABLE_WORD) bwtInc->availableWord = MIN_AVAILABLE_WORD; // lh3: otherwise segfault when availableWord is too small
   //fprintf(stderr, "[%s] textLength=%ld, availableWord=%ld\n", __func__, (long)textLength, (long)bwtInc->availableWord);
   bwtInc->workingMemory = (unsigned*)calloc(bwtInc->availableWord, BYTES_IN_WORD);
+  if (NULL == bwtInc->workingMemory) {
+      tmap_error("bwtInc->workingMemory", Exit, MallocMemory);
+  }
 
   return bwtInc;
 }
@@ -907,6 +957,84 @@ BWTIncSortKey(tmap_bwt_int_t* __restrict key, tmap_bwt_int_t* __restrict seq, co
   }
 }
 
+// for BWTIncConstruct()
+static void
+BWTIncAddSortRange(tmap_bwt_gen_sort_t *ranges, int32_t *numRanges, tmap_bwt_int_t *key, tmap_bwt_int_t *seq,
+                   const tmap_bwt_int_t start, const tmap_bwt_int_t numItem)
+{
+  ranges[*numRanges].key = key + start;
+  ranges[*numRanges].seq = seq + start;
+  ranges[*numRanges].numItem = numItem;
+  (*numRanges)++;
+}
+
+#ifdef HAVE_LIBPTHREAD
+static void *
+BWTIncSortKeyThreadWorker(void *arg)
+{
+  tmap_bwt_gen_sort_thread_data_t *data = (tmap_bwt_gen_sort_thread_data_t*)arg;
+  int32_t i;
+  for (i=0; i<data->numRanges; i++) {
+      BWTIncSortKey(data->ranges[i]->key, data->ranges[i]->seq, data->ranges[i]->numItem);
+  }
+  return arg;
+}
+#endif
+
+// for BWTIncConstruct()
+// sorts each range, which do not overlap, giving the largest remaining range
+// to the thread with the fewest items
+static void
+BWTIncSortKeyRanges(tmap_bwt_gen_sort_t *ranges, const int32_t numRanges, const int32_t numThreads)
+{
+  int32_t i, j;
+#ifdef HAVE_LIBPTHREAD
+  if (1 < numThreads && 1 < numRanges) {
+      int32_t n = (numThreads < numRanges) ? numThreads : numRanges;
+      pthread_attr_t attr;
+      pthread_t threads[ALPHABET_SIZE + 1];
+      tmap_bwt_gen_sort_thread_data_t thread_data[ALPHABET_SIZE + 1];
+      tmap_bwt_gen_sort_t tmp;
+
+      // largest range first
+      for (i=1; i<numRanges; i++) {
+          for (j=i; 0<j && ranges[j-1].numItem < ranges[j].numItem; j--) {
+              tmp = ranges[j-1]; ranges[j-1] = ranges[j]; ranges[j] = tmp;
+          }
+      }
+      for (i=0; i<n; i++) {
+          thread_data[i].numRanges = 0;
+          thread_data[i].numItem = 0;
+      }
+      for (i=0; i<numRanges; i++) {
+          tmap_bwt_gen_sort_thread_data_t *d = &thread_data[0];
+          for (j=1; j<n; j++) {
+              if (thread_data[j].numItem < d->numItem) d = &thread_data[j];
+          }
+          d->ranges[d->numRanges++] = &ranges[i];
+          d->numItem += ranges[i].numItem;
+      }
+
+      pthread_attr_init(&attr);
+      pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+      for (i=0; i<n; i++) {
+          if(0 != pthread_create(&threads[i], &attr, BWTIncSortKeyThreadWorker, &thread_data[i])) {
+              tmap_error("error creating threads", Exit, ThreadError);
+          }
+      }
+      for (i=0; i<n; i++) {
+          if(0 != pthread_join(threads[i], NULL)) {
+              tmap_error("error joining threads", Exit, ThreadError);
+          }
+      }
+      return;
+  }
+#endif
+  for (i=0; i<numRanges; i++) {
+      BWTIncSortKey(ranges[i].key, ranges[i].seq, ranges[i].numItem);
+  }
+}
+
 static void 
 BWTIncBuildRelativeRank(tmap_bwt_int_t* __restrict sortedRank, tmap_bwt_int_t* __restrict seq,
                         tmap_bwt_int_t* __restrict relativeRank, const tmap_bwt_int_t numItem,
@@ -1127,12 +1255,14 @@ BWTClearTrailingBwtCode(tmap_bwt_gen_t *bwt)
 }
 
 
-void 
-BWTGenerateOccValueFromBwt(const uint32_t*  bwt, uint32_t* __restrict occValue,
-                           tmap_bwt_int_t* __restrict occValueMajor,
-                           const tmap_bwt_int_t textLength, const uint32_t*  decodeTable)
+// for BWTGenerateOccValueFromBwt()
+// generates the occurrence values of the major blocks [majorStart, majorEnd),
+// storing the number of each character in each block in occValueMajor
+static void
+BWTGenerateOccValueMajor(const uint32_t*  bwt, uint32_t* __restrict occValue,
+                         tmap_bwt_int_t* __restrict occValueMajor, const uint32_t*  decodeTable,
+                         const tmap_bwt_int_t majorStart, const tmap_bwt_int_t majorEnd)
 {
-  tmap_bwt_int_t numberOfOccValueMajor, numberOfOccValue;
   uint32_t wordBetweenOccValue;
   tmap_bwt_int_t numberOfOccIntervalPerMajor;
   uint32_t c;
@@ -1143,25 +1273,16 @@ BWTGenerateOccValueFromBwt(const uint32_t*  bwt, uint32_t* __restrict occValue,
   tmap_bwt_int_t tempOccValue0[ALPHABET_SIZE], tempOccValue1[ALPHABET_SIZE];
 
   wordBetweenOccValue = OCC_INTERVAL / CHAR_PER_WORD;
-
-  // Calculate occValue
-  // [lh3] by default: OCC_INTERVAL_MAJOR=65536, OCC_INTERVAL=256
-  numberOfOccValue = (textLength + OCC_INTERVAL - 1) / OCC_INTERVAL + 1;				// Value at both end for bi-directional encoding
   numberOfOccIntervalPerMajor = OCC_INTERVAL_MAJOR / OCC_INTERVAL;
-  numberOfOccValueMajor = (numberOfOccValue + numberOfOccIntervalPerMajor - 1) / numberOfOccIntervalPerMajor;
 
   tempOccValue0[0] = 0;
   tempOccValue0[1] = 0;
   tempOccValue0[2] = 0;
   tempOccValue0[3] = 0;
-  occValueMajor[0] = 0;
-  occValueMajor[1] = 0;
-  occValueMajor[2] = 0;
-  occValueMajor[3] = 0;
 
-  occIndex = 0;
-  bwtIndex = 0;
-  for (occMajorIndex=1; occMajorIndex<numberOfOccValueMajor; occMajorIndex++) {
+  occIndex = (majorStart - 1) * (numberOfOccIntervalPerMajor / 2);
+  bwtIndex = (majorStart - 1) * numberOfOccIntervalPerMajor * wordBetweenOccValue;
+  for (occMajorIndex=majorStart; occMajorIndex<majorEnd; occMajorIndex++) {
 
       for (i=0; i<numberOfOccIntervalPerMajor/2; i++) {
 
@@ -1229,16 +1350,109 @@ BWTGenerateOccValueFromBwt(const uint32_t*  bwt, uint32_t* __restrict occValue,
           }
       }
 
-      occValueMajor[occMajorIndex * 4 + 0] = occValueMajor[(occMajorIndex - 1) * 4 + 0] + tempOccValue0[0];
-      occValueMajor[occMajorIndex * 4 + 1] = occValueMajor[(occMajorIndex - 1) * 4 + 1] + tempOccValue0[1];
-      occValueMajor[occMajorIndex * 4 + 2] = occValueMajor[(occMajorIndex - 1) * 4 + 2] + tempOccValue0[2];
-      occValueMajor[occMajorIndex * 4 + 3] = occValueMajor[(occMajorIndex - 1) * 4 + 3] + tempOccValue0[3];
+      occValueMajor[occMajorIndex * 4 + 0] = tempOccValue0[0];
+      occValueMajor[occMajorIndex * 4 + 1] = tempOccValue0[1];
+      occValueMajor[occMajorIndex * 4 + 2] = tempOccValue0[2];
+      occValueMajor[occMajorIndex * 4 + 3] = tempOccValue0[3];
       tempOccValue0[0] = 0;
       tempOccValue0[1] = 0;
       tempOccValue0[2] = 0;
       tempOccValue0[3] = 0;
 
   }
+}
+
+#ifdef HAVE_LIBPTHREAD
+static void *
+BWTGenerateOccValueMajorThreadWorker(void *arg)
+{
+  tmap_bwt_gen_occ_thread_data_t *data = (tmap_bwt_gen_occ_thread_data_t*)arg;
+  BWTGenerateOccValueMajor(data->bwt, data->occValue, data->occValueMajor, data->decodeTable,
+                           data->majorStart, data->majorEnd);
+  return arg;
+}
+#endif
+
+void 
+BWTGenerateOccValueFromBwt(const uint32_t*  bwt, uint32_t* __restrict occValue,
+                           tmap_bwt_int_t* __restrict occValueMajor,
+                           const tmap_bwt_int_t textLength, const uint32_t*  decodeTable,
+                           const int32_t numThreads)
+{
+  tmap_bwt_int_t numberOfOccValueMajor, numberOfOccValue;
+  uint32_t wordBetweenOccValue;
+  tmap_bwt_int_t numberOfOccIntervalPerMajor;
+  uint32_t c;
+  tmap_bwt_int_t i, j;
+  tmap_bwt_int_t occMajorIndex;
+  tmap_bwt_int_t occIndex, bwtIndex;
+  tmap_bwt_int_t sum;
+  tmap_bwt_int_t tempOccValue0[ALPHABET_SIZE], tempOccValue1[ALPHABET_SIZE];
+
+  wordBetweenOccValue = OCC_INTERVAL / CHAR_PER_WORD;
+
+  // Calculate occValue
+  // [lh3] by default: OCC_INTERVAL_MAJOR=65536, OCC_INTERVAL=256
+  numberOfOccValue = (textLength + OCC_INTERVAL - 1) / OCC_INTERVAL + 1;				// Value at both end for bi-directional encoding
+  numberOfOccIntervalPerMajor = OCC_INTERVAL_MAJOR / OCC_INTERVAL;
+  numberOfOccValueMajor = (numberOfOccValue + numberOfOccIntervalPerMajor - 1) / numberOfOccIntervalPerMajor;
+
+  tempOccValue0[0] = 0;
+  tempOccValue0[1] = 0;
+  tempOccValue0[2] = 0;
+  tempOccValue0[3] = 0;
+  occValueMajor[0] = 0;
+  occValueMajor[1] = 0;
+  occValueMajor[2] = 0;
+  occValueMajor[3] = 0;
+
+  // the major blocks, then their cumulative counts
+#ifdef HAVE_LIBPTHREAD
+  if (1 < numThreads && numThreads < numberOfOccValueMajor) {
+      pthread_attr_t attr;
+      pthread_t *threads = NULL;
+      tmap_bwt_gen_occ_thread_data_t *thread_data = NULL;
+
+      pthread_attr_init(&attr);
+      pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+
+      threads = tmap_calloc(numThreads, sizeof(pthread_t), "threads");
+      thread_data = tmap_calloc(numThreads, sizeof(tmap_bwt_gen_occ_thread_data_t), "thread_data");
+
+      for (i=0; i<numThreads; i++) {
+          thread_data[i].bwt = bwt;
+          thread_data[i].occValue = occValue;
+          thread_data[i].occValueMajor = occValueMajor;
+          thread_data[i].decodeTable = decodeTable;
+          thread_data[i].majorStart = 1 + (numberOfOccValueMajor - 1) * i / numThreads;
+          thread_data[i].majorEnd = 1 + (numberOfOccValueMajor - 1) * (i + 1) / numThreads;
+          if(0 != pthread_create(&threads[i], &attr, BWTGenerateOccValueMajorThreadWorker, &thread_data[i])) {
+              tmap_error("error creating threads", Exit, ThreadError);
+          }
+      }
+      for (i=0; i<numThreads; i++) {
+          if(0 != pthread_join(threads[i], NULL)) {
+              tmap_error("error joining threads", Exit, ThreadError);
+          }
+      }
+
+      free(threads);
+      free(thread_data);
+  }
+  else {
+      BWTGenerateOccValueMajor(bwt, occValue, occValueMajor, decodeTable, 1, numberOfOccValueMajor);
+  }
+#else
+  BWTGenerateOccValueMajor(bwt, occValue, occValueMajor, decodeTable, 1, numberOfOccValueMajor);
+#endif
+  for (occMajorIndex=1; occMajorIndex<numberOfOccValueMajor; occMajorIndex++) {
+      occValueMajor[occMajorIndex * 4 + 0] += occValueMajor[(occMajorIndex - 1) * 4 + 0];
+      occValueMajor[occMajorIndex * 4 + 1] += occValueMajor[(occMajorIndex - 1) * 4 + 1];
+      occValueMajor[occMajorIndex * 4 + 2] += occValueMajor[(occMajorIndex - 1) * 4 + 2];
+      occValueMajor[occMajorIndex * 4 + 3] += occValueMajor[(occMajorIndex - 1) * 4 + 3];
+  }
+  occIndex = (numberOfOccValueMajor - 1) * (numberOfOccIntervalPerMajor / 2);
+  bwtIndex = (numberOfOccValueMajor - 1) * numberOfOccIntervalPerMajor * wordBetweenOccValue;
 
   while (occIndex < (numberOfOccValue-1)/2) {
       sum = 0;
@@ -1351,6 +1565,8 @@ BWTIncConstruct(tmap_bwt_gen_inc_t *bwtInc, const tmap_bwt_int_t numChar)
   tmap_bwt_int_t *relativeRank, *seq, *sortedRank;
   uint32_t *insertBwt, *mergedBwt;
   tmap_bwt_int_t newInverseSa0RelativeRank, oldInverseSa0RelativeRank, newInverseSa0;
+  tmap_bwt_gen_sort_t ranges[ALPHABET_SIZE + 1];
+  int32_t numRanges;
 
 #ifdef DEBUG
   if (numChar > bwtInc->buildSize) {
@@ -1419,19 +1635,21 @@ BWTIncConstruct(tmap_bwt_gen_inc_t *bwtInc, const tmap_bwt_int_t numChar)
                                                         numChar, bwtInc->cumulativeCountInCurrentBuild, bwtInc->firstCharInLastIteration);
 
       // Sort rank by ALPHABET_SIZE + 2 groups (or ALPHABET_SIZE + 1 groups when inverseSa0 sit on the border of a group)
+      numRanges = 0;
       for (i=0; i<ALPHABET_SIZE; i++) {
           if (bwtInc->cumulativeCountInCurrentBuild[i] > oldInverseSa0RelativeRank ||
               bwtInc->cumulativeCountInCurrentBuild[i+1] <= oldInverseSa0RelativeRank) {
-              BWTIncSortKey(sortedRank + bwtInc->cumulativeCountInCurrentBuild[i], seq + bwtInc->cumulativeCountInCurrentBuild[i], bwtInc->cumulativeCountInCurrentBuild[i+1] - bwtInc->cumulativeCountInCurrentBuild[i]);
+              BWTIncAddSortRange(ranges, &numRanges, sortedRank, seq, bwtInc->cumulativeCountInCurrentBuild[i], bwtInc->cumulativeCountInCurrentBuild[i+1] - bwtInc->cumulativeCountInCurrentBuild[i]);
           } else {
               if (bwtInc->cumulativeCountInCurrentBuild[i] < oldInverseSa0RelativeRank) {
-                  BWTIncSortKey(sortedRank + bwtInc->cumulativeCountInCurrentBuild[i], seq + bwtInc->cumulativeCountInCurrentBuild[i], oldInverseSa0RelativeRank - bwtInc->cumulativeCountInCurrentBuild[i]);
+                  BWTIncAddSortRange(ranges, &numRanges, sortedRank, seq, bwtInc->cumulativeCountInCurrentBuild[i], oldInverseSa0RelativeRank - bwtInc->cumulativeCountInCurrentBuild[i]);
               }
               if (bwtInc->cumulativeCountInCurrentBuild[i+1] > oldInverseSa0RelativeRank + 1) {
-                  BWTIncSortKey(sortedRank + oldInverseSa0RelativeRank + 1, seq + oldInverseSa0RelativeRank + 1, bwtInc->cumulativeCountInCurrentBuild[i+1] - oldInverseSa0RelativeRank - 1);
+                  BWTIncAddSortRange(ranges, &numRanges, sortedRank, seq, oldInverseSa0RelativeRank + 1, bwtInc->cumulativeCountInCurrentBuild[i+1] - oldInverseSa0RelativeRank - 1);
               }
           }
       }
+      BWTIncSortKeyRanges(ranges, numRanges, bwtInc->numThreads);
 
       // build relative rank; sortedRank is updated for merging to cater for the fact that $ is not encoded in bwt
       // the cumulative freq information is used to make sure that inverseSa0 and suffix beginning with different characters are kept in different unsorted groups)
@@ -1454,6 +1672,8 @@ BWTIncConstruct(tmap_bwt_gen_inc_t *bwtInc, const tmap_bwt_int_t numChar)
       BWTIncBuildBwt(insertBwt, relativeRank, numChar, bwtInc->cumulativeCountInCurrentBuild);
 
       // Merge BWT
+      // NB: the merged BWT is written over the old BWT as the merge goes, so
+      // the merge, like the rank walk above, stays on one thread
       mergedBwt = bwtInc->workingMemory + bwtInc->availableWord - mergedBwtSizeInWord 
         - bwtInc->numberOfIterationDone * OCC_INTERVAL / BIT_PER_CHAR * sizeof(tmap_bwt_int_t) / 4;
       if(mergedBwt < insertBwt + numChar) {
@@ -1477,7 +1697,7 @@ BWTIncConstruct(tmap_bwt_gen_inc_t *bwtInc, const tmap_bwt_int_t numChar)
 
   BWTClearTrailingBwtCode(bwtInc->bwt);
   BWTGenerateOccValueFromBwt(bwtInc->bwt->bwtCode, bwtInc->bwt->occValue, bwtInc->bwt->occValueMajor,
-                             bwtInc->bwt->textLength, bwtInc->bwt->decodeTable);
+                             bwtInc->bwt->textLength, bwtInc->bwt->decodeTable, bwtInc->numThreads);
 
   bwtInc->bwt->inverseSa0 = newInverseSa0;
 
@@ -1496,7 +1716,8 @@ BWTIncConstruct(tmap_bwt_gen_inc_t *bwtInc, const tmap_bwt_int_t numChar)
 
 tmap_bwt_gen_inc_t *
 BWTIncConstructFromPacked(const char *inputFileName, 
-                          const tmap_bwt_int_t initialMaxBuildSize, const tmap_bwt_int_t incMaxBuildSize)
+                          const tmap_bwt_int_t initialMaxBuildSize, const tmap_bwt_int_t incMaxBuildSize,
+                          const uint64_t maxMemory, const int32_t numThreads)
 {
 
   FILE *packedFile;
@@ -1524,7 +1745,7 @@ BWTIncConstructFromPacked(const char *inputFileName,
   }
   totalTextLength = TextLengthFromBytePacked(packedFileLen, BIT_PER_CHAR, lastByteLength);
 
-  bwtInc = BWTIncCreate(totalTextLength, initialMaxBuildSize, incMaxBuildSize);
+  bwtInc = BWTIncCreate(totalTextLength, initialMaxBuildSize, incMaxBuildSize, maxMemory, numThreads);
 
   BWTIncSetBuildSizeAndTextAddr(bwtInc);
 
@@ -1609,7 +1830,7 @@ BWTFileSizeInWord(const tmap_bwt_int_t numChar)
 }
 
 void 
-BWTSaveBwtCodeAndOcc(tmap_bwt_t *bwt_out, const tmap_bwt_gen_t *bwt, const char *fn_fasta, int32_t occ_interval) 
+BWTSaveBwtCodeAndOcc(tmap_bwt_t *bwt_out, const tmap_bwt_gen_t *bwt, const char *fn_fasta, int32_t occ_interval, uint32_t occ_layout) 
 {
   tmap_bwt_int_t i;
   tmap_bwt_t *bwt_tmp=NULL;
@@ -1633,9 +1854,9 @@ BWTSaveBwtCodeAndOcc(tmap_bwt_t *bwt_out, const tmap_bwt_gen_t *bwt, const char
   bwt_out->bwt = NULL;
 
   // update occurrence interval, if necessary
-  if(occ_interval != bwt_out->occ_interval) {
+  if(occ_interval != bwt_out->occ_interval || TMAP_BWT_OCC_LAYOUT_INTERLEAVED != occ_layout) {
       bwt_tmp = tmap_bwt_read(fn_fasta);
-      tmap_bwt_update_occ_interval(bwt_tmp, occ_interval);
+      tmap_bwt_update_occ_interval(bwt_tmp, occ_interval, occ_layout);
       tmap_bwt_write(fn_fasta, bwt_tmp);
       tmap_bwt_destroy(bwt_tmp);
   }
@@ -1660,7 +1881,8 @@ tmap_bwt_tune_hash_width(uint64_t ref_len)
 }
 
 void 
-tmap_bwt_pac2bwt(const char *fn_fasta, uint32_t is_large, int32_t occ_interval, int32_t hash_width, int32_t check_hash)
+tmap_bwt_pac2bwt(const char *fn_fasta, uint32_t is_large, int32_t occ_interval, uint32_t occ_layout, int32_t hash_width, int32_t check_hash,
+                 int32_t num_threads, uint64_t max_memory)
 {
   tmap_bwt_gen_inc_t *bwtInc=NULL;
   tmap_bwt_t *bwt=NULL;
@@ -1690,8 +1912,8 @@ tmap_bwt_pac2bwt(const char *fn_fasta, uint32_t is_large, int32_t occ_interval,
       if(TMAP_PAC_COMPRESSION != TMAP_FILE_NO_COMPRESSION) { // the below uses fseek
           tmap_error("PAC compression not supported", Exit, OutOfRange);
       }
-      bwtInc = BWTIncConstructFromPacked(fn_pac, 10000000, 10000000);
-      BWTSaveBwtCodeAndOcc(bwt, bwtInc->bwt, fn_fasta, occ_interval);
+      bwtInc = BWTIncConstructFromPacked(fn_pac, 10000000, 10000000, max_memory, num_threads);
+      BWTSaveBwtCodeAndOcc(bwt, bwtInc->bwt, fn_fasta, occ_interval, occ_layout);
       BWTIncFree(bwtInc);
       free(fn_pac);
   }
@@ -1724,7 +1946,7 @@ tmap_bwt_pac2bwt(const char *fn_fasta, uint32_t is_large, int32_t occ_interval,
       bwt->occ_interval = 1; 
 
       // update occurrence interval
-      tmap_bwt_update_occ_interval(bwt, occ_interval);
+      tmap_bwt_update_occ_interval(bwt, occ_interval, occ_layout);
 
       bwt->hash_width = 0; // none yet
       tmap_bwt_write(fn_fasta, bwt);
@@ -1740,7 +1962,7 @@ tmap_bwt_pac2bwt(const char *fn_fasta, uint32_t is_large, int32_t occ_interval,
 
   if(0 < hash_width) {
       bwt = tmap_bwt_read(fn_fasta); 
-      tmap_bwt_gen_hash(bwt, hash_width, check_hash);
+      tmap_bwt_gen_hash(bwt, hash_width, check_hash, num_threads);
       tmap_bwt_write(fn_fasta, bwt);
       tmap_bwt_destroy(bwt);
   }
@@ -1750,7 +1972,7 @@ tmap_bwt_pac2bwt(const char *fn_fasta, uint32_t is_large, int32_t occ_interval,
 }
 
 void 
-tmap_bwt_update_hash(const char *fn_fasta, int32_t hash_width, int32_t check_hash)
+tmap_bwt_update_hash(const char *fn_fasta, int32_t hash_width, int32_t check_hash, int32_t num_threads)
 {
   int32_t i;
   tmap_bwt_t *bwt;
@@ -1776,7 +1998,7 @@ tmap_bwt_update_hash(const char *fn_fasta, int32_t hash_width, int32_t check_has
       bwt->hash_k = bwt->hash_l = NULL;
 
       // new hash
-      tmap_bwt_gen_hash(bwt, hash_width, check_hash);
+      tmap_bwt_gen_hash(bwt, hash_width, check_hash, num_threads);
 
       // write
       tmap_bwt_write(fn_fasta, bwt);
@@ -45,20 +45,26 @@ tmap_bwt_tune_hash_width(uint64_t ref_len);
   @param  fn_fasta      file name of the FASTA file
   @param  is_large      0 to use the short BWT construction algorith, 1 otherwise (large BWT construction algorithm) 
   @param  occ_interval  the desired occurrence interval
+  @param  occ_layout    the desired occurrence array layout (TMAP_BWT_OCC_LAYOUT_*)
   @param  hash_width    the desired k-mer hash width
   @param  check_hash    1 to validate the hash, 0 otherwise
+  @param  num_threads   the number of threads for the hash, and for the sorting and occurrence counting of the large BWT construction algorithm
+  @param  max_memory    the bytes of working memory for the large BWT construction algorithm, or zero to build in 10Mb pieces
+  @details              with a memory limit, as much of the text is added in each iteration as fits in the given memory
   */
 void 
-tmap_bwt_pac2bwt(const char *fn_fasta, uint32_t is_large, int32_t occ_interval, int32_t hash_width, int32_t check_hash);
+tmap_bwt_pac2bwt(const char *fn_fasta, uint32_t is_large, int32_t occ_interval, uint32_t occ_layout, int32_t hash_width, int32_t check_hash,
+                 int32_t num_threads, uint64_t max_memory);
 
 /*! 
   updates a bwt FASTA file for a new hash width
   @param  fn_fasta      file name of the FASTA file
   @param  hash_width    the desired k-mer hash width
   @param  check_hash    1 to validate the hash, 0 otherwise
+  @param  num_threads   the number of threads
   */
 void 
-tmap_bwt_update_hash(const char *fn_fasta, int32_t hash_width, int32_t check_hash);
+tmap_bwt_update_hash(const char *fn_fasta, int32_t hash_width, int32_t check_hash, int32_t num_threads);
 
 /*! 
   @param  T  the input string
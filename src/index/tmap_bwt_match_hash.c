@@ -3,81 +3,137 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include "tmap_bwt.h"
-#include "../util/tmap_hash.h"
+#include "../util/tmap_alloc.h"
 #include "../util/tmap_definitions.h"
+#include "../util/tmap_placement.h"
 #include "tmap_bwt_match.h"
 #include "tmap_bwt_match_hash.h"
 
 // TODO: use the register keyword on pointers
-#if TMAP_BWT_INT_MAX == 0xffffu
-TMAP_HASH_MAP_INIT_INT(tmap_bwt_match_hash, tmap_bwt_int_t) 
-#else 
-TMAP_HASH_MAP_INIT_INT64(tmap_bwt_match_hash, tmap_bwt_int_t) 
-#endif
+
+// the number of bits needed to store v
+static inline uint32_t
+tmap_bwt_match_hash_num_bits(uint64_t v)
+{
+  uint32_t n = 1;
+  while(0 != (v >>= 1)) n++;
+  return n;
+}
+
+tmap_bwt_match_hash_cache_t*
+tmap_bwt_match_hash_cache_init(tmap_bwt_int_t seq_len, uint64_t num_bytes)
+{
+  tmap_bwt_match_hash_cache_t *cache = NULL;
+  uint32_t key_bits, min_bucket_bits;
+  const uint64_t bucket_bytes = TMAP_BWT_MATCH_HASH_BUCKET_SIZE * sizeof(uint64_t);
+
+  cache = tmap_calloc(1, sizeof(tmap_bwt_match_hash_cache_t), "cache");
+  cache->seq_len = seq_len;
+  cache->val_bits = tmap_bwt_match_hash_num_bits(seq_len);
+  key_bits = cache->val_bits + 2; // the position and the base
+
+  // an entry is a valid bit, the occurrence, and the key bits not given by its bucket
+  min_bucket_bits = (64 < 1 + cache->val_bits + key_bits) ? (1 + cache->val_bits + key_bits - 64) : 0;
+  cache->bucket_bits = 0;
+  while(cache->bucket_bits < key_bits && (bucket_bytes << (cache->bucket_bits + 1)) <= num_bytes) {
+      cache->bucket_bits++;
+  }
+  if(cache->bucket_bits < min_bucket_bits) cache->bucket_bits = min_bucket_bits;
+  cache->bucket_mask = (((uint64_t)1) << cache->bucket_bits) - 1;
+
+  // NB: the entries start zeroed, as empty
+  cache->num_bytes = bucket_bytes << cache->bucket_bits;
+  cache->entries = tmap_placement_alloc(cache->num_bytes, TMAP_PLACEMENT_HUGE_PAGES_NONE, TMAP_PLACEMENT_NUMA_NONE, 0);
+
+  return cache;
+}
+
+void
+tmap_bwt_match_hash_cache_destroy(tmap_bwt_match_hash_cache_t *cache)
+{
+  if(NULL == cache) return;
+  tmap_placement_free(cache->entries, cache->num_bytes, TMAP_PLACEMENT_HUGE_PAGES_NONE);
+  free(cache);
+}
 
 tmap_bwt_match_hash_t*
-tmap_bwt_match_hash_init()
+tmap_bwt_match_hash_init(tmap_bwt_match_hash_cache_t *cache)
 {
-  int32_t i;
   tmap_bwt_match_hash_t *h = NULL;
   h = tmap_calloc(sizeof(tmap_bwt_match_hash_t), 1, "hash");
-  for(i=0;i<4;i++) {
-      h->hash[i] = (void*)tmap_hash_init(tmap_bwt_match_hash);
-  }
+  h->cache = cache;
   return h;
 }
 
 void
 tmap_bwt_match_hash_destroy(tmap_bwt_match_hash_t *h)
 {
-  int32_t i;
-  for(i=0;i<4;i++) {
-      tmap_hash_t(tmap_bwt_match_hash) *hash = (tmap_hash_t(tmap_bwt_match_hash)*)(h->hash[i]);
-      tmap_hash_destroy(tmap_bwt_match_hash, hash); 
-  }
   free(h);
 }
 
-void
-tmap_bwt_match_hash_clear(tmap_bwt_match_hash_t *h)
-{
-  int32_t i;
-  for(i=0;i<4;i++) {
-      tmap_hash_t(tmap_bwt_match_hash) *hash = (tmap_hash_t(tmap_bwt_match_hash)*)(h->hash[i]);
-      tmap_hash_clear(tmap_bwt_match_hash, hash); 
-  }
-}
+// the bucket of the given key, which is found from the key bits below
+// bucket_bits, mixed with those above, so the key is given by the bucket and
+// the bits above
+#define __tmap_bwt_match_hash_bucket(cache, k, tag) \
+  ((volatile uint64_t*)(cache)->entries + (((k) ^ (tag)) & (cache)->bucket_mask) * TMAP_BWT_MATCH_HASH_BUCKET_SIZE)
 
 int32_t
 tmap_bwt_match_hash_put(tmap_bwt_match_hash_t *h, tmap_bwt_int_t key, uint8_t c, tmap_bwt_int_t val)
 {
-  int32_t ret;
-  tmap_hash_int_t iter;
-  tmap_hash_t(tmap_bwt_match_hash) *hash = (tmap_hash_t(tmap_bwt_match_hash)*)(h->hash[c]);
-  // get the iter
-  iter = tmap_hash_put(tmap_bwt_match_hash, hash, key, &ret); 
-  // set the value
-  tmap_hash_val(hash, iter) = val;
-  return ret;
+  tmap_bwt_match_hash_cache_t *cache = h->cache;
+  volatile uint64_t *bucket;
+  uint64_t k, tag, e, entry;
+  int32_t i, empty = -1;
+
+  if(cache->seq_len < key) return 2; // ex. the position before the first
+
+  k = ((uint64_t)key << 2) | c;
+  tag = k >> cache->bucket_bits;
+  bucket = __tmap_bwt_match_hash_bucket(cache, k, tag);
+  entry = (tag << (1 + cache->val_bits)) | ((uint64_t)val << 1) | 1;
+  for(i=0;i<TMAP_BWT_MATCH_HASH_BUCKET_SIZE;i++) {
+      e = bucket[i];
+      if(0 == e) {
+          if(empty < 0) empty = i;
+      }
+      else if((e >> (1 + cache->val_bits)) == tag) {
+          bucket[i] = entry;
+          return 0;
+      }
+  }
+  if(0 <= empty) {
+      bucket[empty] = entry;
+      return 1;
+  }
+  // the bucket is full, so replace one entry
+  bucket[tag & (TMAP_BWT_MATCH_HASH_BUCKET_SIZE-1)] = entry;
+  return 2;
 }
 
 tmap_bwt_int_t
 tmap_bwt_match_hash_get(tmap_bwt_match_hash_t *h, tmap_bwt_int_t key, uint8_t c, uint32_t *found)
 {
-  tmap_hash_int_t iter;
-  tmap_hash_t(tmap_bwt_match_hash) *hash = (tmap_hash_t(tmap_bwt_match_hash)*)(h->hash[c]);
-  // get the iter
-  iter = tmap_hash_get(tmap_bwt_match_hash, hash, key); 
-  // check it was found
-  if(tmap_hash_end(hash) == iter) { // not found
-      *found = 0;
-      return TMAP_BWT_INT_MAX;
-  }
-  else {
-      *found = 1;
-      // return the value
-      return (tmap_bwt_int_t)(tmap_hash_val(hash, iter));
+  tmap_bwt_match_hash_cache_t *cache = h->cache;
+  volatile uint64_t *bucket;
+  uint64_t k, tag, e;
+  int32_t i;
+
+  if(TMAP_LIKELY(key <= cache->seq_len)) {
+      k = ((uint64_t)key << 2) | c;
+      tag = k >> cache->bucket_bits;
+      bucket = __tmap_bwt_match_hash_bucket(cache, k, tag);
+      for(i=0;i<TMAP_BWT_MATCH_HASH_BUCKET_SIZE;i++) {
+          e = bucket[i]; // NB: read once, as other threads may overwrite it
+          if(1 == (e & 1) && (e >> (1 + cache->val_bits)) == tag) {
+              h->n_hits++;
+              *found = 1;
+              return (tmap_bwt_int_t)((e >> 1) & ((((uint64_t)1) << cache->val_bits) - 1));
+          }
+      }
   }
+  h->n_misses++;
+  *found = 0;
+  return TMAP_BWT_INT_MAX;
 }
 
 // NB: assumes we pass in prev_k, not prev_k-1, and that val had 'L2[c] + 1' added
@@ -560,6 +616,104 @@ tmap_bwt_match_hash_exact_alt_reverse(const tmap_bwt_t *bwt, int len, const uint
   return match_sa->l - match_sa->k + 1;
 }
 
+// prefetches what tmap_bwt_match_hash_2occ will read to extend prev
+#define __tmap_bwt_match_hash_prefetch(bwt, prev) do { \
+    if((bwt)->hash_width <= (prev)->offset) { \
+        tmap_bwt_prefetch_occ(bwt, (prev)->k-1); \
+        tmap_bwt_prefetch_occ(bwt, (prev)->l); \
+    } \
+} while(0)
+
+void
+tmap_bwt_match_hash_exact_batch(const tmap_bwt_t *bwt, int32_t n, const int32_t *len, const uint8_t **str, 
+                                tmap_bwt_match_occ_t *match_sa, tmap_bwt_int_t *num, tmap_bwt_match_hash_t *hash)
+{
+  int32_t i, j, m, n_active;
+  int32_t active[TMAP_BWT_MATCH_HASH_BATCH_SIZE];
+  int32_t pos[TMAP_BWT_MATCH_HASH_BATCH_SIZE];
+  uint8_t c[TMAP_BWT_MATCH_HASH_BATCH_SIZE];
+  tmap_bwt_match_occ_t next;
+
+  for(m=0;m<n;m+=TMAP_BWT_MATCH_HASH_BATCH_SIZE) {
+      // initialize, as in tmap_bwt_match_hash_exact
+      for(i=m,n_active=0;i<n && i<m+TMAP_BWT_MATCH_HASH_BATCH_SIZE;i++) {
+          c[i-m] = 0;
+          if(0 < bwt->hash_width && 0 < len[i]) { 
+              if(0 == tmap_bwt_match_hash_forward_init(bwt, len[i], str[i], &match_sa[i])) {
+                  c[i-m] = 4; // NB: so that no match is returned
+                  continue;
+              }
+          }
+          else {
+              match_sa[i].k = 0; match_sa[i].l = bwt->seq_len;
+              match_sa[i].offset = 0;
+              match_sa[i].hi = 0;
+          }
+          pos[i-m] = match_sa[i].offset;
+          active[n_active++] = i;
+      }
+      // extend all the intervals by one base at a time
+      while(0 < n_active) {
+          for(j=0;j<n_active;j++) {
+              __tmap_bwt_match_hash_prefetch(bwt, &match_sa[active[j]]);
+          }
+          for(i=j=0;j<n_active;j++) {
+              int32_t a = active[j];
+              tmap_bwt_match_occ_t *prev = &match_sa[a];
+              if(len[a] <= pos[a-m]) continue; // done
+              c[a-m] = str[a][pos[a-m]];
+              if(TMAP_UNLIKELY(3 < c[a-m])) {
+                  prev->offset++;
+                  prev->k = prev->l + 1;
+                  continue; // done
+              }
+              tmap_bwt_match_hash_2occ(bwt, prev, c[a-m], &next, hash);
+              (*prev) = next;
+              pos[a-m]++;
+              if(next.k > next.l || TMAP_BWT_INT_MAX == next.k) continue; // no match
+              active[i++] = a; // keep going
+          }
+          n_active = i;
+      }
+      // the interval sizes
+      for(i=m;i<n && i<m+TMAP_BWT_MATCH_HASH_BATCH_SIZE;i++) {
+          if(3 < c[i-m] || match_sa[i].k > match_sa[i].l || TMAP_BWT_INT_MAX == match_sa[i].k) num[i] = 0;
+          else num[i] = match_sa[i].l - match_sa[i].k + 1;
+      }
+  }
+}
+
+void
+tmap_bwt_match_hash_extend_batch(const tmap_bwt_t *bwt, int32_t n, const int32_t *len, const uint8_t **str, 
+                                 tmap_bwt_match_occ_t *match_sa, int32_t *num_ext, tmap_bwt_match_hash_t *hash)
+{
+  int32_t i, j, m, n_active;
+  int32_t active[TMAP_BWT_MATCH_HASH_BATCH_SIZE];
+  tmap_bwt_match_occ_t next;
+
+  for(m=0;m<n;m+=TMAP_BWT_MATCH_HASH_BATCH_SIZE) {
+      for(i=m,n_active=0;i<n && i<m+TMAP_BWT_MATCH_HASH_BATCH_SIZE;i++) {
+          num_ext[i] = 0;
+          if(0 < len[i]) active[n_active++] = i;
+      }
+      // extend all the intervals by one base at a time
+      while(0 < n_active) {
+          for(j=0;j<n_active;j++) {
+              __tmap_bwt_match_hash_prefetch(bwt, &match_sa[active[j]]);
+          }
+          for(i=j=0;j<n_active;j++) {
+              int32_t a = active[j];
+              tmap_bwt_match_hash_2occ(bwt, &match_sa[a], str[a][num_ext[a]], &next, hash);
+              if(next.l < next.k) continue; // keep the previous interval
+              match_sa[a] = next;
+              num_ext[a]++;
+              if(num_ext[a] < len[a]) active[i++] = a; // keep going
+          }
+          n_active = i;
+      }
+  }
+}
+
 tmap_bwt_int_t
 tmap_bwt_match_hash_invPsi(const tmap_bwt_t *bwt, uint32_t sa_intv, tmap_bwt_int_t k, uint32_t *s, tmap_bwt_match_hash_t *hash)
 {
@@ -8,37 +8,71 @@
   */
 
 /*!
-  Hash structure
+  the number of entries in a bucket of the occurrence cache, filling one cache line
+  */
+#define TMAP_BWT_MATCH_HASH_BUCKET_SIZE 8
+
+/*!
+  A fixed-size occurrence cache, shared by all the threads
+  @details  Each entry packs a BWT position, a base, and the occurrence of the
+  base up to the position into one 64-bit word, so the threads read and write
+  entries without locks, and a torn entry is never seen.  The entries are
+  grouped in buckets of one cache line each, and a new entry overwrites one in
+  its bucket when the bucket is full, so the memory used never grows.
+  */
+typedef struct {
+    uint64_t *entries; /*!< the entries, TMAP_BWT_MATCH_HASH_BUCKET_SIZE per bucket */
+    size_t num_bytes; /*!< the number of bytes allocated for the entries */
+    uint64_t bucket_mask; /*!< the number of buckets minus one */
+    uint32_t bucket_bits; /*!< log2 of the number of buckets */
+    uint32_t val_bits; /*!< the number of bits of each stored occurrence */
+    tmap_bwt_int_t seq_len; /*!< the largest position that is cached */
+} tmap_bwt_match_hash_cache_t;
+
+/*!
+  Hash structure, one per thread
   */
 typedef struct {
-   void *hash[4]; /*! the hash used by bwt match for each possible next base, the type is defined in the source */ 
+    tmap_bwt_match_hash_cache_t *cache; /*!< the shared occurrence cache */
+    uint64_t n_hits; /*!< the number of lookups found in the cache by this thread */
+    uint64_t n_misses; /*!< the number of lookups not found in the cache by this thread */
 } tmap_bwt_match_hash_t;
 
 /*!
-  @return  the initialized hash structure
+  @param  seq_len    the BWT length
+  @param  num_bytes  the memory to use
+  @return            the initialized cache
+  @details           the number of buckets is rounded down to a power of two,
+  and up to as many as are needed for each entry to fit in 64 bits
  */
-tmap_bwt_match_hash_t*
-tmap_bwt_match_hash_init();
+tmap_bwt_match_hash_cache_t*
+tmap_bwt_match_hash_cache_init(tmap_bwt_int_t seq_len, uint64_t num_bytes);
 
 /*!
-  @param  h  the hash to destroy
+  @param  cache  the cache to destroy
  */
 void
-tmap_bwt_match_hash_destroy(tmap_bwt_match_hash_t *h);
+tmap_bwt_match_hash_cache_destroy(tmap_bwt_match_hash_cache_t *cache);
 
 /*!
-  @param  h  the hash to clear
+  @param  cache  the shared cache to look up
+  @return        the initialized hash structure
+ */
+tmap_bwt_match_hash_t*
+tmap_bwt_match_hash_init(tmap_bwt_match_hash_cache_t *cache);
+
+/*!
+  @param  h  the hash to destroy, leaving its cache
  */
 void
-tmap_bwt_match_hash_clear(tmap_bwt_match_hash_t *h);
+tmap_bwt_match_hash_destroy(tmap_bwt_match_hash_t *h);
 
 /*!
   @param  h  the hash 
   @param  key  the hash key
   @param  c    the base in integer format
   @param  val  the hash value
-  @return  0 if the key is present in the hash table; 1 if the bucket is empty (never used); 2 if the element in the bucket has been deleted 
-  @details  this does not check if the value is overwritten
+  @return  0 if the key is present in the cache; 1 if it was added to an empty entry; 2 if it replaced another entry, or was not cached
  */
 int32_t
 tmap_bwt_match_hash_put(tmap_bwt_match_hash_t *h, tmap_bwt_int_t key, uint8_t c, tmap_bwt_int_t val);
@@ -48,7 +82,7 @@ tmap_bwt_match_hash_put(tmap_bwt_match_hash_t *h, tmap_bwt_int_t key, uint8_t c,
   @param  key  the hash key
   @param  c    the base in integer format
   @param  found  1 if the it was contained in the hash, 0 otherwise
-  @return the hash value, or UINT32_MAX if not found
+  @return the hash value, or TMAP_BWT_INT_MAX if not found
  */
 tmap_bwt_int_t
 tmap_bwt_match_hash_get(tmap_bwt_match_hash_t *h, tmap_bwt_int_t key, uint8_t c, uint32_t *found);
@@ -169,6 +203,46 @@ tmap_bwt_match_hash_exact_alt(const tmap_bwt_t *bwt, int len, const uint8_t *str
 tmap_bwt_int_t
 tmap_bwt_match_hash_exact_alt_reverse(const tmap_bwt_t *bwt, int len, const uint8_t *str, tmap_bwt_match_occ_t *match_sa, tmap_bwt_match_hash_t *hash);
 
+/*!
+  the maximum number of SA intervals advanced together by the batched searches
+  */
+#define TMAP_BWT_MATCH_HASH_BATCH_SIZE 16
+
+/*! 
+  computes the SA intervals for the given sequences, using forward search
+  @param  bwt       pointer to the bwt structure 
+  @param  n         the number of sequences
+  @param  len       the length of each sequence
+  @param  str       the DNA sequences in 2-bit format
+  @param  match_sa  the match structure to be returned for each sequence
+  @param  num       the size of the SA interval for each sequence, 0 if none found
+  @param  hash      a occurence array hash
+  @details          the results are the same as calling tmap_bwt_match_hash_exact on
+  each sequence, but the intervals are extended together, one base at a time,
+  prefetching the occurrence arrays each needs next, so that their cache misses
+  overlap rather than follow one another
+  */
+void
+tmap_bwt_match_hash_exact_batch(const tmap_bwt_t *bwt, int32_t n, const int32_t *len, const uint8_t **str, 
+                                tmap_bwt_match_occ_t *match_sa, tmap_bwt_int_t *num, tmap_bwt_match_hash_t *hash);
+
+/*! 
+  extends the given SA intervals by the given sequences, using forward search
+  @param  bwt       pointer to the bwt structure 
+  @param  n         the number of intervals
+  @param  len       the maximum number of bases to extend each interval
+  @param  str       the DNA sequences in 2-bit format with which to extend
+  @param  match_sa  the SA intervals to extend, returned as the last non-empty intervals
+  @param  num_ext   the number of bases each interval was extended
+  @param  hash      a occurence array hash
+  @details          each interval is extended until it would become empty or
+  all its bases are used; the intervals are extended together as in
+  tmap_bwt_match_hash_exact_batch
+  */
+void
+tmap_bwt_match_hash_extend_batch(const tmap_bwt_t *bwt, int32_t n, const int32_t *len, const uint8_t **str, 
+                                 tmap_bwt_match_occ_t *match_sa, int32_t *num_ext, tmap_bwt_match_hash_t *hash);
+
 /*!  
   inverse Psi function
   @param  bwt  pointer to the bwt structure
@@ -0,0 +1,255 @@
+/* Copyright (C) 2010 Ion Torrent Systems, Inc. All Rights Reserved */
+#include <config.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "../util/tmap_definitions.h"
+#include "../util/tmap_cpu.h"
+#include "tmap_bwt_rank.h"
+#ifdef TMAP_CPU_X86
+#include <immintrin.h>
+#endif
+
+/*
+ * The bases are 2-bit packed sixteen to a 32-bit word, the first base in the
+ * highest bits.  A base equal to c becomes 3 once xor-ed with
+ * tmap_bwt_rank_xor[c], so that (w & (w >> 1) & 0x55..55) has one bit per
+ * base equal to c.  For all four bases at once, the low (lo) and high (hi)
+ * bits of each base give C (lo & ~hi), G (hi & ~lo) and T (hi & lo), with A
+ * the remainder.
+ */
+
+static const uint32_t tmap_bwt_rank_xor[4] = {
+    0xffffffffu, 0xaaaaaaaau, 0x55555555u, 0x0u
+};
+
+static const char *tmap_bwt_rank_names[TMAP_BWT_RANK_NUM] = {
+    "scalar", "popcnt", "avx2", "avx512"
+};
+
+// the bases up to and including r in the word holding r, one bit per base
+#define __tmap_bwt_rank_last32(r) (~((1u<<((~(r)&15)<<1)) - 1) & 0x55555555u)
+#define __tmap_bwt_rank_last64(r) (~((1ull<<((~(r)&31)<<1)) - 1) & 0x5555555555555555ull)
+#define __tmap_bwt_rank_word64(p, i) ((uint64_t)(p)[(i)<<1]<<32 | (p)[((i)<<1)+1])
+
+// adds the counts of C, G, and T, with A the remainder of the r+1 bases
+#define __tmap_bwt_rank_add4(cnt, r, n1, n2, n3) do { \
+    (cnt)[0] += (r) + 1 - (n1) - (n2) - (n3); \
+    (cnt)[1] += (n1); (cnt)[2] += (n2); (cnt)[3] += (n3); \
+} while(0)
+
+#ifdef TMAP_CPU_X86
+
+/*
+ * SSE4.2: one population count instruction per 32 bases
+ */
+
+__attribute__((target("popcnt")))
+static uint32_t
+tmap_bwt_rank_popcnt_count(const uint32_t *p, uint32_t r, uint8_t c)
+{
+  uint64_t w, x = ((uint64_t)tmap_bwt_rank_xor[c] << 32) | tmap_bwt_rank_xor[c];
+  uint32_t i, j = r >> 5, n = 0;
+  for(i=0;i<j;i++) {
+      w = __tmap_bwt_rank_word64(p, i) ^ x;
+      n += __builtin_popcountll(w & (w >> 1) & 0x5555555555555555ull);
+  }
+  w = __tmap_bwt_rank_word64(p, j) ^ x;
+  n += __builtin_popcountll(w & (w >> 1) & __tmap_bwt_rank_last64(r));
+  return n;
+}
+
+__attribute__((target("popcnt")))
+static void
+tmap_bwt_rank_popcnt_count4(const uint32_t *p, uint32_t r, tmap_bwt_int_t cnt[4])
+{
+  uint64_t w, lo, hi, m;
+  uint32_t i, j = r >> 5, n1 = 0, n2 = 0, n3 = 0;
+  for(i=0;i<=j;i++) {
+      w = __tmap_bwt_rank_word64(p, i);
+      m = (i < j) ? 0x5555555555555555ull : __tmap_bwt_rank_last64(r);
+      lo = w & m;
+      hi = (w >> 1) & m;
+      n1 += __builtin_popcountll(lo & ~hi);
+      n2 += __builtin_popcountll(hi & ~lo);
+      n3 += __builtin_popcountll(hi & lo);
+  }
+  __tmap_bwt_rank_add4(cnt, r, n1, n2, n3);
+}
+
+/*
+ * AVX2: eight words (128 bases) per vector, counted with a nibble look-up
+ * table and summed per 64-bit lane
+ */
+
+__attribute__((target("avx2")))
+static inline __m256i
+tmap_bwt_rank_avx2_popcount(__m256i v)
+{
+  const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                       0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i nibble = _mm256_set1_epi8(0x0f);
+  __m256i lo = _mm256_and_si256(v, nibble);
+  __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble);
+  v = _mm256_add_epi8(_mm256_shuffle_epi8(lut, lo), _mm256_shuffle_epi8(lut, hi));
+  return _mm256_sad_epu8(v, _mm256_setzero_si256());
+}
+
+__attribute__((target("avx2")))
+static inline uint32_t
+tmap_bwt_rank_avx2_sum(__m256i v)
+{
+  __m128i s = _mm_add_epi64(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+  return (uint32_t)(_mm_cvtsi128_si64(s) + _mm_extract_epi64(s, 1));
+}
+
+// loads the words [s,s+8) up to the word holding r, and the per-base mask
+__attribute__((target("avx2")))
+static inline __m256i
+tmap_bwt_rank_avx2_load(const uint32_t *p, uint32_t r, uint32_t s, __m256i *mask)
+{
+  const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  __m256i idx = _mm256_add_epi32(lane, _mm256_set1_epi32(s));
+  __m256i j = _mm256_set1_epi32(r >> 4);
+  __m256i full = _mm256_cmpgt_epi32(j, idx);
+  __m256i last = _mm256_cmpeq_epi32(j, idx);
+  *mask = _mm256_or_si256(_mm256_and_si256(full, _mm256_set1_epi32(0x55555555)),
+                          _mm256_and_si256(last, _mm256_set1_epi32(__tmap_bwt_rank_last32(r))));
+  // NB: the words after r are not read
+  return _mm256_maskload_epi32((const int *)(p + s), _mm256_or_si256(full, last));
+}
+
+__attribute__((target("avx2")))
+static uint32_t
+tmap_bwt_rank_avx2_count(const uint32_t *p, uint32_t r, uint8_t c)
+{
+  __m256i v, mask, n = _mm256_setzero_si256();
+  __m256i x = _mm256_set1_epi32(tmap_bwt_rank_xor[c]);
+  uint32_t s;
+  for(s=0;s<=(r>>4);s+=8) {
+      v = _mm256_xor_si256(tmap_bwt_rank_avx2_load(p, r, s, &mask), x);
+      v = _mm256_and_si256(_mm256_and_si256(v, _mm256_srli_epi32(v, 1)), mask);
+      n = _mm256_add_epi64(n, tmap_bwt_rank_avx2_popcount(v));
+  }
+  return tmap_bwt_rank_avx2_sum(n);
+}
+
+__attribute__((target("avx2")))
+static void
+tmap_bwt_rank_avx2_count4(const uint32_t *p, uint32_t r, tmap_bwt_int_t cnt[4])
+{
+  __m256i v, mask, lo, hi;
+  __m256i n1 = _mm256_setzero_si256(), n2 = _mm256_setzero_si256(), n3 = _mm256_setzero_si256();
+  uint32_t s;
+  for(s=0;s<=(r>>4);s+=8) {
+      v = tmap_bwt_rank_avx2_load(p, r, s, &mask);
+      lo = _mm256_and_si256(v, mask);
+      hi = _mm256_and_si256(_mm256_srli_epi32(v, 1), mask);
+      n1 = _mm256_add_epi64(n1, tmap_bwt_rank_avx2_popcount(_mm256_andnot_si256(hi, lo)));
+      n2 = _mm256_add_epi64(n2, tmap_bwt_rank_avx2_popcount(_mm256_andnot_si256(lo, hi)));
+      n3 = _mm256_add_epi64(n3, tmap_bwt_rank_avx2_popcount(_mm256_and_si256(hi, lo)));
+  }
+  __tmap_bwt_rank_add4(cnt, r, tmap_bwt_rank_avx2_sum(n1), tmap_bwt_rank_avx2_sum(n2), tmap_bwt_rank_avx2_sum(n3));
+}
+
+/*
+ * AVX-512: sixteen words (256 bases) per vector, counted with VPOPCNTDQ
+ */
+
+#define TMAP_BWT_RANK_AVX512_TARGET "avx512f,avx512bw,avx512vl,avx512vpopcntdq"
+
+// loads the words [s,s+16) up to the word holding r, and the per-base mask
+__attribute__((target(TMAP_BWT_RANK_AVX512_TARGET)))
+static inline __m512i
+tmap_bwt_rank_avx512_load(const uint32_t *p, uint32_t r, uint32_t s, __m512i *mask)
+{
+  uint32_t j = (r >> 4) - s; // the lane holding r, if less than 16
+  __mmask16 full = (16 <= j) ? 0xffff : (__mmask16)((1u << j) - 1);
+  __mmask16 last = (16 <= j) ? 0 : (__mmask16)(1u << j);
+  *mask = _mm512_mask_mov_epi32(_mm512_maskz_mov_epi32(full, _mm512_set1_epi32(0x55555555)),
+                                last, _mm512_set1_epi32(__tmap_bwt_rank_last32(r)));
+  // NB: the words after r are not read
+  return _mm512_maskz_loadu_epi32(full | last, p + s);
+}
+
+__attribute__((target(TMAP_BWT_RANK_AVX512_TARGET)))
+static uint32_t
+tmap_bwt_rank_avx512_count(const uint32_t *p, uint32_t r, uint8_t c)
+{
+  __m512i v, mask, n = _mm512_setzero_si512();
+  __m512i x = _mm512_set1_epi32(tmap_bwt_rank_xor[c]);
+  uint32_t s;
+  for(s=0;s<=(r>>4);s+=16) {
+      v = _mm512_xor_si512(tmap_bwt_rank_avx512_load(p, r, s, &mask), x);
+      v = _mm512_and_si512(_mm512_and_si512(v, _mm512_srli_epi32(v, 1)), mask);
+      n = _mm512_add_epi64(n, _mm512_popcnt_epi64(v));
+  }
+  return (uint32_t)_mm512_reduce_add_epi64(n);
+}
+
+__attribute__((target(TMAP_BWT_RANK_AVX512_TARGET)))
+static void
+tmap_bwt_rank_avx512_count4(const uint32_t *p, uint32_t r, tmap_bwt_int_t cnt[4])
+{
+  __m512i v, mask, lo, hi;
+  __m512i n1 = _mm512_setzero_si512(), n2 = _mm512_setzero_si512(), n3 = _mm512_setzero_si512();
+  uint32_t s;
+  for(s=0;s<=(r>>4);s+=16) {
+      v = tmap_bwt_rank_avx512_load(p, r, s, &mask);
+      lo = _mm512_and_si512(v, mask);
+      hi = _mm512_and_si512(_mm512_srli_epi32(v, 1), mask);
+      n1 = _mm512_add_epi64(n1, _mm512_popcnt_epi64(_mm512_andnot_si512(hi, lo)));
+      n2 = _mm512_add_epi64(n2, _mm512_popcnt_epi64(_mm512_andnot_si512(lo, hi)));
+      n3 = _mm512_add_epi64(n3, _mm512_popcnt_epi64(_mm512_and_si512(hi, lo)));
+  }
+  __tmap_bwt_rank_add4(cnt, r, (uint32_t)_mm512_reduce_add_epi64(n1),
+                       (uint32_t)_mm512_reduce_add_epi64(n2), (uint32_t)_mm512_reduce_add_epi64(n3));
+}
+
+static const tmap_bwt_rank_t tmap_bwt_rank_kernels[TMAP_BWT_RANK_NUM] = {
+    {TMAP_BWT_RANK_SCALAR, "scalar", NULL, NULL},
+    {TMAP_BWT_RANK_POPCNT, "popcnt", tmap_bwt_rank_popcnt_count, tmap_bwt_rank_popcnt_count4},
+    {TMAP_BWT_RANK_AVX2, "avx2", tmap_bwt_rank_avx2_count, tmap_bwt_rank_avx2_count4},
+    {TMAP_BWT_RANK_AVX512, "avx512", tmap_bwt_rank_avx512_count, tmap_bwt_rank_avx512_count4}
+};
+
+#endif
+
+const tmap_bwt_rank_t *
+tmap_bwt_rank_get(int32_t type)
+{
+#ifdef TMAP_CPU_X86
+  uint32_t features = tmap_cpu_features();
+  switch(type) {
+    case TMAP_BWT_RANK_POPCNT:
+      if(features & TMAP_CPU_POPCNT) return &tmap_bwt_rank_kernels[type];
+      break;
+    case TMAP_BWT_RANK_AVX2:
+      if(features & TMAP_CPU_AVX2) return &tmap_bwt_rank_kernels[type];
+      break;
+    case TMAP_BWT_RANK_AVX512:
+      if(features & TMAP_CPU_AVX512) return &tmap_bwt_rank_kernels[type];
+      break;
+    default:
+      break;
+  }
+#endif
+  return NULL;
+}
+
+const tmap_bwt_rank_t *
+tmap_bwt_rank_best()
+{
+  int32_t type;
+  const tmap_bwt_rank_t *rank = NULL;
+  for(type=TMAP_BWT_RANK_NUM-1;TMAP_BWT_RANK_SCALAR<type;type--) {
+      if(NULL != (rank = tmap_bwt_rank_get(type))) break;
+  }
+  return rank;
+}
+
+const char *
+tmap_bwt_rank_name(int32_t type)
+{
+  if(type < 0 || TMAP_BWT_RANK_NUM <= type) return NULL;
+  return tmap_bwt_rank_names[type];
+}
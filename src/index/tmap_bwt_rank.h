@@ -0,0 +1,59 @@
+/* Copyright (C) 2010 Ion Torrent Systems, Inc. All Rights Reserved */
+#ifndef TMAP_BWT_RANK_H
+#define TMAP_BWT_RANK_H
+
+#include <stdint.h>
+#include "../util/tmap_definitions.h"
+
+/*!
+  Vector Kernels for the BWT Occurrence (Rank) Queries
+  @details  Each kernel counts the bases in the 2-bit packed BWT words that
+  follow an occurrence array entry, up to and including the queried
+  position, counting all four bases at once where asked.  The kernels are
+  compiled for each instruction set and chosen at run time, and give the same
+  results as the scalar code in tmap_bwt.c, which is used when no kernel is
+  chosen.
+  */
+
+/*!
+  @details  the rank kernels
+  */
+enum {
+    TMAP_BWT_RANK_SCALAR = 0, /*!< the built-in scalar code */
+    TMAP_BWT_RANK_POPCNT = 1, /*!< the SSE4.2 population count instruction */
+    TMAP_BWT_RANK_AVX2   = 2, /*!< AVX2, 128 bases per vector */
+    TMAP_BWT_RANK_AVX512 = 3, /*!< AVX-512 with VPOPCNTDQ, 256 bases per vector */
+    TMAP_BWT_RANK_NUM    = 4 /*!< the number of rank kernels */
+};
+
+/*!
+  a rank kernel
+  */
+typedef struct {
+    int32_t type;  /*!< the kernel type (TMAP_BWT_RANK_*) */
+    const char *name;  /*!< the kernel name */
+    uint32_t (*count)(const uint32_t *p, uint32_t r, uint8_t c);  /*!< returns the number of c in bases [0,r] of p */
+    void (*count4)(const uint32_t *p, uint32_t r, tmap_bwt_int_t cnt[4]);  /*!< adds the number of each base in bases [0,r] of p to cnt */
+} tmap_bwt_rank_t;
+
+/*!
+  @param  type  the kernel type (TMAP_BWT_RANK_*)
+  @return       the kernel, or NULL for the scalar code or if this host or compiler does not support it
+  */
+const tmap_bwt_rank_t *
+tmap_bwt_rank_get(int32_t type);
+
+/*!
+  @return  the fastest kernel this host supports, or NULL for the scalar code
+  */
+const tmap_bwt_rank_t *
+tmap_bwt_rank_best();
+
+/*!
+  @param  type  the kernel type (TMAP_BWT_RANK_*)
+  @return       the kernel name
+  */
+const char *
+tmap_bwt_rank_name(int32_t type);
+
+#endif
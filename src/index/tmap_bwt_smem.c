@@ -42,6 +42,7 @@
 #include "tmap_bwt_aux.h"
 #include "tmap_bwt_check.h"
 #include "tmap_bwt_match.h"
+#include "tmap_bwt_match_hash.h"
 #include "tmap_bwt_smem.h"
 
 // TODO: the primary and secondary hash (etc.)
@@ -69,6 +70,20 @@ tmap_bwt_smem_extend(const tmap_bwt_t *bwt, const tmap_bwt_smem_intv_t *ik, tmap
   ok[0].x[is_back] = ok[1].x[is_back] + ok[1].size;
 }
 
+// extends the given intervals together, prefetching the occurrences each needs first
+static void
+tmap_bwt_smem_extend_batch(const tmap_bwt_t *bwt, int32_t n, const tmap_bwt_smem_intv_t *ik, tmap_bwt_smem_intv_t ok[][4], int32_t is_back)
+{
+  int32_t i;
+  for(i=0;i<n;i++) {
+      tmap_bwt_prefetch_occ(bwt, ik[i].x[!is_back] - 1);
+      tmap_bwt_prefetch_occ(bwt, ik[i].x[!is_back] - 1 + ik[i].size);
+  }
+  for(i=0;i<n;i++) {
+      tmap_bwt_smem_extend(bwt, &ik[i], ok[i], is_back);
+  }
+}
+
 static void 
 tmap_bwt_smem_reverse_intvs(tmap_bwt_smem_intv_vec_t *p)
 {
@@ -88,6 +103,7 @@ tmap_bwt_smem1(const tmap_bwt_t *bwt, int32_t len, const uint8_t *q, int32_t x,
 {
   int32_t i, j, c, ret;
   tmap_bwt_smem_intv_t ik, ok[4];
+  tmap_bwt_smem_intv_t ok_batch[TMAP_BWT_MATCH_HASH_BATCH_SIZE][4], *okp;
   tmap_bwt_smem_intv_vec_t a[2], *prev, *curr, *swap;
 
   mem->n = 0;
@@ -133,8 +149,13 @@ tmap_bwt_smem1(const tmap_bwt_t *bwt, int32_t len, const uint8_t *q, int32_t x,
       if (c > 3) break;
       for (j = 0, curr->n = 0; j < prev->n; ++j) {
           tmap_bwt_smem_intv_t *p = &prev->a[j];
-          tmap_bwt_smem_extend(bwt, p, ok, 1);
-          if (ok[c].size <= 0 || i == -1) { // keep the hit if reaching the beginning or not extended further
+          if (0 == (j % TMAP_BWT_MATCH_HASH_BATCH_SIZE)) { // extend the next batch of intervals together
+              tmap_bwt_smem_extend_batch(bwt, 
+                                         (j + TMAP_BWT_MATCH_HASH_BATCH_SIZE < prev->n) ? TMAP_BWT_MATCH_HASH_BATCH_SIZE : (prev->n - j), 
+                                         p, ok_batch, 1);
+          }
+          okp = ok_batch[j % TMAP_BWT_MATCH_HASH_BATCH_SIZE];
+          if (okp[c].size <= 0 || i == -1) { // keep the hit if reaching the beginning or not extended further
               if (curr->n == 0) { // curr->n to make sure there is no longer matches
                   if (mem->n == 0 || i + 1 < mem->a[mem->n-1].info>>32) { // skip contained matches
                       ik = *p; ik.info |= (uint64_t)(i + 1)<<32;
@@ -142,9 +163,9 @@ tmap_bwt_smem1(const tmap_bwt_t *bwt, int32_t len, const uint8_t *q, int32_t x,
                   }
               } // otherwise the match is contained in another longer match
           }
-          if (0 < ok[c].size && (curr->n == 0 || ok[c].size != curr->a[curr->n-1].size)) {
-              ok[c].info = p->info;
-              tmap_vec_push(tmap_bwt_smem_intv_t, *curr, ok[c]);
+          if (0 < okp[c].size && (curr->n == 0 || okp[c].size != curr->a[curr->n-1].size)) {
+              okp[c].info = p->info;
+              tmap_vec_push(tmap_bwt_smem_intv_t, *curr, okp[c]);
           }
       }
       if (curr->n == 0) break;
@@ -1,11 +1,17 @@
 /* Copyright (C) 2010 Ion Torrent Systems, Inc. All Rights Reserved */
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 #include <unistd.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include "../util/tmap_error.h"
 #include "../util/tmap_alloc.h"
 #include "../util/tmap_progress.h"
 #include "../util/tmap_definitions.h"
+#include "../util/tmap_placement.h"
 #include "../server/tmap_shm.h"
 #include "tmap_refseq.h"
 #include "tmap_bwt_gen.h"
@@ -13,10 +19,109 @@
 #include "tmap_sa.h"
 #include "tmap_index.h"
 
+// returns 1 if the memory-mapped index was used, 0 otherwise
+static int32_t
+tmap_index_mmap_init(tmap_index_t *index, const char *fn_fasta)
+{
+  int32_t i, fd;
+  char *fn_mmap = NULL, *fn = NULL;
+  struct stat st_mmap, st;
+  tmap_index_mmap_header_t header;
+  uint8_t *buf = NULL;
+
+  fn_mmap = tmap_get_file_name(fn_fasta, TMAP_MMAP_FILE);
+  if(0 != stat(fn_mmap, &st_mmap)) { // does not exist
+      free(fn_mmap);
+      return 0;
+  }
+
+  // ignore the memory-mapped index if the index was rebuilt since
+  for(i=TMAP_ANNO_FILE;i<=TMAP_DSA_FILE;i++) {
+      if(TMAP_MMAP_FILE == i) continue;
+      fn = tmap_get_file_name(fn_fasta, i);
+      if(0 == stat(fn, &st) && st_mmap.st_mtime < st.st_mtime) {
+          tmap_error("the memory-mapped index is older than the index files; ignoring it", Warn, OutOfRange);
+          free(fn);
+          free(fn_mmap);
+          return 0;
+      }
+      free(fn);
+  }
+
+  // map the file
+  tmap_progress_print("mapping in reference data");
+  if((fd = open(fn_mmap, O_RDONLY)) < 0) {
+      tmap_error(fn_mmap, Exit, OpenFileError);
+  }
+  buf = mmap(NULL, st_mmap.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if(MAP_FAILED == buf) {
+      tmap_error(fn_mmap, Exit, ReadFileError);
+  }
+  close(fd); // NB: the mapping remains valid
+
+  // check the header
+  if(st_mmap.st_size < TMAP_PACKED_ALIGNMENT) {
+      tmap_error("the memory-mapped index is truncated", Exit, ReadFileError);
+  }
+  memcpy(&header, buf, sizeof(tmap_index_mmap_header_t));
+  if(TMAP_INDEX_MMAP_VERSION_ID != header.version_id && TMAP_VERSION_ID != header.version_id) { // the latter with unpacked SA entries
+      tmap_error("version id did not match, or the memory-mapped index was not fully written", Exit, ReadFileError);
+  }
+  if(st_mmap.st_size != TMAP_PACKED_ALIGNMENT + header.refseq_bytes + header.bwt_bytes + header.sa_bytes) {
+      tmap_error("the memory-mapped index is truncated", Exit, ReadFileError);
+  }
+
+  // NB: the arrays point into the mapped file, which is shared through the page cache
+  index->mmap_buf = buf;
+  index->mmap_size = st_mmap.st_size;
+  buf += TMAP_PACKED_ALIGNMENT;
+  index->refseq = tmap_refseq_shm_unpack(buf);
+  buf += header.refseq_bytes;
+  index->bwt = tmap_bwt_shm_unpack(buf);
+  buf += header.bwt_bytes;
+  index->sa = tmap_sa_shm_unpack(buf);
+  tmap_progress_print2("reference data mapped in");
+
+  free(fn_mmap);
+
+  return 1;
+}
+
+// places a copy of the BWT string and SA on each NUMA node
+static void
+tmap_index_replicate(tmap_index_t *index, int32_t huge_pages, int32_t is_placed)
+{
+  int32_t i;
+  tmap_index_t *node_index = NULL;
+
+  index->num_nodes = tmap_placement_num_nodes();
+  if(index->num_nodes <= 1) {
+      tmap_progress_print("only one NUMA node found; not replicating the reference data");
+      index->num_nodes = 0;
+      return;
+  }
+
+  tmap_progress_print("replicating reference data on %d NUMA nodes", index->num_nodes);
+  index->node_index = tmap_calloc(index->num_nodes, sizeof(tmap_index_t*), "index->node_index");
+  for(i=0;i<index->num_nodes;i++) {
+      if(0 == i && 1 == is_placed) { // already placed on the first node
+          index->node_index[i] = index;
+          continue;
+      }
+      node_index = tmap_calloc(1, sizeof(tmap_index_t), "node_index");
+      node_index->refseq = index->refseq;
+      node_index->bwt = tmap_bwt_replicate(index->bwt, huge_pages, i);
+      node_index->sa = tmap_sa_replicate(index->sa, huge_pages, i);
+      index->node_index[i] = node_index;
+  }
+  tmap_progress_print2("reference data replicated");
+}
+
 tmap_index_t*
-tmap_index_init(const char *fn_fasta, key_t shm_key)
+tmap_index_init(const char *fn_fasta, key_t shm_key, int32_t huge_pages, int32_t numa)
 {
   tmap_index_t *index = NULL;
+  int32_t is_placed = 0;
 
   index = tmap_calloc(1, sizeof(tmap_index_t), "index");
 
@@ -24,15 +129,23 @@ tmap_index_init(const char *fn_fasta, key_t shm_key)
 
   // get the reference information
   if(0 == index->shm_key) {
-      tmap_progress_print("reading in reference data");
-      index->refseq = tmap_refseq_read(fn_fasta);
-      index->bwt = tmap_bwt_read(fn_fasta);
-      index->sa = tmap_sa_read(fn_fasta);
-      tmap_progress_print2("reference data read in");
+      // NB: the pages of the memory-mapped file belong to the page cache
+      if((TMAP_PLACEMENT_HUGE_PAGES_NONE != huge_pages || TMAP_PLACEMENT_NUMA_INTERLEAVE == numa)
+         || 0 == tmap_index_mmap_init(index, fn_fasta)) {
+          tmap_progress_print("reading in reference data");
+          index->refseq = tmap_refseq_read(fn_fasta);
+          index->bwt = tmap_bwt_read_placed(fn_fasta, huge_pages, numa);
+          index->sa = tmap_sa_read_placed(fn_fasta, huge_pages, numa);
+          is_placed = 1;
+          tmap_progress_print2("reference data read in");
+      }
   }
   else {
+      if(TMAP_PLACEMENT_HUGE_PAGES_NONE != huge_pages || TMAP_PLACEMENT_NUMA_INTERLEAVE == numa) {
+          tmap_error("huge pages and interleaving of shared memory are chosen when starting the server", Warn, CommandLineArgument);
+      }
       tmap_progress_print("retrieving reference data from shared memory");
-      index->shm = tmap_shm_init(index->shm_key, 0, 0);
+      index->shm = tmap_shm_init(index->shm_key, 0, 0, TMAP_PLACEMENT_HUGE_PAGES_NONE, TMAP_PLACEMENT_NUMA_NONE);
       if(NULL == (index->refseq = tmap_refseq_shm_unpack(tmap_shm_get_buffer(index->shm, TMAP_SHM_LISTING_REFSEQ)))) {
           tmap_error("the packed reference sequence was not found in shared memory", Exit, SharedMemoryListing);
       }
@@ -51,22 +164,153 @@ tmap_index_init(const char *fn_fasta, key_t shm_key)
   if((index->refseq->len << 1) != index->sa->seq_len) {
       tmap_error("refseq and sa lengths do not match", Exit, OutOfRange);
   }
+
+  if(TMAP_PLACEMENT_NUMA_REPLICATE == numa) {
+      tmap_index_replicate(index, huge_pages, is_placed);
+  }
   
   return index;
 }
 
+tmap_index_t*
+tmap_index_get_thread_index(tmap_index_t *index, int32_t tid)
+{
+  if(0 == index->num_nodes) return index;
+  return index->node_index[tid % index->num_nodes];
+}
+
+void
+tmap_index_pin_thread(tmap_index_t *index, int32_t tid)
+{
+  if(0 == index->num_nodes) return;
+  if(0 == tmap_placement_pin_thread(tid % index->num_nodes)) {
+      tmap_error("could not pin the thread to its NUMA node", Warn, ThreadError);
+  }
+}
+
 void
 tmap_index_destroy(tmap_index_t *index)
 {
+  int32_t i;
+  // NB: the replicas share the hash tables and reference sequence
+  for(i=0;i<index->num_nodes;i++) {
+      if(index->node_index[i] == index) continue;
+      tmap_bwt_destroy(index->node_index[i]->bwt);
+      tmap_sa_destroy(index->node_index[i]->sa);
+      free(index->node_index[i]);
+  }
+  free(index->node_index);
   tmap_refseq_destroy(index->refseq);
   tmap_bwt_destroy(index->bwt);
   tmap_sa_destroy(index->sa);
   if(0 < index->shm_key) {
       tmap_shm_destroy(index->shm, 0);
   }
+  if(NULL != index->mmap_buf) {
+      munmap(index->mmap_buf, index->mmap_size);
+  }
   free(index);
 }
 
+void
+tmap_index_mmap_write(const char *fn_fasta)
+{
+  int32_t fd;
+  char *fn_mmap = NULL, *fn_tmp = NULL;
+  size_t n_bytes = 0;
+  uint8_t *buf = NULL, *cur = NULL;
+  tmap_index_mmap_header_t header;
+  tmap_refseq_t *refseq = NULL;
+  tmap_bwt_t *bwt = NULL;
+  tmap_sa_t *sa = NULL;
+
+  // get data size
+  header.version_id = 0; // not yet written
+  header.refseq_bytes = tmap_refseq_shm_read_num_bytes(fn_fasta);
+  header.bwt_bytes = tmap_bwt_shm_read_num_bytes(fn_fasta);
+  header.sa_bytes = tmap_sa_shm_read_num_bytes(fn_fasta);
+  n_bytes = TMAP_PACKED_ALIGNMENT + header.refseq_bytes + header.bwt_bytes + header.sa_bytes;
+
+  // create the file beside the old one, which mappers may still have mapped, and
+  // move it into place once written so that they keep the old one
+  fn_mmap = tmap_get_file_name(fn_fasta, TMAP_MMAP_FILE);
+  fn_tmp = tmap_malloc(sizeof(char) * (strlen(fn_mmap) + 32), "fn_tmp");
+  sprintf(fn_tmp, "%s.tmp.%d", fn_mmap, (int)getpid());
+  tmap_progress_print("writing the memory-mapped index [%llu bytes]", (long long unsigned int)n_bytes);
+  if((fd = open(fn_tmp, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0) {
+      tmap_error(fn_tmp, Exit, OpenFileError);
+  }
+  if(0 != ftruncate(fd, n_bytes)) {
+      tmap_error(fn_tmp, Exit, WriteFileError);
+  }
+  buf = mmap(NULL, n_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(MAP_FAILED == buf) {
+      tmap_error(fn_tmp, Exit, WriteFileError);
+  }
+  cur = buf + TMAP_PACKED_ALIGNMENT;
+
+  // pack the reference sequence
+  tmap_progress_print("packing the reference");
+  refseq = tmap_refseq_read(fn_fasta);
+  if(cur + header.refseq_bytes != tmap_refseq_shm_pack(refseq, cur)) tmap_bug();
+  cur += header.refseq_bytes;
+  tmap_refseq_destroy(refseq);
+
+  // pack the bwt 
+  tmap_progress_print("packing the bwt");
+  bwt = tmap_bwt_read(fn_fasta);
+  if(cur + header.bwt_bytes != tmap_bwt_shm_pack(bwt, cur)) tmap_bug();
+  cur += header.bwt_bytes;
+  tmap_bwt_destroy(bwt);
+
+  // pack the SA
+  tmap_progress_print("packing the sa");
+  sa = tmap_sa_read(fn_fasta);
+  if(cur + header.sa_bytes != tmap_sa_shm_pack(sa, cur)) tmap_bug();
+  cur += header.sa_bytes;
+  tmap_sa_destroy(sa);
+
+  // write the header only once the data is on disk
+  if(0 != msync(buf, n_bytes, MS_SYNC)) {
+      tmap_error(fn_tmp, Exit, WriteFileError);
+  }
+  header.version_id = TMAP_INDEX_MMAP_VERSION_ID;
+  memcpy(buf, &header, sizeof(tmap_index_mmap_header_t));
+  if(0 != msync(buf, TMAP_PACKED_ALIGNMENT, MS_SYNC) || 0 != munmap(buf, n_bytes)
+     || 0 != fsync(fd) || 0 != close(fd)) {
+      tmap_error(fn_tmp, Exit, WriteFileError);
+  }
+  if(0 != rename(fn_tmp, fn_mmap)) {
+      tmap_error(fn_mmap, Exit, WriteFileError);
+  }
+  tmap_progress_print2("memory-mapped index written");
+
+  free(fn_tmp);
+  free(fn_mmap);
+}
+
+int
+tmap_index_mmap_main(int argc, char *argv[])
+{
+  int c, help=0;
+
+  while((c = getopt(argc, argv, "vh")) >= 0) {
+      switch(c) {
+        case 'v': tmap_progress_set_verbosity(1); break;
+        case 'h': help = 1; break;
+        default: return 1;
+      }
+  }
+  if(1 != argc - optind || 1 == help) {
+      tmap_file_fprintf(tmap_file_stderr, "Usage: %s %s [-vh] <in.fasta>\n", PACKAGE, argv[0]);
+      return 1;
+  }
+
+  tmap_index_mmap_write(argv[optind]);
+
+  return 0;
+}
+
 static void 
 tmap_index_core(tmap_index_opt_t *opt)
 {
@@ -92,10 +336,11 @@ tmap_index_core(tmap_index_opt_t *opt)
   }
 
   // create the bwt 
-  tmap_bwt_pac2bwt(opt->fn_fasta, opt->is_large, opt->occ_interval, opt->hash_width, opt->check_hash);
+  tmap_bwt_pac2bwt(opt->fn_fasta, opt->is_large, opt->occ_interval, opt->occ_layout, opt->hash_width, opt->check_hash,
+                   opt->num_threads, (uint64_t)opt->max_memory << 20);
 
   // create the suffix array
-  tmap_sa_bwt2sa(opt->fn_fasta, opt->sa_interval);
+  tmap_sa_bwt2sa(opt->fn_fasta, opt->sa_interval, opt->num_threads, (uint64_t)opt->max_memory << 20, opt->dense_occ);
 
   // pack the reference sequence
   ref_len = tmap_refseq_fasta2pac(opt->fn_fasta, TMAP_FILE_NO_COMPRESSION, 1);
@@ -112,12 +357,20 @@ usage(tmap_index_opt_t *opt)
   tmap_file_fprintf(tmap_file_stderr, "Options (optional):\n");
   tmap_file_fprintf(tmap_file_stderr, "         -o INT      the occurrence interval (use %d, %d, %d, ...) [%d]\n", 
                     TMAP_BWT_OCC_MOD, TMAP_BWT_OCC_MOD*2, TMAP_BWT_OCC_MOD*3, opt->occ_interval);
+  tmap_file_fprintf(tmap_file_stderr, "         -L          store the occurrence array in %d-byte cache lines (requires -o %d)\n",
+                    TMAP_BWT_LINE_BYTES, TMAP_BWT_LINE_OCC_INTERVAL);
   tmap_file_fprintf(tmap_file_stderr, "         -w INT      the k-mer occurrence hash width [%d]\n", opt->hash_width);
   tmap_file_fprintf(tmap_file_stderr, "         -i INT      the suffix array interval (use 1, 2, 4, ...) [%d]\n", opt->sa_interval);
+  tmap_file_fprintf(tmap_file_stderr, "         -d INT      store every suffix array entry of the hash-width k-mers that\n");
+  tmap_file_fprintf(tmap_file_stderr, "                     occur at least INT times, 0 for none [%d]\n", opt->dense_occ);
   tmap_file_fprintf(tmap_file_stderr, "         -a STRING   override BWT construction algorithm:\n");
   tmap_file_fprintf(tmap_file_stderr, "                     \t\"bwtsw\" (large genomes)\n");
   tmap_file_fprintf(tmap_file_stderr, "                     \t\"is\" (short genomes)\n");
   tmap_file_fprintf(tmap_file_stderr, "         -H          do not validate the BWT hash [%d]\n", opt->check_hash);
+  tmap_file_fprintf(tmap_file_stderr, "         -n INT      the number of threads for the SA and hash (\"bwtsw\" is mostly serial) [%d]\n", opt->num_threads);
+  tmap_file_fprintf(tmap_file_stderr, "         -M,--max-memory INT\n");
+  tmap_file_fprintf(tmap_file_stderr, "                     the memory in megabytes to construct the BWT (\"bwtsw\") and SA, using\n");
+  tmap_file_fprintf(tmap_file_stderr, "                     temporary files for the SA if it does not fit, 0 for no limit [%d]\n", opt->max_memory);
   tmap_file_fprintf(tmap_file_stderr, "         --version   print the index format that will be created and exit\n");
   tmap_file_fprintf(tmap_file_stderr, "         -v          print verbose progress information\n");
   tmap_file_fprintf(tmap_file_stderr, "         -h          print this message\n");
@@ -130,13 +383,21 @@ tmap_index(int argc, char *argv[])
 {
   int c;
   tmap_index_opt_t opt;
+  struct option options[] = {
+      {"max-memory", required_argument, 0, 'M'},
+      {0, 0, 0, 0}
+  };
 
   opt.fn_fasta = NULL;
   opt.occ_interval = TMAP_BWT_OCC_INTERVAL; 
+  opt.occ_layout = TMAP_BWT_OCC_LAYOUT_INTERLEAVED;
   opt.hash_width = INT32_MAX;
   opt.sa_interval = TMAP_SA_INTERVAL; 
   opt.is_large = -1;
   opt.check_hash = 1;
+  opt.num_threads = 1;
+  opt.max_memory = 0;
+  opt.dense_occ = 0;
       
   if(2 == argc && 0 == strcmp("--version", argv[1])) {
       tmap_file_stdout = tmap_file_fdopen(fileno(stdout), "wb", TMAP_FILE_NO_COMPRESSION);
@@ -145,16 +406,20 @@ tmap_index(int argc, char *argv[])
       return 0;
   }
 
-  while((c = getopt(argc, argv, "f:o:i:w:a:hvH")) >= 0) {
+  while((c = getopt_long(argc, argv, "f:o:Li:w:d:a:n:M:hvH", options, NULL)) >= 0) {
       switch(c) {
         case 'f':
           opt.fn_fasta = tmap_strdup(optarg); break;
         case 'o':
           opt.occ_interval = atoi(optarg); break;
+        case 'L':
+          opt.occ_layout = TMAP_BWT_OCC_LAYOUT_LINE; break;
         case 'i':
           opt.sa_interval = atoi(optarg); break;
         case 'w':
           opt.hash_width = atoi(optarg); break;
+        case 'd':
+          opt.dense_occ = atoi(optarg); break;
         case 'a':
           if(0 == strcmp("is", optarg)) opt.is_large = 0;
           else if(0 == strcmp("bwtsw", optarg)) opt.is_large = 1;
@@ -166,6 +431,10 @@ tmap_index(int argc, char *argv[])
           return usage(&opt);
         case 'H':
           opt.check_hash = 0; break;
+        case 'n':
+          opt.num_threads = atoi(optarg); break;
+        case 'M':
+          opt.max_memory = atoi(optarg); break;
         default:
           return usage(&opt);
       }
@@ -180,12 +449,24 @@ tmap_index(int argc, char *argv[])
   if(opt.occ_interval < TMAP_BWT_OCC_MOD || 0 != (opt.occ_interval % 2) || 0 != (opt.occ_interval % TMAP_BWT_OCC_MOD)) {
       tmap_error("option -o out of range", Exit, CommandLineArgument);
   }
+  if(TMAP_BWT_OCC_LAYOUT_LINE == opt.occ_layout && TMAP_BWT_LINE_OCC_INTERVAL != opt.occ_interval) {
+      tmap_error("option -o must be 128 with option -L", Exit, CommandLineArgument);
+  }
   if(opt.hash_width < 0) {
       tmap_error("option -w out of range", Exit, CommandLineArgument);
   }
   if(opt.sa_interval <= 0 || (1 < opt.sa_interval && 0 != (opt.sa_interval % 2))) {
       tmap_error("option -i out of range", Exit, CommandLineArgument);
   }
+  if(opt.dense_occ < 0) {
+      tmap_error("option -d out of range", Exit, CommandLineArgument);
+  }
+  if(opt.num_threads <= 0) {
+      tmap_error("option -n out of range", Exit, CommandLineArgument);
+  }
+  if(opt.max_memory < 0) {
+      tmap_error("option -M out of range", Exit, CommandLineArgument);
+  }
 
   tmap_index_core(&opt);
 
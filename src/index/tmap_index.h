@@ -20,22 +20,70 @@
 /*!
   The reference sequence data structure.
  */
-typedef struct {
+typedef struct __tmap_index_t {
     tmap_refseq_t *refseq; /*!< the packed reference sequence */
     tmap_bwt_t *bwt; /*!< the forward and reverse FM-indexes */
     tmap_sa_t *sa; /*!< the forward and reverse suffix arrays */
     tmap_shm_t *shm; /*!< the shared memory location if loaded from shared memory */
     key_t shm_key; /*!< the shared memory key, zero if not loaded from shared memory */
+    uint8_t *mmap_buf; /*!< the memory-mapped index file, or NULL if not memory-mapped */
+    size_t mmap_size; /*!< the number of bytes memory-mapped */
+    int32_t num_nodes; /*!< the number of NUMA nodes with a replica of the BWT and SA, zero if not replicated */
+    struct __tmap_index_t **node_index; /*!< the index to use on each NUMA node, sharing the reference sequence */
 } tmap_index_t;
 
+/*! d TMAP_INDEX_MMAP_VERSION_ID
+  the version id of a memory-mapped index whose SA entries are packed
+  @details  differs from TMAP_VERSION_ID so that older versions refuse the file
+  */
+#define TMAP_INDEX_MMAP_VERSION_ID (TMAP_VERSION_ID + 1)
+
+/*!
+  The header of the memory-mapped index file.
+  @details  The packed reference sequence, BWT, and SA follow, in that order, 
+  starting at TMAP_PACKED_ALIGNMENT bytes, in the same format as packed into
+  shared memory.
+  */
+typedef struct {
+    uint64_t version_id; /*!< the version id, written last so that a partially written file is not used */
+    uint64_t refseq_bytes; /*!< the number of bytes of the packed reference sequence */
+    uint64_t bwt_bytes; /*!< the number of bytes of the packed BWT */
+    uint64_t sa_bytes; /*!< the number of bytes of the packed SA */
+} tmap_index_mmap_header_t;
+
 /*!
   Initializes the full reference data from file or shared memory.
-  @param  fn_fasta  the FASTA file name
-  @param  shm_key   the shared memory key, or zero if we are to read in from file
-  @return           the full reference index
+  @param  fn_fasta    the FASTA file name
+  @param  shm_key     the shared memory key, or zero if we are to read in from file
+  @param  huge_pages  the page size of the BWT string and SA (TMAP_PLACEMENT_HUGE_PAGES_*)
+  @param  numa        the NUMA placement of the BWT string and SA (TMAP_PLACEMENT_NUMA_*)
+  @return             the full reference index
+  @details            when reading from file, the memory-mapped index is used if
+  it exists and is not older than the index files, unless huge pages or
+  interleaving were requested.  The placement of an index in shared memory is
+  chosen when starting the server, but it may still be replicated.
  */
 tmap_index_t*
-tmap_index_init(const char *fn_fasta, key_t shm_key);
+tmap_index_init(const char *fn_fasta, key_t shm_key, int32_t huge_pages, int32_t numa);
+
+/*!
+  @param  index  the reference index
+  @param  tid    the zero-based thread id
+  @return        the index to be used by the given thread
+  @details       when the BWT and SA are replicated, the threads are assigned
+  to the NUMA nodes in turn
+ */
+tmap_index_t*
+tmap_index_get_thread_index(tmap_index_t *index, int32_t tid);
+
+/*!
+  Pins the calling thread to the NUMA node of the index it uses.
+  @param  index  the reference index
+  @param  tid    the zero-based thread id
+  @details       does nothing unless the BWT and SA are replicated
+ */
+void
+tmap_index_pin_thread(tmap_index_t *index, int32_t tid);
 
 /*!
   Destroys the index data.
@@ -44,16 +92,38 @@ tmap_index_init(const char *fn_fasta, key_t shm_key);
 void
 tmap_index_destroy(tmap_index_t *index);
 
+/*!
+  Writes the memory-mapped index file from the index files.
+  @param  fn_fasta  the FASTA file name
+  @details  the file is written under a temporary name and renamed over the old one, so that
+  mappers using the old one keep it until they exit
+ */
+void
+tmap_index_mmap_write(const char *fn_fasta);
+
+/*! 
+  main-like function for 'tmap index2mmap'
+  @param  argc  the number of arguments
+  @param  argv  the argument list
+  @return       0 if executed successful
+  */
+int 
+tmap_index_mmap_main(int argc, char *argv[]);
+
 /*! 
   structure to store the command line options for 'tmap index'
   */
 typedef struct {
     char *fn_fasta;  /*!< the fasta file name (-f) */
     int32_t occ_interval;  /*!< the occurrence array interval (-o) */
+    int32_t occ_layout;  /*!< the occurrence array layout (-L) */
     int32_t hash_width;  /*!< the occurrence hash width (-w) */
     int32_t sa_interval;  /*!< the suffix array interval (-i) */
     int32_t is_large;  /*!< 0 to use the short BWT construction algorith, 1 otherwise (large BWT construction algorithm) */
     int32_t check_hash;  /*< 1 to validate the BWT hash, 0 otherwise */
+    int32_t num_threads;  /*!< the number of threads (-n) */
+    int32_t max_memory;  /*!< the memory in megabytes to construct the BWT (large algorithm) and SA, zero for no limit (-M,--max-memory) */
+    int32_t dense_occ;  /*!< the number of occurrences of a hash-width k-mer from which its suffix array entries are all stored, zero for none (-d) */
 } tmap_index_opt_t;
 
 /*! 
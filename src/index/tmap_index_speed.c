@@ -8,6 +8,7 @@
 #include "../util/tmap_alloc.h"
 #include "../util/tmap_progress.h"
 #include "../util/tmap_rand.h"
+#include "../util/tmap_placement.h"
 #include "../io/tmap_file.h"
 #include "tmap_refseq.h"
 #include "tmap_bwt_gen.h"
@@ -102,30 +103,35 @@ tmap_index_speed_test(tmap_index_t *index, clock_t *total_clock, tmap_index_spee
   return num_found;
 }
 
-static void 
-tmap_index_speed_core(tmap_index_speed_opt_t *opt)
+// returns the index lookup cpu cycle time
+static clock_t
+tmap_index_speed_run(tmap_index_speed_opt_t *opt, int32_t huge_pages, int32_t numa)
 {
-  tmap_index_t *index = NULL;
+  tmap_index_t *index = NULL, *thread_index = NULL;
   clock_t total_clock= 0;
   time_t start_time, end_time;
   int32_t num_found;
 
   // read in the index
-  index = tmap_index_init(opt->fn_fasta, opt->shm_key);
+  index = tmap_index_init(opt->fn_fasta, opt->shm_key, huge_pages, numa);
+
+  // use the copy on the node this thread runs on
+  tmap_index_pin_thread(index, 0);
+  thread_index = tmap_index_get_thread_index(index, 0);
 
   // modify the hash width
   if(0 <= opt->hash_width) {
-      if(index->bwt->hash_width < opt->hash_width) {
+      if(thread_index->bwt->hash_width < opt->hash_width) {
           tmap_error("the hash width too large (-w)", Exit, CommandLineArgument);
       }
-      index->bwt->hash_width = opt->hash_width;
+      thread_index->bwt->hash_width = opt->hash_width;
   }
 
   // clock on
   start_time = time(NULL);
 
   // run the speed test
-  num_found = tmap_index_speed_test(index, &total_clock, opt);
+  num_found = tmap_index_speed_test(thread_index, &total_clock, opt);
 
   // clock off
   end_time = time(NULL);
@@ -137,6 +143,31 @@ tmap_index_speed_core(tmap_index_speed_opt_t *opt)
   tmap_progress_print2("[tmap index] found %d out of %d (%.2f%%)", num_found, opt->kmer_num, (100.0 * num_found) / opt->kmer_num);
   tmap_progress_print2("[tmap index] wallclock time: %d seconds", (int)difftime(end_time,start_time));
   tmap_progress_print2("[tmap index] index lookup cpu cycle time: %.2f seconds", (float)(total_clock) / CLOCKS_PER_SEC);
+
+  return total_clock;
+}
+
+static void 
+tmap_index_speed_core(tmap_index_speed_opt_t *opt)
+{
+  clock_t base_clock, placed_clock;
+
+  if(0 == opt->measure) {
+      tmap_index_speed_run(opt, opt->huge_pages, opt->numa);
+      return;
+  }
+
+  // run with the default placement, then the given placement
+  tmap_progress_print2("[tmap index] measuring the default placement");
+  base_clock = tmap_index_speed_run(opt, TMAP_PLACEMENT_HUGE_PAGES_NONE, TMAP_PLACEMENT_NUMA_NONE);
+  tmap_progress_print2("[tmap index] measuring the given placement (-g %d -n %d)", opt->huge_pages, opt->numa);
+  placed_clock = tmap_index_speed_run(opt, opt->huge_pages, opt->numa);
+
+  tmap_file_fprintf(tmap_file_stderr, "[tmap index] default placement: %.2f seconds\n", (float)(base_clock) / CLOCKS_PER_SEC);
+  tmap_file_fprintf(tmap_file_stderr, "[tmap index] given placement: %.2f seconds\n", (float)(placed_clock) / CLOCKS_PER_SEC);
+  if(0 < placed_clock) {
+      tmap_file_fprintf(tmap_file_stderr, "[tmap index] speedup: %.2fx\n", (double)base_clock / placed_clock);
+  }
 }
 
 static int 
@@ -162,6 +193,15 @@ usage(tmap_index_speed_opt_t *opt)
   tmap_file_fprintf(tmap_file_stderr, "         -e INT      the maximum number of hits to enumerate with -F 0 (-1 for unlimited, 0 to disable) [%d]\n", opt->enum_max_hits);
   tmap_file_fprintf(tmap_file_stderr, "         -K INT      the kmer length to simulate with -F 0 [%d]\n", opt->kmer_length);
   tmap_file_fprintf(tmap_file_stderr, "         -R FLOAT    the fraction of random kmers with -F 0 [%.2lf]\n", opt->rand_frac);
+  tmap_file_fprintf(tmap_file_stderr, "         -g INT      the page size of the BWT and SA [%d]:\n", opt->huge_pages);
+  tmap_file_fprintf(tmap_file_stderr, "                         0 - the default page size\n");
+  tmap_file_fprintf(tmap_file_stderr, "                         1 - 2MB huge pages\n");
+  tmap_file_fprintf(tmap_file_stderr, "                         2 - 1GB huge pages\n");
+  tmap_file_fprintf(tmap_file_stderr, "         -n INT      the NUMA placement of the BWT and SA [%d]:\n", opt->numa);
+  tmap_file_fprintf(tmap_file_stderr, "                         0 - the default placement\n");
+  tmap_file_fprintf(tmap_file_stderr, "                         1 - interleave across the nodes\n");
+  tmap_file_fprintf(tmap_file_stderr, "                         2 - replicate on each node\n");
+  tmap_file_fprintf(tmap_file_stderr, "         -M          measure the gain of -g and -n over the default placement\n");
   tmap_file_fprintf(tmap_file_stderr, "         -v          print verbose progress information\n");
   tmap_file_fprintf(tmap_file_stderr, "         -h          print this message\n");
   tmap_file_fprintf(tmap_file_stderr, "\n");
@@ -182,8 +222,11 @@ tmap_index_speed(int argc, char *argv[])
   opt.rand_frac = 0.0;
   opt.shm_key = 0;
   opt.func = 0;
+  opt.huge_pages = TMAP_PLACEMENT_HUGE_PAGES_NONE;
+  opt.numa = TMAP_PLACEMENT_NUMA_NONE;
+  opt.measure = 0;
       
-  while((c = getopt(argc, argv, "f:k:w:e:K:N:R:F:hv")) >= 0) {
+  while((c = getopt(argc, argv, "f:k:w:e:K:N:R:F:g:n:Mhv")) >= 0) {
       switch(c) {
         case 'f':
           opt.fn_fasta = tmap_strdup(optarg); break;
@@ -203,6 +246,12 @@ tmap_index_speed(int argc, char *argv[])
           tmap_progress_set_verbosity(1); break;
         case 'F':
           opt.func = atoi(optarg); break;
+        case 'g':
+          opt.huge_pages = atoi(optarg); break;
+        case 'n':
+          opt.numa = atoi(optarg); break;
+        case 'M':
+          opt.measure = 1; break;
         case 'h':
         default:
           return usage(&opt);
@@ -230,6 +279,12 @@ tmap_index_speed(int argc, char *argv[])
   if(opt.func < 0 || 5 < opt.func) {
       tmap_error("the option -F must be between 0 and 5", Exit, CommandLineArgument);
   }
+  if(opt.huge_pages < TMAP_PLACEMENT_HUGE_PAGES_NONE || TMAP_PLACEMENT_HUGE_PAGES_1GB < opt.huge_pages) {
+      tmap_error("the option -g must be between 0 and 2", Exit, CommandLineArgument);
+  }
+  if(opt.numa < TMAP_PLACEMENT_NUMA_NONE || TMAP_PLACEMENT_NUMA_REPLICATE < opt.numa) {
+      tmap_error("the option -n must be between 0 and 2", Exit, CommandLineArgument);
+  }
 
   tmap_index_speed_core(&opt);
 
@@ -19,6 +19,9 @@ typedef struct {
     int32_t kmer_num;  /*!< the number of kmers to simulate (-N) */
     double rand_frac;  /*!< the fraction of random kmers (-R) */
     int32_t func;  /*!< the function to test (-F) */
+    int32_t huge_pages;  /*!< the page size of the BWT and SA (-g) */
+    int32_t numa;  /*!< the NUMA placement of the BWT and SA (-n) */
+    int32_t measure;  /*!< 1 to compare against the default placement, 0 otherwise (-M) */
 } tmap_index_speed_opt_t;
 
 /*! 
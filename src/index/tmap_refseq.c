@@ -1,6 +1,7 @@
 /* Copyright (C) 2010 Ion Torrent Systems, Inc. All Rights Reserved */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <time.h>
 #include <config.h>
@@ -527,6 +528,30 @@ tmap_refseq_read_anno(tmap_file_t *fp, tmap_refseq_t *refseq, int32_t ignore_ver
   }
 }
 
+// builds the contig of the first position in each bucket of positions, with
+// about TMAP_REFSEQ_SEQID_LOOKUP_RATIO buckets per contig, so a position's
+// contig is found between its bucket's contig and the next bucket's
+static void
+tmap_refseq_seqid_lookup_init(tmap_refseq_t *refseq)
+{
+  uint64_t i, n, pacpos;
+  int32_t seqid = 0;
+
+  if(0 == refseq->num_annos) return;
+
+  refseq->seqid_lookup_shift = 0;
+  while((uint64_t)TMAP_REFSEQ_SEQID_LOOKUP_RATIO * refseq->num_annos < (refseq->len >> refseq->seqid_lookup_shift)) {
+      refseq->seqid_lookup_shift++;
+  }
+  n = (refseq->len >> refseq->seqid_lookup_shift) + 1;
+  refseq->seqid_lookup = tmap_malloc(sizeof(uint32_t) * n, "refseq->seqid_lookup");
+  for(i=0;i<n;i++) {
+      pacpos = i << refseq->seqid_lookup_shift; // one-based
+      while(seqid + 1 < refseq->num_annos && refseq->annos[seqid+1].offset < pacpos) seqid++;
+      refseq->seqid_lookup[i] = seqid;
+  }
+}
+
 tmap_refseq_t *
 tmap_refseq_read(const char *fn_fasta)
 {
@@ -556,6 +581,7 @@ tmap_refseq_read(const char *fn_fasta)
   tmap_file_fclose(fp_pac);
   free(fn_pac);
 
+  tmap_refseq_seqid_lookup_init(refseq);
 
   return refseq;
 }
@@ -599,6 +625,7 @@ tmap_refseq_shm_num_bytes(tmap_refseq_t *refseq)
   n += sizeof(uint32_t); // annos
   n += sizeof(uint64_t); // len
   n += sizeof(char)*(refseq->package_version->l+1); // package_version->s
+  n = __tmap_packed_align(n); // the seq starts on a page boundary
   n += sizeof(uint8_t)*tmap_refseq_seq_memory(refseq->len); // seq 
   for(i=0;i<refseq->num_annos;i++) {
       n += sizeof(uint64_t); // len
@@ -611,7 +638,7 @@ tmap_refseq_shm_num_bytes(tmap_refseq_t *refseq)
       n += sizeof(uint8_t)*refseq->annos[i].num_amb; // amb_bases
   }
 
-  return n;
+  return __tmap_packed_align(n);
 }
 
 size_t
@@ -649,6 +676,7 @@ uint8_t *
 tmap_refseq_shm_pack(tmap_refseq_t *refseq, uint8_t *buf)
 {
   int32_t i;
+  uint8_t *start = buf;
 
   // fixed length data
   memcpy(buf, &refseq->version_id, sizeof(uint64_t)); buf += sizeof(uint64_t);
@@ -658,6 +686,7 @@ tmap_refseq_shm_pack(tmap_refseq_t *refseq, uint8_t *buf)
   // variable length data
   memcpy(buf, refseq->package_version->s, sizeof(char)*(refseq->package_version->l+1));
   buf += sizeof(char)*(refseq->package_version->l+1); 
+  buf = tmap_packed_pad(start, buf);
   memcpy(buf, refseq->seq, tmap_refseq_seq_memory(refseq->len)*sizeof(uint8_t)); 
   buf += tmap_refseq_seq_memory(refseq->len)*sizeof(uint8_t);
 
@@ -680,7 +709,7 @@ tmap_refseq_shm_pack(tmap_refseq_t *refseq, uint8_t *buf)
       }
   }
 
-  return buf;
+  return tmap_packed_pad(start, buf);
 }
 
 tmap_refseq_t *
@@ -688,6 +717,7 @@ tmap_refseq_shm_unpack(uint8_t *buf)
 {
   int32_t i;
   tmap_refseq_t *refseq = NULL;
+  uint8_t *start = buf;
   
   if(NULL == buf) return NULL;
 
@@ -711,6 +741,7 @@ tmap_refseq_shm_unpack(uint8_t *buf)
   if(0 == tmap_refseq_supported(refseq)) {
       tmap_error("the reference index is not supported", Exit, ReadFileError);
   }
+  buf = start + __tmap_packed_align(buf - start);
   refseq->seq = (uint8_t*)buf;
   buf += tmap_refseq_seq_memory(refseq->len)*sizeof(uint8_t);
   refseq->annos = tmap_calloc(refseq->num_annos, sizeof(tmap_anno_t), "refseq->annos");
@@ -742,6 +773,8 @@ tmap_refseq_shm_unpack(uint8_t *buf)
 
   refseq->is_shm = 1;
 
+  tmap_refseq_seqid_lookup_init(refseq);
+
   return refseq;
 }
 
@@ -750,6 +783,7 @@ tmap_refseq_destroy(tmap_refseq_t *refseq)
 {
   int32_t i;
 
+  free(refseq->seqid_lookup);
   if(1 == refseq->is_shm) {
       free(refseq->package_version);
       for(i=0;i<refseq->num_annos;i++) {
@@ -777,11 +811,26 @@ static inline int32_t
 tmap_refseq_get_seqid1(const tmap_refseq_t *refseq, tmap_bwt_int_t pacpos)
 {
   int32_t left, right, mid;
+  uint64_t b;
 
   if(refseq->len < pacpos) {
       tmap_error("Coordinate was larger than the reference", Exit, OutOfRange);
   }
 
+  if(NULL != refseq->seqid_lookup) { // the last contig starting before pacpos
+      // search between the contigs of this bucket and the next, as a bucket may
+      // hold many short contigs
+      b = pacpos >> refseq->seqid_lookup_shift;
+      left = refseq->seqid_lookup[b];
+      right = (b < (refseq->len >> refseq->seqid_lookup_shift)) ? (int32_t)refseq->seqid_lookup[b+1] : refseq->num_annos - 1;
+      while(left < right) {
+          mid = (left + right + 1) >> 1;
+          if(refseq->annos[mid].offset < pacpos) left = mid;
+          else right = mid - 1;
+      }
+      return left;
+  }
+
   left = 0; mid = 0; right = refseq->num_annos;
   while (left < right) {
       mid = (left + right) >> 1;
@@ -808,6 +857,14 @@ tmap_refseq_get_seqid(const tmap_refseq_t *refseq, tmap_bwt_int_t pacpos, uint32
   seqid_left = tmap_refseq_get_seqid1(refseq, pacpos);
   if(1 == aln_len) return seqid_left;
 
+  if(NULL != refseq->seqid_lookup) { // the next contig must start at or after the end
+      if(refseq->len < pacpos+aln_len-1) {
+          tmap_error("Coordinate was larger than the reference", Exit, OutOfRange);
+      }
+      if(seqid_left + 1 < refseq->num_annos && refseq->annos[seqid_left+1].offset < pacpos+aln_len-1) return -1; // overlaps two chromosomes
+      return seqid_left;
+  }
+
   seqid_right = tmap_refseq_get_seqid1(refseq, pacpos+aln_len-1);
   if(seqid_left != seqid_right) return -1; // overlaps two chromosomes
 
@@ -858,11 +915,33 @@ tmap_refseq_pac2real(const tmap_refseq_t *refseq, tmap_bwt_int_t pacpos, uint32_
   return (*pos);
 }
 
+int32_t
+tmap_refseq_pac2real_batch(const tmap_refseq_t *refseq, int32_t n, const tmap_bwt_int_t *pacpos, uint32_t aln_length, 
+                           uint32_t *seqid, uint32_t *pos, uint8_t *strand)
+{
+  int32_t i, m;
+  for(i=m=0;i<n;i++) {
+      if(0 < tmap_refseq_pac2real(refseq, pacpos[i], aln_length, &seqid[i], &pos[i], &strand[i])) m++;
+      else pos[i] = 0;
+  }
+  return m;
+}
+
+// the four bases packed in each byte, in the order they are stored
+#define __tmap_refseq_unpack1(b) { ((b) >> 6) & 0x3, ((b) >> 4) & 0x3, ((b) >> 2) & 0x3, (b) & 0x3 }
+#define __tmap_refseq_unpack4(b) __tmap_refseq_unpack1(b), __tmap_refseq_unpack1((b)+1), __tmap_refseq_unpack1((b)+2), __tmap_refseq_unpack1((b)+3)
+#define __tmap_refseq_unpack16(b) __tmap_refseq_unpack4(b), __tmap_refseq_unpack4((b)+4), __tmap_refseq_unpack4((b)+8), __tmap_refseq_unpack4((b)+12)
+#define __tmap_refseq_unpack64(b) __tmap_refseq_unpack16(b), __tmap_refseq_unpack16((b)+16), __tmap_refseq_unpack16((b)+32), __tmap_refseq_unpack16((b)+48)
+static const uint8_t tmap_refseq_unpack_table[256][4] = {
+    __tmap_refseq_unpack64(0), __tmap_refseq_unpack64(64), __tmap_refseq_unpack64(128), __tmap_refseq_unpack64(192)
+};
+
 inline int32_t
 tmap_refseq_subseq(const tmap_refseq_t *refseq, tmap_bwt_int_t pacpos, uint32_t length, uint8_t *target)
 {
   tmap_bwt_int_t k, pacpos_upper;
-  uint32_t l;
+  uint32_t l, n;
+  const uint8_t *p;
   if(0 == length) {
       return 0;
   }
@@ -872,9 +951,33 @@ tmap_refseq_subseq(const tmap_refseq_t *refseq, tmap_bwt_int_t pacpos, uint32_t
   else {
       pacpos_upper = refseq->len;
   }
-  for(k=pacpos,l=0;k<=pacpos_upper;k++,l++) {
-      // k-1 since pacpos is one-based
-      target[l] = tmap_refseq_seq_i(refseq, k-1);
+  if(pacpos_upper < pacpos) return 0;
+  n = pacpos_upper - pacpos + 1;
+  // k is zero-based, since pacpos is one-based
+  k = pacpos - 1;
+  l = 0;
+  // up to the start of a byte
+  for(;l<n && 0 != (k & 0x3);k++,l++) {
+      target[l] = tmap_refseq_seq_i(refseq, k);
+  }
+  // a byte (four bases) at a time, 32 bases per step
+  p = refseq->seq + tmap_refseq_seq_byte_i(k);
+  for(;l+32<=n;l+=32,k+=32,p+=8) {
+      memcpy(target + l, tmap_refseq_unpack_table[p[0]], 4);
+      memcpy(target + l + 4, tmap_refseq_unpack_table[p[1]], 4);
+      memcpy(target + l + 8, tmap_refseq_unpack_table[p[2]], 4);
+      memcpy(target + l + 12, tmap_refseq_unpack_table[p[3]], 4);
+      memcpy(target + l + 16, tmap_refseq_unpack_table[p[4]], 4);
+      memcpy(target + l + 20, tmap_refseq_unpack_table[p[5]], 4);
+      memcpy(target + l + 24, tmap_refseq_unpack_table[p[6]], 4);
+      memcpy(target + l + 28, tmap_refseq_unpack_table[p[7]], 4);
+  }
+  for(;l+4<=n;l+=4,k+=4,p++) {
+      memcpy(target + l, tmap_refseq_unpack_table[p[0]], 4);
+  }
+  // the rest
+  for(;l<n;k++,l++) {
+      target[l] = tmap_refseq_seq_i(refseq, k);
   }
   return l;
 }
@@ -882,30 +985,41 @@ tmap_refseq_subseq(const tmap_refseq_t *refseq, tmap_bwt_int_t pacpos, uint32_t
 inline uint8_t*
 tmap_refseq_subseq2(const tmap_refseq_t *refseq, uint32_t seqid, uint32_t start, uint32_t end, uint8_t *target, int32_t to_n, int32_t *conv)
 {
-  uint32_t i, j;
+  uint32_t i, j, low, high, mid;
+  uint8_t *buf = NULL;
+  tmap_anno_t *anno;
 
   if(0 == seqid || (uint32_t)refseq->num_annos < seqid || end < start) {
       return NULL;
   }
 
   if(NULL == target) { 
-      target = tmap_malloc(sizeof(char) * (end - start + 1), "target");
+      target = buf = tmap_malloc(sizeof(char) * (end - start + 1), "target");
   }
   if((end - start + 1) != (uint32_t)tmap_refseq_subseq(refseq, refseq->annos[seqid-1].offset + start, end - start + 1, target)) {
-      free(target);
+      free(buf); // NB: not the caller's memory
       return NULL;
   }
 
-  // check if any IUPAC bases fall within the range
-  // NB: this could be done more efficiently, since we we know start <= end
+  // overlay the IUPAC bases that fall within the range
   if(NULL != conv) (*conv) = 0;
-  if(0 < tmap_refseq_amb_bases(refseq, seqid, start, end)) {
-      // modify them
-      for(i=start;i<=end;i++) {
-          j = tmap_refseq_amb_bases(refseq, seqid, i, i); // Note: j is one-based
-          if(0 < j) {
-              target[i-start] = (0 == to_n) ? refseq->annos[seqid-1].amb_bases[j-1] : 4;
-              if(NULL != conv) (*conv)++;
+  anno = &refseq->annos[seqid-1];
+  if(0 < anno->num_amb) {
+      // the first ambiguous interval ending at or after start
+      low = 0; high = anno->num_amb;
+      while(low < high) {
+          mid = (low + high) >> 1;
+          if(anno->amb_positions_end[mid] < start) low = mid + 1;
+          else high = mid;
+      }
+      // the intervals are sorted and do not overlap
+      for(j=low;j<anno->num_amb && anno->amb_positions_start[j] <= end;j++) {
+          uint8_t c = (0 == to_n) ? anno->amb_bases[j] : 4;
+          uint32_t i_end = (anno->amb_positions_end[j] < end) ? anno->amb_positions_end[j] : end;
+          i = (start < anno->amb_positions_start[j]) ? anno->amb_positions_start[j] : start;
+          if(NULL != conv) (*conv) += i_end - i + 1;
+          for(;i<=i_end;i++) {
+              target[i-start] = c;
           }
       }
   }
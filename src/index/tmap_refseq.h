@@ -17,6 +17,9 @@
 // the number of bases on a given line for "tmap pac2refseq"
 #define TMAP_REFSEQ_FASTA_LINE_LENGTH 72
 
+// the number of buckets of positions per contig in the contig lookup table
+#define TMAP_REFSEQ_SEQID_LOOKUP_RATIO 8
+
 /*! 
   @param  _len  the number of bases stored 
   @return       the number of bytes allocated
@@ -72,6 +75,8 @@ typedef struct {
     int32_t num_annos;  /*!< the number of contigs (and annotations) */
     uint64_t len;  /*!< the total length of the reference sequence */
     uint32_t is_shm;  /*!< 1 if loaded from shared memory, 0 otherwise */
+    uint32_t *seqid_lookup;  /*!< the contig of the first position in each bucket of positions, or NULL if not built */
+    uint32_t seqid_lookup_shift;  /*!< log2 of the number of positions in each bucket of the contig lookup table */
 } tmap_refseq_t;
 
 /*!
@@ -136,6 +141,7 @@ tmap_refseq_shm_read_num_bytes(const char *fn_fasta);
   @param  refseq  the refseq structure to pack 
   @param  buf     the byte array in which to pack the refseq data
   @return         a pointer to the next unused byte in memory
+  @details        the sequence is aligned to TMAP_PACKED_ALIGNMENT relative to buf
   */
 uint8_t *
 tmap_refseq_shm_pack(tmap_refseq_t *refseq, uint8_t *buf);
@@ -165,6 +171,21 @@ tmap_refseq_destroy(tmap_refseq_t *refseq);
 inline tmap_bwt_int_t
 tmap_refseq_pac2real(const tmap_refseq_t *refseq, tmap_bwt_int_t pacpos, uint32_t aln_length, uint32_t *seqid, uint32_t *pos, uint8_t *strand);
 
+/*! 
+  converts many packed positions, as tmap_refseq_pac2real does for each 
+  @param  refseq      pointer to the structure in which the data is stored
+  @param  n           the number of packed positions
+  @param  pacpos      the packed FASTA positions (one-based)
+  @param  aln_length  the alignment length, the same for all the positions
+  @param  seqid       the zero-based sequence indexes to be returned
+  @param  pos         the one-based positions to be returned, 0 where tmap_refseq_pac2real would return 0 (i.e. overlaps two chromosomes)
+  @param  strand      the strands to be returned (0 - forward, 1 - reverse)
+  @return             the number of positions found
+  */
+int32_t
+tmap_refseq_pac2real_batch(const tmap_refseq_t *refseq, int32_t n, const tmap_bwt_int_t *pacpos, uint32_t aln_length, 
+                           uint32_t *seqid, uint32_t *pos, uint8_t *strand);
+
 /*! 
   Retrieves a subsequence of the reference in 2-bit format
   @param  refseq  pointer to the structure in which the data is stored
@@ -182,10 +203,13 @@ tmap_refseq_subseq(const tmap_refseq_t *refseq, tmap_bwt_int_t pacpos, uint32_t
   @param  seqid   the sequence id (one-based)
   @param  start   the start position (one-based)
   @param  end     the end position (one-based)
-  @param  target  pre-allocated memory for the target
+  @param  target  pre-allocated memory for the target, or NULL to allocate it
   @param  to_n    change all ambiguous bases to N, otherwise they will be returned as the correct code
   @param  conv    the number of bases converted to ambiguity bases
   @return         the target sequence if successful, NULL otherwise
+  @details        no memory is allocated when the target is given, and the
+  IUPAC bases are found by walking only the ambiguous intervals that overlap
+  the range
   */
 inline uint8_t*
 tmap_refseq_subseq2(const tmap_refseq_t *refseq, uint32_t seqid, uint32_t start, uint32_t end, uint8_t *target, int32_t to_n, int32_t *conv);
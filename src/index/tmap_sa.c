@@ -3,16 +3,23 @@
 #include <limits.h>
 #include <string.h>
 #include <unistd.h>
+#include <getopt.h>
+#include <config.h>
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 
 #include "../util/tmap_error.h"
 #include "../util/tmap_alloc.h"
 #include "../util/tmap_progress.h"
 #include "../util/tmap_definitions.h"
+#include "../util/tmap_placement.h"
 #include "../io/tmap_file.h"
 #include "tmap_bwt.h"
 #include "tmap_bwt_match.h"
 #include "tmap_bwt_match_hash.h"
 #include "tmap_bwt_gen.h"
+#include "tmap_refseq.h"
 #include "tmap_sa.h"
 //#include "tmap_sa_aux.h"
 
@@ -25,13 +32,181 @@
 #include "tmap_sa_aux.h"
 #endif
 
+/*! d TMAP_SA_READ_BUFFER
+  the number of suffix array entries read at a time before they are packed
+  */
+#define TMAP_SA_READ_BUFFER 0x10000
+
+// sets the number of bits in a packed entry, enough for the reference length
+// plus one
+static inline void
+tmap_sa_set_width(tmap_sa_t *sa, uint64_t seq_len)
+{
+  sa->sa_width = 1;
+  while(0 != ((seq_len + 1) >> sa->sa_width)) sa->sa_width++;
+  sa->sa_mask = (((uint64_t)1) << sa->sa_width) - 1;
+}
+
+// the number of bytes of n entries, where the packed entries are padded so
+// that the last one can be read with a 64-bit load
+static inline size_t
+tmap_sa_entries_num_bytes(const tmap_sa_t *sa, tmap_bwt_int_t n)
+{
+  if(0 == sa->sa_width) return n * sizeof(tmap_bwt_int_t);
+  return ((((uint64_t)n * sa->sa_width + 7) >> 3) + sizeof(uint64_t) + 7) & ~((uint64_t)7);
+}
+
+// packs v as the ith entry, where the packed entries start zeroed
+static inline void
+tmap_sa_pack_entry(tmap_sa_t *sa, tmap_bwt_int_t *entries, tmap_bwt_int_t i, tmap_bwt_int_t v)
+{
+  uint64_t b, x;
+  uint8_t *p;
+  b = (uint64_t)i * sa->sa_width;
+  p = (uint8_t*)entries + (b >> 3);
+  memcpy(&x, p, sizeof(uint64_t));
+  x |= ((uint64_t)(tmap_bwt_int_t)(v + 1) & sa->sa_mask) << (b & 7);
+  memcpy(p, &x, sizeof(uint64_t));
+}
+
+// reads n entries and packs them from the ith entry on
+static void
+tmap_sa_read_packed(tmap_file_t *fp, tmap_sa_t *sa, tmap_bwt_int_t *entries, tmap_bwt_int_t i, tmap_bwt_int_t n)
+{
+  tmap_bwt_int_t *buf = NULL;
+  tmap_bwt_int_t j, m;
+
+  buf = tmap_malloc(TMAP_SA_READ_BUFFER * sizeof(tmap_bwt_int_t), "buf");
+  for(;0 < n;n-=m,i+=m) {
+      m = (n < TMAP_SA_READ_BUFFER) ? n : TMAP_SA_READ_BUFFER;
+      if(m != tmap_file_fread(buf, sizeof(tmap_bwt_int_t), m, fp)) {
+          tmap_error(NULL, Exit, ReadFileError);
+      }
+      for(j=0;j<m;j++) {
+          tmap_sa_pack_entry(sa, entries, i + j, buf[j]);
+      }
+  }
+  free(buf);
+}
+
+// returns the index of the fully stored SA interval that contains k, or
+// n_dense if none does
+static inline tmap_bwt_int_t
+tmap_sa_dense_find(const tmap_sa_t *sa, tmap_bwt_int_t k)
+{
+  tmap_bwt_int_t low = 0, high = sa->n_dense, mid;
+  // the first interval whose upper bound is at least k
+  while(low < high) {
+      mid = low + ((high - low) >> 1);
+      if(sa->dense_l[mid] < k) low = mid + 1;
+      else high = mid;
+  }
+  if(low < sa->n_dense && sa->dense_k[low] <= k) return low;
+  return sa->n_dense;
+}
+
+// reads the fully stored SA intervals if they were constructed for this SA,
+// and only their numbers if entries is zero
+static void
+tmap_sa_dense_read(const char *fn_fasta, tmap_sa_t *sa, int32_t entries)
+{
+  char *fn_dsa = NULL;
+  tmap_file_t *fp_dsa = NULL;
+  tmap_bwt_int_t header[5], i, n;
+
+  sa->n_dense = sa->n_dense_sa = 0;
+
+  fn_dsa = tmap_get_file_name(fn_fasta, TMAP_DSA_FILE);
+  if(0 != access(fn_dsa, R_OK)) { // none were constructed
+      free(fn_dsa);
+      return;
+  }
+  fp_dsa = tmap_file_fopen(fn_dsa, "rb", TMAP_SA_COMPRESSION);
+
+  // primary, sa_intv, seq_len, n_dense, n_dense_sa
+  if(5 != tmap_file_fread(header, sizeof(tmap_bwt_int_t), 5, fp_dsa)) {
+      tmap_error(fn_dsa, Exit, ReadFileError);
+  }
+  if(header[0] != sa->primary || header[1] != sa->sa_intv || header[2] != sa->seq_len) {
+      tmap_error("the fully stored SA intervals were not constructed for this SA; ignoring them", Warn, OutOfRange);
+      tmap_file_fclose(fp_dsa);
+      free(fn_dsa);
+      return;
+  }
+  sa->n_dense = header[3];
+  sa->n_dense_sa = header[4];
+
+  if(1 == entries) {
+      sa->dense_k = tmap_malloc(sizeof(tmap_bwt_int_t) * sa->n_dense, "sa->dense_k");
+      sa->dense_l = tmap_malloc(sizeof(tmap_bwt_int_t) * sa->n_dense, "sa->dense_l");
+      sa->dense_offset = tmap_malloc(sizeof(tmap_bwt_int_t) * sa->n_dense, "sa->dense_offset");
+      if(sa->n_dense != tmap_file_fread(sa->dense_k, sizeof(tmap_bwt_int_t), sa->n_dense, fp_dsa)
+         || sa->n_dense != tmap_file_fread(sa->dense_l, sizeof(tmap_bwt_int_t), sa->n_dense, fp_dsa)) {
+          tmap_error(fn_dsa, Exit, ReadFileError);
+      }
+      for(i=n=0;i<sa->n_dense;i++) {
+          sa->dense_offset[i] = n;
+          n += sa->dense_l[i] - sa->dense_k[i] + 1;
+      }
+      if(n != sa->n_dense_sa) {
+          tmap_error(fn_dsa, Exit, ReadFileError);
+      }
+      sa->dense_sa = tmap_calloc(tmap_sa_entries_num_bytes(sa, sa->n_dense_sa), sizeof(uint8_t), "sa->dense_sa");
+      tmap_sa_read_packed(fp_dsa, sa, sa->dense_sa, 0, sa->n_dense_sa);
+  }
+
+  tmap_file_fclose(fp_dsa);
+  free(fn_dsa);
+}
+
+// writes the fully stored SA intervals, or removes those of a previous SA
+// if there are none
+static void
+tmap_sa_dense_write(const char *fn_fasta, tmap_sa_t *sa)
+{
+  char *fn_dsa = NULL;
+  tmap_file_t *fp_dsa = NULL;
+  tmap_bwt_int_t header[5];
+
+  fn_dsa = tmap_get_file_name(fn_fasta, TMAP_DSA_FILE);
+  if(0 == sa->n_dense) {
+      if(0 == access(fn_dsa, F_OK) && 0 != unlink(fn_dsa)) {
+          tmap_error(fn_dsa, Warn, OpenFileError);
+      }
+      free(fn_dsa);
+      return;
+  }
+  fp_dsa = tmap_file_fopen(fn_dsa, "wb", TMAP_SA_COMPRESSION);
+
+  header[0] = sa->primary;
+  header[1] = sa->sa_intv;
+  header[2] = sa->seq_len;
+  header[3] = sa->n_dense;
+  header[4] = sa->n_dense_sa;
+  if(5 != tmap_file_fwrite(header, sizeof(tmap_bwt_int_t), 5, fp_dsa)
+     || sa->n_dense != tmap_file_fwrite(sa->dense_k, sizeof(tmap_bwt_int_t), sa->n_dense, fp_dsa)
+     || sa->n_dense != tmap_file_fwrite(sa->dense_l, sizeof(tmap_bwt_int_t), sa->n_dense, fp_dsa)
+     || sa->n_dense_sa != tmap_file_fwrite(sa->dense_sa, sizeof(tmap_bwt_int_t), sa->n_dense_sa, fp_dsa)) {
+      tmap_error(fn_dsa, Exit, WriteFileError);
+  }
+
+  tmap_file_fclose(fp_dsa);
+  free(fn_dsa);
+}
 
 tmap_sa_t *
 tmap_sa_read(const char *fn_fasta)
+{
+  return tmap_sa_read_placed(fn_fasta, TMAP_PLACEMENT_HUGE_PAGES_NONE, TMAP_PLACEMENT_NUMA_NONE);
+}
+
+tmap_sa_t *
+tmap_sa_read_placed(const char *fn_fasta, int32_t huge_pages, int32_t numa)
 {
   char *fn_sa = NULL;
   tmap_file_t *fp_sa = NULL;
   tmap_sa_t *sa = NULL;
+  size_t n_bytes;
 
   fn_sa = tmap_get_file_name(fn_fasta, TMAP_SA_FILE);
   fp_sa = tmap_file_fopen(fn_sa, "rb", TMAP_SA_COMPRESSION);
@@ -45,18 +220,28 @@ tmap_sa_read(const char *fn_fasta)
   }
 
   sa->n_sa = (sa->seq_len + sa->sa_intv) / sa->sa_intv;
-  sa->sa = tmap_calloc(sa->n_sa, sizeof(tmap_bwt_int_t), "sa->sa");
-  sa->sa[0] = -1;
-
-  if(sa->n_sa-1 != tmap_file_fread(sa->sa + 1, sizeof(tmap_bwt_int_t), sa->n_sa - 1, fp_sa)) {
-      tmap_error(NULL, Exit, ReadFileError);
+  tmap_sa_set_width(sa, sa->seq_len);
+  n_bytes = tmap_sa_entries_num_bytes(sa, sa->n_sa);
+  if(TMAP_PLACEMENT_HUGE_PAGES_NONE == huge_pages && TMAP_PLACEMENT_NUMA_NONE == numa) {
+      sa->sa = tmap_calloc(n_bytes, sizeof(uint8_t), "sa->sa");
   }
+  else {
+      sa->sa = tmap_placement_alloc(n_bytes, huge_pages, numa, 0);
+      memset(sa->sa, 0, n_bytes);
+      sa->is_placed = 1;
+      sa->huge_pages = huge_pages;
+  }
+
+  // S(0) = -1 is packed as zero, so read from the second entry
+  tmap_sa_read_packed(fp_sa, sa, sa->sa, 1, sa->n_sa - 1);
 
   sa->sa_intv_log2 = tmap_log2(sa->sa_intv);
 
   tmap_file_fclose(fp_sa);
   free(fn_sa);
 
+  tmap_sa_dense_read(fn_fasta, sa, 1);
+
   sa->is_shm = 0;
 
   return sa;
@@ -67,6 +252,10 @@ tmap_sa_write(const char *fn_fasta, tmap_sa_t *sa)
 {
   char *fn_sa = NULL;
   tmap_file_t *fp_sa = NULL;
+
+  if(0 != sa->sa_width) {
+      tmap_error("the suffix array entries are packed", Exit, OutOfRange);
+  }
   
   fn_sa = tmap_get_file_name(fn_fasta, TMAP_SA_FILE);
   fp_sa = tmap_file_fopen(fn_sa, "wb", TMAP_SA_COMPRESSION);
@@ -86,12 +275,18 @@ size_t
 tmap_sa_approx_num_bytes(uint64_t len, uint32_t sa_intv)
 {
   size_t n = 0;
+  tmap_sa_t sa;
   
   n += sizeof(tmap_bwt_int_t); // primary
   n += sizeof(tmap_bwt_int_t); // sa_intv
   n += sizeof(tmap_bwt_int_t); // seq_len
   n += sizeof(tmap_bwt_int_t); // n_sa
-  n += sizeof(tmap_bwt_int_t)*(size_t)((len + sa_intv)/sa_intv); // sa
+  n += sizeof(uint32_t); // sa_width
+  n += sizeof(tmap_bwt_int_t); // n_dense
+  n += sizeof(tmap_bwt_int_t); // n_dense_sa
+  sa.n_sa = (len + sa_intv)/sa_intv;
+  tmap_sa_set_width(&sa, len);
+  n += tmap_sa_entries_num_bytes(&sa, sa.n_sa); // sa
 
   return n;
 }
@@ -106,9 +301,17 @@ tmap_sa_shm_num_bytes(tmap_sa_t *sa)
   n += sizeof(tmap_bwt_int_t); // sa_intv
   n += sizeof(tmap_bwt_int_t); // seq_len
   n += sizeof(tmap_bwt_int_t); // n_sa
-  n += sizeof(tmap_bwt_int_t)*sa->n_sa; // sa
+  n += sizeof(uint32_t); // sa_width
+  n += sizeof(tmap_bwt_int_t); // n_dense
+  n += sizeof(tmap_bwt_int_t); // n_dense_sa
+  n = __tmap_packed_align(n); // the sa starts on a page boundary
+  n += tmap_sa_entries_num_bytes(sa, sa->n_sa); // sa
+  if(0 < sa->n_dense) {
+      n += 3 * sizeof(tmap_bwt_int_t) * sa->n_dense; // dense_k, dense_l, dense_offset
+      n += tmap_sa_entries_num_bytes(sa, sa->n_dense_sa); // dense_sa
+  }
 
-  return n;
+  return __tmap_packed_align(n);
 }
 
 size_t
@@ -131,9 +334,11 @@ tmap_sa_shm_read_num_bytes(const char *fn_fasta)
   }
 
   sa->n_sa = (sa->seq_len + sa->sa_intv) / sa->sa_intv;
+  tmap_sa_set_width(sa, sa->seq_len); // as tmap_sa_read packs it
 
   // No need to read in sa->sa
   sa->sa = NULL;
+  tmap_sa_dense_read(fn_fasta, sa, 0);
 
   tmap_file_fclose(fp_sa);
   free(fn_sa);
@@ -151,21 +356,33 @@ tmap_sa_shm_read_num_bytes(const char *fn_fasta)
 uint8_t *
 tmap_sa_shm_pack(tmap_sa_t *sa, uint8_t *buf)
 {
+  uint8_t *start = buf;
   // fixed length data
   memcpy(buf, &sa->primary, sizeof(tmap_bwt_int_t)); buf += sizeof(tmap_bwt_int_t);
   memcpy(buf, &sa->sa_intv, sizeof(tmap_bwt_int_t)); buf += sizeof(tmap_bwt_int_t);
   memcpy(buf, &sa->seq_len, sizeof(tmap_bwt_int_t)); buf += sizeof(tmap_bwt_int_t);
   memcpy(buf, &sa->n_sa, sizeof(tmap_bwt_int_t)); buf += sizeof(tmap_bwt_int_t);
+  memcpy(buf, &sa->sa_width, sizeof(uint32_t)); buf += sizeof(uint32_t);
+  memcpy(buf, &sa->n_dense, sizeof(tmap_bwt_int_t)); buf += sizeof(tmap_bwt_int_t);
+  memcpy(buf, &sa->n_dense_sa, sizeof(tmap_bwt_int_t)); buf += sizeof(tmap_bwt_int_t);
   // variable length data
-  memcpy(buf, sa->sa, sa->n_sa*sizeof(tmap_bwt_int_t)); buf += sa->n_sa*sizeof(tmap_bwt_int_t);
+  buf = tmap_packed_pad(start, buf);
+  memcpy(buf, sa->sa, tmap_sa_entries_num_bytes(sa, sa->n_sa)); buf += tmap_sa_entries_num_bytes(sa, sa->n_sa);
+  if(0 < sa->n_dense) {
+      memcpy(buf, sa->dense_k, sizeof(tmap_bwt_int_t) * sa->n_dense); buf += sizeof(tmap_bwt_int_t) * sa->n_dense;
+      memcpy(buf, sa->dense_l, sizeof(tmap_bwt_int_t) * sa->n_dense); buf += sizeof(tmap_bwt_int_t) * sa->n_dense;
+      memcpy(buf, sa->dense_offset, sizeof(tmap_bwt_int_t) * sa->n_dense); buf += sizeof(tmap_bwt_int_t) * sa->n_dense;
+      memcpy(buf, sa->dense_sa, tmap_sa_entries_num_bytes(sa, sa->n_dense_sa)); buf += tmap_sa_entries_num_bytes(sa, sa->n_dense_sa);
+  }
 
-  return buf;
+  return tmap_packed_pad(start, buf);
 }
 
 tmap_sa_t *
 tmap_sa_shm_unpack(uint8_t *buf)
 {
   tmap_sa_t *sa = NULL;
+  uint8_t *start = buf;
 
   if(NULL == buf) return NULL;
 
@@ -176,9 +393,22 @@ tmap_sa_shm_unpack(uint8_t *buf)
   memcpy(&sa->sa_intv, buf, sizeof(tmap_bwt_int_t)); buf += sizeof(tmap_bwt_int_t);
   memcpy(&sa->seq_len, buf, sizeof(tmap_bwt_int_t)); buf += sizeof(tmap_bwt_int_t);
   memcpy(&sa->n_sa, buf, sizeof(tmap_bwt_int_t)); buf += sizeof(tmap_bwt_int_t);
+  memcpy(&sa->sa_width, buf, sizeof(uint32_t)); buf += sizeof(uint32_t);
+  if(0 != sa->sa_width) {
+      sa->sa_mask = (((uint64_t)1) << sa->sa_width) - 1;
+  }
+  memcpy(&sa->n_dense, buf, sizeof(tmap_bwt_int_t)); buf += sizeof(tmap_bwt_int_t);
+  memcpy(&sa->n_dense_sa, buf, sizeof(tmap_bwt_int_t)); buf += sizeof(tmap_bwt_int_t);
   // variable length data
+  buf = start + __tmap_packed_align(buf - start);
   sa->sa = (tmap_bwt_int_t*)buf;
-  buf += sa->n_sa*sizeof(tmap_bwt_int_t);
+  buf += tmap_sa_entries_num_bytes(sa, sa->n_sa);
+  if(0 < sa->n_dense) {
+      sa->dense_k = (tmap_bwt_int_t*)buf; buf += sizeof(tmap_bwt_int_t) * sa->n_dense;
+      sa->dense_l = (tmap_bwt_int_t*)buf; buf += sizeof(tmap_bwt_int_t) * sa->n_dense;
+      sa->dense_offset = (tmap_bwt_int_t*)buf; buf += sizeof(tmap_bwt_int_t) * sa->n_dense;
+      sa->dense_sa = (tmap_bwt_int_t*)buf; buf += tmap_sa_entries_num_bytes(sa, sa->n_dense_sa);
+  }
   
   sa->sa_intv_log2 = tmap_log2(sa->sa_intv);
 
@@ -187,14 +417,52 @@ tmap_sa_shm_unpack(uint8_t *buf)
   return sa;
 }
 
+tmap_sa_t *
+tmap_sa_replicate(const tmap_sa_t *sa, int32_t huge_pages, int32_t node)
+{
+  tmap_sa_t *replica = NULL;
+
+  replica = tmap_malloc(sizeof(tmap_sa_t), "replica");
+  memcpy(replica, sa, sizeof(tmap_sa_t));
+
+  // copy the entries onto the node
+  replica->sa = tmap_placement_alloc(tmap_sa_entries_num_bytes(sa, sa->n_sa), huge_pages, TMAP_PLACEMENT_NUMA_REPLICATE, node);
+  memcpy(replica->sa, sa->sa, tmap_sa_entries_num_bytes(sa, sa->n_sa));
+  replica->is_placed = 1;
+  replica->huge_pages = huge_pages;
+  replica->is_shm = 0;
+
+  // the fully stored intervals are small, so are copied wherever malloc places them
+  if(0 < sa->n_dense) {
+      replica->dense_k = tmap_malloc(sizeof(tmap_bwt_int_t) * sa->n_dense, "replica->dense_k");
+      replica->dense_l = tmap_malloc(sizeof(tmap_bwt_int_t) * sa->n_dense, "replica->dense_l");
+      replica->dense_offset = tmap_malloc(sizeof(tmap_bwt_int_t) * sa->n_dense, "replica->dense_offset");
+      replica->dense_sa = tmap_malloc(tmap_sa_entries_num_bytes(sa, sa->n_dense_sa), "replica->dense_sa");
+      memcpy(replica->dense_k, sa->dense_k, sizeof(tmap_bwt_int_t) * sa->n_dense);
+      memcpy(replica->dense_l, sa->dense_l, sizeof(tmap_bwt_int_t) * sa->n_dense);
+      memcpy(replica->dense_offset, sa->dense_offset, sizeof(tmap_bwt_int_t) * sa->n_dense);
+      memcpy(replica->dense_sa, sa->dense_sa, tmap_sa_entries_num_bytes(sa, sa->n_dense_sa));
+  }
+
+  return replica;
+}
+
 void 
 tmap_sa_destroy(tmap_sa_t *sa)
 {
+  if(1 == sa->is_placed) {
+      tmap_placement_free(sa->sa, tmap_sa_entries_num_bytes(sa, sa->n_sa), sa->huge_pages);
+      sa->sa = NULL;
+  }
   if(1 == sa->is_shm) {
   free(sa);
   }
   else {
   free(sa->sa);
+  free(sa->dense_k);
+  free(sa->dense_l);
+  free(sa->dense_offset);
+  free(sa->dense_sa);
   free(sa);
   }
 }
@@ -211,12 +479,98 @@ tmap_bwt_int_t
 tmap_sa_pac_pos_hash(const tmap_sa_t *sa, const tmap_bwt_t *bwt, tmap_bwt_int_t k, tmap_bwt_match_hash_t *hash)
 {
   uint32_t s = 0;
-  if(1 == sa->sa_intv) return sa->sa[k];
+  tmap_bwt_int_t i;
+  if(1 == sa->sa_intv) return tmap_sa_entry(sa, k);
+  if(0 < sa->n_dense && (i = tmap_sa_dense_find(sa, k)) < sa->n_dense) { // a frequent k-mer
+      return tmap_sa_unpack(sa, sa->dense_sa, sa->dense_offset[i] + k - sa->dense_k[i]);
+  }
   k = tmap_bwt_match_hash_invPsi(bwt, sa->sa_intv, k, &s, hash);
-  return s + sa->sa[k >> sa->sa_intv_log2];
+  return s + tmap_sa_entry(sa, k >> sa->sa_intv_log2);
   //return s + sa->sa[k/sa->sa_intv];
 }
 
+// prefetches the ith sampled entry
+#ifdef __GNUC__
+#define __tmap_sa_prefetch_entry(sa, i) \
+  __builtin_prefetch((0 == (sa)->sa_width) ? (const void*)((sa)->sa + (i)) : (const void*)((const uint8_t*)(sa)->sa + (((uint64_t)(i) * (sa)->sa_width) >> 3)))
+#else
+#define __tmap_sa_prefetch_entry(sa, i)
+#endif
+
+void
+tmap_sa_pac_pos_batch(const tmap_sa_t *sa, const tmap_bwt_t *bwt, int32_t n, const tmap_bwt_int_t *k, tmap_bwt_int_t *pos, 
+                      tmap_bwt_match_hash_t *hash)
+{
+  int32_t i, j, m, n_active;
+  int32_t active[TMAP_SA_PAC_POS_BATCH_SIZE];
+  tmap_bwt_int_t cur[TMAP_SA_PAC_POS_BATCH_SIZE];
+  uint32_t s[TMAP_SA_PAC_POS_BATCH_SIZE];
+  uint8_t is_dense[TMAP_SA_PAC_POS_BATCH_SIZE];
+  tmap_bwt_match_occ_t prev, next;
+  tmap_bwt_int_t d;
+  uint8_t b0;
+
+  if(1 == sa->sa_intv) {
+      for(i=0;i<n;i++) {
+          pos[i] = tmap_sa_entry(sa, k[i]);
+      }
+      return;
+  }
+
+  prev.l = TMAP_BWT_INT_MAX;
+  prev.offset = UINT32_MAX; // do not use the bwt hash
+  prev.hi = TMAP_BWT_INT_MAX;
+  for(m=0;m<n;m+=TMAP_SA_PAC_POS_BATCH_SIZE) {
+      // initialize, as in tmap_sa_pac_pos_hash
+      for(i=m,n_active=0;i<n && i<m+TMAP_SA_PAC_POS_BATCH_SIZE;i++) {
+          cur[i-m] = k[i];
+          s[i-m] = 0;
+          is_dense[i-m] = 0;
+          if(0 < sa->n_dense && (d = tmap_sa_dense_find(sa, k[i])) < sa->n_dense) { // a frequent k-mer
+              cur[i-m] = tmap_sa_unpack(sa, sa->dense_sa, sa->dense_offset[d] + k[i] - sa->dense_k[d]);
+              is_dense[i-m] = 1;
+          }
+          else if(0 != (cur[i-m] & (sa->sa_intv-1))) {
+              active[n_active++] = i-m;
+          }
+      }
+      // step all the walks back one base at a time, as in tmap_bwt_match_hash_invPsi
+      while(0 < n_active) {
+          for(j=0;j<n_active;j++) {
+              tmap_bwt_prefetch_occ(bwt, cur[active[j]]);
+          }
+          for(i=j=0;j<n_active;j++) {
+              int32_t a = active[j];
+              s[a]++;
+              if(TMAP_LIKELY(cur[a] != bwt->primary)) { // likely
+                  if(cur[a] < bwt->primary) {
+                      b0 = tmap_bwt_B0(bwt, cur[a]);
+                  }
+                  else {
+                      b0 = tmap_bwt_B0(bwt, cur[a]-1);
+                  }
+                  prev.k = cur[a] + 1; // since k-1 will be used in tmap_bwt_match_hash_occ
+                  tmap_bwt_match_hash_occ(bwt, &prev, b0, &next, hash); 
+                  cur[a] = next.k - 1; // since there was an extra one added in tmap_bwt_match_hash_occ
+              }
+              else {
+                  cur[a] = 0;
+              }
+              if(0 != (cur[a] & (sa->sa_intv-1))) active[i++] = a; // keep going
+          }
+          n_active = i;
+      }
+      // the sampled entries
+      for(i=m;i<n && i<m+TMAP_SA_PAC_POS_BATCH_SIZE;i++) {
+          if(0 == is_dense[i-m]) __tmap_sa_prefetch_entry(sa, cur[i-m] >> sa->sa_intv_log2);
+      }
+      for(i=m;i<n && i<m+TMAP_SA_PAC_POS_BATCH_SIZE;i++) {
+          if(1 == is_dense[i-m]) pos[i] = cur[i-m];
+          else pos[i] = s[i-m] + tmap_sa_entry(sa, cur[i-m] >> sa->sa_intv_log2);
+      }
+  }
+}
+
 tmap_bwt_int_t 
 tmap_sa_pac_pos(const tmap_sa_t *sa, const tmap_bwt_t *bwt, tmap_bwt_int_t k)
 {
@@ -246,13 +600,465 @@ tmap_sa_pac_pos(const tmap_sa_t *sa, const tmap_bwt_t *bwt, tmap_bwt_int_t k)
 
 extern int32_t debug_on;
 
+/*! d TMAP_SA_BWT2SA_BUFFER
+  the number of suffix array entries each thread buffers for each partition
+  before writing them to the partition's temporary file
+  */
+#define TMAP_SA_BWT2SA_BUFFER 4096
+
+/*! d TMAP_SA_BWT2SA_MAX_PARTS
+  the maximum number of temporary files used to construct the SA
+  */
+#define TMAP_SA_BWT2SA_MAX_PARTS 256
+
+// the sampled suffix array being constructed, held in memory, or written to
+// a temporary file for each partition of its indexes when it does not fit
+typedef struct {
+    tmap_sa_t *sa;
+    tmap_bwt_int_t part_size; // the number of indexes in each partition, zero when in memory
+    int32_t num_parts;
+    char **fns;
+    FILE **fps;
+#ifdef HAVE_LIBPTHREAD
+    pthread_mutex_t *locks;
+#endif
+} tmap_sa_bwt2sa_out_t;
+
+// the suffix array index and value pairs buffered for each partition
+typedef struct {
+    tmap_bwt_int_t *entries;
+    int32_t *n;
+} tmap_sa_bwt2sa_buf_t;
+
+static void
+tmap_sa_bwt2sa_out_init(tmap_sa_bwt2sa_out_t *out, const char *fn_fasta, tmap_sa_t *sa, tmap_bwt_int_t part_size)
+{
+  char *fn_sa = NULL;
+  int32_t i;
+
+  memset(out, 0, sizeof(tmap_sa_bwt2sa_out_t));
+  out->sa = sa;
+  if(sa->n_sa <= part_size) { // in memory
+      sa->sa = tmap_calloc(sa->n_sa, sizeof(tmap_bwt_int_t), "sa->sa");
+      return;
+  }
+
+  out->part_size = part_size;
+  out->num_parts = (sa->n_sa + part_size - 1) / part_size;
+  out->fns = tmap_calloc(out->num_parts, sizeof(char*), "out->fns");
+  out->fps = tmap_calloc(out->num_parts, sizeof(FILE*), "out->fps");
+#ifdef HAVE_LIBPTHREAD
+  out->locks = tmap_calloc(out->num_parts, sizeof(pthread_mutex_t), "out->locks");
+#endif
+  fn_sa = tmap_get_file_name(fn_fasta, TMAP_SA_FILE);
+  for(i=0;i<out->num_parts;i++) {
+      out->fns[i] = tmap_malloc(sizeof(char) * (strlen(fn_sa) + 32), "out->fns[i]");
+      sprintf(out->fns[i], "%s.%d.tmp", fn_sa, i);
+      if(NULL == (out->fps[i] = fopen(out->fns[i], "w+b"))) {
+          tmap_error(out->fns[i], Exit, OpenFileError);
+      }
+#ifdef HAVE_LIBPTHREAD
+      pthread_mutex_init(&out->locks[i], NULL);
+#endif
+  }
+  free(fn_sa);
+  tmap_progress_print2("writing the SA to %d temporary files of %llu entries", 
+                       out->num_parts, (unsigned long long)part_size);
+}
+
+static void
+tmap_sa_bwt2sa_buf_init(tmap_sa_bwt2sa_out_t *out, tmap_sa_bwt2sa_buf_t *buf)
+{
+  buf->entries = NULL;
+  buf->n = NULL;
+  if(0 == out->part_size) return;
+  buf->entries = tmap_malloc(sizeof(tmap_bwt_int_t) * 2 * TMAP_SA_BWT2SA_BUFFER * out->num_parts, "buf->entries");
+  buf->n = tmap_calloc(out->num_parts, sizeof(int32_t), "buf->n");
+}
+
+static void
+tmap_sa_bwt2sa_buf_flush(tmap_sa_bwt2sa_out_t *out, tmap_sa_bwt2sa_buf_t *buf, int32_t p)
+{
+  if(0 == buf->n[p]) return;
+#ifdef HAVE_LIBPTHREAD
+  pthread_mutex_lock(&out->locks[p]);
+#endif
+  if(2 * buf->n[p] != fwrite(buf->entries + (size_t)p * 2 * TMAP_SA_BWT2SA_BUFFER, sizeof(tmap_bwt_int_t), 2 * buf->n[p], out->fps[p])) {
+      tmap_error(out->fns[p], Exit, WriteFileError);
+  }
+#ifdef HAVE_LIBPTHREAD
+  pthread_mutex_unlock(&out->locks[p]);
+#endif
+  buf->n[p] = 0;
+}
+
+static void
+tmap_sa_bwt2sa_buf_destroy(tmap_sa_bwt2sa_out_t *out, tmap_sa_bwt2sa_buf_t *buf)
+{
+  int32_t i;
+  if(0 == out->part_size) return;
+  for(i=0;i<out->num_parts;i++) {
+      tmap_sa_bwt2sa_buf_flush(out, buf, i);
+  }
+  free(buf->entries);
+  free(buf->n);
+}
+
+// writes the suffix array one partition at a time, and removes the temporary files
+static void
+tmap_sa_bwt2sa_out_write(tmap_sa_bwt2sa_out_t *out, const char *fn_fasta)
+{
+  tmap_sa_t *sa = out->sa;
+  char *fn_sa = NULL;
+  tmap_file_t *fp_sa = NULL;
+  tmap_bwt_int_t *part = NULL, *entries = NULL;
+  tmap_bwt_int_t lo, hi;
+  size_t i, n;
+  int32_t p;
+
+  if(0 == out->part_size) {
+      sa->sa[0] = (tmap_bwt_int_t)-1; // before this line, bwt->sa[0] = bwt->seq_len
+      tmap_sa_write(fn_fasta, sa);
+      return;
+  }
+
+  fn_sa = tmap_get_file_name(fn_fasta, TMAP_SA_FILE);
+  fp_sa = tmap_file_fopen(fn_sa, "wb", TMAP_SA_COMPRESSION);
+  if(1 != tmap_file_fwrite(&sa->primary, sizeof(tmap_bwt_int_t), 1, fp_sa)
+     || 1 != tmap_file_fwrite(&sa->sa_intv, sizeof(tmap_bwt_int_t), 1, fp_sa) 
+     || 1 != tmap_file_fwrite(&sa->seq_len, sizeof(tmap_bwt_int_t), 1, fp_sa)) {
+      tmap_error(NULL, Exit, WriteFileError);
+  }
+
+  part = tmap_malloc(sizeof(tmap_bwt_int_t) * out->part_size, "part");
+  entries = tmap_malloc(sizeof(tmap_bwt_int_t) * 2 * TMAP_SA_BWT2SA_BUFFER, "entries");
+  for(p=0;p<out->num_parts;p++) {
+      lo = p * out->part_size;
+      hi = (sa->n_sa < lo + out->part_size) ? sa->n_sa : lo + out->part_size;
+      rewind(out->fps[p]);
+      while(0 < (n = fread(entries, sizeof(tmap_bwt_int_t), 2 * TMAP_SA_BWT2SA_BUFFER, out->fps[p]))) {
+          for(i=0;i<n;i+=2) {
+              part[entries[i] - lo] = entries[i+1];
+          }
+      }
+      if(0 != ferror(out->fps[p])) {
+          tmap_error(out->fns[p], Exit, ReadFileError);
+      }
+      // NB: the first entry, for the end-of-string suffix, is not stored
+      if(hi - lo - (0 == p) != tmap_file_fwrite(part + (0 == p), sizeof(tmap_bwt_int_t), hi - lo - (0 == p), fp_sa)) {
+          tmap_error(NULL, Exit, WriteFileError);
+      }
+      fclose(out->fps[p]);
+      if(0 != unlink(out->fns[p])) {
+          tmap_error(out->fns[p], Warn, OpenFileError);
+      }
+      free(out->fns[p]);
+#ifdef HAVE_LIBPTHREAD
+      pthread_mutex_destroy(&out->locks[p]);
+#endif
+  }
+  tmap_file_fclose(fp_sa);
+
+  free(part);
+  free(entries);
+  free(fn_sa);
+  free(out->fns);
+  free(out->fps);
+#ifdef HAVE_LIBPTHREAD
+  free(out->locks);
+#endif
+}
+
+// an SA interval to store in full
+typedef struct {
+    tmap_bwt_int_t k;
+    tmap_bwt_int_t l;
+} tmap_sa_bwt2sa_dense_t;
+
+static int
+tmap_sa_bwt2sa_dense_compare(const void *a, const void *b)
+{
+  const tmap_sa_bwt2sa_dense_t *x = (const tmap_sa_bwt2sa_dense_t*)a, *y = (const tmap_sa_bwt2sa_dense_t*)b;
+  if(x->k < y->k) return -1;
+  if(x->k > y->k) return 1;
+  return 0;
+}
+
+// finds the SA intervals of the hash-width k-mers that occur at least
+// dense_occ times, whose entries will all be stored
+static void
+tmap_sa_bwt2sa_dense_init(const tmap_bwt_t *bwt, tmap_sa_t *sa, uint32_t dense_occ)
+{
+  tmap_sa_bwt2sa_dense_t *dense = NULL;
+  uint64_t h, hash_length;
+  tmap_bwt_int_t k, l, i, m;
+
+  if(0 == bwt->hash_width) {
+      tmap_error("the BWT has no k-mer hash, so no SA intervals will be stored in full", Warn, OutOfRange);
+      return;
+  }
+  if(1 == sa->sa_intv) return; // every entry is stored
+
+  hash_length = ((uint64_t)1) << (2 * bwt->hash_width);
+  for(h=0,m=0;h<hash_length;h++) { // count them
+      k = bwt->hash_k[bwt->hash_width-1][h];
+      l = bwt->hash_l[bwt->hash_width-1][h];
+      if(TMAP_BWT_INT_MAX != k && k <= l && dense_occ <= l - k + 1) m++;
+  }
+  if(0 == m) return;
+  dense = tmap_malloc(sizeof(tmap_sa_bwt2sa_dense_t) * m, "dense");
+  for(h=0,m=0;h<hash_length;h++) {
+      k = bwt->hash_k[bwt->hash_width-1][h];
+      l = bwt->hash_l[bwt->hash_width-1][h];
+      if(TMAP_BWT_INT_MAX != k && k <= l && dense_occ <= l - k + 1) {
+          dense[m].k = k;
+          dense[m].l = l;
+          m++;
+      }
+  }
+  // the intervals of k-mers of the same length do not overlap
+  qsort(dense, m, sizeof(tmap_sa_bwt2sa_dense_t), tmap_sa_bwt2sa_dense_compare);
+
+  sa->n_dense = m;
+  sa->dense_k = tmap_malloc(sizeof(tmap_bwt_int_t) * m, "sa->dense_k");
+  sa->dense_l = tmap_malloc(sizeof(tmap_bwt_int_t) * m, "sa->dense_l");
+  sa->dense_offset = tmap_malloc(sizeof(tmap_bwt_int_t) * m, "sa->dense_offset");
+  for(i=0,sa->n_dense_sa=0;i<m;i++) {
+      sa->dense_k[i] = dense[i].k;
+      sa->dense_l[i] = dense[i].l;
+      sa->dense_offset[i] = sa->n_dense_sa;
+      sa->n_dense_sa += dense[i].l - dense[i].k + 1;
+  }
+  sa->dense_sa = tmap_calloc(sa->n_dense_sa, sizeof(tmap_bwt_int_t), "sa->dense_sa");
+  free(dense);
+
+  tmap_progress_print2("storing the %llu SA entries of %llu %d-mers that occur at least %u times", 
+                       (unsigned long long)sa->n_dense_sa, (unsigned long long)sa->n_dense, bwt->hash_width, dense_occ);
+}
+
+// records S(isa) = s if isa is in a fully stored SA interval
+static inline void
+tmap_sa_bwt2sa_dense_put(tmap_sa_t *sa, tmap_bwt_int_t isa, tmap_bwt_int_t s)
+{
+  tmap_bwt_int_t i = tmap_sa_dense_find(sa, isa);
+  if(i < sa->n_dense) {
+      sa->dense_sa[sa->dense_offset[i] + isa - sa->dense_k[i]] = s;
+  }
+}
+
+// records S(isa) = s, stepping to the previous text position until s is end,
+// and returns the suffix array position of end
+static tmap_bwt_int_t
+tmap_sa_bwt2sa_walk(const tmap_bwt_t *bwt, tmap_sa_bwt2sa_out_t *out, tmap_sa_bwt2sa_buf_t *buf, 
+                    tmap_bwt_int_t isa, tmap_bwt_int_t s, tmap_bwt_int_t end)
+{
+  tmap_bwt_int_t intv = out->sa->sa_intv;
+  int32_t p;
+  while(1) {
+      if(isa % intv == 0) {
+          if(0 == out->part_size) {
+              out->sa->sa[isa/intv] = s;
+          }
+          else {
+              p = (isa/intv) / out->part_size;
+              buf->entries[((size_t)p * TMAP_SA_BWT2SA_BUFFER + buf->n[p]) * 2] = isa/intv;
+              buf->entries[((size_t)p * TMAP_SA_BWT2SA_BUFFER + buf->n[p]) * 2 + 1] = s;
+              if(TMAP_SA_BWT2SA_BUFFER == ++buf->n[p]) tmap_sa_bwt2sa_buf_flush(out, buf, p);
+          }
+      }
+      if(0 < out->sa->n_dense) {
+          tmap_sa_bwt2sa_dense_put(out->sa, isa, s);
+      }
+      if(s == end) break;
+      --s;
+      isa = tmap_bwt_invPsi(bwt, isa);
+  }
+  return isa;
+}
+
+#ifdef HAVE_LIBPTHREAD
+/*! d TMAP_SA_BWT2SA_SEGMENTS
+  the number of segments of the inverse-Psi walk per thread
+  */
+#define TMAP_SA_BWT2SA_SEGMENTS 4
+
+/*! d TMAP_SA_BWT2SA_SEED_MAX
+  the maximum length of the backward search for a segment's seed
+  */
+#define TMAP_SA_BWT2SA_SEED_MAX 0x100000
+
+// a text position and its suffix array position, S(isa) = s
+typedef struct {
+    tmap_bwt_int_t s;
+    tmap_bwt_int_t isa;
+} tmap_sa_bwt2sa_seed_t;
+
+typedef struct {
+    const tmap_bwt_t *bwt;
+    tmap_sa_bwt2sa_out_t *out;
+    const tmap_sa_bwt2sa_seed_t *seeds;
+    int32_t num_seeds;
+    int32_t num_threads;
+    int32_t tid;
+} tmap_sa_bwt2sa_thread_data_t;
+
+// the base at position i of the text the BWT was built from, where the
+// packed reference may hold only the forward strand
+static inline uint8_t
+tmap_sa_bwt2sa_text_i(const tmap_refseq_t *refseq, tmap_bwt_int_t i)
+{
+  if(i < refseq->len) return tmap_refseq_seq_i(refseq, i);
+  return 3 - tmap_refseq_seq_i(refseq, 2*refseq->len - 1 - i);
+}
+
+// finds the suffix array position of a text position at or before e, by
+// searching backwards from e until the interval is a single suffix
+static int32_t
+tmap_sa_bwt2sa_seed(const tmap_bwt_t *bwt, const tmap_refseq_t *refseq, tmap_bwt_int_t e, tmap_sa_bwt2sa_seed_t *seed)
+{
+  tmap_bwt_int_t k, l, ok, ol, n;
+  uint8_t c;
+
+  // the interval of text[e-n+1..e]
+  k = 0; l = bwt->seq_len;
+  for(n=0;k < l && n <= e && n < TMAP_SA_BWT2SA_SEED_MAX;n++) {
+      c = tmap_sa_bwt2sa_text_i(refseq, e - n);
+      tmap_bwt_2occ(bwt, k-1, l, c, &ok, &ol);
+      k = bwt->L2[c] + ok + 1;
+      l = bwt->L2[c] + ol;
+  }
+  if(0 == n || k != l) return 0;
+  seed->s = e - n + 1;
+  seed->isa = k;
+  return 1;
+}
+
+static void *
+tmap_sa_bwt2sa_thread_worker(void *arg)
+{
+  tmap_sa_bwt2sa_thread_data_t *data = (tmap_sa_bwt2sa_thread_data_t*)arg;
+  tmap_sa_bwt2sa_buf_t buf;
+  tmap_bwt_int_t isa;
+  int32_t i;
+
+  tmap_sa_bwt2sa_buf_init(data->out, &buf);
+  for(i=data->tid;i<data->num_seeds;i+=data->num_threads) {
+      isa = tmap_sa_bwt2sa_walk(data->bwt, data->out, &buf, data->seeds[i].isa, data->seeds[i].s, 
+                                (0 == i) ? 0 : data->seeds[i-1].s + 1);
+      // the walk must arrive at the previous seed
+      if(0 < i && tmap_bwt_invPsi(data->bwt, isa) != data->seeds[i-1].isa) {
+          tmap_error("the packed FASTA does not match the BWT", Exit, OutOfRange);
+      }
+  }
+  tmap_sa_bwt2sa_buf_destroy(data->out, &buf);
+
+  return arg;
+}
+
+// returns 0 if the packed reference does not match the BWT
+static int32_t
+tmap_sa_bwt2sa_threads(const char *fn_fasta, const tmap_bwt_t *bwt, tmap_sa_bwt2sa_out_t *out, int32_t num_threads)
+{
+  tmap_refseq_t *refseq = NULL;
+  tmap_sa_bwt2sa_seed_t *seeds = NULL;
+  int32_t i, num_seeds, max_seeds;
+  pthread_attr_t attr;
+  pthread_t *threads = NULL;
+  tmap_sa_bwt2sa_thread_data_t *thread_data = NULL;
+
+  // the text, both strands or only the forward strand
+  refseq = tmap_refseq_read(fn_fasta);
+  if(refseq->len != bwt->seq_len && 2 * refseq->len != bwt->seq_len) {
+      tmap_refseq_destroy(refseq);
+      return 0;
+  }
+
+  // seed each segment, the last ending at the end-of-string suffix, which is first
+  max_seeds = num_threads * TMAP_SA_BWT2SA_SEGMENTS;
+  seeds = tmap_calloc(max_seeds, sizeof(tmap_sa_bwt2sa_seed_t), "seeds");
+  for(i=1,num_seeds=0;i<max_seeds;i++) {
+      tmap_bwt_int_t e = (tmap_bwt_int_t)(((uint64_t)bwt->seq_len * i) / max_seeds);
+      if(0 == e) continue;
+      if(0 == tmap_sa_bwt2sa_seed(bwt, refseq, e - 1, &seeds[num_seeds])) continue; // a long repeat
+      if(0 < num_seeds && seeds[num_seeds].s <= seeds[num_seeds-1].s) continue;
+      num_seeds++;
+  }
+  seeds[num_seeds].s = bwt->seq_len;
+  seeds[num_seeds].isa = 0;
+  num_seeds++;
+  tmap_refseq_destroy(refseq);
+  
+  tmap_progress_print2("walking %d segments with %d threads", num_seeds, num_threads);
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+
+  threads = tmap_calloc(num_threads, sizeof(pthread_t), "threads");
+  thread_data = tmap_calloc(num_threads, sizeof(tmap_sa_bwt2sa_thread_data_t), "thread_data");
+
+  for(i=0;i<num_threads;i++) {
+      thread_data[i].bwt = bwt;
+      thread_data[i].out = out;
+      thread_data[i].seeds = seeds;
+      thread_data[i].num_seeds = num_seeds;
+      thread_data[i].num_threads = num_threads;
+      thread_data[i].tid = i;
+      if(0 != pthread_create(&threads[i], &attr, tmap_sa_bwt2sa_thread_worker, &thread_data[i])) {
+          tmap_error("error creating threads", Exit, ThreadError);
+      }
+  }
+  for(i=0;i<num_threads;i++) {
+      if(0 != pthread_join(threads[i], NULL)) {
+          tmap_error("error joining threads", Exit, ThreadError);
+      }
+  }
+
+  free(threads);
+  free(thread_data);
+  free(seeds);
+
+  return 1;
+}
+#endif
+
+// walks the whole text on one thread
+static void
+tmap_sa_bwt2sa_single(const tmap_bwt_t *bwt, tmap_sa_bwt2sa_out_t *out)
+{
+  tmap_sa_bwt2sa_buf_t buf;
+  tmap_sa_bwt2sa_buf_init(out, &buf);
+  tmap_sa_bwt2sa_walk(bwt, out, &buf, 0, bwt->seq_len, 0);
+  tmap_sa_bwt2sa_buf_destroy(out, &buf);
+}
+
+// returns the number of SA entries in each temporary file, so that the entries
+// of one file fit in the memory left after the given bytes and the buffers of
+// every file, or zero if the memory limit is too small
+static tmap_bwt_int_t
+tmap_sa_bwt2sa_part_size(tmap_bwt_int_t n_sa, uint64_t max_memory, uint64_t bytes, int32_t num_threads)
+{
+  uint64_t buf_bytes;
+  int32_t num_parts;
+
+  // each thread buffers entries for each file, which also has a stdio buffer
+  buf_bytes = sizeof(tmap_bwt_int_t) * 2 * TMAP_SA_BWT2SA_BUFFER * num_threads + BUFSIZ;
+  for(num_parts=2;num_parts<=TMAP_SA_BWT2SA_MAX_PARTS;num_parts++) {
+      if(max_memory < bytes + buf_bytes * num_parts) break;
+      if(n_sa <= ((max_memory - bytes - buf_bytes * num_parts) / sizeof(tmap_bwt_int_t)) * num_parts) {
+          return (n_sa + num_parts - 1) / num_parts;
+      }
+  }
+  return 0;
+}
+
 void
-tmap_sa_bwt2sa(const char *fn_fasta, uint32_t intv)
+tmap_sa_bwt2sa(const char *fn_fasta, uint32_t intv, int32_t num_threads, uint64_t max_memory, uint32_t dense_occ)
 {
-  int64_t isa, s; // S(isa) = sa
-  uint64_t i;
   tmap_bwt_t *bwt = NULL;
   tmap_sa_t *sa = NULL;
+  tmap_sa_bwt2sa_out_t out;
+  tmap_bwt_int_t part_size;
+  uint64_t bwt_bytes;
 
   tmap_progress_print("constructing the SA from the BWT string");
 
@@ -265,18 +1071,50 @@ tmap_sa_bwt2sa(const char *fn_fasta, uint32_t intv)
   sa->seq_len = bwt->seq_len;
   sa->n_sa = (bwt->seq_len + intv) / intv;
 
+  // the SA intervals of frequent k-mers, stored in full
+  if(0 < dense_occ) {
+      tmap_sa_bwt2sa_dense_init(bwt, sa, dense_occ);
+  }
+
+  // the walk counts with the occurrence array alone, so the hash only takes memory
+  tmap_bwt_destroy_hash(bwt);
+
+  // the SA is written through temporary files when it does not fit in memory with the BWT
+  part_size = sa->n_sa;
+  bwt_bytes = tmap_bwt_shm_num_bytes(bwt);
+  bwt_bytes += sizeof(tmap_bwt_int_t) * (3 * sa->n_dense + sa->n_dense_sa); // held in memory too
+#ifdef HAVE_LIBPTHREAD
+  if(1 < num_threads) {
+      bwt_bytes += tmap_refseq_shm_read_num_bytes(fn_fasta); // read to seed the threads
+  }
+#else
+  num_threads = 1;
+#endif
+  if(0 < max_memory && max_memory < bwt_bytes + sa->n_sa * sizeof(tmap_bwt_int_t)) {
+      part_size = tmap_sa_bwt2sa_part_size(sa->n_sa, max_memory, bwt_bytes, num_threads);
+      if(0 == part_size) {
+          tmap_error("the memory limit is too small to hold the BWT and part of the SA", Exit, OutOfRange);
+      }
+  }
+  tmap_sa_bwt2sa_out_init(&out, fn_fasta, sa, part_size);
+
   // calculate SA value
-  sa->sa = tmap_calloc(sa->n_sa, sizeof(tmap_bwt_int_t), "sa->sa");
-  isa = 0; s = bwt->seq_len;
-  for(i = 0; i < bwt->seq_len; ++i) {
-      if(isa % intv == 0) sa->sa[isa/intv] = s;
-      --s;
-      isa = tmap_bwt_invPsi(bwt, isa);
+#ifdef HAVE_LIBPTHREAD
+  if(1 < num_threads) {
+      if(0 == tmap_sa_bwt2sa_threads(fn_fasta, bwt, &out, num_threads)) {
+          tmap_error("the packed FASTA does not match the BWT, using one thread", Warn, OutOfRange);
+          tmap_sa_bwt2sa_single(bwt, &out);
+      }
   }
-  if(isa % intv == 0) sa->sa[isa/intv] = s;
-  sa->sa[0] = (tmap_bwt_int_t)-1; // before this line, bwt->sa[0] = bwt->seq_len
+  else {
+      tmap_sa_bwt2sa_single(bwt, &out);
+  }
+#else
+  tmap_sa_bwt2sa_single(bwt, &out);
+#endif
 
-  tmap_sa_write(fn_fasta, sa);
+  tmap_sa_bwt2sa_out_write(&out, fn_fasta);
+  tmap_sa_dense_write(fn_fasta, sa);
 
   tmap_bwt_destroy(bwt);
   tmap_sa_destroy(sa);
@@ -941,25 +1779,41 @@ tmap_sa_gen_short(const uint8_t *T, int32_t *SA, uint32_t n)
 int
 tmap_sa_bwt2sa_main(int argc, char *argv[])
 {
-  int c, intv = TMAP_SA_INTERVAL, help=0;
+  int c, intv = TMAP_SA_INTERVAL, num_threads = 1, max_memory = 0, dense_occ = 0, help=0;
+  struct option options[] = {
+      {"max-memory", required_argument, 0, 'M'},
+      {0, 0, 0, 0}
+  };
 
-  while((c = getopt(argc, argv, "i:vh")) >= 0) {
+  while((c = getopt_long(argc, argv, "i:n:M:d:vh", options, NULL)) >= 0) {
       switch(c) {
         case 'i': intv = atoi(optarg); break;
+        case 'd': dense_occ = atoi(optarg); break;
+        case 'n': num_threads = atoi(optarg); break;
+        case 'M': max_memory = atoi(optarg); break;
         case 'v': tmap_progress_set_verbosity(1); break;
         case 'h': help = 1; break;
         default: return 1;
       }
   }
   if(1 != argc - optind || 1 == help) {
-      tmap_file_fprintf(tmap_file_stderr, "Usage: %s %s [-i INT -vh] <in.fasta>\n", PACKAGE, argv[0]);
+      tmap_file_fprintf(tmap_file_stderr, "Usage: %s %s [-i INT -n INT -M INT -d INT -vh] <in.fasta>\n", PACKAGE, argv[0]);
       return 1;
   }
   if(intv <= 0 || (1 < intv && 0 != (intv % 2))) {
       tmap_error("option -i out of range", Exit, CommandLineArgument);
   }
+  if(num_threads <= 0) {
+      tmap_error("option -n out of range", Exit, CommandLineArgument);
+  }
+  if(max_memory < 0) {
+      tmap_error("option -M out of range", Exit, CommandLineArgument);
+  }
+  if(dense_occ < 0) {
+      tmap_error("option -d out of range", Exit, CommandLineArgument);
+  }
 
-  tmap_sa_bwt2sa(argv[optind], intv);
+  tmap_sa_bwt2sa(argv[optind], intv, num_threads, (uint64_t)max_memory << 20, dense_occ);
 
   return 0;
 }
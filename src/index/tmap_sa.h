@@ -5,6 +5,7 @@
 #define TMAP_SA_INTERVAL 32
 
 #include <stdint.h>
+#include <string.h>
 #include "tmap_bwt.h"
 #include "tmap_bwt_match.h"
 #include "tmap_bwt_match_hash.h"
@@ -20,22 +21,81 @@ typedef struct {
     uint32_t sa_intv;  /*!< the suffix array interval (sampled) */
     tmap_bwt_int_t seq_len;  /*!< the length of the reference sequence */
     tmap_bwt_int_t n_sa;  /*!< number of suffix array entries */
-    tmap_bwt_int_t *sa;  /*!< pointer to the suffix array entries */
+    tmap_bwt_int_t *sa;  /*!< pointer to the suffix array entries, or to the packed entries if sa_width is non-zero */
+    uint32_t sa_width;  /*!< the number of bits in each packed entry, or zero if the entries are not packed */
     uint32_t is_shm;  /*!< 1 if loaded from shared memory, 0 otherwise */
     // Not stored in the file
+    uint32_t is_placed;  /*!< 1 if the suffix array entries were allocated with tmap_placement_alloc, 0 otherwise */
+    int32_t huge_pages;  /*!< the page size of the suffix array entries if placed (TMAP_PLACEMENT_HUGE_PAGES_*) */
     uint32_t sa_intv_log2;  /*!< the log2 suffix array interval (sampled) */
+    uint64_t sa_mask;  /*!< the mask of the bits in a packed entry */
+    tmap_bwt_int_t n_dense;  /*!< the number of SA intervals whose entries are all stored */
+    tmap_bwt_int_t n_dense_sa;  /*!< the number of entries in the fully stored SA intervals */
+    tmap_bwt_int_t *dense_k;  /*!< the lower bound of each fully stored SA interval, in increasing order */
+    tmap_bwt_int_t *dense_l;  /*!< the upper bound of each fully stored SA interval */
+    tmap_bwt_int_t *dense_offset;  /*!< the index in dense_sa of the entry for the lower bound of each fully stored SA interval */
+    tmap_bwt_int_t *dense_sa;  /*!< the entries of the fully stored SA intervals, packed as the sampled entries */
 } tmap_sa_t;
 
+/*! 
+  @param  sa       the suffix array
+  @param  entries  the sampled or the fully stored entries of sa
+  @param  i        the index of the entry
+  @return          the ith entry
+  @details         packed entries are stored plus one, so that S(0) = -1 is
+  stored as zero, and are read with one unaligned 64-bit load
+  */
+static inline tmap_bwt_int_t
+tmap_sa_unpack(const tmap_sa_t *sa, const tmap_bwt_int_t *entries, tmap_bwt_int_t i)
+{
+  uint64_t b, x;
+  if(0 == sa->sa_width) return entries[i];
+  b = (uint64_t)i * sa->sa_width;
+  memcpy(&x, (const uint8_t*)entries + (b >> 3), sizeof(uint64_t));
+  return (tmap_bwt_int_t)(((x >> (b & 7)) & sa->sa_mask) - 1);
+}
+
+/*! 
+  @param  sa  the suffix array
+  @param  i   the index of the sampled entry
+  @return     the ith sampled suffix array entry
+  */
+static inline tmap_bwt_int_t
+tmap_sa_entry(const tmap_sa_t *sa, tmap_bwt_int_t i)
+{
+  return tmap_sa_unpack(sa, sa->sa, i);
+}
+
 /*! 
   @param  fn_fasta  the FASTA file name
   @return           pointer to the sa structure 
+  @details          the entries are packed into as many bits as the longest position needs, and
+  the fully stored SA intervals are read too if they were constructed
   */
 tmap_sa_t *
 tmap_sa_read(const char *fn_fasta);
 
+/*! 
+  @param  fn_fasta    the FASTA file name
+  @param  huge_pages  the page size of the suffix array entries (TMAP_PLACEMENT_HUGE_PAGES_*)
+  @param  numa        the NUMA placement of the suffix array entries (TMAP_PLACEMENT_NUMA_*)
+  @return             pointer to the sa structure 
+  */
+tmap_sa_t *
+tmap_sa_read_placed(const char *fn_fasta, int32_t huge_pages, int32_t numa);
+
+/*! 
+  @param  sa          the sa structure to replicate
+  @param  huge_pages  the page size of the copied entries (TMAP_PLACEMENT_HUGE_PAGES_*)
+  @param  node        the NUMA node on which to place the copied entries
+  @return             pointer to the replicated sa structure 
+  */
+tmap_sa_t *
+tmap_sa_replicate(const tmap_sa_t *sa, int32_t huge_pages, int32_t node);
+
 /*! 
   @param  fn_fasta  the FASTA file name
-  @param  sa        the sa structure to write
+  @param  sa        the sa structure to write, with entries that are not packed
   */
 void
 tmap_sa_write(const char *fn_fasta, tmap_sa_t *sa);
@@ -66,6 +126,7 @@ tmap_sa_shm_read_num_bytes(const char *fn_fasta);
   @param  sa  the sa structure to pack 
   @param  buf  the byte array in which to pack the sa data
   @return      a pointer to the next unused byte in memory
+  @details     the suffix array is aligned to TMAP_PACKED_ALIGNMENT relative to buf
   */
 uint8_t *
 tmap_sa_shm_pack(tmap_sa_t *sa, uint8_t *buf);
@@ -94,6 +155,28 @@ tmap_sa_destroy(tmap_sa_t *sa);
 tmap_bwt_int_t
 tmap_sa_pac_pos_hash(const tmap_sa_t *sa, const tmap_bwt_t *bwt, tmap_bwt_int_t k, tmap_bwt_match_hash_t *hash);
 
+/*!
+  the maximum number of suffix array positions located together by tmap_sa_pac_pos_batch
+  */
+#define TMAP_SA_PAC_POS_BATCH_SIZE 32
+
+/*! 
+  returns the pac positions given many suffix array positions
+  @param  sa    the suffix array
+  @param  bwt   the bwt structure 
+  @param  n     the number of suffix array positions
+  @param  k     the suffix array positions, from any number of intervals or reads
+  @param  pos   the pac positions returned in the same order as k, which may be the same array as k
+  @param  hash  the user occurence hash
+  @details      the results are the same as calling tmap_sa_pac_pos_hash on
+  each position, but the walks to the sampled suffix array entries are
+  stepped together, prefetching the occurrence arrays each needs next, so
+  that their cache misses overlap rather than follow one another
+*/
+void
+tmap_sa_pac_pos_batch(const tmap_sa_t *sa, const tmap_bwt_t *bwt, int32_t n, const tmap_bwt_int_t *k, tmap_bwt_int_t *pos, 
+                      tmap_bwt_match_hash_t *hash);
+
 /*! 
   returns the suffix array position given the occurrence position
   @param  sa   the suffix array
@@ -105,11 +188,21 @@ tmap_bwt_int_t
 tmap_sa_pac_pos(const tmap_sa_t *sa, const tmap_bwt_t *bwt, tmap_bwt_int_t k);
 
 /*! 
-  @param  fn_fasta  the FASTA file name
-  @param  intv      the suffix array interval
+  @param  fn_fasta     the FASTA file name
+  @param  intv         the suffix array interval
+  @param  num_threads  the number of threads
+  @param  max_memory   the bytes of memory for the BWT, SA, reference, and temporary file buffers, or zero for no limit
+  @param  dense_occ    store every entry of the SA intervals of the hash-width k-mers that occur at least this many times, or zero for none
+  @details             with more than one thread, the inverse-Psi walk is split
+  into segments, each starting from a text position whose suffix array
+  position is found by a unique backward search of the packed FASTA.  When
+  the SA does not fit in memory with the BWT, the sampled entries are written
+  to a temporary file for each partition of the SA, and the SA is then
+  written one partition at a time.  The fully stored intervals let repeats be
+  located without walking to a sampled entry.
   */
 void
-tmap_sa_bwt2sa(const char *fn_fasta, uint32_t intv);
+tmap_sa_bwt2sa(const char *fn_fasta, uint32_t intv, int32_t num_threads, uint64_t max_memory, uint32_t dense_occ);
 
 /*! 
   constructs the suffix array of a given string.
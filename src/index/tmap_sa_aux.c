@@ -164,6 +164,6 @@ tmap_sa_pac_pos_aux(const tmap_sa_t *sa, const tmap_bwt_t *bwt, tmap_bwt_int_t k
   }
   /* without setting bwt->sa[0] = -1, the following line should be
      changed to (s + bwt->sa[k/bwt->sa_intv]) % (bwt->seq_len + 1) */
-  return s + sa->sa[k/sa->sa_intv];
+  return s + tmap_sa_entry(sa, k/sa->sa_intv);
 }
 #endif
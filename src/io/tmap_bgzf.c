@@ -0,0 +1,342 @@
+/* Copyright (C) 2010 Ion Torrent Systems, Inc. All Rights Reserved */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <zlib.h>
+#include <config.h>
+
+#include "../util/tmap_error.h"
+#include "../util/tmap_alloc.h"
+#include "tmap_bgzf.h"
+
+#ifdef HAVE_LIBPTHREAD
+
+// the number of bytes in the BGZF block header and footer
+#define TMAP_BGZF_HEADER_SIZE 18
+#define TMAP_BGZF_FOOTER_SIZE 8
+
+// the number of blocks in the ring per compression thread
+#define TMAP_BGZF_BLOCKS_PER_THREAD 4
+
+static const uint8_t tmap_bgzf_header[TMAP_BGZF_HEADER_SIZE] = {
+    31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 'B', 'C', 2, 0, 0, 0
+};
+
+// the empty block marking the end of a BGZF file
+static const uint8_t tmap_bgzf_eof[28] = {
+    31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 'B', 'C', 2, 0, 27, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+static inline void
+tmap_bgzf_pack_int16(uint8_t *buf, uint16_t value)
+{
+  buf[0] = value & 0xff;
+  buf[1] = value >> 8;
+}
+
+static inline void
+tmap_bgzf_pack_int32(uint8_t *buf, uint32_t value)
+{
+  buf[0] = value & 0xff;
+  buf[1] = (value >> 8) & 0xff;
+  buf[2] = (value >> 16) & 0xff;
+  buf[3] = value >> 24;
+}
+
+static int32_t
+tmap_bgzf_deflate(tmap_bgzf_block_t *block, int32_t compress_level)
+{
+  z_stream zs;
+  int32_t status;
+
+  memset(&zs, 0, sizeof(z_stream));
+  if(Z_OK != deflateInit2(&zs, compress_level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY)) {
+      return -1;
+  }
+  zs.next_in = block->data;
+  zs.avail_in = block->length;
+  zs.next_out = block->cdata + TMAP_BGZF_HEADER_SIZE;
+  zs.avail_out = TMAP_BGZF_MAX_BLOCK_SIZE - TMAP_BGZF_HEADER_SIZE - TMAP_BGZF_FOOTER_SIZE;
+  status = deflate(&zs, Z_FINISH);
+  if(Z_STREAM_END != status) {
+      deflateEnd(&zs);
+      return -1;
+  }
+  block->clength = zs.total_out + TMAP_BGZF_HEADER_SIZE + TMAP_BGZF_FOOTER_SIZE;
+  if(Z_OK != deflateEnd(&zs)) {
+      return -1;
+  }
+  return 0;
+}
+
+static void
+tmap_bgzf_compress_block(tmap_bgzf_block_t *block, int32_t compress_level)
+{
+  uint32_t crc;
+
+  // incompressible data may not fit, so store it instead
+  if(0 != tmap_bgzf_deflate(block, compress_level)
+     && (0 == compress_level || 0 != tmap_bgzf_deflate(block, 0))) {
+      tmap_error("deflate failed", Exit, WriteFileError);
+  }
+
+  memcpy(block->cdata, tmap_bgzf_header, TMAP_BGZF_HEADER_SIZE);
+  tmap_bgzf_pack_int16(block->cdata + 16, block->clength - 1);
+  crc = crc32(crc32(0L, NULL, 0L), block->data, block->length);
+  tmap_bgzf_pack_int32(block->cdata + block->clength - 8, crc);
+  tmap_bgzf_pack_int32(block->cdata + block->clength - 4, block->length);
+}
+
+static void *
+tmap_bgzf_compress_worker(void *arg)
+{
+  tmap_bgzf_t *fp = (tmap_bgzf_t*)arg;
+  tmap_bgzf_block_t *block;
+
+  while(1) {
+      if(0 != pthread_mutex_lock(&fp->mutex)) {
+          tmap_error("pthread_mutex_lock", Exit, ThreadError);
+      }
+      while(fp->compress == fp->fill && 0 == fp->shutdown) {
+          if(0 != pthread_cond_wait(&fp->full_cond, &fp->mutex)) {
+              tmap_error("pthread_cond_wait", Exit, ThreadError);
+          }
+      }
+      if(fp->compress == fp->fill) { // shutdown, and nothing left to compress
+          if(0 != pthread_mutex_unlock(&fp->mutex)) {
+              tmap_error("pthread_mutex_unlock", Exit, ThreadError);
+          }
+          break;
+      }
+      block = &fp->blocks[fp->compress % fp->num_blocks];
+      block->state = TMAP_BGZF_BLOCK_COMPRESSING;
+      fp->compress++;
+      if(0 != pthread_mutex_unlock(&fp->mutex)) {
+          tmap_error("pthread_mutex_unlock", Exit, ThreadError);
+      }
+
+      tmap_bgzf_compress_block(block, fp->compress_level);
+
+      if(0 != pthread_mutex_lock(&fp->mutex)) {
+          tmap_error("pthread_mutex_lock", Exit, ThreadError);
+      }
+      block->state = TMAP_BGZF_BLOCK_COMPRESSED;
+      if(0 != pthread_cond_signal(&fp->compressed_cond)) {
+          tmap_error("pthread_cond_signal", Exit, ThreadError);
+      }
+      if(0 != pthread_mutex_unlock(&fp->mutex)) {
+          tmap_error("pthread_mutex_unlock", Exit, ThreadError);
+      }
+  }
+
+  return arg;
+}
+
+static void *
+tmap_bgzf_write_worker(void *arg)
+{
+  tmap_bgzf_t *fp = (tmap_bgzf_t*)arg;
+  tmap_bgzf_block_t *block;
+
+  if(0 != pthread_mutex_lock(&fp->mutex)) {
+      tmap_error("pthread_mutex_lock", Exit, ThreadError);
+  }
+  while(1) {
+      block = &fp->blocks[fp->write % fp->num_blocks];
+      // blocks are written in the order they were filled
+      while(TMAP_BGZF_BLOCK_COMPRESSED != block->state
+            && !(1 == fp->shutdown && fp->write == fp->fill)) {
+          if(0 != pthread_cond_wait(&fp->compressed_cond, &fp->mutex)) {
+              tmap_error("pthread_cond_wait", Exit, ThreadError);
+          }
+      }
+      if(TMAP_BGZF_BLOCK_COMPRESSED != block->state) break; // all blocks written
+      if(0 != pthread_mutex_unlock(&fp->mutex)) {
+          tmap_error("pthread_mutex_unlock", Exit, ThreadError);
+      }
+
+      if(block->clength != fwrite(block->cdata, sizeof(uint8_t), block->clength, fp->fp)) {
+          fp->error = 1;
+      }
+
+      if(0 != pthread_mutex_lock(&fp->mutex)) {
+          tmap_error("pthread_mutex_lock", Exit, ThreadError);
+      }
+      block->length = 0;
+      block->state = TMAP_BGZF_BLOCK_EMPTY;
+      fp->write++;
+      if(0 != pthread_cond_signal(&fp->empty_cond)) {
+          tmap_error("pthread_cond_signal", Exit, ThreadError);
+      }
+  }
+  if(0 != pthread_mutex_unlock(&fp->mutex)) {
+      tmap_error("pthread_mutex_unlock", Exit, ThreadError);
+  }
+
+  return arg;
+}
+
+tmap_bgzf_t *
+tmap_bgzf_open(const char *fn, int32_t compress_level, int32_t num_threads)
+{
+  tmap_bgzf_t *fp = NULL;
+  int32_t i;
+
+  if(num_threads <= 0) num_threads = 1;
+
+  fp = tmap_calloc(1, sizeof(tmap_bgzf_t), "fp");
+  if(0 == strcmp("-", fn)) {
+      fp->fp = stdout;
+  }
+  else {
+      fp->fp = fopen(fn, "wb");
+      if(NULL == fp->fp) {
+          tmap_error(fn, Exit, OpenFileError);
+      }
+  }
+  fp->compress_level = (compress_level < 0) ? Z_DEFAULT_COMPRESSION : compress_level;
+  fp->num_threads = num_threads;
+
+  // allow a few blocks per thread to be in flight
+  fp->num_blocks = TMAP_BGZF_BLOCKS_PER_THREAD * num_threads;
+  fp->blocks = tmap_calloc(fp->num_blocks, sizeof(tmap_bgzf_block_t), "fp->blocks");
+  for(i=0;i<fp->num_blocks;i++) {
+      fp->blocks[i].data = tmap_malloc(sizeof(uint8_t) * TMAP_BGZF_BLOCK_SIZE, "fp->blocks[i].data");
+      fp->blocks[i].cdata = tmap_malloc(sizeof(uint8_t) * TMAP_BGZF_MAX_BLOCK_SIZE, "fp->blocks[i].cdata");
+  }
+
+  if(0 != pthread_mutex_init(&fp->mutex, NULL)
+     || 0 != pthread_cond_init(&fp->full_cond, NULL)
+     || 0 != pthread_cond_init(&fp->compressed_cond, NULL)
+     || 0 != pthread_cond_init(&fp->empty_cond, NULL)) {
+      tmap_error("pthread_mutex_init", Exit, ThreadError);
+  }
+
+  fp->threads = tmap_calloc(num_threads, sizeof(pthread_t), "fp->threads");
+  for(i=0;i<num_threads;i++) {
+      if(0 != pthread_create(&fp->threads[i], NULL, tmap_bgzf_compress_worker, fp)) {
+          tmap_error("error creating threads", Exit, ThreadError);
+      }
+  }
+  if(0 != pthread_create(&fp->writer, NULL, tmap_bgzf_write_worker, fp)) {
+      tmap_error("error creating threads", Exit, ThreadError);
+  }
+
+  return fp;
+}
+
+// hands the block being filled to the compression threads, and waits for the
+// next block in the ring to be written
+static void
+tmap_bgzf_submit(tmap_bgzf_t *fp)
+{
+  tmap_bgzf_block_t *block;
+
+  if(0 != pthread_mutex_lock(&fp->mutex)) {
+      tmap_error("pthread_mutex_lock", Exit, ThreadError);
+  }
+  fp->blocks[fp->fill % fp->num_blocks].state = TMAP_BGZF_BLOCK_FULL;
+  fp->fill++;
+  if(0 != pthread_cond_signal(&fp->full_cond)) {
+      tmap_error("pthread_cond_signal", Exit, ThreadError);
+  }
+  block = &fp->blocks[fp->fill % fp->num_blocks];
+  while(TMAP_BGZF_BLOCK_EMPTY != block->state) {
+      if(0 != pthread_cond_wait(&fp->empty_cond, &fp->mutex)) {
+          tmap_error("pthread_cond_wait", Exit, ThreadError);
+      }
+  }
+  if(0 != pthread_mutex_unlock(&fp->mutex)) {
+      tmap_error("pthread_mutex_unlock", Exit, ThreadError);
+  }
+}
+
+int32_t
+tmap_bgzf_write(tmap_bgzf_t *fp, const void *data, int32_t length)
+{
+  const uint8_t *input = (const uint8_t*)data;
+  tmap_bgzf_block_t *block;
+  int32_t n, remaining = length;
+
+  // the block being filled is only touched by the caller
+  while(0 < remaining) {
+      block = &fp->blocks[fp->fill % fp->num_blocks];
+      n = TMAP_BGZF_BLOCK_SIZE - block->length;
+      if(remaining < n) n = remaining;
+      memcpy(block->data + block->length, input, n);
+      block->length += n;
+      input += n;
+      remaining -= n;
+      if(TMAP_BGZF_BLOCK_SIZE == block->length) {
+          tmap_bgzf_submit(fp);
+      }
+  }
+
+  return (1 == fp->error) ? -1 : length;
+}
+
+void
+tmap_bgzf_flush_try(tmap_bgzf_t *fp, int32_t length)
+{
+  tmap_bgzf_block_t *block = &fp->blocks[fp->fill % fp->num_blocks];
+  if(0 < block->length && TMAP_BGZF_BLOCK_SIZE < block->length + length) {
+      tmap_bgzf_submit(fp);
+  }
+}
+
+int32_t
+tmap_bgzf_close(tmap_bgzf_t *fp)
+{
+  int32_t i, ret = 0;
+
+  // flush the last partial block
+  if(0 < fp->blocks[fp->fill % fp->num_blocks].length) {
+      tmap_bgzf_submit(fp);
+  }
+
+  // let the threads drain the ring and exit
+  if(0 != pthread_mutex_lock(&fp->mutex)) {
+      tmap_error("pthread_mutex_lock", Exit, ThreadError);
+  }
+  fp->shutdown = 1;
+  if(0 != pthread_cond_broadcast(&fp->full_cond)
+     || 0 != pthread_cond_broadcast(&fp->compressed_cond)) {
+      tmap_error("pthread_cond_broadcast", Exit, ThreadError);
+  }
+  if(0 != pthread_mutex_unlock(&fp->mutex)) {
+      tmap_error("pthread_mutex_unlock", Exit, ThreadError);
+  }
+  for(i=0;i<fp->num_threads;i++) {
+      if(0 != pthread_join(fp->threads[i], NULL)) {
+          tmap_error("error joining threads", Exit, ThreadError);
+      }
+  }
+  if(0 != pthread_join(fp->writer, NULL)) {
+      tmap_error("error joining threads", Exit, ThreadError);
+  }
+
+  if(1 == fp->error
+     || sizeof(tmap_bgzf_eof) != fwrite(tmap_bgzf_eof, sizeof(uint8_t), sizeof(tmap_bgzf_eof), fp->fp)
+     || 0 != fflush(fp->fp)) {
+      ret = -1;
+  }
+  if(stdout != fp->fp && 0 != fclose(fp->fp)) {
+      ret = -1;
+  }
+
+  pthread_mutex_destroy(&fp->mutex);
+  pthread_cond_destroy(&fp->full_cond);
+  pthread_cond_destroy(&fp->compressed_cond);
+  pthread_cond_destroy(&fp->empty_cond);
+  for(i=0;i<fp->num_blocks;i++) {
+      free(fp->blocks[i].data);
+      free(fp->blocks[i].cdata);
+  }
+  free(fp->blocks);
+  free(fp->threads);
+  free(fp);
+
+  return ret;
+}
+
+#endif
@@ -0,0 +1,112 @@
+/* Copyright (C) 2010 Ion Torrent Systems, Inc. All Rights Reserved */
+#ifndef TMAP_BGZF_H
+#define TMAP_BGZF_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <config.h>
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
+
+/*!
+  A multi-threaded BGZF writer
+  @details  Data is packed into 64KB blocks, the blocks are compressed by a
+  pool of threads, and a separate thread writes the compressed blocks to the
+  file in order.  The output is identical in format to that of the SAMtools
+  BGZF writer.
+  */
+
+#ifdef HAVE_LIBPTHREAD
+
+/*!
+  the maximum number of uncompressed bytes in a block (as in SAMtools)
+  */
+#define TMAP_BGZF_BLOCK_SIZE 0xff00
+
+/*!
+  the maximum size of a compressed block
+  */
+#define TMAP_BGZF_MAX_BLOCK_SIZE 0x10000
+
+/*!
+  @details  the state of a block in the ring
+  */
+enum {
+    TMAP_BGZF_BLOCK_EMPTY=0, /*!< the block can be filled */
+    TMAP_BGZF_BLOCK_FULL, /*!< the block is waiting to be compressed */
+    TMAP_BGZF_BLOCK_COMPRESSING, /*!< the block is being compressed */
+    TMAP_BGZF_BLOCK_COMPRESSED /*!< the block is waiting to be written */
+};
+
+/*!
+  a single BGZF block
+  */
+typedef struct {
+    uint8_t *data; /*!< the uncompressed data */
+    int32_t length; /*!< the number of uncompressed bytes */
+    uint8_t *cdata; /*!< the compressed block, including the BGZF header and footer */
+    int32_t clength; /*!< the number of compressed bytes */
+    int32_t state; /*!< the state of the block */
+} tmap_bgzf_block_t;
+
+/*!
+  the multi-threaded BGZF writer
+  */
+typedef struct {
+    FILE *fp; /*!< the output file */
+    int32_t compress_level; /*!< the zlib compression level */
+    int32_t num_threads; /*!< the number of compression threads */
+    int32_t num_blocks; /*!< the number of blocks in the ring */
+    tmap_bgzf_block_t *blocks; /*!< the ring of blocks */
+    int64_t fill; /*!< the sequence number of the block being filled */
+    int64_t compress; /*!< the sequence number of the next block to compress */
+    int64_t write; /*!< the sequence number of the next block to write */
+    int32_t shutdown; /*!< 1 if no more blocks will be submitted, 0 otherwise */
+    int32_t error; /*!< 1 if writing failed, 0 otherwise */
+    pthread_t *threads; /*!< the compression threads */
+    pthread_t writer; /*!< the thread writing the compressed blocks */
+    pthread_mutex_t mutex; /*!< guards the block states and sequence numbers */
+    pthread_cond_t full_cond; /*!< signalled when a block is ready to be compressed */
+    pthread_cond_t compressed_cond; /*!< signalled when a block has been compressed */
+    pthread_cond_t empty_cond; /*!< signalled when a block has been written */
+} tmap_bgzf_t;
+
+/*!
+  @param  fn              the output file name, or "-" for stdout
+  @param  compress_level  the zlib compression level (-1 for the default)
+  @param  num_threads     the number of compression threads
+  @return                 the initialized writer
+  */
+tmap_bgzf_t *
+tmap_bgzf_open(const char *fn, int32_t compress_level, int32_t num_threads);
+
+/*!
+  @param  fp      the writer
+  @param  data    the data to write
+  @param  length  the number of bytes to write
+  @return         the number of bytes written, or -1 upon error
+  */
+int32_t
+tmap_bgzf_write(tmap_bgzf_t *fp, const void *data, int32_t length);
+
+/*!
+  Starts a new block if the given number of bytes does not fit in the current one
+  @param  fp      the writer
+  @param  length  the number of bytes about to be written
+  @details        this keeps small records (e.g. BAM records) from spanning blocks
+  */
+void
+tmap_bgzf_flush_try(tmap_bgzf_t *fp, int32_t length);
+
+/*!
+  Writes any remaining data and the BGZF EOF marker, and closes the file
+  @param  fp  the writer
+  @return     0 upon success, -1 upon error
+  */
+int32_t
+tmap_bgzf_close(tmap_bgzf_t *fp);
+
+#endif
+
+#endif
@@ -70,13 +70,105 @@ tmap_sam_io_init2(const char *fn, const char *mode,
   return io;
 }
 
+#ifdef HAVE_LIBPTHREAD
+static int32_t
+tmap_sam_io_is_big_endian()
+{
+  long one = 1;
+  return !(*((char *)(&one)));
+}
+
+// writes the BAM magic, text, and references, as in SAMtools
+static void
+tmap_sam_io_write_bam_header(tmap_bgzf_t *bgzf, const bam_header_t *header)
+{
+  int32_t i, len;
+
+  tmap_bgzf_write(bgzf, "BAM\1", 4);
+  len = header->l_text;
+  tmap_bgzf_write(bgzf, &len, sizeof(int32_t));
+  if(0 < len) tmap_bgzf_write(bgzf, header->text, len);
+  tmap_bgzf_write(bgzf, &header->n_targets, sizeof(int32_t));
+  for(i=0;i<header->n_targets;i++) {
+      len = strlen(header->target_name[i]) + 1;
+      tmap_bgzf_write(bgzf, &len, sizeof(int32_t));
+      tmap_bgzf_write(bgzf, header->target_name[i], len);
+      tmap_bgzf_write(bgzf, &header->target_len[i], sizeof(uint32_t));
+  }
+}
+#endif
+
+tmap_sam_io_t *
+tmap_sam_io_init3(const char *fn, const char *mode,
+                  bam_header_t *header, int32_t num_threads)
+{
+#ifdef HAVE_LIBPTHREAD
+  tmap_sam_io_t *io = NULL;
+
+  // the records are serialized in host byte order
+  if(num_threads <= 0 || 0 != strcmp("wb", mode) || 1 == tmap_sam_io_is_big_endian()) {
+      return tmap_sam_io_init2(fn, mode, header);
+  }
+
+  io = tmap_calloc(1, sizeof(tmap_sam_io_t), "io");
+  io->bgzf = tmap_bgzf_open(fn, -1, num_threads);
+  io->header = sam_header_clone(header->header);
+  tmap_sam_io_write_bam_header(io->bgzf, header);
+
+  return io;
+#else
+  return tmap_sam_io_init2(fn, mode, header);
+#endif
+}
+
 void
 tmap_sam_io_destroy(tmap_sam_io_t *samio)
 {
+#ifdef HAVE_LIBPTHREAD
+  if(NULL != samio->bgzf) {
+      if(0 != tmap_bgzf_close(samio->bgzf)) {
+          tmap_error("Error writing the BAM file", Exit, WriteFileError);
+      }
+      sam_header_destroy(samio->header);
+      free(samio);
+      return;
+  }
+#endif
   samclose(samio->fp);
   free(samio);
 }
 
+int32_t
+tmap_sam_io_write(tmap_sam_io_t *samio, const bam1_t *b)
+{
+#ifdef HAVE_LIBPTHREAD
+  if(NULL != samio->bgzf) {
+      const bam1_core_t *c = &b->core;
+      uint32_t x[8];
+      int32_t block_len;
+
+      block_len = b->data_len + 32;
+      x[0] = c->tid;
+      x[1] = c->pos;
+      x[2] = (uint32_t)c->bin<<16 | c->qual<<8 | c->l_qname;
+      x[3] = (uint32_t)c->flag<<16 | c->n_cigar;
+      x[4] = c->l_qseq;
+      x[5] = c->mtid;
+      x[6] = c->mpos;
+      x[7] = c->isize;
+      // keep each record within a single block
+      tmap_bgzf_flush_try(samio->bgzf, 4 + block_len);
+      if(tmap_bgzf_write(samio->bgzf, &block_len, sizeof(int32_t)) < 0
+         || tmap_bgzf_write(samio->bgzf, x, sizeof(uint32_t) * 8) < 0
+         || tmap_bgzf_write(samio->bgzf, b->data, b->data_len) < 0) {
+          return -1;
+      }
+      return 4 + block_len;
+  }
+#endif
+  return samwrite(samio->fp, b);
+}
+
 static void
 tmap_sam_io_update_string(tmap_string_t **dst, char *src, int32_t len)
 {
@@ -142,5 +234,8 @@ tmap_sam_io_read_buffer(tmap_sam_io_t *samio, tmap_sam_t **sam_buffer, int32_t b
 sam_header_t*
 tmap_sam_io_get_sam_header(tmap_sam_io_t *samio)
 {
+#ifdef HAVE_LIBPTHREAD
+  if(NULL != samio->bgzf) return samio->header;
+#endif
   return samio->fp->header->header;
 }
@@ -6,6 +6,8 @@
 
 #include "../samtools/bam.h"
 #include "../samtools/sam.h"
+#include "../samtools/sam_header.h"
+#include "tmap_bgzf.h"
 
 /*! 
   A SAM/BAM Reading Library
@@ -15,6 +17,10 @@
 */
 typedef struct _tmap_sam_io_t {
     samfile_t *fp;  /*!< the file pointer to the SAM/BAM file */
+#ifdef HAVE_LIBPTHREAD
+    tmap_bgzf_t *bgzf; /*!< the multi-threaded BGZF writer, or NULL if the SAM/BAM file pointer is used */
+    sam_header_t *header; /*!< the SAM header when writing with the multi-threaded BGZF writer */
+#endif
 } tmap_sam_io_t;
 
 #include "../seq/tmap_sam.h"
@@ -46,6 +52,19 @@ inline tmap_sam_io_t *
 tmap_sam_io_init2(const char *fn, const char *mode,
                   bam_header_t *header);
 
+/*!
+  initialized SAM/BAM writing structure, compressing BAM output with multiple threads
+  @param  fn  the output file name, or "-" for stdout
+  @param  mode  the mode; must be one of "wh", "wb", or "wbu"
+  @param  header  the output BAM Header
+  @param  num_threads  the number of BGZF compression threads; zero or less to use the SAMtools writer
+  @return  a pointer to the initialized memory for writing SAMs/BAMs
+  @details  only compressed BAM ("wb") output uses the compression threads
+  */
+tmap_sam_io_t *
+tmap_sam_io_init3(const char *fn, const char *mode,
+                  bam_header_t *header, int32_t num_threads);
+
 /*! 
   destroys SAM/BAM reading structure
   @param  samio  a pointer to the SAM/BAM structure
@@ -72,6 +91,15 @@ tmap_sam_io_read(tmap_sam_io_t *samio, tmap_sam_t *sam);
 int32_t
 tmap_sam_io_read_buffer(tmap_sam_io_t *samio, tmap_sam_t **sam_buffer, int32_t buffer_length);
 
+/*!
+  writes a SAM/BAM record
+  @param  samio  a pointer to a previously initialized SAM/BAM writing structure
+  @param  b      the record to write
+  @return        the number of bytes written, or zero or less upon error
+  */
+int32_t
+tmap_sam_io_write(tmap_sam_io_t *samio, const bam1_t *b);
+
 /*!
   @param  samio  a pointer to a previously initialized SAM/BAM structure
   @return   the SAM header structure 
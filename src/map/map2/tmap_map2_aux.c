@@ -43,6 +43,7 @@ tmap_map2_aux_sa_pac_pos(const tmap_refseq_t *refseq, const tmap_bwt_t *bwt, con
   int64_t n;
   //uint32_t seqid, pos;
   uint8_t is_rev;
+  tmap_bwt_int_t *pacpos = NULL;
   if(b->n == 0) return 1;
   if(NULL != bwt && NULL != sa) { // convert to chromosomal coordinates if suitable
       tmap_map2_aln_t *tmp_b;
@@ -68,6 +69,7 @@ tmap_map2_aux_sa_pac_pos(const tmap_refseq_t *refseq, const tmap_bwt_t *bwt, con
       // realloc
       tmap_map2_aln_realloc(b, n);
       b->n = n;
+      pacpos = tmap_malloc(sizeof(tmap_bwt_int_t) * (0 < n ? n : 1), "pacpos");
       // copy over
       for(i = j = 0; i < tmp_b->n; ++i) {
           tmap_map2_hit_t *p = tmp_b->hits + i;
@@ -76,29 +78,32 @@ tmap_map2_aux_sa_pac_pos(const tmap_refseq_t *refseq, const tmap_bwt_t *bwt, con
               tmap_bwt_int_t k;
               for(k = p->k; k <= p->l; ++k) {
                   b->hits[j] = *p;
-                  b->hits[j].k = tmap_sa_pac_pos_hash(sa, bwt, k, hash); // NB: keep zero based for now
+                  pacpos[j] = k;
                   b->hits[j].l = 0;
-                  is_rev = (refseq->len < b->hits[j].k) ? 1 : 0;
-                  b->hits[j].is_rev = is_rev;
                   // TODO: does this hurt/help?
                   b->hits[j].n_seeds = 1;
-                  if (is_rev) b->hits[j].k -= p->qlen - 1;
                   ++j;
               }
           } else if(p->G > min_as) {
               b->hits[j] = *p;
-              b->hits[j].k = tmap_sa_pac_pos_hash(sa, bwt, p->k, hash); // NB: keep zero based for now
+              pacpos[j] = p->k;
               b->hits[j].l = 0;
-              is_rev = (refseq->len < b->hits[j].k) ? 1 : 0;
-              b->hits[j].is_rev = is_rev;
               b->hits[j].flag |= 0x1;
               // TODO: does this hurt/help?
               b->hits[j].n_seeds = p->l - p->k + 1;
-              if (is_rev) b->hits[j].k -= p->qlen - 1;
               ++j;
           }
       }
       tmap_map2_aln_destroy(tmp_b);
+      // locate all the hits together
+      tmap_sa_pac_pos_batch(sa, bwt, j, pacpos, pacpos, hash);
+      for(i = 0; i < j; ++i) {
+          b->hits[i].k = pacpos[i]; // NB: keep zero based for now
+          is_rev = (refseq->len < b->hits[i].k) ? 1 : 0;
+          b->hits[i].is_rev = is_rev;
+          if (is_rev) b->hits[i].k -= b->hits[i].qlen - 1;
+      }
+      free(pacpos);
   }
   return 1;
 }
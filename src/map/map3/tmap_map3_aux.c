@@ -38,6 +38,64 @@ tmap_map3_aux_seed_add(tmap_map3_aux_seed_t **seeds,
   (*n_seeds)++;
 }
 
+/*!
+  forward seeds matched and extended together
+  */
+typedef struct {
+    int32_t low; /*!< the query start of the first seed in the batch */
+    int32_t high; /*!< one past the query start of the last seed in the batch */
+    tmap_bwt_int_t num[TMAP_BWT_MATCH_HASH_BATCH_SIZE]; /*!< the number of hits of each seed */
+    tmap_bwt_match_occ_t sa[TMAP_BWT_MATCH_HASH_BATCH_SIZE]; /*!< the SA interval of each seed */
+    tmap_bwt_match_occ_t ext_sa[TMAP_BWT_MATCH_HASH_BATCH_SIZE]; /*!< the SA interval of each seed once extended */
+    int32_t ext[TMAP_BWT_MATCH_HASH_BATCH_SIZE]; /*!< the number of bases each seed was extended */
+} tmap_map3_aux_seed_batch_t;
+
+// matches the forward seeds starting in [low,high), extending those with few hits
+static void
+tmap_map3_aux_core_seed_batch(uint8_t *query,
+                              int32_t query_length,
+                              tmap_bwt_t *bwt,
+                              tmap_bwt_match_hash_t *hash,
+                              tmap_map_opt_t *opt,
+                              int32_t seed_length,
+                              int32_t low,
+                              int32_t high,
+                              tmap_map3_aux_seed_batch_t *batch)
+{
+  int32_t i, n;
+  int32_t len[TMAP_BWT_MATCH_HASH_BATCH_SIZE], idx[TMAP_BWT_MATCH_HASH_BATCH_SIZE], ext[TMAP_BWT_MATCH_HASH_BATCH_SIZE];
+  const uint8_t *str[TMAP_BWT_MATCH_HASH_BATCH_SIZE];
+  tmap_bwt_match_occ_t ext_sa[TMAP_BWT_MATCH_HASH_BATCH_SIZE];
+
+  batch->low = low;
+  batch->high = high;
+
+  // the seeds
+  for(i=0;i<high-low;i++) {
+      len[i] = seed_length;
+      str[i] = query + low + i;
+  }
+  tmap_bwt_match_hash_exact_batch(bwt, high-low, len, str, batch->sa, batch->num, hash);
+
+  // extend the seeds with few hits, up to query_length - seed_length
+  for(i=n=0;i<high-low;i++) {
+      batch->ext_sa[i] = batch->sa[i];
+      batch->ext[i] = 0;
+      if(0 < batch->num[i] && (batch->sa[i].l - batch->sa[i].k + 1) <= opt->max_seed_hits) {
+          idx[n] = i;
+          len[n] = query_length - seed_length - (low + i + 1);
+          str[n] = query + low + i + 1;
+          ext_sa[n] = batch->sa[i];
+          n++;
+      }
+  }
+  tmap_bwt_match_hash_extend_batch(bwt, n, len, str, ext_sa, ext, hash);
+  for(i=0;i<n;i++) {
+      batch->ext_sa[idx[i]] = ext_sa[i];
+      batch->ext[idx[i]] = ext[i];
+  }
+}
+
 static inline void
 tmap_map3_aux_core_seed(uint8_t *query,
                         int32_t query_length,
@@ -56,30 +114,27 @@ tmap_map3_aux_core_seed(uint8_t *query,
   int32_t i, j;
 
   int k, count;
-  tmap_bwt_match_occ_t cur_sa, prev_sa;
+  tmap_bwt_match_occ_t cur_sa;
+  tmap_map3_aux_seed_batch_t batch;
+  int32_t batch_size;
   j = count = 0;
   if(1 == fwd_search) {
+      // NB: when skipping, the next seed depends on how far this one was extended
+      batch_size = (0 < opt->skip_seed_frac) ? 1 : TMAP_BWT_MATCH_HASH_BATCH_SIZE;
+      batch.low = batch.high = 0;
       for(i=0;i<query_length-seed_length+1;i++) {
-          if(0 < tmap_bwt_match_hash_exact(bwt, seed_length, query + i, &cur_sa, hash)) {
+          if(batch.high <= i) { // match and extend the next batch of seeds
+              tmap_map3_aux_core_seed_batch(query, query_length, bwt, hash, opt, seed_length, i, 
+                                            (i + batch_size < query_length-seed_length+1) ? (i + batch_size) : (query_length-seed_length+1),
+                                            &batch);
+          }
+          if(0 < batch.num[i - batch.low]) {
               count++;
+              cur_sa = batch.sa[i - batch.low];
               if((cur_sa.l - cur_sa.k + 1) <= opt->max_seed_hits) {
-                  // extend further
-                  prev_sa = cur_sa;
-                  k = i + 1;
-                  while(k < query_length - seed_length) {
-                      tmap_bwt_match_hash_2occ(bwt, &prev_sa, query[k], &cur_sa, hash);
-                      if(cur_sa.l < cur_sa.k) {
-                          // use prev
-                          cur_sa = prev_sa;
-                          break;
-                      }
-                      else {
-                          // keep going
-                          prev_sa = cur_sa;
-                          k++;
-                      }
-                  }
-                  k--; // k is always one greater
+                  // extended further
+                  cur_sa = batch.ext_sa[i - batch.low];
+                  k = i + batch.ext[i - batch.low];
                   tmap_map3_aux_seed_add(seeds, n_seeds, m_seeds, cur_sa.k, cur_sa.l, k, seed_length + k - i);
                   j++;
                   // skip over 
@@ -165,11 +220,14 @@ tmap_map3_aux_core(tmap_seq_t *seq,
                    tmap_bwt_match_hash_t *hash,
                    tmap_map_opt_t *opt)
 {
-  int32_t i, j, n, seed_length;
+  int32_t i, j, n, m, seed_length;
   int32_t seq_len;
   tmap_string_t *bases;
   uint8_t *query;
   tmap_map3_aux_seed_t *seeds;
+  tmap_bwt_int_t *pacpos_all = NULL;
+  uint32_t *seqid_all = NULL, *pos_all = NULL;
+  uint8_t *strand_all = NULL;
   int32_t m_seeds, n_seeds;
   tmap_map_sams_t *sams = NULL;
 
@@ -237,19 +295,38 @@ tmap_map3_aux_core(tmap_seq_t *seq,
 
   // make enough room
   tmap_map_sams_realloc(sams, n);
+
+  // locate all the occurrences of all the seeds together
+  pacpos_all = tmap_malloc(sizeof(tmap_bwt_int_t) * (0 < n ? n : 1), "pacpos_all");
+  for(j=n=0;j<n_seeds;j++) {
+      tmap_bwt_int_t k;
+      for(k=seeds[j].k;k<=seeds[j].l;k++) {
+          pacpos_all[n++] = k;
+      }
+  }
+  tmap_sa_pac_pos_batch(sa, bwt, n, pacpos_all, pacpos_all, hash);
+  for(i=0;i<n;i++) {
+      pacpos_all[i] = bwt->seq_len - pacpos_all[i];
+  }
+  seqid_all = tmap_malloc(sizeof(uint32_t) * (0 < n ? n : 1), "seqid_all");
+  pos_all = tmap_malloc(sizeof(uint32_t) * (0 < n ? n : 1), "pos_all");
+  strand_all = tmap_malloc(sizeof(uint8_t) * (0 < n ? n : 1), "strand_all");
+  tmap_refseq_pac2real_batch(refseq, n, pacpos_all, 1, seqid_all, pos_all, strand_all);
   
   // convert seeds to chr/pos
-  n = 0;
+  n = m = 0;
   for(j=0;j<n_seeds;j++) { // go through all seeds
       uint32_t seqid, pos, pos_adj;
-      tmap_bwt_int_t k, pacpos;
+      tmap_bwt_int_t k;
       uint16_t seed_length_ext = seeds[j].seed_length;
       uint16_t start = seeds[j].start;
       uint8_t strand;
-      for(k=seeds[j].k;k<=seeds[j].l;k++) { // through all occurrences
+      for(k=seeds[j].k;k<=seeds[j].l;k++,m++) { // through all occurrences
           tmap_map_sam_t *s = NULL;
-          pacpos = bwt->seq_len - tmap_sa_pac_pos_hash(sa, bwt, k, hash);
-          if(0 < tmap_refseq_pac2real(refseq, pacpos, 1, &seqid, &pos, &strand)) {
+          seqid = seqid_all[m];
+          pos = pos_all[m];
+          strand = strand_all[m];
+          if(0 < pos) {
               // adjust based on offset
               pos_adj = start + seed_length_ext - 1; // NB: we only used the forward read, so adjustment is based off of this...
               /*
@@ -290,6 +367,10 @@ tmap_map3_aux_core(tmap_seq_t *seq,
   // free the seeds
   free(seeds);
   seeds=NULL;
+  free(pacpos_all);
+  free(seqid_all);
+  free(pos_all);
+  free(strand_all);
 
   return sams;
 }
@@ -108,7 +108,7 @@ tmap_map4_aux_core(tmap_seq_t *seq,
                    tmap_rand_t *rand,
                    tmap_map_opt_t *opt)
 {
-  int32_t i, n;
+  int32_t i, j, n;
   int32_t start, by, end;
   int32_t min_seed_length, max_seed_length;
   tmap_bwt_int_t k;
@@ -116,6 +116,9 @@ tmap_map4_aux_core(tmap_seq_t *seq,
   tmap_bwt_smem_intv_vec_t *matches;
   int32_t total = 0;
   int32_t max_repr;
+  tmap_bwt_int_t *pacpos_all = NULL;
+  uint32_t *seqid_all = NULL, *pos_all = NULL;
+  uint8_t *strand_all = NULL;
   
   uint8_t *query;
   int32_t query_len;
@@ -244,8 +247,26 @@ tmap_map4_aux_core(tmap_seq_t *seq,
           n += p->size;
       }
       tmap_map_sams_realloc(sams, n);
-      // go through the matches
+      // locate all the matches together
+      pacpos_all = tmap_malloc(sizeof(tmap_bwt_int_t) * (0 < n ? n : 1), "pacpos_all");
       for (i = n = 0; i < matches->n; ++i) {
+          tmap_bwt_smem_intv_t *p = &matches->a[i];
+          for (k = 0; k < p->size; ++k) {
+              pacpos_all[n] = p->x[0] + k;
+              if(bwt->seq_len < pacpos_all[n]) pacpos_all[n] = bwt->seq_len;
+              n++;
+          }
+      }
+      tmap_sa_pac_pos_batch(sa, bwt, n, pacpos_all, pacpos_all, hash);
+      for (i = 0; i < n; ++i) {
+          pacpos_all[i]++; // make zero based
+      }
+      seqid_all = tmap_malloc(sizeof(uint32_t) * (0 < n ? n : 1), "seqid_all");
+      pos_all = tmap_malloc(sizeof(uint32_t) * (0 < n ? n : 1), "pos_all");
+      strand_all = tmap_malloc(sizeof(uint8_t) * (0 < n ? n : 1), "strand_all");
+      tmap_refseq_pac2real_batch(refseq, n, pacpos_all, 1, seqid_all, pos_all, strand_all);
+      // go through the matches
+      for (i = n = j = 0; i < matches->n; ++i) {
           tmap_bwt_smem_intv_t *p = &matches->a[i];
           for (k = 0; k < p->size; ++k) {
               tmap_bwt_int_t pacpos;
@@ -259,15 +280,18 @@ tmap_map4_aux_core(tmap_seq_t *seq,
               
               pacpos = p->x[0] + k;
               tmp = pacpos;
-              if(bwt->seq_len < pacpos) pacpos = bwt->seq_len;
 
               // get the packed position
-              pacpos = tmap_sa_pac_pos_hash(sa, bwt, pacpos, hash) + 1; // make zero based
+              pacpos = pacpos_all[j];
+              seqid = seqid_all[j];
+              pos = pos_all[j];
+              strand = strand_all[j];
+              j++;
               //fprintf(stderr, "X0 p->x[0]=%llu p->x[1]=%llu p->size=%llu k=%llu bwt->seq_len=%llu pacpos=%llu tmp=%llu\n", p->x[0], p->x[1], p->size, k, bwt->seq_len, pacpos, tmp);
               
               // convert to reference co-ordinates
               //if(pacpos == 0 || bwt->seq_len < pacpos) tmap_bug();
-              if(0 < tmap_refseq_pac2real(refseq, pacpos, 1, &seqid, &pos, &strand)) {
+              if(0 < pos) {
                   tmap_map_sam_t *s;
 
                   pos--; // make zero-baed
@@ -314,6 +338,10 @@ tmap_map4_aux_core(tmap_seq_t *seq,
       }
       // realloc
       tmap_map_sams_realloc(sams, n);
+      free(pacpos_all);
+      free(seqid_all);
+      free(pos_all);
+      free(strand_all);
   }
 
   tmap_bwt_smem_intv_vec_destroy(matches);
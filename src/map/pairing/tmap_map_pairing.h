@@ -51,6 +51,8 @@ tmap_map_pairing_get_position_diff(tmap_map_sam_t *one, tmap_map_sam_t *two, int
   @param  one_seq  the sequence for the first end (foward/reverse compliment) (A)
   @param  two_seq  the sequence for the second end (forward/reverse compliment) (B)
   @param  rand     the random number generator
+  @param  one_vsws the vectorized aligners for the first end, NULL to use temporary ones (A)
+  @param  two_vsws the vectorized aligners for the second end, NULL to use temporary ones (B)
   @param  opt      the program parameters
   @return          0 if no reads are rescued, 1 if only end 1 was rescued, 2 if only end 2 was 
   rescued, and 3 if both ends were rescued
@@ -60,7 +62,8 @@ tmap_map_pairing_read_rescue(tmap_refseq_t *refseq,
                              tmap_seq_t *one_orig, tmap_seq_t *two_orig,
                              tmap_map_sams_t *one, tmap_map_sams_t *two, 
                              tmap_seq_t *one_seq[2], tmap_seq_t *two_seq[2], 
-                             tmap_rand_t *rand, tmap_map_opt_t *opt);
+                             tmap_rand_t *rand, tmap_map_util_vsw_t *one_vsws, tmap_map_util_vsw_t *two_vsws, 
+                             tmap_map_opt_t *opt);
 
 /*!
   given sets of seeds for two ends of pair, scores all possible pairs of seeds and
@@ -1,5 +1,6 @@
 /* Copyright (C) 2010 Ion Torrent Systems, Inc. All Rights Reserved */
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <float.h>
 #include <config.h>
@@ -15,6 +16,7 @@
 #include "../util/tmap_sort.h"
 #include "../util/tmap_rand.h"
 #include "../util/tmap_hash.h"
+#include "../util/tmap_time.h"
 #include "../seq/tmap_seq.h"
 #include "../index/tmap_refseq.h"
 #include "../index/tmap_bwt_gen.h"
@@ -32,12 +34,6 @@
 #include "pairing/tmap_map_pairing.h"
 #include "tmap_map_driver.h"
 
-// NB: do not turn these on, as they do not currently improve run time. They
-// could be useful if many duplicate lookups are performed and the hash
-// retrieval was fast...
-//#define TMAP_DRIVER_USE_HASH 1
-//#define TMAP_DRIVER_CLEAR_HASH_PER_READ 1
-
 #define __tmap_map_sam_sort_score_lt(a, b) ((a).score > (b).score)
 TMAP_SORT_INIT(tmap_map_sam_sort_score, tmap_map_sam_t, __tmap_map_sam_sort_score_lt)
 
@@ -110,6 +106,565 @@ tmap_map_driver_do_threads_cleanup(tmap_map_driver_t *driver, int32_t tid)
   }
 }
 
+static tmap_map_driver_buffer_t*
+tmap_map_driver_buffer_init(int32_t reads_queue_size, int32_t seq_type, int32_t num_threads)
+{
+  int32_t i;
+  tmap_map_driver_buffer_t *buffer = NULL;
+  buffer = tmap_calloc(1, sizeof(tmap_map_driver_buffer_t), "buffer");
+  buffer->seq = -1;
+  buffer->seqs_buffer = tmap_malloc(sizeof(tmap_seqs_t*)*reads_queue_size, "buffer->seqs_buffer");
+  for(i=0;i<reads_queue_size;i++) { // initialize the buffer
+      buffer->seqs_buffer[i] = tmap_seqs_init(seq_type);
+  }
+  buffer->records = tmap_malloc(sizeof(tmap_map_record_t*)*reads_queue_size, "buffer->records");
+  buffer->bams = tmap_malloc(sizeof(tmap_map_bams_t*)*reads_queue_size, "buffer->bams");
+  buffer->done = tmap_calloc(reads_queue_size, sizeof(int32_t), "buffer->done");
+  buffer->stats = tmap_malloc(sizeof(tmap_map_stats_t*)*num_threads, "buffer->stats");
+  for(i=0;i<num_threads;i++) {
+      buffer->stats[i] = tmap_map_stats_init();
+  }
+  return buffer;
+}
+
+static void
+tmap_map_driver_buffer_destroy(tmap_map_driver_buffer_t *buffer, int32_t reads_queue_size, int32_t num_threads)
+{
+  int32_t i;
+  for(i=0;i<reads_queue_size;i++) {
+      tmap_seqs_destroy(buffer->seqs_buffer[i]);
+  }
+  for(i=0;i<num_threads;i++) {
+      tmap_map_stats_destroy(buffer->stats[i]);
+  }
+  free(buffer->seqs_buffer);
+  free(buffer->records);
+  free(buffer->bams);
+  free(buffer->done);
+  free(buffer->stats);
+  free(buffer);
+}
+
+static tmap_map_driver_pipeline_t*
+tmap_map_driver_pipeline_init(tmap_seqs_io_t *io_in,
+                              sam_header_t *header,
+                              tmap_index_t *index,
+                              tmap_map_driver_t *driver,
+                              int32_t reads_queue_size,
+                              int32_t seq_type)
+{
+  int32_t i;
+  tmap_map_driver_pipeline_t *p = NULL;
+
+  p = tmap_calloc(1, sizeof(tmap_map_driver_pipeline_t), "p");
+  p->io_in = io_in;
+  p->header = header;
+  p->index = index;
+  p->driver = driver;
+  p->reads_queue_size = reads_queue_size;
+  p->wait_idx = -1;
+#ifdef HAVE_LIBPTHREAD
+  p->num_map_threads = driver->opt->num_threads;
+  p->num_encode_threads = driver->opt->encoding_threads;
+#else
+  p->num_map_threads = 1;
+  p->num_encode_threads = 0;
+#endif
+  p->steps[TMAP_MAP_DRIVER_PIPELINE_READ].num_threads = 1;
+  p->steps[TMAP_MAP_DRIVER_PIPELINE_MAP].num_threads = p->num_map_threads;
+  p->steps[TMAP_MAP_DRIVER_PIPELINE_ENCODE].num_threads = p->num_encode_threads;
+  p->steps[TMAP_MAP_DRIVER_PIPELINE_WRITE].num_threads = 1;
+
+  // the occurrence cache shared by the mapping threads
+  if(0 < driver->opt->occ_cache_size) {
+      p->occ_cache = tmap_bwt_match_hash_cache_init(index->bwt->seq_len, (uint64_t)driver->opt->occ_cache_size << 20);
+  }
+
+  // the buffers of reads
+  p->num_buffers = driver->opt->pipeline_buffers;
+  p->buffers = tmap_malloc(sizeof(tmap_map_driver_buffer_t*)*p->num_buffers, "p->buffers");
+  for(i=0;i<p->num_buffers;i++) {
+      p->buffers[i] = tmap_map_driver_buffer_init(reads_queue_size, seq_type, p->num_map_threads);
+  }
+
+  // random # generator for each mapping thread
+  p->map_thread_data = tmap_calloc(p->num_map_threads, sizeof(tmap_map_driver_thread_data_t), "p->map_thread_data");
+  for(i=0;i<p->num_map_threads;i++) {
+      p->map_thread_data[i].pipeline = p;
+#ifdef HAVE_LIBPTHREAD
+      p->map_thread_data[i].rand = tmap_rand_init(i);
+#else
+      p->map_thread_data[i].rand = tmap_rand_init(13);
+#endif
+      p->map_thread_data[i].tid = i;
+      p->map_thread_data[i].index = tmap_index_get_thread_index(index, i);
+  }
+  p->encode_thread_data = tmap_calloc(p->num_encode_threads, sizeof(tmap_map_driver_thread_data_t), "p->encode_thread_data");
+  for(i=0;i<p->num_encode_threads;i++) {
+      p->encode_thread_data[i].pipeline = p;
+      p->encode_thread_data[i].tid = i;
+  }
+#ifdef ENABLE_TMAP_DEBUG_FUNCTIONS
+  p->rand_core = tmap_rand_init(13); // random # generator for sampling
+#endif
+
+#ifdef HAVE_LIBPTHREAD
+  if(0 != pthread_mutex_init(&p->mutex, NULL)
+     || 0 != pthread_cond_init(&p->state_cond, NULL)
+     || 0 != pthread_cond_init(&p->done_cond, NULL)) {
+      tmap_error("error initializing the mutex", Exit, ThreadError);
+  }
+#endif
+
+  return p;
+}
+
+static void
+tmap_map_driver_pipeline_destroy(tmap_map_driver_pipeline_t *p)
+{
+  int32_t i;
+  if(NULL == p) return;
+#ifdef HAVE_LIBPTHREAD
+  pthread_mutex_destroy(&p->mutex);
+  pthread_cond_destroy(&p->state_cond);
+  pthread_cond_destroy(&p->done_cond);
+  free(p->reader);
+  free(p->map_threads);
+  free(p->encode_threads);
+#endif
+  for(i=0;i<p->num_buffers;i++) {
+      tmap_map_driver_buffer_destroy(p->buffers[i], p->reads_queue_size, p->num_map_threads);
+  }
+  for(i=0;i<p->num_map_threads;i++) {
+      tmap_rand_destroy(p->map_thread_data[i].rand);
+  }
+#ifdef ENABLE_TMAP_DEBUG_FUNCTIONS
+  tmap_rand_destroy(p->rand_core);
+#endif
+  tmap_bwt_match_hash_cache_destroy(p->occ_cache);
+  free(p->buffers);
+  free(p->map_thread_data);
+  free(p->encode_thread_data);
+  free(p);
+}
+
+static inline void
+tmap_map_driver_pipeline_lock(tmap_map_driver_pipeline_t *p)
+{
+#ifdef HAVE_LIBPTHREAD
+  pthread_mutex_lock(&p->mutex);
+#endif
+}
+
+static inline void
+tmap_map_driver_pipeline_unlock(tmap_map_driver_pipeline_t *p)
+{
+#ifdef HAVE_LIBPTHREAD
+  pthread_mutex_unlock(&p->mutex);
+#endif
+}
+
+// counts the buffers queued for the given step; called with the mutex held
+static void
+tmap_map_driver_pipeline_count_queue(tmap_map_driver_pipeline_t *p, int32_t step)
+{
+  int64_t n = 0;
+  switch(step) {
+    case TMAP_MAP_DRIVER_PIPELINE_READ: // buffers that can be filled
+      n = p->num_buffers - (p->read_seq - p->write_seq);
+      break;
+    case TMAP_MAP_DRIVER_PIPELINE_MAP:
+      n = p->read_seq - p->map_seq;
+      break;
+    case TMAP_MAP_DRIVER_PIPELINE_ENCODE:
+      n = p->map_seq - p->encode_seq;
+      break;
+    case TMAP_MAP_DRIVER_PIPELINE_WRITE:
+      n = ((0 < p->num_encode_threads) ? p->encode_seq : p->map_seq) - p->write_seq;
+      break;
+    default:
+      tmap_bug();
+  }
+  if(n < 0) n = 0;
+  p->steps[step].queue_sum += n;
+  p->steps[step].queue_n++;
+  if(p->steps[step].queue_max < n) p->steps[step].queue_max = n;
+}
+
+// waits until the buffer at the position given by next has reached the given
+// state, returning NULL if there are no more reads; called with the mutex held
+// NB: next is re-read after each wait, as other threads may move it forward
+static tmap_map_driver_buffer_t*
+tmap_map_driver_pipeline_get(tmap_map_driver_pipeline_t *p, int64_t *next, int32_t state, int64_t *seq, double *wait_time)
+{
+  tmap_map_driver_buffer_t *buffer = NULL;
+  double start = tmap_time_realtime();
+  while(1) {
+      (*seq) = (*next);
+      buffer = p->buffers[(*seq) % p->num_buffers];
+      if((*seq) == buffer->seq && state <= buffer->state) break;
+      if(1 == p->eof && p->read_seq <= (*seq)) {
+          buffer = NULL;
+          break;
+      }
+#ifdef HAVE_LIBPTHREAD
+      pthread_cond_wait(&p->state_cond, &p->mutex);
+#else
+      tmap_bug();
+#endif
+  }
+  (*wait_time) += tmap_time_realtime() - start;
+  return buffer;
+}
+
+// hands the reads in the buffer to the mapping threads, or marks the end of
+// the reads if there are none
+static void
+tmap_map_driver_pipeline_publish(tmap_map_driver_pipeline_t *p, tmap_map_driver_buffer_t *buffer, 
+                                 int64_t seq, int64_t first, int32_t seqs_buffer_length, int32_t do_pairing)
+{
+  int32_t i;
+  tmap_map_driver_pipeline_lock(p);
+  if(0 == seqs_buffer_length) {
+      p->eof = 1;
+  }
+  else {
+      buffer->seq = seq;
+      buffer->first = first;
+      buffer->do_pairing = do_pairing;
+      buffer->seqs_buffer_length = seqs_buffer_length;
+      buffer->map_low = buffer->encode_low = buffer->num_mapped = 0;
+      for(i=0;i<seqs_buffer_length;i++) {
+          buffer->done[i] = 0;
+      }
+      buffer->state = TMAP_MAP_DRIVER_BUFFER_LOADED;
+      p->read_seq = seq + 1;
+  }
+#ifdef HAVE_LIBPTHREAD
+  pthread_cond_broadcast(&p->state_cond);
+#endif
+  tmap_map_driver_pipeline_unlock(p);
+}
+
+#ifdef ENABLE_TMAP_DEBUG_FUNCTIONS
+// sample reads, returning the number kept
+static int32_t
+tmap_map_driver_pipeline_sample(tmap_map_driver_pipeline_t *p, tmap_seqs_t **seqs_buffer, int32_t seqs_buffer_length)
+{
+  int32_t i, j;
+
+  if(1 <= p->driver->opt->sample_reads) return seqs_buffer_length;
+
+  for(i=j=0;i<seqs_buffer_length;i++) {
+      if(p->driver->opt->sample_reads < tmap_rand_get(p->rand_core)) continue; // skip
+      if(j < i) {
+          tmap_seqs_t *seqs;
+          seqs = seqs_buffer[j];
+          seqs_buffer[j] = seqs_buffer[i]; 
+          seqs_buffer[i] = seqs;
+      }
+      j++;
+  }
+  tmap_progress_print2("sampling %d out of %d [%.2lf%%]", j, seqs_buffer_length, 100.0*j/(double)seqs_buffer_length);
+  return j;
+}
+#endif
+
+// reads the next buffer of reads, returning the number of reads read
+static int32_t
+tmap_map_driver_pipeline_load(tmap_map_driver_pipeline_t *p, int32_t do_pairing)
+{
+  tmap_map_driver_pipeline_step_t *step = &p->steps[TMAP_MAP_DRIVER_PIPELINE_READ];
+  tmap_map_driver_buffer_t *buffer = NULL;
+  int32_t seqs_buffer_length;
+  int64_t seq, first;
+  double start;
+
+  // wait for the buffer to be written 
+  tmap_map_driver_pipeline_lock(p);
+  seq = p->read_seq;
+  buffer = p->buffers[seq % p->num_buffers];
+  tmap_map_driver_pipeline_count_queue(p, TMAP_MAP_DRIVER_PIPELINE_READ);
+  start = tmap_time_realtime();
+  while(TMAP_MAP_DRIVER_BUFFER_EMPTY != buffer->state) {
+#ifdef HAVE_LIBPTHREAD
+      pthread_cond_wait(&p->state_cond, &p->mutex);
+#else
+      tmap_bug();
+#endif
+  }
+  step->wait_time += tmap_time_realtime() - start;
+  tmap_map_driver_pipeline_unlock(p);
+
+  // get the reads
+  start = tmap_time_realtime();
+  tmap_progress_print("loading reads");
+  seqs_buffer_length = tmap_seqs_io_read_buffer(p->io_in, buffer->seqs_buffer, p->reads_queue_size, p->header);
+#ifdef ENABLE_TMAP_DEBUG_FUNCTIONS
+  // keep reading if no reads were sampled
+  while(0 < seqs_buffer_length 
+        && 0 == (seqs_buffer_length = tmap_map_driver_pipeline_sample(p, buffer->seqs_buffer, seqs_buffer_length))) {
+      seqs_buffer_length = tmap_seqs_io_read_buffer(p->io_in, buffer->seqs_buffer, p->reads_queue_size, p->header);
+  }
+#endif
+  tmap_progress_print2("loaded %d reads", seqs_buffer_length);
+  first = step->num_reads;
+  step->num_reads += seqs_buffer_length;
+  step->busy_time += tmap_time_realtime() - start;
+
+  tmap_map_driver_pipeline_publish(p, buffer, seq, first, seqs_buffer_length, do_pairing);
+
+  return seqs_buffer_length;
+}
+
+// claims the next block of reads [low, high) for the given step, returning 0
+// if none are left 
+static int32_t
+tmap_map_driver_pipeline_claim(tmap_map_driver_pipeline_t *p, tmap_map_driver_buffer_t *buffer, int64_t seq,
+                               int32_t step, int32_t *low, int32_t *high)
+{
+  int32_t n, num_threads, state, *next = NULL;
+  if(TMAP_MAP_DRIVER_PIPELINE_MAP == step) {
+      next = &buffer->map_low;
+      num_threads = p->num_map_threads;
+      state = TMAP_MAP_DRIVER_BUFFER_LOADED;
+  }
+  else {
+      next = &buffer->encode_low;
+      num_threads = p->num_encode_threads;
+      state = TMAP_MAP_DRIVER_BUFFER_MAPPED;
+  }
+  tmap_map_driver_pipeline_lock(p);
+  // NB: the buffer may have been written and re-filled since it was handed out
+  if(seq != buffer->seq || state != buffer->state) {
+      (*low) = (*high) = 0;
+  }
+  else {
+      // hand out smaller blocks as the buffer empties, so that the threads
+      // finish at about the same time
+      n = (buffer->seqs_buffer_length - (*next)) / (2 * num_threads);
+      if(TMAP_MAP_DRIVER_THREAD_BLOCK_SIZE < n) n = TMAP_MAP_DRIVER_THREAD_BLOCK_SIZE;
+      else if(n < 1) n = 1;
+      (*low) = (*next);
+      (*high) = (*low) + n;
+      if(buffer->seqs_buffer_length < (*high)) (*high) = buffer->seqs_buffer_length;
+      (*next) = (*high);
+  }
+  tmap_map_driver_pipeline_unlock(p);
+  return ((*low) < (*high)) ? 1 : 0;
+}
+
+// records that the given step is done with the read 
+static void
+tmap_map_driver_pipeline_set_done(tmap_map_driver_pipeline_t *p, tmap_map_driver_buffer_t *buffer, int32_t idx, int32_t step)
+{
+  tmap_map_driver_pipeline_lock(p);
+  if(TMAP_MAP_DRIVER_PIPELINE_MAP == step && 0 < p->num_encode_threads && 0 == buffer->do_pairing) {
+      // hand the buffer to the encoding threads once all its reads are mapped
+      buffer->num_mapped++;
+      if(buffer->num_mapped == buffer->seqs_buffer_length) {
+          buffer->state = TMAP_MAP_DRIVER_BUFFER_MAPPED;
+#ifdef HAVE_LIBPTHREAD
+          pthread_cond_broadcast(&p->state_cond);
+#endif
+      }
+  }
+  else {
+      buffer->done[idx] = 1;
+#ifdef HAVE_LIBPTHREAD
+      // wake up the writer if it is waiting on this read
+      if(buffer->seq == p->write_seq && idx == p->wait_idx) {
+          pthread_cond_signal(&p->done_cond);
+      }
+#endif
+  }
+  tmap_map_driver_pipeline_unlock(p);
+}
+
+// blocks until the read at the given index is ready to be written.  Waking
+// up sooner only changes when the reads are written, not their order, and the
+// alignments only match across runs and -n since each read is seeded by its
+// position in the input.
+static void
+tmap_map_driver_pipeline_wait(tmap_map_driver_pipeline_t *p, tmap_map_driver_buffer_t *buffer, int32_t idx)
+{
+  double start;
+  tmap_map_driver_pipeline_lock(p);
+  if(0 == buffer->done[idx]) {
+      start = tmap_time_realtime();
+#ifdef HAVE_LIBPTHREAD
+      while(0 == buffer->done[idx]) {
+          p->wait_idx = idx;
+          pthread_cond_wait(&p->done_cond, &p->mutex);
+      }
+      p->wait_idx = -1;
+#else
+      tmap_bug();
+#endif
+      p->steps[TMAP_MAP_DRIVER_PIPELINE_WRITE].wait_time += tmap_time_realtime() - start;
+  }
+  tmap_map_driver_pipeline_unlock(p);
+}
+
+// hands the buffer back to the reader once its reads have been written
+static void
+tmap_map_driver_pipeline_release(tmap_map_driver_pipeline_t *p, tmap_map_driver_buffer_t *buffer)
+{
+  tmap_map_driver_pipeline_lock(p);
+  buffer->state = TMAP_MAP_DRIVER_BUFFER_EMPTY;
+  p->write_seq = buffer->seq + 1;
+  // no thread should wait on a written buffer
+  if(p->map_seq < p->write_seq) p->map_seq = p->write_seq;
+  if(p->encode_seq < p->write_seq) p->encode_seq = p->write_seq;
+#ifdef HAVE_LIBPTHREAD
+  pthread_cond_broadcast(&p->state_cond);
+#endif
+  tmap_map_driver_pipeline_unlock(p);
+}
+
+// hands the reads in the given buffer, which have been mapped to infer the
+// pairing parameters, to the mapping threads again
+// NB: must be called before the reader is started
+static void
+tmap_map_driver_pipeline_reload(tmap_map_driver_pipeline_t *p, tmap_map_driver_buffer_t *prev)
+{
+  tmap_map_driver_buffer_t *buffer = NULL;
+  tmap_seqs_t **seqs_buffer = NULL;
+  int64_t seq;
+
+  tmap_map_driver_pipeline_release(p, prev);
+
+  seq = p->read_seq;
+  buffer = p->buffers[seq % p->num_buffers];
+  if(TMAP_MAP_DRIVER_BUFFER_EMPTY != buffer->state) tmap_bug();
+
+  // swap the reads into the next buffer
+  seqs_buffer = buffer->seqs_buffer;
+  buffer->seqs_buffer = prev->seqs_buffer;
+  prev->seqs_buffer = seqs_buffer;
+
+  tmap_map_driver_pipeline_publish(p, buffer, seq, prev->first, prev->seqs_buffer_length, 0);
+}
+
+// writes the next buffer of reads, returning the number of reads written, or
+// zero if there are no more reads
+static int32_t
+tmap_map_driver_pipeline_write(tmap_map_driver_pipeline_t *p, tmap_sam_io_t *io_out, tmap_map_stats_t *stat)
+{
+  tmap_map_driver_pipeline_step_t *step = &p->steps[TMAP_MAP_DRIVER_PIPELINE_WRITE];
+  tmap_map_driver_buffer_t *buffer = NULL;
+  tmap_map_bams_t **bams = NULL;
+  int32_t i, j, k, seqs_buffer_length;
+  int64_t seq;
+  double start;
+
+  tmap_map_driver_pipeline_lock(p);
+  tmap_map_driver_pipeline_count_queue(p, TMAP_MAP_DRIVER_PIPELINE_WRITE);
+  buffer = tmap_map_driver_pipeline_get(p, &p->write_seq, TMAP_MAP_DRIVER_BUFFER_LOADED, &seq, &step->wait_time);
+  tmap_map_driver_pipeline_unlock(p);
+  if(NULL == buffer) return 0;
+
+  // write data
+  bams = buffer->bams;
+  seqs_buffer_length = buffer->seqs_buffer_length;
+  for(i=0;i<seqs_buffer_length;i++) {
+      // NB: we will write data as threads process the data.  This is to
+      // facilitate SAM/BAM writing, which may be slow, especially for
+      // BAM.
+      tmap_map_driver_pipeline_wait(p, buffer, i);
+      start = tmap_time_realtime();
+      // write
+      for(j=0;j<bams[i]->n;j++) { // for each end
+          for(k=0;k<bams[i]->bams[j]->n;k++) { // for each hit
+              bam1_t *b = NULL;
+              b = bams[i]->bams[j]->bams[k]; // that's a lot of BAMs
+              if(NULL == b) tmap_bug();
+              if(tmap_sam_io_write(io_out, b) <= 0) {
+                  tmap_error("Error writing the SAM file", Exit, WriteFileError);
+              }
+          }
+      }
+      tmap_map_bams_destroy(bams[i]);
+      bams[i] = NULL;
+      step->busy_time += tmap_time_realtime() - start;
+  }
+  step->num_reads += seqs_buffer_length;
+
+  // add the stats
+  for(i=0;i<p->num_map_threads;i++) {
+      tmap_map_stats_add(stat, buffer->stats[i]);
+      memset(buffer->stats[i], 0, sizeof(tmap_map_stats_t));
+  }
+
+  tmap_map_driver_pipeline_release(p, buffer);
+
+  return seqs_buffer_length;
+}
+
+// prints the work done by each step of the pipeline
+static void
+tmap_map_driver_pipeline_print(tmap_map_driver_pipeline_t *p)
+{
+  static char *names[] = {"reading", "mapping", "encoding", "writing"};
+  tmap_map_driver_pipeline_step_t *step = NULL;
+  uint64_t n_8bit, n_16bit;
+  int32_t i;
+
+  // sum the work done by each thread
+  step = &p->steps[TMAP_MAP_DRIVER_PIPELINE_MAP];
+  for(i=0;i<p->num_map_threads;i++) {
+      step->num_reads += p->map_thread_data[i].num_reads;
+      step->busy_time += p->map_thread_data[i].busy_time;
+      step->wait_time += p->map_thread_data[i].wait_time;
+  }
+  step = &p->steps[TMAP_MAP_DRIVER_PIPELINE_ENCODE];
+  for(i=0;i<p->num_encode_threads;i++) {
+      step->num_reads += p->encode_thread_data[i].num_reads;
+      step->busy_time += p->encode_thread_data[i].busy_time;
+      step->wait_time += p->encode_thread_data[i].wait_time;
+  }
+
+  for(i=0;i<TMAP_MAP_DRIVER_PIPELINE_NUM;i++) {
+      step = &p->steps[i];
+      if(0 == step->num_threads) continue;
+      tmap_progress_print2("%s: %d threads processed %lld reads (%.2lf sec busy, %.2lf sec waiting, %.2lf buffers queued on average, %d at most)",
+                           names[i], step->num_threads, (long long int)step->num_reads, step->busy_time, step->wait_time,
+                           (0 < step->queue_n) ? step->queue_sum / (double)step->queue_n : 0.0, step->queue_max);
+  }
+
+  // how often the occurrence cache saved a lookup
+  if(NULL != p->occ_cache) {
+      uint64_t n_hits = 0, n_misses = 0;
+      for(i=0;i<p->num_map_threads;i++) {
+          n_hits += p->map_thread_data[i].occ_hits;
+          n_misses += p->map_thread_data[i].occ_misses;
+      }
+      tmap_progress_print2("occurrence cache: %llu hits and %llu misses (%.2lf%% hits) in %llu MB", 
+                           (unsigned long long)n_hits, (unsigned long long)n_misses,
+                           (0 < n_hits + n_misses) ? 100.0 * n_hits / (double)(n_hits + n_misses) : 0.0,
+                           (unsigned long long)(p->occ_cache->num_bytes >> 20));
+  }
+
+  // how often the vectorized alignment needed 16-bit lanes
+  n_8bit = n_16bit = 0;
+  for(i=0;i<p->num_map_threads;i++) {
+      n_8bit += p->map_thread_data[i].vsw_8bit;
+      n_16bit += p->map_thread_data[i].vsw_16bit;
+  }
+  if(0 < n_8bit) {
+      tmap_progress_print2("vectorized alignment: %llu of %llu problems started with 8-bit lanes needed 16-bit lanes (%.2lf%%)", 
+                           (unsigned long long)n_16bit, (unsigned long long)n_8bit, 100.0 * n_16bit / (double)n_8bit);
+  }
+
+  // how well the reads were balanced across the mapping threads
+  if(1 < p->num_map_threads) {
+      for(i=0;i<p->num_map_threads;i++) {
+          tmap_progress_print2("mapping thread %d processed %d reads (%.2lf sec busy, %.2lf sec waiting)", 
+                               i, p->map_thread_data[i].num_reads, p->map_thread_data[i].busy_time, p->map_thread_data[i].wait_time);
+      }
+  }
+}
+
 static void
 tmap_map_driver_init_seqs(tmap_seq_t **seqs, tmap_seq_t *seq, int32_t max_length)
 {
@@ -137,69 +692,99 @@ tmap_map_driver_init_seqs(tmap_seq_t **seqs, tmap_seq_t *seq, int32_t max_length
   }
 }
 
+// converts the mappings for the read to BAM records, and destroys the mappings
+static void
+tmap_map_driver_encode_read(tmap_map_driver_buffer_t *buffer, int32_t low, tmap_refseq_t *refseq, tmap_map_driver_t *driver)
+{
+  int32_t j;
+  tmap_seqs_t **seqs_buffer = buffer->seqs_buffer;
+  tmap_map_record_t **records = buffer->records;
+  tmap_map_bams_t **bams = buffer->bams;
+
+  // convert the record to bam
+  if(1 == seqs_buffer[low]->n) {
+      bams[low] = tmap_map_bams_init(1); 
+      bams[low]->bams[0] = tmap_map_sams_print(seqs_buffer[low]->seqs[0], refseq, records[low]->sams[0], 
+                                               0, NULL, driver->opt->sam_flowspace_tags, driver->opt->bidirectional, driver->opt->seq_eq);
+  }
+  else {
+      bams[low] = tmap_map_bams_init(seqs_buffer[low]->n);
+      for(j=0;j<seqs_buffer[low]->n;j++) {
+          bams[low]->bams[j] = tmap_map_sams_print(seqs_buffer[low]->seqs[j], refseq, records[low]->sams[j],
+                                                   (0 == j) ? 1 : ((seqs_buffer[low]->n-1 == j) ? 2 : 0),
+                                                   records[low]->sams[(j+1) % seqs_buffer[low]->n], 
+                                                   driver->opt->sam_flowspace_tags, driver->opt->bidirectional, driver->opt->seq_eq);
+      }
+  }
+
+  // free alignments, for space
+  tmap_map_record_destroy(records[low]); 
+  records[low] = NULL;
+}
+
 void
-tmap_map_driver_core_worker(sam_header_t *sam_header,
-                            tmap_seqs_t **seqs_buffer, 
-                            tmap_map_record_t **records, 
-                            tmap_map_bams_t **bams,
-                            int32_t seqs_buffer_length,
-                            int32_t *buffer_idx,
-                            tmap_index_t *index,
-                            tmap_map_driver_t *driver,
-                            tmap_map_stats_t *stat,
-                            tmap_rand_t *rand,
-                            int32_t do_pairing,
-                            int32_t tid)
+tmap_map_driver_core_worker(tmap_map_driver_thread_data_t *thread_data,
+                            tmap_map_driver_buffer_t *buffer,
+                            int64_t seq,
+                            tmap_bwt_match_hash_t *hash)
 {
-  int32_t i, j, k, low = 0;
-  int32_t found;
+  int32_t i, j, k, low = 0, high = 0;
+  int32_t found, do_pairing;
+  double busy_start;
+  tmap_map_driver_pipeline_t *p = thread_data->pipeline;
+  tmap_index_t *index = thread_data->index;
+  tmap_map_driver_t *driver = p->driver;
+  tmap_rand_t *rand = thread_data->rand;
+  int32_t tid = thread_data->tid;
+  tmap_seqs_t **seqs_buffer = NULL;
+  tmap_map_record_t **records = NULL;
+  tmap_map_stats_t *stat = NULL;
   tmap_seq_t ***seqs = NULL;
-  tmap_bwt_match_hash_t *hash=NULL;
+  tmap_map_util_vsw_t **vsws = NULL;
   int32_t max_num_ends = 0;
 
-#ifdef TMAP_DRIVER_USE_HASH
-  // init the occurence hash
-  hash = tmap_bwt_match_hash_init(); 
-#endif
-
   // init memory
   max_num_ends = 2;
   seqs = tmap_malloc(sizeof(tmap_seq_t**)*max_num_ends, "seqs");
+  vsws = tmap_malloc(sizeof(tmap_map_util_vsw_t*)*max_num_ends, "vsws");
   for(i=0;i<max_num_ends;i++) {
       seqs[i] = tmap_calloc(4, sizeof(tmap_seq_t*), "seqs[i]");
+      vsws[i] = tmap_map_util_vsw_init();
   }
-  
-  // initialize thread data
-  tmap_map_driver_do_threads_init(driver, tid);
 
-  // Go through the buffer
-  while(low < seqs_buffer_length) {
-      if(tid == (low % driver->opt->num_threads)) {
+  // Go through the buffer, one block of reads at a time
+  while(1 == tmap_map_driver_pipeline_claim(p, buffer, seq, TMAP_MAP_DRIVER_PIPELINE_MAP, &low, &high)) {
+      busy_start = tmap_time_realtime();
+      // NB: only read the buffer once we hold a block of its reads
+      seqs_buffer = buffer->seqs_buffer;
+      records = buffer->records;
+      do_pairing = buffer->do_pairing;
+      stat = (1 == do_pairing) ? NULL : buffer->stats[tid];
+      for(;low<high;low++) {
           tmap_map_stats_t *stage_stat = NULL;
           tmap_map_record_t *record_prev = NULL;
           int32_t num_ends;
           
-#ifdef TMAP_DRIVER_USE_HASH
-#ifdef TMAP_DRIVER_CLEAR_HASH_PER_READ
-          // TODO: should we hash each read, or across the thread?
-          tmap_bwt_match_hash_clear(hash);
-#endif
-#endif
-
           num_ends = seqs_buffer[low]->n;
           if(max_num_ends < num_ends) {
               seqs = tmap_realloc(seqs, sizeof(tmap_seq_t**)*num_ends, "seqs");
+              vsws = tmap_realloc(vsws, sizeof(tmap_map_util_vsw_t*)*num_ends, "vsws");
               while(max_num_ends < num_ends) {
                   seqs[max_num_ends] = tmap_calloc(4, sizeof(tmap_seq_t*), "seqs[max_num_ends]");
+                  vsws[max_num_ends] = tmap_map_util_vsw_init();
                   max_num_ends++;
               }
               max_num_ends = num_ends;
           }
           
-          // re-initialize the random seed
+          // re-initialize the random seed, so the output does not depend on
+          // which thread maps the read
           if(driver->opt->rand_read_name) {
               tmap_rand_reinit(rand, tmap_hash_str_hash_func(tmap_seq_get_name(seqs_buffer[low]->seqs[0])->s));
           }
+          else {
+              tmap_rand_reinit(rand, buffer->first + low);
+          }
 
           // init
           for(i=0;i<num_ends;i++) {
@@ -274,7 +859,7 @@ tmap_map_driver_core_worker(sam_header_t *sam_header,
 
               // generate scores with smith waterman
               for(j=0;j<num_ends;j++) { // for each end
-                  records[low]->sams[j] = tmap_map_util_sw_gen_score(index->refseq, seqs_buffer[low]->seqs[j], records[low]->sams[j], seqs[j], rand, stage->opt, &k);
+                  records[low]->sams[j] = tmap_map_util_sw_gen_score(index->refseq, seqs_buffer[low]->seqs[j], records[low]->sams[j], seqs[j], rand, vsws[j], stage->opt, &k);
                   stage_stat->num_after_scoring += records[low]->sams[j]->n;
                   stage_stat->num_after_grouping += k;
               }
@@ -306,7 +891,7 @@ tmap_map_driver_core_worker(sam_header_t *sam_header,
                                                                   seqs_buffer[low]->seqs[0], seqs_buffer[low]->seqs[1],
                                                                   records[low]->sams[0], records[low]->sams[1],
                                                                   seqs[0], seqs[1],
-                                                                  rand, stage->opt);
+                                                                  rand, vsws[0], vsws[1], stage->opt);
                       // recalculate mapping qualities if necessary
                       if(0 < (flag & 0x1)) { // first end was rescued
                           //fprintf(stderr, "re-doing mapq for end #1\n");
@@ -335,7 +920,7 @@ tmap_map_driver_core_worker(sam_header_t *sam_header,
               // generate the cigars
               found = 0;
               for(j=0;j<num_ends;j++) { // for each end
-                  records[low]->sams[j] = tmap_map_util_sw_gen_cigar(index->refseq, records[low]->sams[j], seqs_buffer[low]->seqs[j], seqs[j], stage->opt);
+                  records[low]->sams[j] = tmap_map_util_sw_gen_cigar(index->refseq, records[low]->sams[j], seqs_buffer[low]->seqs[j], seqs[j], vsws[j], stage->opt);
                   if(0 < records[low]->sams[j]->n) {
                       stage_stat->num_with_mapping++;
                       found = 1;
@@ -388,27 +973,9 @@ tmap_map_driver_core_worker(sam_header_t *sam_header,
           }
 
           // only convert to BAM and destroy the records if we are not trying to
-          // estimate the pairing parameters
-          if(0 == do_pairing) {
-              // convert the record to bam
-              if(1 == seqs_buffer[low]->n) {
-                  bams[low] = tmap_map_bams_init(1); 
-                  bams[low]->bams[0] = tmap_map_sams_print(seqs_buffer[low]->seqs[0], index->refseq, records[low]->sams[0], 
-                                                           0, NULL, driver->opt->sam_flowspace_tags, driver->opt->bidirectional, driver->opt->seq_eq);
-              }
-              else {
-                  bams[low] = tmap_map_bams_init(seqs_buffer[low]->n);
-                  for(j=0;j<seqs_buffer[low]->n;j++) {
-                      bams[low]->bams[j] = tmap_map_sams_print(seqs_buffer[low]->seqs[j], index->refseq, records[low]->sams[j],
-                                                               (0 == j) ? 1 : ((seqs_buffer[low]->n-1 == j) ? 2 : 0),
-                                                               records[low]->sams[(j+1) % seqs_buffer[low]->n], 
-                                                               driver->opt->sam_flowspace_tags, driver->opt->bidirectional, driver->opt->seq_eq);
-                  }
-              }
-
-              // free alignments, for space
-              tmap_map_record_destroy(records[low]); 
-              records[low] = NULL;
+          // estimate the pairing parameters, and there are no threads to do so
+          if(0 == do_pairing && 0 == p->num_encode_threads) {
+              tmap_map_driver_encode_read(buffer, low, index->refseq, driver);
           }
 
           // free seqs
@@ -419,198 +986,232 @@ tmap_map_driver_core_worker(sam_header_t *sam_header,
               }
           }
           tmap_map_record_destroy(record_prev);
+
+          // the read is mapped
+          thread_data->num_reads++;
+          tmap_map_driver_pipeline_set_done(p, buffer, low, TMAP_MAP_DRIVER_PIPELINE_MAP);
       }
-      // next
-      (*buffer_idx) = low;
-      low++;
+      thread_data->busy_time += tmap_time_realtime() - busy_start;
   }
-  (*buffer_idx) = seqs_buffer_length;
-                  
+
   // free thread variables
   for(i=0;i<max_num_ends;i++) {
       free(seqs[i]);
+      tmap_vsw_count_escalations(vsws[i]->fwd, &thread_data->vsw_8bit, &thread_data->vsw_16bit);
+      tmap_vsw_count_escalations(vsws[i]->rev, &thread_data->vsw_8bit, &thread_data->vsw_16bit);
+      tmap_map_util_vsw_destroy(vsws[i]);
   }
   free(seqs);
-
-  // cleanup
-  tmap_map_driver_do_threads_cleanup(driver, tid);
-#ifdef TMAP_DRIVER_USE_HASH
-  // free hash
-  tmap_bwt_match_hash_destroy(hash);
-#endif
+  free(vsws);
 }
 
 void *
 tmap_map_driver_core_thread_worker(void *arg)
 {
   tmap_map_driver_thread_data_t *thread_data = (tmap_map_driver_thread_data_t*)arg;
+  tmap_map_driver_pipeline_t *p = thread_data->pipeline;
+  tmap_map_driver_buffer_t *buffer = NULL;
+  tmap_bwt_match_hash_t *hash = NULL;
+  int64_t seq;
+
+  // run on the NUMA node of the index this thread uses
+  tmap_index_pin_thread(p->index, thread_data->tid);
+
+  // initialize thread data, kept for the whole run
+  tmap_map_driver_do_threads_init(p->driver, thread_data->tid);
+  // the occurence hash, looking up the shared cache
+  if(NULL != p->occ_cache) {
+      hash = tmap_bwt_match_hash_init(p->occ_cache); 
+  }
 
-  tmap_map_driver_core_worker(thread_data->sam_header, thread_data->seqs_buffer, thread_data->records, thread_data->bams, 
-                              thread_data->seqs_buffer_length, thread_data->buffer_idx, thread_data->index, thread_data->driver, 
-                              thread_data->stat, thread_data->rand, thread_data->do_pairing, thread_data->tid);
+  tmap_map_driver_pipeline_lock(p);
+  while(1) {
+      // wait for the next buffer
+      buffer = tmap_map_driver_pipeline_get(p, &p->map_seq, TMAP_MAP_DRIVER_BUFFER_LOADED, &seq, &thread_data->wait_time);
+      if(NULL == buffer) break; // no more reads
+      tmap_map_driver_pipeline_unlock(p);
+
+      tmap_map_driver_core_worker(thread_data, buffer, seq, hash);
+
+      tmap_map_driver_pipeline_lock(p);
+      // move onto the next buffer, if no other thread has done so
+      if(seq == p->map_seq) {
+          p->map_seq++;
+          tmap_map_driver_pipeline_count_queue(p, TMAP_MAP_DRIVER_PIPELINE_MAP);
+      }
+  }
+  tmap_map_driver_pipeline_unlock(p);
+
+  // cleanup
+  tmap_map_driver_do_threads_cleanup(p->driver, thread_data->tid);
+  if(NULL != hash) {
+      thread_data->occ_hits += hash->n_hits;
+      thread_data->occ_misses += hash->n_misses;
+      tmap_bwt_match_hash_destroy(hash);
+  }
 
   return arg;
 }
 
-//static inline void
-static int32_t
-tmap_map_driver_create_threads(sam_header_t *header,
-                               tmap_seqs_t **seqs_buffer, 
-                               tmap_map_record_t **records, 
-                               tmap_map_bams_t **bams,
-                               int32_t seqs_buffer_length,
-                               tmap_index_t *index,
-                               tmap_map_driver_t *driver,
-                               tmap_map_stats_t *stat,
-#ifdef ENABLE_TMAP_DEBUG_FUNCTIONS
-                               tmap_rand_t *rand_core,
-#endif
 #ifdef HAVE_LIBPTHREAD
-                               pthread_attr_t **attr,
-                               pthread_t **threads,
-                               tmap_map_driver_thread_data_t **thread_data,
-                               tmap_rand_t **rand,
-                               tmap_map_stats_t **stats,
-#endif
-                               int32_t do_pairing)
+// converts the mappings to BAM records as the buffers are mapped
+static void *
+tmap_map_driver_encode_thread_worker(void *arg)
 {
-  int32_t i;
-#ifdef ENABLE_TMAP_DEBUG_FUNCTIONS
-  int32_t j;
-#endif
-  int32_t buffer_idx; // buffer index for processing data with a single thread
+  tmap_map_driver_thread_data_t *thread_data = (tmap_map_driver_thread_data_t*)arg;
+  tmap_map_driver_pipeline_t *p = thread_data->pipeline;
+  tmap_map_driver_buffer_t *buffer = NULL;
+  int32_t low = 0, high = 0;
+  int64_t seq;
+  double start;
 
-#ifdef ENABLE_TMAP_DEBUG_FUNCTIONS
-  // sample reads
-  if(driver->opt->sample_reads < 1) {
-      for(i=j=0;i<seqs_buffer_length;i++) {
-          if(driver->opt->sample_reads < tmap_rand_get(rand_core)) continue; // skip
-          if(j < i) {
-              tmap_seqs_t *seqs;
-              seqs = seqs_buffer[j];
-              seqs_buffer[j] = seqs_buffer[i]; 
-              seqs_buffer[i] = seqs;
+  pthread_mutex_lock(&p->mutex);
+  while(1) {
+      // wait for the next buffer
+      buffer = tmap_map_driver_pipeline_get(p, &p->encode_seq, TMAP_MAP_DRIVER_BUFFER_LOADED, &seq, &thread_data->wait_time);
+      if(NULL == buffer) break; // no more reads
+      // NB: the mappings are kept when inferring the pairing parameters
+      if(0 == buffer->do_pairing) {
+          if(TMAP_MAP_DRIVER_BUFFER_MAPPED != buffer->state) { // wait for it to be mapped
+              start = tmap_time_realtime();
+              pthread_cond_wait(&p->state_cond, &p->mutex);
+              thread_data->wait_time += tmap_time_realtime() - start;
+              continue;
+          }
+          pthread_mutex_unlock(&p->mutex);
+          while(1 == tmap_map_driver_pipeline_claim(p, buffer, seq, TMAP_MAP_DRIVER_PIPELINE_ENCODE, &low, &high)) {
+              start = tmap_time_realtime();
+              for(;low<high;low++) {
+                  tmap_map_driver_encode_read(buffer, low, p->index->refseq, p->driver);
+                  tmap_map_driver_pipeline_set_done(p, buffer, low, TMAP_MAP_DRIVER_PIPELINE_ENCODE);
+                  thread_data->num_reads++;
+              }
+              thread_data->busy_time += tmap_time_realtime() - start;
           }
-          j++;
+          pthread_mutex_lock(&p->mutex);
+      }
+      // move onto the next buffer, if no other thread has done so
+      if(seq == p->encode_seq) {
+          p->encode_seq++;
+          tmap_map_driver_pipeline_count_queue(p, TMAP_MAP_DRIVER_PIPELINE_ENCODE);
       }
-      tmap_progress_print2("sampling %d out of %d [%.2lf%%]", j, seqs_buffer_length, 100.0*j/(double)seqs_buffer_length);
-      seqs_buffer_length = j;
-      if(0 == seqs_buffer_length) return 0;
   }
-#endif
+  pthread_mutex_unlock(&p->mutex);
 
-  // do alignment
-#ifdef HAVE_LIBPTHREAD
-  if(1 == driver->opt->num_threads) {
-      buffer_idx = 0;
-      tmap_map_driver_core_worker(header, seqs_buffer, records, bams, 
-                                  seqs_buffer_length, &buffer_idx, index, driver, stat, rand[0], do_pairing, 0);
+  return arg;
+}
+
+// starts the mapping and encoding threads, which live for the whole run
+static void
+tmap_map_driver_pipeline_start_threads(tmap_map_driver_pipeline_t *p)
+{
+  int32_t i;
+  pthread_attr_t attr;
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+
+  p->map_threads = tmap_calloc(p->num_map_threads, sizeof(pthread_t), "p->map_threads");
+  for(i=0;i<p->num_map_threads;i++) {
+      if(0 != pthread_create(&p->map_threads[i], &attr, tmap_map_driver_core_thread_worker, &p->map_thread_data[i])) {
+          tmap_error("error creating threads", Exit, ThreadError);
+      }
   }
-  else {
-      (*attr) = tmap_calloc(1, sizeof(pthread_attr_t), "(*attr)");
-      pthread_attr_init((*attr));
-      pthread_attr_setdetachstate((*attr), PTHREAD_CREATE_JOINABLE);
-
-      (*threads) = tmap_calloc(driver->opt->num_threads, sizeof(pthread_t), "(*threads)");
-      (*thread_data) = tmap_calloc(driver->opt->num_threads, sizeof(tmap_map_driver_thread_data_t), "(*thread_data)");
-
-      // create threads
-      for(i=0;i<driver->opt->num_threads;i++) {
-          (*thread_data)[i].sam_header = header;
-          (*thread_data)[i].seqs_buffer = seqs_buffer;
-          (*thread_data)[i].seqs_buffer_length = seqs_buffer_length;
-          (*thread_data)[i].buffer_idx = tmap_calloc(1, sizeof(int32_t), "(*thread_data)[i].buffer_id");
-          (*thread_data)[i].records = records;
-          (*thread_data)[i].bams = bams;
-          (*thread_data)[i].index = index;
-          (*thread_data)[i].driver = driver;
-          if(NULL != stats) (*thread_data)[i].stat = stats[i];
-          else (*thread_data)[i].stat = NULL;
-          (*thread_data)[i].rand = rand[i];
-          (*thread_data)[i].do_pairing = do_pairing;
-          (*thread_data)[i].tid = i;
-          if(0 != pthread_create(&(*threads)[i], (*attr), tmap_map_driver_core_thread_worker, &(*thread_data)[i])) {
-              tmap_error("error creating threads", Exit, ThreadError);
-          }
+  p->encode_threads = tmap_calloc(p->num_encode_threads, sizeof(pthread_t), "p->encode_threads");
+  for(i=0;i<p->num_encode_threads;i++) {
+      if(0 != pthread_create(&p->encode_threads[i], &attr, tmap_map_driver_encode_thread_worker, &p->encode_thread_data[i])) {
+          tmap_error("error creating threads", Exit, ThreadError);
       }
   }
-#else 
-  buffer_idx = 0;
-  tmap_map_driver_core_worker(header, seqs_buffer, records, bams, 
-                              seqs_buffer_length, &buffer_idx, index, driver, stat, rand, do_pairing, 0);
-#endif
-  return 1;
+  pthread_attr_destroy(&attr);
 }
 
-static int32_t
-tmap_map_driver_infer_pairing(tmap_seqs_io_t *io_in,
-                              sam_header_t *header,
-                              tmap_seqs_t **seqs_buffer, 
-                              tmap_map_record_t **records, 
-                              tmap_map_bams_t **bams,
-                              int32_t seqs_buffer_length,
-                              int32_t reads_queue_size,
-                              tmap_index_t *index,
-                              tmap_map_driver_t *driver,
-                              tmap_map_stats_t *stat,
-#ifdef ENABLE_TMAP_DEBUG_FUNCTIONS
-                              tmap_rand_t *rand_core,
-#endif
-#ifdef HAVE_LIBPTHREAD
-                              pthread_attr_t **attr,
-                              pthread_t **threads,
-                              tmap_map_driver_thread_data_t **thread_data,
-                              tmap_rand_t **rand,
-                              tmap_map_stats_t **stats,
+static void *
+tmap_map_driver_reader_thread_worker(void *arg)
+{
+  tmap_map_driver_pipeline_t *p = (tmap_map_driver_pipeline_t*)arg;
+  while(0 < tmap_map_driver_pipeline_load(p, 0)) {
+      // keep reading until the buffers are full or all the reads are read
+  }
+  return arg;
+}
+
+// starts the thread that reads in the sequences
+static void
+tmap_map_driver_pipeline_start_reader(tmap_map_driver_pipeline_t *p)
+{
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+  p->reader = tmap_malloc(sizeof(pthread_t), "p->reader");
+  if(0 != pthread_create(p->reader, &attr, tmap_map_driver_reader_thread_worker, p)) {
+      tmap_error("error creating threads", Exit, ThreadError);
+  }
+  pthread_attr_destroy(&attr);
+}
+
+// waits for all the threads to exit, once all the reads have been written
+static void
+tmap_map_driver_pipeline_join(tmap_map_driver_pipeline_t *p)
+{
+  int32_t i;
+  if(NULL != p->reader && 0 != pthread_join((*p->reader), NULL)) {
+      tmap_error("error joining IO thread", Exit, ThreadError);
+  }
+  // NB: all the threads exit since there are no more reads
+  for(i=0;i<p->num_map_threads;i++) {
+      if(0 != pthread_join(p->map_threads[i], NULL)) {
+          tmap_error("error joining threads", Exit, ThreadError);
+      }
+  }
+  for(i=0;i<p->num_encode_threads;i++) {
+      if(0 != pthread_join(p->encode_threads[i], NULL)) {
+          tmap_error("error joining threads", Exit, ThreadError);
+      }
+  }
+}
 #endif
-                              ...) // NB: just so that the function definition is clean
+
+// maps the first buffer of reads to infer the pairing parameters, and then
+// queues the same reads to be mapped again
+static void
+tmap_map_driver_infer_pairing(tmap_map_driver_pipeline_t *p, tmap_bwt_match_hash_t *hash)
 {
   int32_t i, isize_num = 0, tmp;
   int32_t *isize = NULL;
   int32_t p25, p50, p75;
   int32_t max_len = 0;
+  tmap_map_driver_t *driver = p->driver;
+  tmap_map_driver_buffer_t *buffer = NULL;
+  tmap_seqs_t **seqs_buffer = NULL;
+  tmap_map_record_t **records = NULL;
+  int32_t seqs_buffer_length;
       
   // check if we should do pairing
-  if(driver->opt->strandedness < 0 || driver->opt->positioning < 0 || !(driver->opt->ins_size_std < 0)) return 0;
+  if(driver->opt->strandedness < 0 || driver->opt->positioning < 0 || !(driver->opt->ins_size_std < 0)) return;
 
   // NB: infers from the first chunk of reads
   tmap_progress_print("inferring pairing parameters");
-  tmap_progress_print("loading reads");
-  seqs_buffer_length = tmap_seqs_io_read_buffer(io_in, seqs_buffer, reads_queue_size, header);
-  tmap_progress_print2("loaded %d reads", seqs_buffer_length);
-  if(0 == seqs_buffer_length) return 0;
+  buffer = p->buffers[p->read_seq % p->num_buffers];
+  seqs_buffer_length = tmap_map_driver_pipeline_load(p, 1);
+  if(0 == seqs_buffer_length) return;
+  seqs_buffer = buffer->seqs_buffer;
+  records = buffer->records;
 
   // holds the insert sizes
   isize = tmap_malloc(sizeof(int32_t) * seqs_buffer_length, "isize");
 
   // TODO: check that he data is paired...
   // TODO: check that we choose only the best scoring alignment
-  // create the threads
-  if(0 == tmap_map_driver_create_threads(header, seqs_buffer, records, 
-                                         bams, seqs_buffer_length, index, driver, NULL,
-#ifdef ENABLE_TMAP_DEBUG_FUNCTIONS
-                                         rand_core,
+#ifndef HAVE_LIBPTHREAD
+  // start mapping the reads
+  tmap_map_driver_core_worker(&p->map_thread_data[0], buffer, buffer->seq, hash);
 #endif
-#ifdef HAVE_LIBPTHREAD
-                                         attr, threads, thread_data, rand, NULL,
-#endif
-                                         1)) {
-      return 0;
-  }
 
   // estimate pairing parameters
   for(i=0;i<seqs_buffer_length;i++) {
-#ifdef HAVE_LIBPTHREAD
-      if(1 < driver->opt->num_threads) {
-          // NB: we will write data as threads process the data.  This is to
-          // facilitate SAM/BAM writing, which may be slow, especially for
-          // BAM.
-          int32_t tid = (i % driver->opt->num_threads);
-          while((*(*thread_data)[tid].buffer_idx) <= i) {
-              usleep(1000*1000); // sleep
-          }
-      }
-#endif
+      // NB: we will use the data as threads process the data.
+      tmap_map_driver_pipeline_wait(p, buffer, i);
       // only for paired ends
       if(NULL != records[i]
          && 2 == records[i]->n 
@@ -648,28 +1249,13 @@ tmap_map_driver_infer_pairing(tmap_seqs_io_t *io_in,
       records[i] = NULL;
   }
 
-#ifdef HAVE_LIBPTHREAD
-  // join threads
-  if(1 < driver->opt->num_threads) {
-      // join threads
-      for(i=0;i<driver->opt->num_threads;i++) {
-          if(0 != pthread_join((*threads)[i], NULL)) {
-              tmap_error("error joining threads", Exit, ThreadError);
-          }
-          // free the buffer index
-          free((*thread_data)[i].buffer_idx);
-          (*thread_data)[i].buffer_idx = NULL;
-      }
-      free((*threads)); (*threads) = NULL;
-      free(*(thread_data)); (*thread_data) = NULL;
-      free((*attr)); (*attr) = NULL;
-  }
-#endif
-
   if(isize_num < 8) {
       tmap_error("failed to infer the insert size distribution (too few reads): turning pairing off", Warn, OutOfRange);
       driver->opt->pairing = -1;
-      return seqs_buffer_length;
+      free(isize);
+      // map the reads again
+      tmap_map_driver_pipeline_reload(p, buffer);
+      return;
   }
 
   // print the # of pairs we are using to infer the insert size distribution
@@ -733,59 +1319,21 @@ tmap_map_driver_infer_pairing(tmap_seqs_io_t *io_in,
   // free
   free(isize);
 
-  // return the # of sequences loaded into the buffer
-  return seqs_buffer_length;
+  // map the reads again, now with the pairing parameters
+  tmap_map_driver_pipeline_reload(p, buffer);
 }
 
-#ifdef HAVE_LIBPTHREAD
-typedef struct {
-    tmap_seqs_io_t *io_in;
-    tmap_sam_io_t *io_out;
-    tmap_seqs_t **seqs_buffer;
-    int32_t seqs_buffer_length;
-    int32_t reads_queue_size;
-} tmap_map_driver_thread_io_data_t;
-
-static void *
-tmap_map_driver_thread_io_worker(void *arg)
-{
-  tmap_map_driver_thread_io_data_t *d = (tmap_map_driver_thread_io_data_t*)arg;
-  d->seqs_buffer_length = tmap_seqs_io_read_buffer(d->io_in, d->seqs_buffer, d->reads_queue_size, d->io_out->fp->header->header);
-  return d;
-}
-#endif
-
 void 
 tmap_map_driver_core(tmap_map_driver_t *driver)
 {
-  uint32_t i, j, k, n_reads_processed=0; // # of reads processed
-  int32_t seqs_buffer_length=0; // # of reads read in
-  int32_t seqs_loaded=0; // 1 if the seq_buffer is loaded, 0 otherwse
+  uint32_t i, j, n_reads_processed=0; // # of reads processed
+  int32_t seqs_buffer_length=0; // # of reads written
   tmap_seqs_io_t *io_in = NULL; // input file(s)
   tmap_sam_io_t *io_out = NULL; // output file
-  tmap_seqs_t **seqs_buffer = NULL; // buffer for the reads
-#ifdef HAVE_LIBPTHREAD
-  tmap_seqs_t **seqs_buffer_next = NULL; // buffer for the reads
-#endif
-  tmap_map_record_t **records=NULL; // buffer for the mapped data
-  tmap_map_bams_t **bams=NULL;// buffer for the mapped BAM data
   tmap_index_t *index = NULL; // reference indes
   tmap_map_stats_t *stat = NULL; // alignment statistics
-#ifdef HAVE_LIBPTHREAD
-  pthread_attr_t *attr = NULL;
-  pthread_attr_t attr_io;
-  pthread_t *threads = NULL;
-  pthread_t *thread_io = NULL;
-  tmap_map_driver_thread_data_t *thread_data=NULL;
-  tmap_map_driver_thread_io_data_t thread_io_data;
-  tmap_rand_t **rand = NULL; // random # generator for each thread
-  tmap_map_stats_t **stats = NULL; // alignment statistics for each thread
-#else
-  tmap_rand_t *rand = NULL; // random # generator
-#endif
-#ifdef ENABLE_TMAP_DEBUG_FUNCTIONS
-  tmap_rand_t *rand_core = tmap_rand_init(13); // random # generator for sampling
-#endif
+  tmap_map_driver_pipeline_t *pipeline = NULL; // passes the reads between the reader, threads, and writer
+  tmap_bwt_match_hash_t *hash = NULL; // the occurrence hash when mapping without worker threads
   int32_t seq_type, reads_queue_size; // read type, read queue size
   bam_header_t *header = NULL; // BAM Header
 
@@ -814,7 +1362,7 @@ tmap_map_driver_core(tmap_map_driver_t *driver)
   io_in = tmap_seqs_io_init(driver->opt->fn_reads, driver->opt->fn_reads_num, seq_type, driver->opt->input_compr);
 
   // get the index
-  index = tmap_index_init(driver->opt->fn_fasta, driver->opt->shm_key);
+  index = tmap_index_init(driver->opt->fn_fasta, driver->opt->shm_key, driver->opt->index_huge_pages, driver->opt->index_numa);
 
   // initialize the driver->options and print any relevant information
   tmap_map_driver_do_init(driver, index->refseq);
@@ -826,30 +1374,8 @@ tmap_map_driver_core(tmap_map_driver_t *driver)
   else {
       reads_queue_size = driver->opt->reads_queue_size;
   }
-  seqs_buffer = tmap_malloc(sizeof(tmap_seqs_t*)*reads_queue_size, "seqs_buffer");
-#ifdef HAVE_LIBPTHREAD
-  seqs_buffer_next = tmap_malloc(sizeof(tmap_seqs_t*)*reads_queue_size, "seqs_buffer_next");
-#endif
-  for(i=0;i<reads_queue_size;i++) { // initialize the buffer
-      seqs_buffer[i] = tmap_seqs_init(seq_type);
-#ifdef HAVE_LIBPTHREAD
-      seqs_buffer_next[i] = tmap_seqs_init(seq_type);
-#endif
-  }
-  records = tmap_malloc(sizeof(tmap_map_record_t*)*reads_queue_size, "records");
-  bams = tmap_malloc(sizeof(tmap_map_bams_t*)*reads_queue_size, "bams");
 
   stat = tmap_map_stats_init();
-#ifdef HAVE_LIBPTHREAD
-  stats = tmap_malloc(driver->opt->num_threads * sizeof(tmap_map_stats_t*), "stats");
-  rand = tmap_malloc(driver->opt->num_threads * sizeof(tmap_rand_t*), "rand");
-  for(i=0;i<driver->opt->num_threads;i++) {
-      stats[i] = tmap_map_stats_init();
-      rand[i] = tmap_rand_init(i);
-  }
-#else
-  rand = tmap_rand_init(13);
-#endif
   
   // BAM Header
   header = tmap_seqs_io_to_bam_header(index->refseq, io_in, 
@@ -862,7 +1388,7 @@ tmap_map_driver_core(tmap_map_driver_t *driver)
       io_out = tmap_sam_io_init2((NULL == driver->opt->fn_sam) ? "-" : driver->opt->fn_sam, "wh", header); 
       break;
     case 1:
-      io_out = tmap_sam_io_init2((NULL == driver->opt->fn_sam) ? "-" : driver->opt->fn_sam, "wb", header); 
+      io_out = tmap_sam_io_init3((NULL == driver->opt->fn_sam) ? "-" : driver->opt->fn_sam, "wb", header, driver->opt->bam_compression_threads); 
       break;
     case 2:
       io_out = tmap_sam_io_init2((NULL == driver->opt->fn_sam) ? "-" : driver->opt->fn_sam, "wbu", header); 
@@ -875,131 +1401,46 @@ tmap_map_driver_core(tmap_map_driver_t *driver)
   bam_header_destroy(header);
   header = NULL;
 
-  // pairing
-  seqs_buffer_length = tmap_map_driver_infer_pairing(io_in, io_out->fp->header->header, seqs_buffer, records, 
-                                                     bams, seqs_buffer_length, reads_queue_size,
-                                                     index, driver, stat,
-#ifdef ENABLE_TMAP_DEBUG_FUNCTIONS
-                                                     rand_core,
-#endif
+  // the buffers of reads
+  pipeline = tmap_map_driver_pipeline_init(io_in, tmap_sam_io_get_sam_header(io_out), index, driver, reads_queue_size, seq_type);
+
+  // start the mapping threads, which live for the whole run
 #ifdef HAVE_LIBPTHREAD
-                                                     &attr, &threads, &thread_data, rand, stats,
-#endif
-                                                     0);
-  if(0 == seqs_buffer_length) {
-      tmap_progress_print("loading reads");
-      seqs_buffer_length = tmap_seqs_io_read_buffer(io_in, seqs_buffer, reads_queue_size, io_out->fp->header->header);
-      tmap_progress_print2("loaded %d reads", seqs_buffer_length);
+  tmap_map_driver_pipeline_start_threads(pipeline);
+#else
+  tmap_map_driver_do_threads_init(driver, 0);
+  if(NULL != pipeline->occ_cache) {
+      hash = tmap_bwt_match_hash_init(pipeline->occ_cache); 
   }
-  seqs_loaded = 1;
+#endif
+
+  // pairing
+  tmap_map_driver_infer_pairing(pipeline, hash);
 
   // main processing loop
   tmap_progress_print("processing reads");
-  while(1) {
-      // get the reads
-      if(0 == seqs_loaded) { 
-          tmap_progress_print("loading reads");
 #ifdef HAVE_LIBPTHREAD
-          // join the thread that loads in the reads
-          if(0 != pthread_join((*thread_io), NULL)) {
-              tmap_error("error joining IO thread", Exit, ThreadError);
-          }
-          free(thread_io);
-          thread_io = NULL;
-          // swap buffers
-          seqs_buffer_length = thread_io_data.seqs_buffer_length;
-          seqs_buffer_next = seqs_buffer; // temporarily store this here
-          seqs_buffer = thread_io_data.seqs_buffer; 
-          thread_io_data.seqs_buffer = seqs_buffer_next;
-#else
-          seqs_buffer_length = tmap_seqs_io_read_buffer(io_in, seqs_buffer, reads_queue_size, io_out->fp->header->header);
+  // read in the reads while the threads map them 
+  if(0 == pipeline->eof) {
+      tmap_map_driver_pipeline_start_reader(pipeline);
+  }
 #endif
-          seqs_loaded = 1;
-          tmap_progress_print2("loaded %d reads", seqs_buffer_length);
-      }
-      if(0 == seqs_buffer_length) { // are there any more?
+  while(1) {
+#ifndef HAVE_LIBPTHREAD
+      // get the reads, unless they were loaded when inferring the pairing parameters
+      if(pipeline->read_seq == pipeline->write_seq 
+         && 0 == tmap_map_driver_pipeline_load(pipeline, 0)) {
           break;
       }
-#ifdef HAVE_LIBPTHREAD
-      // launch a new thread that loads in the reads 
-      pthread_attr_init(&attr_io);
-      pthread_attr_setdetachstate(&attr_io, PTHREAD_CREATE_JOINABLE);
-      thread_io = tmap_malloc(sizeof(pthread_t), "thread_io");
-      thread_io_data.io_in = io_in;
-      thread_io_data.io_out = io_out;
-      thread_io_data.seqs_buffer_length = 0;
-      thread_io_data.reads_queue_size = reads_queue_size;
-      thread_io_data.seqs_buffer = seqs_buffer_next;
-      if(0 != pthread_create(thread_io, &attr_io, tmap_map_driver_thread_io_worker, &thread_io_data)) {
-          tmap_error("error creating threads", Exit, ThreadError);
-      }
+      // map the reads
+      tmap_map_driver_core_worker(&pipeline->map_thread_data[0], pipeline->buffers[pipeline->write_seq % pipeline->num_buffers], pipeline->write_seq, hash);
 #endif
 
-      // create the threads
-      if(0 == tmap_map_driver_create_threads(io_out->fp->header->header, seqs_buffer, records, 
-                                             bams, seqs_buffer_length, index, driver, stat,
-#ifdef ENABLE_TMAP_DEBUG_FUNCTIONS
-                                             rand_core,
-#endif
-#ifdef HAVE_LIBPTHREAD
-                                             &attr, &threads, &thread_data, rand, stats,
-#endif
-                                             0)) {
-          break;
-      }
-
-      /*
-      if(-1 != driver->opt->reads_queue_size) {
-          tmap_progress_print("writing alignments");
-      }
-      */
-
       // write data
-      for(i=0;i<seqs_buffer_length;i++) {
-#ifdef HAVE_LIBPTHREAD
-          if(1 < driver->opt->num_threads) {
-              // NB: we will write data as threads process the data.  This is to
-              // facilitate SAM/BAM writing, which may be slow, especially for
-              // BAM.
-              int32_t tid = (i % driver->opt->num_threads);
-              while((*thread_data[tid].buffer_idx) <= i) {
-                  usleep(1000*1000); // sleep
-              }
-          }
-#endif
-          // write
-          for(j=0;j<bams[i]->n;j++) { // for each end
-              for(k=0;k<bams[i]->bams[j]->n;k++) { // for each hit
-                  bam1_t *b = NULL;
-                  b = bams[i]->bams[j]->bams[k]; // that's a lot of BAMs
-                  if(NULL == b) tmap_bug();
-                  if(samwrite(io_out->fp, b) <= 0) {
-                      tmap_error("Error writing the SAM file", Exit, WriteFileError);
-                  }
-              }
-          }
-          tmap_map_bams_destroy(bams[i]);
-          bams[i] = NULL;
-      }
-
-#ifdef HAVE_LIBPTHREAD
-      // join threads
-      if(1 < driver->opt->num_threads) {
-          // join threads
-          for(i=0;i<driver->opt->num_threads;i++) {
-              if(0 != pthread_join(threads[i], NULL)) {
-                  tmap_error("error joining threads", Exit, ThreadError);
-              }
-              // add the stats
-              tmap_map_stats_add(stat, stats[i]);
-              // free the buffer index
-              free(thread_data[i].buffer_idx);
-          }
-          free(threads); threads = NULL;
-          free(thread_data); thread_data = NULL;
-          free(attr); attr = NULL;
+      seqs_buffer_length = tmap_map_driver_pipeline_write(pipeline, io_out, stat);
+      if(0 == seqs_buffer_length) { // are there any more?
+          break;
       }
-#endif
       // TODO: should we flush when writing SAM and processing one read at a time?
 
       // print statistics
@@ -1014,7 +1455,6 @@ tmap_map_driver_core(tmap_map_driver_t *driver)
                                stat->num_after_rmdup/(double)stat->num_with_mapping,
                                stat->num_after_filter/(double)stat->num_with_mapping);
       }
-      seqs_loaded = 0;
   }
   if(-1 == driver->opt->reads_queue_size) {
       tmap_progress_print2("processed %d reads", n_reads_processed);
@@ -1029,6 +1469,21 @@ tmap_map_driver_core(tmap_map_driver_t *driver)
           
   tmap_progress_print2("cleaning up");
 
+  // stop the threads
+#ifdef HAVE_LIBPTHREAD
+  tmap_map_driver_pipeline_join(pipeline);
+#else
+  tmap_map_driver_do_threads_cleanup(driver, 0);
+  if(NULL != hash) {
+      pipeline->map_thread_data[0].occ_hits += hash->n_hits;
+      pipeline->map_thread_data[0].occ_misses += hash->n_misses;
+      tmap_bwt_match_hash_destroy(hash);
+  }
+#endif
+
+  // print how busy each step of the pipeline was
+  tmap_map_driver_pipeline_print(pipeline);
+
   // cleanup the algorithm persistent data
   tmap_map_driver_do_cleanup(driver);
 
@@ -1038,33 +1493,8 @@ tmap_map_driver_core(tmap_map_driver_t *driver)
   // free memory
   tmap_index_destroy(index);
   tmap_seqs_io_destroy(io_in);
-  for(i=0;i<reads_queue_size;i++) {
-      tmap_seqs_destroy(seqs_buffer[i]);
-#ifdef HAVE_LIBPTHREAD
-      tmap_seqs_destroy(seqs_buffer_next[i]);
-#endif
-  }
-  free(seqs_buffer);
-#ifdef HAVE_LIBPTHREAD
-  free(seqs_buffer_next);
-#endif
-  free(records);
-  free(bams);
+  tmap_map_driver_pipeline_destroy(pipeline);
   tmap_map_stats_destroy(stat);
-#ifdef HAVE_LIBPTHREAD
-  for(i=0;i<driver->opt->num_threads;i++) {
-      tmap_map_stats_destroy(stats[i]);
-      tmap_rand_destroy(rand[i]);
-  }
-  free(stats);
-  free(rand);
-  free(thread_io);
-#else
-  tmap_rand_destroy(rand);
-#endif
-#ifdef ENABLE_TMAP_DEBUG_FUNCTIONS
-  tmap_rand_destroy(rand_core);
-#endif
 }
 
 /* MAIN API */
@@ -3,12 +3,15 @@
 #define TMAP_MAP_DRIVER_H
 
 #include <sys/types.h>
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 #include "../index/tmap_index.h"
 #include "../seq/tmap_seqs.h"
+#include "../io/tmap_seqs_io.h"
 
-#ifdef HAVE_LIBPTHREAD
-#define TMAP_MAP_DRIVER_THREAD_BLOCK_SIZE 512
-#endif
+// the maximum number of reads a thread claims from the buffer at once
+#define TMAP_MAP_DRIVER_THREAD_BLOCK_SIZE 64
 
 /*!
   This function will be invoked after reading in all the reference data
@@ -141,55 +144,131 @@ tmap_map_driver_run(tmap_map_driver_t *driver);
 void
 tmap_map_driver_destroy(tmap_map_driver_t *driver);
 
-/*! 
-  Driver data to be passed to a thread                         
+/*!
+  The steps of the driver pipeline, each run by its own thread(s).
   */
-typedef struct {                                            
-    sam_header_t *sam_header;  /*!< the SAM Header */
+enum {
+    TMAP_MAP_DRIVER_PIPELINE_READ = 0, /*!< reads in the sequences */
+    TMAP_MAP_DRIVER_PIPELINE_MAP, /*!< maps the sequences */
+    TMAP_MAP_DRIVER_PIPELINE_ENCODE, /*!< converts the mappings to BAM records */
+    TMAP_MAP_DRIVER_PIPELINE_WRITE, /*!< writes the BAM records */
+    TMAP_MAP_DRIVER_PIPELINE_NUM /*!< the number of steps */
+};
+
+/*!
+  The state of a buffer of reads in the pipeline.
+  */
+enum {
+    TMAP_MAP_DRIVER_BUFFER_EMPTY = 0, /*!< the buffer can be filled with reads */
+    TMAP_MAP_DRIVER_BUFFER_LOADED, /*!< the reads are waiting to be mapped */
+    TMAP_MAP_DRIVER_BUFFER_MAPPED /*!< the reads are waiting to be converted to BAM records */
+};
+
+/*!
+  A buffer of reads, which hands out its reads to the threads as they become
+  free and records which reads are ready to be written.
+  */
+typedef struct {
+    int64_t seq; /*!< the zero-based position of the buffer in the input */
+    int64_t first; /*!< the zero-based index in the input of the first read in the buffer */
+    int32_t state; /*!< the state of the buffer */
+    int32_t do_pairing;  /*!< 1 if we are performing pairing paramter calculation, 0 otherwise */
     tmap_seqs_t **seqs_buffer;  /*!< the buffers of sequences */    
     int32_t seqs_buffer_length;  /*!< the buffers length */
-    int32_t *buffer_idx; /*!< the current zero-based index into the buffer */
     tmap_map_record_t **records;  /*!< the alignments for each sequence */
     tmap_map_bams_t **bams;  /*!< the BAM alignments for each sequence */
-    tmap_index_t *index;  /*!< pointer to the reference index */
-    tmap_map_driver_t *driver;  /*!< the main driver object */
-    tmap_map_stats_t *stat; /*!< the driver statistics */
+    tmap_map_stats_t **stats; /*!< the driver statistics from each mapping thread */
+    int32_t map_low; /*!< the zero-based index of the next read to be mapped */
+    int32_t encode_low; /*!< the zero-based index of the next read to be converted to BAM records */
+    int32_t num_mapped; /*!< the number of reads mapped, when converted by the encoding threads */
+    int32_t *done; /*!< 1 if the read at the given index is ready to be written, 0 otherwise */
+} tmap_map_driver_buffer_t;
+
+/*!
+  The work done by one step of the pipeline.
+  */
+typedef struct {
+    int32_t num_threads; /*!< the number of threads running the step */
+    int64_t num_reads; /*!< the number of reads processed */
+    double busy_time; /*!< the time spent processing reads, summed across threads */
+    double wait_time; /*!< the time spent waiting on the other steps, summed across threads */
+    int32_t queue_max; /*!< the most buffers found queued for the step */
+    int64_t queue_sum; /*!< the sum of the number of buffers found queued for the step */
+    int64_t queue_n; /*!< the number of times the queued buffers were counted */
+} tmap_map_driver_pipeline_step_t;
+
+/*! 
+  Driver data to be passed to a thread                         
+  */
+typedef struct {                                            
+    struct __tmap_map_driver_pipeline_t *pipeline; /*!< the pipeline this thread belongs to */
+    tmap_index_t *index; /*!< the reference index used by this thread, on its NUMA node when replicated */
     tmap_rand_t *rand;  /*!< the random number generator */
-    int32_t do_pairing;  /*!< 1 if we are performing pairing paramter calculation, 0 otherwise */
+    int32_t num_reads; /*!< the number of reads processed by this thread */
+    double busy_time; /*!< the time this thread spent processing reads */
+    double wait_time; /*!< the time this thread spent waiting for reads */
+    uint64_t occ_hits; /*!< the number of occurrence lookups this thread found in the occurrence cache */
+    uint64_t occ_misses; /*!< the number of occurrence lookups this thread did not find in the occurrence cache */
+    uint64_t vsw_8bit; /*!< the number of vectorized alignments this thread started with 8-bit lanes */
+    uint64_t vsw_16bit; /*!< the number of those vectorized alignments that needed 16-bit lanes to finish */
     int32_t tid;  /*!< the zero-based thread id */
 } tmap_map_driver_thread_data_t;
 
 /*!
-  The core worker routine of mapall
-  @param  sam_header           the SAM Header
-  @param  seqs_buffer           the buffer of sequences
-  @param  records              the records to return
-  @param  bams                 the bams to return
-  @param  seqs_buffer_length    the number of sequences in the buffer
-  @param  buffer_idx            the current zero-based index into the buffer
-  @param  index                the reference index
-  @param  driver               the driver
-  @param  stat                 the driver statistics
-  @param  rand                 the random number generator
-  @param  do_pairing           1 if we are performing pairing paramter calculation, 0 otherwise 
-  @param  tid                  the thread ids
+  Passes buffers of reads from the reader, to the mapping threads, to the
+  encoding threads, and to the writer.  A fixed number of buffers cycle
+  through the pipeline, so a step that falls behind stalls the steps before it.
+  */
+typedef struct __tmap_map_driver_pipeline_t {
+    int32_t num_buffers; /*!< the number of buffers */
+    tmap_map_driver_buffer_t **buffers; /*!< the buffers, where the buffer at position i is stored at i modulo the number of buffers */
+    int32_t reads_queue_size; /*!< the maximum number of reads in a buffer */
+    int64_t read_seq; /*!< the position of the next buffer to be read */
+    int64_t map_seq; /*!< the position of the buffer being handed out to the mapping threads */
+    int64_t encode_seq; /*!< the position of the buffer being handed out to the encoding threads */
+    int64_t write_seq; /*!< the position of the buffer being written */
+    int32_t eof; /*!< 1 if all the reads have been read, 0 otherwise */
+    int32_t wait_idx; /*!< the index of the read the writer is waiting on, -1 if none */
+    tmap_map_driver_pipeline_step_t steps[TMAP_MAP_DRIVER_PIPELINE_NUM]; /*!< the work done by each step */
+    tmap_seqs_io_t *io_in; /*!< the input reads */
+    sam_header_t *header; /*!< the SAM Header */
+    tmap_index_t *index;  /*!< pointer to the reference index */
+    tmap_map_driver_t *driver;  /*!< the main driver object */
+    tmap_bwt_match_hash_cache_t *occ_cache; /*!< the occurrence cache shared by the mapping threads, or NULL if not used */
+    int32_t num_map_threads; /*!< the number of mapping threads */
+    int32_t num_encode_threads; /*!< the number of encoding threads, or zero if the mapping threads convert the mappings */
+    tmap_map_driver_thread_data_t *map_thread_data; /*!< the data for each mapping thread */
+    tmap_map_driver_thread_data_t *encode_thread_data; /*!< the data for each encoding thread */
+#ifdef ENABLE_TMAP_DEBUG_FUNCTIONS
+    tmap_rand_t *rand_core; /*!< random # generator for sampling */
+#endif
+#ifdef HAVE_LIBPTHREAD
+    pthread_t *reader; /*!< the thread reading in the sequences, or NULL if not started */
+    pthread_t *map_threads; /*!< the mapping threads */
+    pthread_t *encode_threads; /*!< the encoding threads */
+    pthread_mutex_t mutex; /*!< guards the buffer states, positions, and done flags */
+    pthread_cond_t state_cond; /*!< signalled when a buffer changes state or all reads have been read */
+    pthread_cond_t done_cond; /*!< signalled when the read the writer is waiting on is done */
+#endif
+} tmap_map_driver_pipeline_t;
+
+/*!
+  The core worker routine of mapall, which maps reads from the buffer until
+  none are left to hand out
+  @param  thread_data          the thread data
+  @param  buffer               the buffer of reads
+  @param  seq                  the position of the buffer in the input
+  @param  hash                 the occurrence hash, or NULL if not used
  */
 void
-tmap_map_driver_core_worker(sam_header_t *sam_header,
-                            tmap_seqs_t **seqs_buffer, 
-                            tmap_map_record_t **records,
-                            tmap_map_bams_t **bams,
-                            int32_t seqs_buffer_length,
-                            int32_t *buffer_idx,
-                            tmap_index_t *index,
-                            tmap_map_driver_t *driver,
-                            tmap_map_stats_t* stat,
-                            tmap_rand_t *rand,
-                            int32_t do_pairing,
-                            int32_t tid);
-
-/*!
- A wrapper around the core function of mapall
+tmap_map_driver_core_worker(tmap_map_driver_thread_data_t *thread_data,
+                            tmap_map_driver_buffer_t *buffer,
+                            int64_t seq,
+                            tmap_bwt_match_hash_t *hash);
+
+/*!
+ A wrapper around the core function of mapall, which initializes the thread
+ data once and then maps each buffer in the pipeline
  @param  arg  the worker arguments in the type: tmap_map_driver_thread_data_t
  @return      the worker arguments
  */
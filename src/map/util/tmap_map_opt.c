@@ -12,6 +12,7 @@
 #include "../../seq/tmap_seq.h"
 #include "../../util/tmap_progress.h"
 #include "../../util/tmap_definitions.h"
+#include "../../util/tmap_placement.h"
 #include "tmap_map_opt.h"
 
 // For sorting the @RG fields
@@ -169,6 +170,12 @@ __tmap_map_opt_option_print_func_tf_init(rand_read_name)
 __tmap_map_opt_option_print_func_compr_init(input_compr_gz, input_compr, TMAP_FILE_GZ_COMPRESSION)
 __tmap_map_opt_option_print_func_compr_init(input_compr_bz2, input_compr, TMAP_FILE_BZ2_COMPRESSION)
 __tmap_map_opt_option_print_func_int_init(output_type)
+__tmap_map_opt_option_print_func_int_init(bam_compression_threads)
+__tmap_map_opt_option_print_func_int_init(encoding_threads)
+__tmap_map_opt_option_print_func_int_init(pipeline_buffers)
+__tmap_map_opt_option_print_func_int_init(index_huge_pages)
+__tmap_map_opt_option_print_func_int_init(index_numa)
+__tmap_map_opt_option_print_func_int_init(occ_cache_size)
 __tmap_map_opt_option_print_func_int_init(end_repair)
 __tmap_map_opt_option_print_func_int_init(max_adapter_bases_for_soft_clipping)
 
@@ -432,6 +439,8 @@ tmap_map_opt_init_helper(tmap_map_opt_t *opt)
   static char *strandedness[] = {"0 - same strand", "1 - opposite strand", NULL};
   static char *positioning[] = {"0 - read one before read two", "1 - read two before read one", NULL};
   static char *end_repair[] = {"0 - disable", "1 - prefer mismatches", "2 - prefer indels", NULL};
+  static char *index_huge_pages[] = {"0 - default page size", "1 - 2MB huge pages", "2 - 1GB huge pages", NULL};
+  static char *index_numa[] = {"0 - default placement", "1 - interleave across the NUMA nodes", "2 - replicate on each NUMA node, pinning the mapping threads to match", NULL};
 
   opt->options = tmap_map_opt_options_init();
 
@@ -582,7 +591,7 @@ tmap_map_opt_init_helper(tmap_map_opt_t *opt)
                            TMAP_MAP_ALGO_GLOBAL);
   tmap_map_opt_options_add(opt->options, "rand-read-name", no_argument, 0, 'u', 
                            TMAP_MAP_OPT_TYPE_NONE,
-                           "specifies to randomize based on the read name",
+                           "specifies to randomize based on the read name, rather than the position of the read in the input",
                            NULL,
                            tmap_map_opt_option_print_func_rand_read_name,
                            TMAP_MAP_ALGO_GLOBAL);
@@ -606,6 +615,42 @@ tmap_map_opt_init_helper(tmap_map_opt_t *opt)
                            output_type,
                            tmap_map_opt_option_print_func_output_type,
                            TMAP_MAP_ALGO_GLOBAL);
+  tmap_map_opt_options_add(opt->options, "bam-compression-threads", required_argument, 0, 0 /* no short flag */, 
+                           TMAP_MAP_OPT_TYPE_INT,
+                           "the number of threads used to compress BAM output (-o 1), or zero to compress in the output thread",
+                           NULL,
+                           tmap_map_opt_option_print_func_bam_compression_threads,
+                           TMAP_MAP_ALGO_GLOBAL);
+  tmap_map_opt_options_add(opt->options, "encoding-threads", required_argument, 0, 0 /* no short flag */, 
+                           TMAP_MAP_OPT_TYPE_INT,
+                           "the number of threads used to convert the mappings to BAM records, or zero to convert them in the mapping threads",
+                           NULL,
+                           tmap_map_opt_option_print_func_encoding_threads,
+                           TMAP_MAP_ALGO_GLOBAL);
+  tmap_map_opt_options_add(opt->options, "pipeline-buffers", required_argument, 0, 0 /* no short flag */, 
+                           TMAP_MAP_OPT_TYPE_INT,
+                           "the number of buffers of reads (-q) passed between reading, mapping, and writing",
+                           NULL,
+                           tmap_map_opt_option_print_func_pipeline_buffers,
+                           TMAP_MAP_ALGO_GLOBAL);
+  tmap_map_opt_options_add(opt->options, "index-huge-pages", required_argument, 0, 0 /* no short flag */, 
+                           TMAP_MAP_OPT_TYPE_INT,
+                           "the page size of the BWT and SA when read from file",
+                           index_huge_pages,
+                           tmap_map_opt_option_print_func_index_huge_pages,
+                           TMAP_MAP_ALGO_GLOBAL);
+  tmap_map_opt_options_add(opt->options, "index-numa", required_argument, 0, 0 /* no short flag */, 
+                           TMAP_MAP_OPT_TYPE_INT,
+                           "the placement of the BWT and SA across the NUMA nodes",
+                           index_numa,
+                           tmap_map_opt_option_print_func_index_numa,
+                           TMAP_MAP_ALGO_GLOBAL);
+  tmap_map_opt_options_add(opt->options, "occ-cache-size", required_argument, 0, 0 /* no short flag */, 
+                           TMAP_MAP_OPT_TYPE_INT,
+                           "the size in megabytes of the occurrence cache shared by the mapping threads, or zero for none",
+                           NULL,
+                           tmap_map_opt_option_print_func_occ_cache_size,
+                           TMAP_MAP_ALGO_GLOBAL);
   tmap_map_opt_options_add(opt->options, "end-repair", required_argument, 0, 0 /* no short flag */, 
                            TMAP_MAP_OPT_TYPE_INT,
                            "specifies to perform 5' end repair",
@@ -1095,6 +1140,12 @@ tmap_map_opt_init(int32_t algo_id)
   opt->rand_read_name = 0;
   opt->input_compr = TMAP_FILE_NO_COMPRESSION;
   opt->output_type = 0;
+  opt->bam_compression_threads = 0;
+  opt->encoding_threads = 0;
+  opt->pipeline_buffers = 2;
+  opt->index_huge_pages = TMAP_PLACEMENT_HUGE_PAGES_NONE;
+  opt->index_numa = TMAP_PLACEMENT_NUMA_NONE;
+  opt->occ_cache_size = 0;
   opt->end_repair = 0;
   opt->max_adapter_bases_for_soft_clipping = INT32_MAX;
   opt->shm_key = 0;
@@ -1566,6 +1617,24 @@ tmap_map_opt_parse(int argc, char *argv[], tmap_map_opt_t *opt)
       else if(0 == c && 0 == strcmp("long-hit-mult", options[option_index].name)) {
           opt->long_hit_mult = atof(optarg);
       }
+      else if(0 == c && 0 == strcmp("bam-compression-threads", options[option_index].name)) {
+          opt->bam_compression_threads = atoi(optarg);
+      }
+      else if(0 == c && 0 == strcmp("encoding-threads", options[option_index].name)) {
+          opt->encoding_threads = atoi(optarg);
+      }
+      else if(0 == c && 0 == strcmp("pipeline-buffers", options[option_index].name)) {
+          opt->pipeline_buffers = atoi(optarg);
+      }
+      else if(0 == c && 0 == strcmp("index-huge-pages", options[option_index].name)) {
+          opt->index_huge_pages = atoi(optarg);
+      }
+      else if(0 == c && 0 == strcmp("index-numa", options[option_index].name)) {
+          opt->index_numa = atoi(optarg);
+      }
+      else if(0 == c && 0 == strcmp("occ-cache-size", options[option_index].name)) {
+          opt->occ_cache_size = atoi(optarg);
+      }
       else if(0 == c && 0 == strcmp("end-repair", options[option_index].name)) {
           opt->end_repair = atoi(optarg);
       }
@@ -1921,6 +1990,24 @@ tmap_map_opt_check_global(tmap_map_opt_t *opt_a, tmap_map_opt_t *opt_b)
     if(opt_a->long_hit_mult != opt_b->long_hit_mult) {
         tmap_error("option --long-hit-mult was specified outside of the common options", Exit, CommandLineArgument);
     }
+    if(opt_a->bam_compression_threads != opt_b->bam_compression_threads) {
+        tmap_error("option --bam-compression-threads was specified outside of the common options", Exit, CommandLineArgument);
+    }
+    if(opt_a->encoding_threads != opt_b->encoding_threads) {
+        tmap_error("option --encoding-threads was specified outside of the common options", Exit, CommandLineArgument);
+    }
+    if(opt_a->pipeline_buffers != opt_b->pipeline_buffers) {
+        tmap_error("option --pipeline-buffers was specified outside of the common options", Exit, CommandLineArgument);
+    }
+    if(opt_a->index_huge_pages != opt_b->index_huge_pages) {
+        tmap_error("option --index-huge-pages was specified outside of the common options", Exit, CommandLineArgument);
+    }
+    if(opt_a->index_numa != opt_b->index_numa) {
+        tmap_error("option --index-numa was specified outside of the common options", Exit, CommandLineArgument);
+    }
+    if(opt_a->occ_cache_size != opt_b->occ_cache_size) {
+        tmap_error("option --occ-cache-size was specified outside of the common options", Exit, CommandLineArgument);
+    }
     if(opt_a->end_repair != opt_b->end_repair) {
         tmap_error("option --end-repair was specified outside of the common options", Exit, CommandLineArgument);
     }
@@ -2076,6 +2163,12 @@ tmap_map_opt_check(tmap_map_opt_t *opt)
   */
   tmap_error_cmd_check_int(opt->rand_read_name, 0, 1, "-u");
   tmap_error_cmd_check_int(opt->output_type, 0, 2, "-o");
+  tmap_error_cmd_check_int(opt->bam_compression_threads, 0, INT32_MAX, "--bam-compression-threads");
+  tmap_error_cmd_check_int(opt->encoding_threads, 0, INT32_MAX, "--encoding-threads");
+  tmap_error_cmd_check_int(opt->pipeline_buffers, 2, INT32_MAX, "--pipeline-buffers");
+  tmap_error_cmd_check_int(opt->index_huge_pages, TMAP_PLACEMENT_HUGE_PAGES_NONE, TMAP_PLACEMENT_HUGE_PAGES_1GB, "--index-huge-pages");
+  tmap_error_cmd_check_int(opt->index_numa, TMAP_PLACEMENT_NUMA_NONE, TMAP_PLACEMENT_NUMA_REPLICATE, "--index-numa");
+  tmap_error_cmd_check_int(opt->occ_cache_size, 0, INT32_MAX, "--occ-cache-size");
   tmap_error_cmd_check_int(opt->end_repair, 0, 2, "--end-repair");
   tmap_error_cmd_check_int(opt->max_adapter_bases_for_soft_clipping, 0, INT32_MAX, "max-adapter-bases-for-soft-clipping");
 #ifdef ENABLE_TMAP_DEBUG_FUNCTIONS
@@ -2251,6 +2344,12 @@ tmap_map_opt_copy_global(tmap_map_opt_t *opt_dest, tmap_map_opt_t *opt_src)
     opt_dest->rand_read_name = opt_src->rand_read_name;
     opt_dest->input_compr = opt_src->input_compr;
     opt_dest->output_type = opt_src->output_type;
+    opt_dest->bam_compression_threads = opt_src->bam_compression_threads;
+    opt_dest->encoding_threads = opt_src->encoding_threads;
+    opt_dest->pipeline_buffers = opt_src->pipeline_buffers;
+    opt_dest->index_huge_pages = opt_src->index_huge_pages;
+    opt_dest->index_numa = opt_src->index_numa;
+    opt_dest->occ_cache_size = opt_src->occ_cache_size;
     opt_dest->end_repair = opt_src->end_repair;
     opt_dest->max_adapter_bases_for_soft_clipping = opt_src->max_adapter_bases_for_soft_clipping;
     opt_dest->shm_key = opt_src->shm_key;
@@ -2338,6 +2437,12 @@ tmap_map_opt_print(tmap_map_opt_t *opt)
   fprintf(stderr, "aln_flowspace=%d\n", opt->aln_flowspace);
   fprintf(stderr, "input_compr=%d\n", opt->input_compr);
   fprintf(stderr, "output_type=%d\n", opt->output_type);
+  fprintf(stderr, "bam_compression_threads=%d\n", opt->bam_compression_threads);
+  fprintf(stderr, "encoding_threads=%d\n", opt->encoding_threads);
+  fprintf(stderr, "pipeline_buffers=%d\n", opt->pipeline_buffers);
+  fprintf(stderr, "index_huge_pages=%d\n", opt->index_huge_pages);
+  fprintf(stderr, "index_numa=%d\n", opt->index_numa);
+  fprintf(stderr, "occ_cache_size=%d\n", opt->occ_cache_size);
   fprintf(stderr, "end_repair=%d\n", opt->end_repair);
   fprintf(stderr, "max_adapter_bases_for_soft_clipping=%d\n", opt->max_adapter_bases_for_soft_clipping);
   fprintf(stderr, "shm_key=%d\n", (int)opt->shm_key);
@@ -197,6 +197,12 @@ typedef struct __tmap_map_opt_t {
     int32_t rand_read_name;  /*!< specifies to randomize based on the read name (-u,--rand-read-name) */
     int32_t input_compr;  /*!< the input compression type (-j,--input-bz2 and -z,--input-gz) */
     int32_t output_type;  /*!< the output type (0 - SAM, 1 - BAM (compressed), 2 - BAM (uncompressed)) (-o,--output-type) */
+    int32_t bam_compression_threads; /*!< the number of threads used to compress BAM output, or zero to compress in the output thread (--bam-compression-threads) */
+    int32_t encoding_threads; /*!< the number of threads used to convert the mappings to BAM records, or zero to convert them in the mapping threads (--encoding-threads) */
+    int32_t pipeline_buffers; /*!< the number of buffers of reads passed between reading, mapping, and writing (--pipeline-buffers) */
+    int32_t index_huge_pages; /*!< the page size of the BWT and SA (TMAP_PLACEMENT_HUGE_PAGES_*) (--index-huge-pages) */
+    int32_t index_numa; /*!< the placement of the BWT and SA across the NUMA nodes (TMAP_PLACEMENT_NUMA_*) (--index-numa) */
+    int32_t occ_cache_size; /*!< the size in megabytes of the occurrence cache shared by the mapping threads, or zero for none (--occ-cache-size) */
     int32_t end_repair; /*!< specifies to perform 5' end repair (0 - disabled, 1 - prefer mismatches, 2 - prefer indels) (--end-repair) */
     int32_t max_adapter_bases_for_soft_clipping; /*!< specifies to perform 3' soft-clipping (via -g) if at most this # of adapter bases were found (ZB tag) (--max-adapter-bases-for-soft-clipping) */ 
     key_t shm_key;  /*!< the shared memory key (-k,--shared-memory-key) */
@@ -184,6 +184,21 @@ tmap_map_sams_destroy(tmap_map_sams_t *s)
   free(s);
 }
 
+tmap_map_util_vsw_t*
+tmap_map_util_vsw_init()
+{
+  return tmap_calloc(1, sizeof(tmap_map_util_vsw_t), "vsws");
+}
+
+void
+tmap_map_util_vsw_destroy(tmap_map_util_vsw_t *vsws)
+{
+  if(NULL == vsws) return;
+  tmap_vsw_destroy(vsws->fwd);
+  tmap_vsw_destroy(vsws->rev);
+  free(vsws);
+}
+
 tmap_map_record_t*
 tmap_map_record_init(int32_t num_ends)
 {
@@ -964,6 +979,50 @@ tmap_map_util_sw_get_start_and_end_pos(tmap_map_sam_t *sam, int32_t seq_len, uin
   }
 }
 
+// adds in the band width to the one-based window, and returns the target length
+static int32_t
+tmap_map_util_sw_gen_score_window(tmap_refseq_t *refseq, uint32_t seqid,
+                                  uint32_t *start_pos, uint32_t *end_pos,
+                                  tmap_map_opt_t *opt)
+{
+  // add in band width
+  // one-based
+  if((*start_pos) < opt->bw) {
+      (*start_pos) = 1;
+  }
+  else {
+      (*start_pos) -= opt->bw - 1;
+  }
+  (*end_pos) += opt->bw - 1;
+  if(refseq->annos[seqid].len < (*end_pos)) {
+      (*end_pos) = refseq->annos[seqid].len; // one-based
+  }
+  return (*end_pos) - (*start_pos) + 1;
+}
+
+// gets the target sequence for the window, in the direction of the query
+static void
+tmap_map_util_sw_gen_score_target(tmap_refseq_t *refseq, uint32_t seqid, uint8_t strand,
+                                  uint32_t start_pos, uint32_t end_pos,
+                                  int32_t *target_mem, uint8_t **target)
+{
+  int32_t tlen = end_pos - start_pos + 1;
+  if((*target_mem) < tlen) { // more memory?
+      (*target_mem) = tlen;
+      tmap_roundup32((*target_mem));
+      (*target) = tmap_realloc((*target), sizeof(uint8_t)*(*target_mem), "target");
+  }
+  // NB: IUPAC codes are turned into mismatches
+  if(NULL == tmap_refseq_subseq2(refseq, seqid+1, start_pos, end_pos, (*target), 1, NULL)) {
+      tmap_error("bug encountered", Exit, OutOfRange);
+  }
+
+  // reverse compliment the target
+  if(1 == strand) {
+      tmap_reverse_compliment_int((*target), tlen);
+  }
+}
+
 // NB: this function unrolls banding in some cases
 static int32_t
 tmap_map_util_sw_gen_score_helper(tmap_refseq_t *refseq, tmap_map_sams_t *sams, 
@@ -972,6 +1031,8 @@ tmap_map_util_sw_gen_score_helper(tmap_refseq_t *refseq, tmap_map_sams_t *sams,
                         uint8_t strand, tmap_vsw_t *vsw,
                         int32_t seq_len, uint32_t start_pos, uint32_t end_pos,
                         int32_t *target_mem, uint8_t **target,
+                        tmap_vsw_result_t *batch_result, // NB: the alignment of this window if already done, NULL otherwise
+                        int32_t batch_score,
                         int32_t softclip_start, int32_t softclip_end,
                         int32_t prev_n_best,
                         int32_t max_seed_band, // NB: this may be modified as banding is unrolled
@@ -1003,49 +1064,26 @@ tmap_map_util_sw_gen_score_helper(tmap_refseq_t *refseq, tmap_map_sams_t *sams,
   query = (uint8_t*)tmap_seq_get_bases(seq)->s;
   qlen = tmap_seq_get_bases_length(seq);
 
-  // add in band width
-  // one-based
-  if(start_pos < opt->bw) {
-      start_pos = 1;
-  }
-  else {
-      start_pos -= opt->bw - 1;
-  }
-  end_pos += opt->bw - 1;
-  if(refseq->annos[sams->sams[end].seqid].len < end_pos) {
-      end_pos = refseq->annos[sams->sams[end].seqid].len; // one-based
-  }
-
-  // get the target sequence
-  tlen = end_pos - start_pos + 1;
-  if((*target_mem) < tlen) { // more memory?
-      (*target_mem) = tlen;
-      tmap_roundup32((*target_mem));
-      (*target) = tmap_realloc((*target), sizeof(uint8_t)*(*target_mem), "target");
-  }
-  // NB: IUPAC codes are turned into mismatches
-  if(NULL == tmap_refseq_subseq2(refseq, sams->sams[end].seqid+1, start_pos, end_pos, (*target), 1, NULL)) {
-      tmap_error("bug encountered", Exit, OutOfRange);
-  }
+  tlen = tmap_map_util_sw_gen_score_window(refseq, sams->sams[end].seqid, &start_pos, &end_pos, opt);
 
-  // reverse compliment the target
-  if(1 == strand) {
-      tmap_reverse_compliment_int((*target), tlen);
-  }
+  if(NULL == batch_result) {
+      // get the target sequence
+      tmap_map_util_sw_gen_score_target(refseq, sams->sams[end].seqid, strand, start_pos, end_pos, target_mem, target);
 
-  // Debugging
+      // Debugging
 #ifdef TMAP_VSW_DEBUG
-  int j;
-  fprintf(stderr, "seqid:%u start_pos=%u end_pos=%u strand=%d\n", sams->sams[end].seqid+1, start_pos, end_pos, strand);
-  for(j=0;j<qlen;j++) {
-      fputc("ACGTN"[query[j]], stderr);
-  }
-  fputc('\n', stderr);
-  for(j=0;j<tlen;j++) {
-      fputc("ACGTN"[(*target)[j]], stderr);
-  }
-  fputc('\n', stderr);
+      int j;
+      fprintf(stderr, "seqid:%u start_pos=%u end_pos=%u strand=%d\n", sams->sams[end].seqid+1, start_pos, end_pos, strand);
+      for(j=0;j<qlen;j++) {
+          fputc("ACGTN"[query[j]], stderr);
+      }
+      fputc('\n', stderr);
+      for(j=0;j<tlen;j++) {
+          fputc("ACGTN"[(*target)[j]], stderr);
+      }
+      fputc('\n', stderr);
 #endif
+  }
 
   // initialize the bounds
   tmp_sam.result.query_start = tmp_sam.result.query_end = 0;
@@ -1078,8 +1116,14 @@ tmap_map_util_sw_gen_score_helper(tmap_refseq_t *refseq, tmap_map_sams_t *sams,
    */
 
   // NB: this aligns in the sequencing direction
-  tmp_sam.score = tmap_vsw_process_fwd(vsw, query, qlen, (*target), tlen,
-                                   &tmp_sam.result, &overflow, opt->score_thr, 1);
+  if(NULL == batch_result) {
+      tmp_sam.score = tmap_vsw_process_fwd(vsw, query, qlen, (*target), tlen,
+                                           &tmp_sam.result, &overflow, opt->score_thr, 1);
+  }
+  else {
+      tmp_sam.result = (*batch_result);
+      tmp_sam.score = batch_score;
+  }
 
   if(1 < tmp_sam.result.n_best) {
       // What happens if soft-clipping or not soft-clipping causes two
@@ -1169,6 +1213,7 @@ tmap_map_util_sw_gen_score_helper(tmap_refseq_t *refseq, tmap_map_sams_t *sams,
                   cur_score = tmap_map_util_sw_gen_score_helper(refseq, sams, seq, sams_tmp, idx, start, end,
                                                                 strand, vsw, seq_len, start_pos, end_pos,
                                                                 target_mem, target,
+                                                                NULL, 0,
                                                                 softclip_start, softclip_end,
                                                                 tmp_sam.result.n_best,
                                                                 (max_seed_band <= 0) ? -1 : (max_seed_band >> 1),
@@ -1276,6 +1321,7 @@ tmap_map_util_sw_gen_score(tmap_refseq_t *refseq,
                            tmap_map_sams_t *sams, 
                            tmap_seq_t **seqs,
                            tmap_rand_t *rand,
+                           tmap_map_util_vsw_t *vsws,
                            tmap_map_opt_t *opt,
                            int32_t *num_after_grouping)
 {
@@ -1295,6 +1341,9 @@ tmap_map_util_sw_gen_score(tmap_refseq_t *refseq,
   int32_t num_groups = 0, num_groups_filtered = 0;
   double stage_seed_freqc = opt->stage_seed_freqc;
   int32_t max_group_size = 0, repr_hit, filter_ok = 0;
+  uint8_t *batch_targets[TMAP_VSW_BATCH_SIZE];
+  int32_t batch_target_mem[TMAP_VSW_BATCH_SIZE], batch_tlens[TMAP_VSW_BATCH_SIZE], batch_scores[TMAP_VSW_BATCH_SIZE];
+  tmap_vsw_result_t batch_results[TMAP_VSW_BATCH_SIZE];
 
   if(NULL != num_after_grouping) (*num_after_grouping) = 0;
 
@@ -1316,10 +1365,19 @@ tmap_map_util_sw_gen_score(tmap_refseq_t *refseq,
   seq_len = tmap_seq_get_bases_length(seqs[0]);
 
   // forward
-  vsw = tmap_vsw_init((uint8_t*)tmap_seq_get_bases(seqs[0])->s, seq_len, softclip_start, softclip_end, opt->vsw_type, vsw_opt); 
+  if(NULL != vsws) {
+      vsw = vsws->fwd = tmap_vsw_reuse(vsws->fwd, softclip_start, softclip_end, opt->vsw_type, vsw_opt);
+  }
+  else {
+      vsw = tmap_vsw_init((uint8_t*)tmap_seq_get_bases(seqs[0])->s, seq_len, softclip_start, softclip_end, opt->vsw_type, vsw_opt); 
+  }
 
   // pre-allocate groups
   groups = tmap_calloc(sams->n, sizeof(tmap_map_util_gen_score_t), "groups");
+  for(i=0;i<TMAP_VSW_BATCH_SIZE;i++) {
+      batch_targets[i] = NULL;
+      batch_target_mem[i] = 0;
+  }
 
   // determine groups
   num_groups = num_groups_filtered = 0;
@@ -1505,44 +1563,59 @@ tmap_map_util_sw_gen_score(tmap_refseq_t *refseq,
           */
 
   // process unfiltered...
-  for(i=j=0;i<num_groups;i++) { // go through each group
-      tmap_map_util_gen_score_t *group = &groups[i];
-      /*
-      fprintf(stderr, "start=%d end=%d num=%d seqid=%u strand=%d start_pos=%u end_pos=%u repr_hit=%u filtered=%d\n", 
-              group->start,
-              group->end,
-              group->end - group->start + 1,
-              group->seqid,
-              group->strand,
-              group->start_pos,
-              group->end_pos,
-              group->repr_hit,
-              group->filtered);
-              */
-      if(1 == group->filtered && 0 == group->repr_hit) continue;
-      /*
-      fprintf(stderr, "start=%d end=%d num=%d seqid=%u strand=%d start_pos=%u end_pos=%u filtered=%d\n", 
-              group->start,
-              group->end,
-              group->end - group->start + 1,
-              group->seqid,
-              group->strand,
-              group->start_pos,
-              group->end_pos,
-              group->filtered);
-              */
-
-      // generate the score
-      tmap_map_util_sw_gen_score_helper(refseq, sams, seqs[0], sams_tmp, &j, group->start, group->end,
-                                        group->strand, vsw, seq_len, group->start_pos, group->end_pos,
-                                        &target_mem, &target,
-                                        softclip_start, softclip_end,
-                                        -1, // this is our first call
-                                        opt->max_seed_band, // NB: this may be modified as banding is unrolled
-                                        opt->score_thr-1,
-                                        vsw_opt, rand, opt);
-      // save the number of groups
-      if(NULL != num_after_grouping) (*num_after_grouping)++;
+  // NB: the first alignment of each group is done in batches, with the query
+  // aligned to many targets at once
+  for(i=j=0;i<num_groups;) {
+      int32_t k, n;
+
+      // get the targets for the next batch of groups
+      for(k=i,n=0;k<num_groups && n<TMAP_VSW_BATCH_SIZE;k++) {
+          tmap_map_util_gen_score_t *group = &groups[k];
+          if(1 == group->filtered && 0 == group->repr_hit) continue;
+          start_pos = group->start_pos;
+          end_pos = group->end_pos;
+          batch_tlens[n] = tmap_map_util_sw_gen_score_window(refseq, sams->sams[group->end].seqid, &start_pos, &end_pos, opt);
+          tmap_map_util_sw_gen_score_target(refseq, sams->sams[group->end].seqid, group->strand, start_pos, end_pos,
+                                            &batch_target_mem[n], &batch_targets[n]);
+          // initialize the bounds
+          batch_results[n].query_start = batch_results[n].query_end = 0;
+          batch_results[n].target_start = batch_results[n].target_end = 0;
+          n++;
+      }
+      tmap_vsw_process_fwd_batch(vsw, (uint8_t*)tmap_seq_get_bases(seqs[0])->s, seq_len,
+                                 batch_targets, batch_tlens, n, 
+                                 batch_results, batch_scores, NULL, opt->score_thr, 1);
+
+      for(n=0;i<k;i++) { // go through each group
+          tmap_map_util_gen_score_t *group = &groups[i];
+          /*
+          fprintf(stderr, "start=%d end=%d num=%d seqid=%u strand=%d start_pos=%u end_pos=%u repr_hit=%u filtered=%d\n", 
+                  group->start,
+                  group->end,
+                  group->end - group->start + 1,
+                  group->seqid,
+                  group->strand,
+                  group->start_pos,
+                  group->end_pos,
+                  group->repr_hit,
+                  group->filtered);
+                  */
+          if(1 == group->filtered && 0 == group->repr_hit) continue;
+
+          // generate the score
+          tmap_map_util_sw_gen_score_helper(refseq, sams, seqs[0], sams_tmp, &j, group->start, group->end,
+                                            group->strand, vsw, seq_len, group->start_pos, group->end_pos,
+                                            &target_mem, &target,
+                                            &batch_results[n], batch_scores[n],
+                                            softclip_start, softclip_end,
+                                            -1, // this is our first call
+                                            opt->max_seed_band, // NB: this may be modified as banding is unrolled
+                                            opt->score_thr-1,
+                                            vsw_opt, rand, opt);
+          n++;
+          // save the number of groups
+          if(NULL != num_after_grouping) (*num_after_grouping)++;
+      }
   }
   //fprintf(stderr, "unfiltered # = %d\n", j);
 
@@ -1586,6 +1659,7 @@ tmap_map_util_sw_gen_score(tmap_refseq_t *refseq,
               tmap_map_util_sw_gen_score_helper(refseq, sams, seqs[0], sams_tmp, &j, group->start, group->end,
                                                 group->strand, vsw, seq_len, group->start_pos, group->end_pos,
                                                 &target_mem, &target,
+                                                NULL, 0,
                                                 softclip_start, softclip_end,
                                                 -1, // this is our first call
                                                 opt->max_seed_band, // NB: this may be modified as banding is unrolled
@@ -1605,6 +1679,7 @@ tmap_map_util_sw_gen_score(tmap_refseq_t *refseq,
                   tmap_map_util_sw_gen_score_helper(refseq, sams, seqs[0], sams_tmp, &j, group->start, group->end,
                                                     group->strand, vsw, seq_len, group->start_pos, group->end_pos,
                                                     &target_mem, &target,
+                                                    NULL, 0,
                                                     softclip_start, softclip_end,
                                                     -1, // this is our first call
                                                     opt->max_seed_band, // NB: this may be modified as banding is unrolled
@@ -1639,6 +1714,7 @@ tmap_map_util_sw_gen_score(tmap_refseq_t *refseq,
                   tmap_map_util_sw_gen_score_helper(refseq, sams, seqs[0], sams_tmp, &j, group->start, group->end,
                                                     group->strand, vsw, seq_len, group->start_pos, group->end_pos,
                                                     &target_mem, &target,
+                                                    NULL, 0,
                                                     softclip_start, softclip_end,
                                                     -1, // this is our first call
                                                     opt->max_seed_band, // NB: this may be modified as banding is unrolled
@@ -1666,8 +1742,11 @@ tmap_map_util_sw_gen_score(tmap_refseq_t *refseq,
   // free memory
   tmap_map_sams_destroy(sams);
   free(target);
+  for(i=0;i<TMAP_VSW_BATCH_SIZE;i++) {
+      free(batch_targets[i]);
+  }
   tmap_vsw_opt_destroy(vsw_opt);
-  tmap_vsw_destroy(vsw);
+  if(NULL == vsws) tmap_vsw_destroy(vsw);
   free(groups);
 
   return sams_tmp;
@@ -2196,6 +2275,7 @@ tmap_map_util_sw_gen_cigar(tmap_refseq_t *refseq,
                  tmap_map_sams_t *sams, 
                  tmap_seq_t *seq,
                  tmap_seq_t **seqs,
+                 tmap_map_util_vsw_t *vsws,
                  tmap_map_opt_t *opt)
 {
   int32_t i, j, matrix[25], matrix_iupac[80];
@@ -2236,7 +2316,12 @@ tmap_map_util_sw_gen_cigar(tmap_refseq_t *refseq,
   seq_len = tmap_seq_get_bases_length(seqs[0]);
 
   // reverse compliment query
-  vsw = tmap_vsw_init((uint8_t*)tmap_seq_get_bases(seqs[1])->s, seq_len, softclip_end, softclip_start, opt->vsw_type, vsw_opt); 
+  if(NULL != vsws) {
+      vsw = vsws->rev = tmap_vsw_reuse(vsws->rev, softclip_end, softclip_start, opt->vsw_type, vsw_opt);
+  }
+  else {
+      vsw = tmap_vsw_init((uint8_t*)tmap_seq_get_bases(seqs[1])->s, seq_len, softclip_end, softclip_start, opt->vsw_type, vsw_opt); 
+  }
       
   if(1 == opt->softclip_key) {
       // get first base
@@ -2874,7 +2959,7 @@ tmap_map_util_sw_gen_cigar(tmap_refseq_t *refseq,
   tmap_map_sams_destroy(sams);
   free(path);
   free(target);
-  tmap_vsw_destroy(vsw);
+  if(NULL == vsws) tmap_vsw_destroy(vsw);
   tmap_vsw_opt_destroy(vsw_opt);
   
   // sort by max score, then min coordinate
@@ -136,6 +136,27 @@ typedef struct {
     int32_t n; /*!< the number of records (multi-end) */
 } tmap_map_bams_t;
 
+/*!
+  The vectorized aligners for one end of a read, kept across stages, read rescue and reads,
+  so that each query profile is only built when the query, clipping or scoring changes
+  */
+typedef struct {
+    tmap_vsw_t *fwd; /*!< aligns the forward query (tmap_map_util_sw_gen_score) */
+    tmap_vsw_t *rev; /*!< aligns the reverse compliment query (tmap_map_util_sw_gen_cigar) */
+} tmap_map_util_vsw_t;
+
+/*!
+  @return  the vectorized aligners, built on first use
+  */
+tmap_map_util_vsw_t*
+tmap_map_util_vsw_init();
+
+/*!
+  @param  vsws  the vectorized aligners to destroy
+  */
+void
+tmap_map_util_vsw_destroy(tmap_map_util_vsw_t *vsws);
+
 /*!
   initializes
   @param  s  the mapping structure
@@ -359,6 +380,7 @@ tmap_map_util_mapq(tmap_map_sams_t *sams, int32_t seq_len, tmap_map_opt_t *opt);
   @param  sams          the seeded sams
   @param  seqs          the query sequence (forward, reverse compliment, reverse, and compliment)
   @param  rand          the random number generator
+  @param  vsws          the vectorized aligners for this end, NULL to use temporary ones
   @param  opt           the program parameters
   @param  num_after_grouping used to return the number seeds after grouping
   @return               the locally aligned sams
@@ -369,6 +391,7 @@ tmap_map_util_sw_gen_score(tmap_refseq_t *refseq,
                            tmap_map_sams_t *sams,
                            tmap_seq_t **seqs,
                            tmap_rand_t *rand,
+                           tmap_map_util_vsw_t *vsws,
                            tmap_map_opt_t *opt,
                            int32_t *num_after_grouping);
 
@@ -379,6 +402,7 @@ tmap_map_util_sw_gen_score(tmap_refseq_t *refseq,
   @param  sams          the seeded sams
   @param  seq           the original query sequence 
   @param  seqs          the query sequence (forward, reverse compliment, reverse, and compliment)
+  @param  vsws          the vectorized aligners for this end, NULL to use temporary ones
   @param  opt           the program parameters
   @return               the locally aligned sams
   */
@@ -387,6 +411,7 @@ tmap_map_util_sw_gen_cigar(tmap_refseq_t *refseq,
                  tmap_map_sams_t *sams, 
                  tmap_seq_t *seq,
                  tmap_seq_t **seqs,
+                 tmap_map_util_vsw_t *vsws,
                  tmap_map_opt_t *opt);
 
 /*!
@@ -12,6 +12,7 @@
 #include "../util/tmap_error.h"
 #include "../util/tmap_alloc.h"
 #include "../util/tmap_progress.h"
+#include "../util/tmap_placement.h"
 #include "../index/tmap_refseq.h"
 #include "../index/tmap_bwt.h"
 #include "../index/tmap_sa.h"
@@ -44,7 +45,7 @@ tmap_server_set_sigint(tmap_shm_t *shm)
 }
 
 void
-tmap_server_start(char *fn_fasta, key_t key, uint32_t listing)
+tmap_server_start(char *fn_fasta, key_t key, uint32_t listing, int32_t huge_pages, int32_t numa)
 {
   tmap_shm_t *shm = NULL;
   tmap_refseq_t *refseq = NULL;
@@ -70,7 +71,7 @@ tmap_server_start(char *fn_fasta, key_t key, uint32_t listing)
 
   // get shared memory
   tmap_progress_print("retrieving shared memory [%llu bytes]", (long long unsigned int)n_bytes);
-  shm = tmap_shm_init(key, n_bytes, 1);
+  shm = tmap_shm_init(key, n_bytes, 1, huge_pages, numa);
   tmap_progress_print2("shared memory retrieved");
 
   // catch a ctrl-c signal from now on
@@ -140,7 +141,7 @@ tmap_server_stop(key_t key)
 
   // get shared memory
   tmap_progress_print("retrieving shared memory");
-  shm = tmap_shm_init(key, 0, 0);
+  shm = tmap_shm_init(key, 0, 0, TMAP_PLACEMENT_HUGE_PAGES_NONE, TMAP_PLACEMENT_NUMA_NONE);
   tmap_progress_print2("shared memory retrieved");
 
   // set as not ready
@@ -159,7 +160,7 @@ tmap_server_kill(key_t key)
 
   // get shared memory
   tmap_progress_print("retrieving shared memory");
-  shm = tmap_shm_init(key, 0, 0);
+  shm = tmap_shm_init(key, 0, 0, TMAP_PLACEMENT_HUGE_PAGES_NONE, TMAP_PLACEMENT_NUMA_NONE);
   tmap_progress_print2("shared memory retrieved");
 
   // set as not ready
@@ -187,6 +188,8 @@ usage()
   tmap_file_fprintf(tmap_file_stderr, "         -r          load the packed reference\n");
   tmap_file_fprintf(tmap_file_stderr, "         -b          load the bwt\n");
   tmap_file_fprintf(tmap_file_stderr, "         -s          load the SA\n");
+  tmap_file_fprintf(tmap_file_stderr, "         -g INT      the page size (0: default, 1: 2MB huge pages, 2: 1GB huge pages) [0]\n");
+  tmap_file_fprintf(tmap_file_stderr, "         -n INT      the NUMA placement (0: default, 1: interleave across the nodes) [0]\n");
   tmap_file_fprintf(tmap_file_stderr, "         -v          print verbose progress information\n");
   tmap_file_fprintf(tmap_file_stderr, "         -h          print this message\n");
   tmap_file_fprintf(tmap_file_stderr, "\n");
@@ -209,8 +212,9 @@ tmap_server_main(int argc, char *argv[])
   char *fn_fasta=NULL;
   key_t key=13;
   uint32_t listing = 0;
+  int32_t huge_pages = TMAP_PLACEMENT_HUGE_PAGES_NONE, numa = TMAP_PLACEMENT_NUMA_NONE;
 
-  while((c = getopt(argc, argv, "f:c:k:arbsvh")) >= 0) {
+  while((c = getopt(argc, argv, "f:c:k:arbsg:n:vh")) >= 0) {
       switch(c) {
         case 'a':
           listing |= TMAP_SHM_LISTING_REFSEQ;
@@ -229,6 +233,10 @@ tmap_server_main(int argc, char *argv[])
           listing |= TMAP_SHM_LISTING_BWT; break;
         case 's':
           listing |= TMAP_SHM_LISTING_SA; break;
+        case 'g':
+          huge_pages = atoi(optarg); break;
+        case 'n':
+          numa = atoi(optarg); break;
         case 'v': 
           tmap_progress_set_verbosity(1); break;
         case 'h': 
@@ -244,10 +252,17 @@ tmap_server_main(int argc, char *argv[])
   if(TMAP_SERVER_START == cmd && 0 == listing) {
       tmap_error("no data structures to load", Exit, CommandLineArgument);
   }
+  if(huge_pages < TMAP_PLACEMENT_HUGE_PAGES_NONE || TMAP_PLACEMENT_HUGE_PAGES_1GB < huge_pages) {
+      tmap_error("option -g out of range", Exit, CommandLineArgument);
+  }
+  // NB: the shared memory cannot be replicated
+  if(numa < TMAP_PLACEMENT_NUMA_NONE || TMAP_PLACEMENT_NUMA_INTERLEAVE < numa) {
+      tmap_error("option -n out of range", Exit, CommandLineArgument);
+  }
 
   switch(cmd) {
     case TMAP_SERVER_START:
-      tmap_server_start(fn_fasta, key, listing); break;
+      tmap_server_start(fn_fasta, key, listing, huge_pages, numa); break;
     case TMAP_SERVER_STOP:
       tmap_server_stop(key); break;
     case TMAP_SERVER_KILL:
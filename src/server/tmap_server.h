@@ -36,12 +36,14 @@ tmap_server_set_sigint(tmap_shm_t *shm);
 
 /*! 
   starts a server and loads in reference data
-  @param  fn_fasta  the file name of the fasta file
-  @param  key       the server key
-  @param  listing   the server listing to load
+  @param  fn_fasta    the file name of the fasta file
+  @param  key         the server key
+  @param  listing     the server listing to load
+  @param  huge_pages  the page size of the shared memory (TMAP_PLACEMENT_HUGE_PAGES_*)
+  @param  numa        the NUMA placement of the shared memory (TMAP_PLACEMENT_NUMA_*)
   */
 void
-tmap_server_start(char *fn_fasta, key_t key, uint32_t listing);
+tmap_server_start(char *fn_fasta, key_t key, uint32_t listing, int32_t huge_pages, int32_t numa);
 
 /*! 
   stops the server with the given key
@@ -6,13 +6,26 @@
 #include <sys/shm.h>
 #include <stdint.h>
 #include <unistd.h>
+#include <sys/mman.h>
 
 #include "../util/tmap_error.h"
 #include "../util/tmap_alloc.h"
 #include "../util/tmap_definitions.h"
 #include "../util/tmap_progress.h"
+#include "../util/tmap_placement.h"
 #include "tmap_shm.h"
 
+// NB: from <linux/shm.h>, which may not be installed
+#ifndef SHM_HUGE_SHIFT
+#define SHM_HUGE_SHIFT 26
+#endif
+#ifndef SHM_HUGE_2MB
+#define SHM_HUGE_2MB (21 << SHM_HUGE_SHIFT)
+#endif
+#ifndef SHM_HUGE_1GB
+#define SHM_HUGE_1GB (30 << SHM_HUGE_SHIFT)
+#endif
+
 static int32_t
 tmap_shmget(key_t key, size_t size, int32_t shmflg, int32_t create)
 {
@@ -149,22 +162,28 @@ tmap_shm_get_buffer(tmap_shm_t *shm, uint32_t listing)
 }
 
 tmap_shm_t *
-tmap_shm_init(key_t key, size_t size, int32_t create)
+tmap_shm_init(key_t key, size_t size, int32_t create, int32_t huge_pages, int32_t numa)
 {
   tmap_shm_t *shm = NULL;
   int32_t i, shmflg = 0;
   struct shmid_ds buf;
+  size_t page_size;
 
   shm = tmap_calloc(1, sizeof(tmap_shm_t), "shm");
   shm->key = key;
   shm->size = size;
 
   if(1 == create) {
-      shm->size += sizeof(uint32_t); // add for synchronization
-      shm->size += sizeof(uint32_t); // add for on/off bits for listing what is in memory
-      shm->size += 32*sizeof(size_t); // add for the byte size of each listing
+      // add for synchronization, on/off bits for listing what is in memory,
+      // and the byte size of each listing, padded so the data starts on a page
+      shm->size += TMAP_SHM_HEADER_SIZE;
       shmflg = IPC_CREAT | IPC_EXCL | 0666;
       shm->creator = 1;
+      if(TMAP_PLACEMENT_HUGE_PAGES_NONE != huge_pages) {
+          // NB: a whole number of huge pages
+          page_size = tmap_placement_page_size(huge_pages);
+          shm->size = ((shm->size + page_size - 1) / page_size) * page_size;
+      }
   }
   else {
       shmflg = 0666;
@@ -172,13 +191,34 @@ tmap_shm_init(key_t key, size_t size, int32_t create)
   }
 
   // get the shared memory id
-  shm->shmid = tmap_shmget(shm->key, shm->size, shmflg, create);
+  shm->shmid = -1;
+#ifdef SHM_HUGETLB
+  if(1 == create && TMAP_PLACEMENT_HUGE_PAGES_NONE != huge_pages) {
+      shm->shmid = shmget(shm->key, shm->size, 
+                          shmflg | SHM_HUGETLB | ((TMAP_PLACEMENT_HUGE_PAGES_1GB == huge_pages) ? SHM_HUGE_1GB : SHM_HUGE_2MB));
+      if(shm->shmid < 0) {
+          tmap_error("could not reserve huge pages for the shared memory, falling back to transparent huge pages", Warn, SharedMemoryGet);
+      }
+  }
+#endif
+  if(shm->shmid < 0) {
+      shm->shmid = tmap_shmget(shm->key, shm->size, shmflg, create);
+  }
 
   // attach the shared memory
   shm->ptr = tmap_shmat(shm->shmid, NULL, 0);
   shm->buf = ((uint8_t*)shm->ptr);
-  shm->buf += sizeof(uint32_t); // synchronization 
-  shm->buf += sizeof(uint32_t) + 32*sizeof(size_t); // listings
+  shm->buf += TMAP_SHM_HEADER_SIZE; // synchronization and listings
+
+  if(1 == create) {
+#ifdef MADV_HUGEPAGE
+      if(TMAP_PLACEMENT_HUGE_PAGES_NONE != huge_pages) {
+          madvise(shm->ptr, shm->size, MADV_HUGEPAGE); // a hint only
+      }
+#endif
+      // NB: before the pages are touched
+      tmap_placement_bind(shm->ptr, shm->size, numa, 0);
+  }
 
   tmap_shmctl(shm->shmid, IPC_STAT, &buf);
   if(1 == create) {
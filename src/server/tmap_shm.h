@@ -8,6 +8,7 @@
 #include <sys/ipc.h>
 #include <sys/shm.h>
 #include <stdint.h>
+#include "../util/tmap_definitions.h"
 
 #define TMAP_SHM_NOT_READY ~0xffaa6161
 #define TMAP_SHM_READY 0xffaa6161
@@ -15,6 +16,13 @@
 #define TMAP_SHMGET_SLEEP 10
 #define TMAP_SHMGET_RETRIES 10
 
+/*! d TMAP_SHM_HEADER_SIZE
+  the number of bytes before the packed data: the synchronization state, the
+  listings, and the byte size of each listing, padded so the packed data is
+  page-aligned
+  */
+#define TMAP_SHM_HEADER_SIZE __tmap_packed_align(sizeof(uint32_t) + sizeof(uint32_t) + 32*sizeof(size_t))
+
 /*! 
   Shared Memory Library
   */
@@ -101,10 +109,12 @@ tmap_shm_set_dead(tmap_shm_t *shm);
   @param  key         the key of the shared memory 
   @param  size        the total size of the shared memory
   @param  create      1 if the process is to create the shared memory, 0 otherwise
+  @param  huge_pages  the page size when creating the shared memory (TMAP_PLACEMENT_HUGE_PAGES_*)
+  @param  numa        the NUMA placement when creating the shared memory (TMAP_PLACEMENT_NUMA_*)
   @return             a pointer to the initialized shared memory
   */
 tmap_shm_t *
-tmap_shm_init(key_t key, size_t size, int32_t create);
+tmap_shm_init(key_t key, size_t size, int32_t create, int32_t huge_pages, int32_t numa);
 
 /*! 
   @param  shm    pointer to the shared memory structure
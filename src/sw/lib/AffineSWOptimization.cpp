@@ -15,7 +15,7 @@
 
 using namespace std;
 
-AffineSWOptimization::AffineSWOptimization(int type) {
+AffineSWOptimization::AffineSWOptimization(int type, int simd) {
     myType = type;
     switch(type) {
       case 1:
@@ -28,7 +28,7 @@ AffineSWOptimization::AffineSWOptimization(int type) {
         s = new Solution3();
         break;
       case 4:
-        s = new Solution4();
+        s = new Solution4(simd);
         break;
       case 5:
         s = new Solution5();
@@ -57,8 +57,10 @@ AffineSWOptimization::AffineSWOptimization(int type) {
 #else
     hash = NULL;
 #endif
+#ifdef AFFINESWOPTIMIZATION_USE_HASH
     a.reserve(512);
     b.reserve(1024);
+#endif
 }
 
 int AffineSWOptimization::process(const uint8_t *target, int32_t tlen,
@@ -66,6 +68,7 @@ int AffineSWOptimization::process(const uint8_t *target, int32_t tlen,
                                   int qsc, int qec,
                                   int mm, int mi, int o, int e, int dir,
                                   int *opt, int *te, int *qe, int *n_best) {
+#ifdef AFFINESWOPTIMIZATION_USE_HASH
     int i;
     // resize
     b.resize(tlen);
@@ -73,7 +76,6 @@ int AffineSWOptimization::process(const uint8_t *target, int32_t tlen,
     // copy
     for(i=0;i<tlen;i++) b[i] = "ACGTN"[target[i]];
     for(i=0;i<qlen;i++) a[i] = "ACGTN"[query[i]];
-#ifdef AFFINESWOPTIMIZATION_USE_HASH
     // try the hash
     if(!hash->process(b, a, qsc, qec, mm, mi, o, e, dir, opt, te, qe, n_best)) {
         s->process(b, a, qsc, qec, mm, mi, o, e, dir, opt, te, qe, n_best);
@@ -82,7 +84,23 @@ int AffineSWOptimization::process(const uint8_t *target, int32_t tlen,
     }
     return (*opt);
 #else
-    return s->process(b, a, qsc, qec, mm, mi, o, e, dir, opt, te, qe, n_best);
+    // NB: no copy, the solution reads the integer-encoded sequences
+    return s->process(target, tlen, query, qlen, qsc, qec, mm, mi, o, e, dir, opt, te, qe, n_best);
+#endif
+}
+
+void AffineSWOptimization::processBatch(const uint8_t **targets, const int32_t *tlens, int32_t n,
+                                        const uint8_t *query, int32_t qlen,
+                                        int qsc, int qec,
+                                        int mm, int mi, int o, int e, int dir,
+                                        int *opt, int *te, int *qe, int *n_best) {
+#ifdef AFFINESWOPTIMIZATION_USE_HASH
+    int i;
+    for(i=0;i<n;i++) {
+        process(targets[i], tlens[i], query, qlen, qsc, qec, mm, mi, o, e, dir, opt + i, te + i, qe + i, n_best + i);
+    }
+#else
+    s->processBatch(targets, tlens, n, query, qlen, qsc, qec, mm, mi, o, e, dir, opt, te, qe, n_best);
 #endif
 }
 
@@ -16,7 +16,8 @@ using namespace std;
 
 class AffineSWOptimization {
 public:
-  AffineSWOptimization(int type);
+  // simd is the instruction set of the default algorithm (see Solution4)
+  AffineSWOptimization(int type, int simd = -1);
 
   int process(const uint8_t *target, int32_t tlen,
               const uint8_t *query, int32_t qlen,
@@ -24,10 +25,18 @@ public:
               int mm, int mi, int o, int e, int dir,
               int *opt, int *te, int *qe, int *n_best);
 
+  void processBatch(const uint8_t **targets, const int32_t *tlens, int32_t n,
+                    const uint8_t *query, int32_t qlen,
+                    int qsc, int qec,
+                    int mm, int mi, int o, int e, int dir,
+                    int *opt, int *te, int *qe, int *n_best);
+
   ~AffineSWOptimization();
 
   int getMaxQlen() { return s->getMaxQlen(); }
   int getMaxTlen() { return s->getMaxTlen(); }
+  void getEscalations(int64_t *started, int64_t *escalated) { s->getEscalations(started, escalated); }
+  void set8Bit(bool enable) { s->set8Bit(enable); }
 private:
   int myType;
   Solution *s;
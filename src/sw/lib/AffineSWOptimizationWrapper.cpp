@@ -4,6 +4,7 @@
 #include <limits>
 #include <iostream>
 #include "AffineSWOptimization.h"
+#include "Solution4.h"
 #include "AffineSWOptimizationWrapper.h"
 
 using namespace std;
@@ -14,6 +15,26 @@ tmap_vsw_wrapper_init(int32_t type)
   return new AffineSWOptimization(type);
 }
 
+tmap_vsw_wrapper_t*
+tmap_vsw_wrapper_init_simd(int32_t type, int32_t simd)
+{
+  return new AffineSWOptimization(type, simd);
+}
+
+int
+tmap_vsw_wrapper_simd_supported(int32_t simd)
+{
+  return Solution4::isSupported(simd);
+}
+
+const char*
+tmap_vsw_wrapper_simd_name(int32_t simd)
+{
+  static const char *names[TMAP_VSW_SIMD_NUM] = {"sse2", "avx2", "avx512"};
+  if(simd < 0 || TMAP_VSW_SIMD_NUM <= simd) return NULL;
+  return names[simd];
+}
+
 int32_t 
 tmap_vsw_wrapper_process(tmap_vsw_wrapper_t *v,
                          const uint8_t *target, int32_t tlen,
@@ -49,6 +70,17 @@ tmap_vsw_wrapper_process(tmap_vsw_wrapper_t *v,
   return v->process(target, tlen, query, qlen, qsc, qec, mm, mi, o, e, dir, opt, te, qe, n_best);
 }
 
+void
+tmap_vsw_wrapper_process_batch(tmap_vsw_wrapper_t *v,
+                               const uint8_t **targets, const int32_t *tlens, int32_t n,
+                               const uint8_t *query, int32_t qlen,
+                               int mm, int mi, int o, int e, int dir,
+                               int qsc, int qec,
+                               int *opt, int *te, int *qe, int *n_best)
+{
+  v->processBatch(targets, tlens, n, query, qlen, qsc, qec, mm, mi, o, e, dir, opt, te, qe, n_best);
+}
+
 void
 tmap_vsw_wrapper_destroy(tmap_vsw_wrapper_t *v)
 {
@@ -67,3 +99,15 @@ tmap_vsw_wrapper_get_max_tlen(tmap_vsw_wrapper_t *v)
 {
   return v->getMaxTlen();
 }
+
+void
+tmap_vsw_wrapper_get_escalations(tmap_vsw_wrapper_t *v, int64_t *started, int64_t *escalated)
+{
+  v->getEscalations(started, escalated);
+}
+
+void
+tmap_vsw_wrapper_set_8bit(tmap_vsw_wrapper_t *v, int32_t enable)
+{
+  v->set8Bit(0 != enable);
+}
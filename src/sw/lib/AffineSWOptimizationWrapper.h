@@ -11,9 +11,30 @@ extern "C" {
     typedef struct AffineSWOptimization tmap_vsw_wrapper_t; 
 #endif
 
+    // the instruction sets of the default algorithm (type 4)
+    enum {
+        TMAP_VSW_SIMD_SSE2 = 0,
+        TMAP_VSW_SIMD_AVX2 = 1,
+        TMAP_VSW_SIMD_AVX512 = 2,
+        TMAP_VSW_SIMD_NUM = 3
+    };
+
     tmap_vsw_wrapper_t* 
       tmap_vsw_wrapper_init(int type);
 
+    // the default algorithm uses the given instruction set, or the widest
+    // supported if -1; the other algorithms ignore it
+    tmap_vsw_wrapper_t* 
+      tmap_vsw_wrapper_init_simd(int type, int simd);
+
+    // returns 1 if the default algorithm can use the instruction set on this CPU, 0 otherwise
+    int
+      tmap_vsw_wrapper_simd_supported(int simd);
+
+    // returns the name of the instruction set, NULL if it is unknown
+    const char*
+      tmap_vsw_wrapper_simd_name(int simd);
+
     int32_t
       tmap_vsw_wrapper_process(tmap_vsw_wrapper_t *v,
                                const uint8_t *target, int32_t tlen,
@@ -22,6 +43,14 @@ extern "C" {
                                int32_t qsc, int32_t qec,
                                int32_t *opt, int32_t *target_end, int32_t *query_start, int32_t *n_best);
 
+    void
+      tmap_vsw_wrapper_process_batch(tmap_vsw_wrapper_t *v,
+                                     const uint8_t **targets, const int32_t *tlens, int32_t n,
+                                     const uint8_t *query, int32_t qlen,
+                                     int32_t mm, int32_t mi, int32_t o, int32_t e, int32_t dir,
+                                     int32_t qsc, int32_t qec,
+                                     int32_t *opt, int32_t *target_end, int32_t *query_end, int32_t *n_best);
+
     void
       tmap_vsw_wrapper_destroy(tmap_vsw_wrapper_t *v);
 
@@ -30,6 +59,15 @@ extern "C" {
     
     int
       tmap_vsw_wrapper_get_max_tlen(tmap_vsw_wrapper_t *v);
+
+    // the number of problems started with 8-bit lanes, and of those that
+    // needed 16-bit lanes to finish
+    void
+      tmap_vsw_wrapper_get_escalations(tmap_vsw_wrapper_t *v, int64_t *started, int64_t *escalated);
+
+    // 0 to score every problem with 16-bit lanes, 1 to start with 8-bit lanes where they fit
+    void
+      tmap_vsw_wrapper_set_8bit(tmap_vsw_wrapper_t *v, int32_t enable);
 #ifdef __cplusplus 
 }
 #endif
@@ -5,9 +5,39 @@ using namespace std;
 
 
 Solution::Solution() {
-    // dummy ctor
+    // NB: a solution that does not set its limits is never called
+    max_qlen = max_tlen = 0;
 }
 
 Solution::~Solution() {
     // dummy dtor
 }
+
+int Solution::process(const uint8_t *b, int32_t n, const uint8_t *a, int32_t m, int qsc, int qec,
+                      int mm, int mi, int o, int e, int dir,
+                      int *opt, int *te, int *qe, int *n_best) {
+    int i;
+    b_str.resize(n);
+    a_str.resize(m);
+    for(i=0;i<n;i++) b_str[i] = "ACGTN"[b[i]];
+    for(i=0;i<m;i++) a_str[i] = "ACGTN"[a[i]];
+    return process(b_str, a_str, qsc, qec, mm, mi, o, e, dir, opt, te, qe, n_best);
+}
+
+void Solution::getEscalations(int64_t *started, int64_t *escalated) {
+    (*started) = (*escalated) = 0;
+}
+
+void Solution::set8Bit(bool enable) {
+    // nothing to do
+}
+
+void Solution::processBatch(const uint8_t **b, const int32_t *n, int32_t num,
+                            const uint8_t *a, int32_t m, int qsc, int qec,
+                            int mm, int mi, int o, int e, int dir,
+                            int *opt, int *te, int *qe, int *n_best) {
+    int i;
+    for(i=0;i<num;i++) {
+        process(b[i], n[i], a, m, qsc, qec, mm, mi, o, e, dir, opt + i, te + i, qe + i, n_best + i);
+    }
+}
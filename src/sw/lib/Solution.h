@@ -7,6 +7,7 @@
 
 #include <cstring>
 #include <sstream>
+#include <stdint.h>
 
 using namespace std;
 
@@ -18,6 +19,26 @@ public:
                  int mm, int mi, int o, int e, int dir,
                  int *opt, int *te, int *qe, int *n_best) = 0;
 
+  // the target and query are integer-encoded (0-4 for A, C, G, T, and N),
+  // and are not copied by solutions that override this; the default
+  // converts them to characters and calls the above
+  virtual int process(const uint8_t *b, int32_t n, const uint8_t *a, int32_t m, int qsc, int qec,
+                 int mm, int mi, int o, int e, int dir,
+                 int *opt, int *te, int *qe, int *n_best);
+  // aligns the integer-encoded query to each of the num targets, storing the
+  // results for the i-th target in the i-th element of opt, te, qe, and n_best;
+  // the default calls process on each target in turn
+  virtual void processBatch(const uint8_t **b, const int32_t *n, int32_t num,
+                 const uint8_t *a, int32_t m, int qsc, int qec,
+                 int mm, int mi, int o, int e, int dir,
+                 int *opt, int *te, int *qe, int *n_best);
+  // the number of problems started with 8-bit lanes, and of those that needed
+  // 16-bit lanes to finish; the default uses neither
+  virtual void getEscalations(int64_t *started, int64_t *escalated);
+  // false to score every problem with 16-bit lanes, to check the 8-bit ones;
+  // the default has no 8-bit lanes to turn off
+  virtual void set8Bit(bool enable);
+
   virtual ~Solution();
 
   int getMaxQlen() { return max_qlen; }
@@ -26,6 +47,8 @@ public:
 protected:
   int max_qlen;
   int max_tlen;
+private:
+  string b_str, a_str;
 };
 
 #endif
@@ -40,9 +40,12 @@ Solution1::Solution1() {
     // dummy ctor
     vsw_opt = NULL;
     vsw_query = NULL;
-    target = query = NULL;
+    target = query = a_int = NULL;
     target_len = query_len = 0;
-    q_max = t_max = 0;
+    query_qsc = query_qec = 0;
+    q_max = t_max = a_max = 0;
+    batch_mem = NULL;
+    batch_mem_len = 0;
     max_qlen = INT_MAX;
     max_tlen = INT_MAX;
 }
@@ -50,6 +53,8 @@ Solution1::Solution1() {
 Solution1::~Solution1() {
     free(query);
     free(target);
+    free(a_int);
+    free(batch_mem);
     vsw_opt_destroy(vsw_opt);
     vsw_opt = NULL;
     if(NULL != vsw_query) vsw_query_destroy(vsw_query);
@@ -59,57 +64,114 @@ Solution1::~Solution1() {
 int Solution1::process(const string& b, const string& a, int qsc, int qec,
                                      int mm, int mi, int o, int e, int dir,
                                      int *_opt, int *_te, int *_qe, int *_n_best) {
-    int i, score;
+    int i;
     int n = b.size(), m = a.size();
-    int16_t query_end, target_end;
-    int32_t overflow, n_best;
-    // set opt
+    // convert to integers
+    if(t_max < n) {
+        t_max = n;
+        tmap_roundup32(t_max);
+        target = (uint8_t*)tmap_realloc(target, sizeof(uint8_t) * t_max, "target");
+    }
+    for(i=0;i<n;i++) {
+        target[i] = nt_char_to_int[(int)b[i]];
+    }
+    if(a_max < m) {
+        a_max = m;
+        tmap_roundup32(a_max);
+        a_int = (uint8_t*)tmap_realloc(a_int, sizeof(uint8_t) * a_max, "a_int");
+    }
+    for(i=0;i<m;i++) {
+        a_int[i] = nt_char_to_int[(int)a[i]];
+    }
+    return process(target, n, a_int, m, qsc, qec, mm, mi, o, e, dir, _opt, _te, _qe, _n_best);
+}
+
+void Solution1::initQuery(const uint8_t *a, int32_t m, int qsc, int qec, int mm, int mi, int o, int e) {
     if(NULL == vsw_opt) vsw_opt = vsw_opt_init(mm, -mi, -o, -e, SCORE_THR); // NB: mm/mi/o/e are fixed
-    // set query
-    if(0 == query_cmp(a, m, query, query_len)) {
+    if(NULL == query || query_len != m || query_qsc != qsc || query_qec != qec || 0 != memcmp(a, query, m)) {
         query_len = m;
+        query_qsc = qsc;
+        query_qec = qec;
         if(q_max < query_len) {
             q_max = query_len;
             tmap_roundup32(q_max);
             query = (uint8_t*)tmap_realloc(query, sizeof(uint8_t) * q_max, "query");
         }
-        for(i=0;i<m;i++) {
-            query[i] = nt_char_to_int[(int)a[i]];
-        }
+        memcpy(query, a, m);
         if(NULL != vsw_query) vsw_query_destroy(vsw_query);
         vsw_query = vsw_query_init(query, query_len, query_len, qsc, qec, vsw_opt); 
     }
+}
 
-    // reset query
-    vsw_query->query16 = vsw16_query_init(vsw_query->query16, query, query_len, qsc, qec, vsw_opt);
+int Solution1::process(const uint8_t *b, int32_t n, const uint8_t *a, int32_t m, int qsc, int qec,
+                       int mm, int mi, int o, int e, int dir,
+                       int *_opt, int *_te, int *_qe, int *_n_best) {
+    int score;
+    int16_t query_end, target_end;
+    int32_t overflow, n_best;
 
-    // set target
-    target_len = n;
-    if(t_max < target_len) {
-        t_max = target_len;
-        tmap_roundup32(t_max);
-        target = (uint8_t*)tmap_realloc(target, sizeof(uint8_t) * t_max, "target");
-    }
-    for(i=0;i<(int)target_len;i++) {
-        target[i] = nt_char_to_int[(int)b[i]];
-    }
+    initQuery(a, m, qsc, qec, mm, mi, o, e);
 
-    // run SW
     overflow = 0;
-    score = vsw16_sse2_forward(vsw_query->query16, target, target_len,
+    score = vsw16_sse2_forward(vsw_query->query16, b, n,
                                qsc, qec,
                                vsw_opt, &query_end, &target_end,
                                dir, &overflow, &n_best, SCORE_THR);
 
-    // return results
     (*_opt) = score;
     (*_te) = target_end;
     (*_qe) = query_end;
     (*_n_best) = n_best;
-    //fprintf(stderr, "%s SCORE=%d %d %d %d %d\n", __func__, score, target_end, query_end, n_best, overflow);
     return score;
 }
 
+void Solution1::processBatch(const uint8_t **b, const int32_t *n, int32_t num,
+                             const uint8_t *a, int32_t m, int qsc, int qec,
+                             int mm, int mi, int o, int e, int dir,
+                             int *_opt, int *_te, int *_qe, int *_n_best) {
+    int32_t i, j, k, len;
+    int16_t query_ends[vsw16_values_per_128_bits], target_ends[vsw16_values_per_128_bits];
+    int32_t overflows[vsw16_values_per_128_bits];
+
+    // NB: positions and counts are kept in 16-bit lanes
+    if(INT16_MAX - vsw16_values_per_128_bits < m) {
+        Solution::processBatch(b, n, num, a, m, qsc, qec, mm, mi, o, e, dir, _opt, _te, _qe, _n_best);
+        return;
+    }
+
+    initQuery(a, m, qsc, qec, mm, mi, o, e);
+
+    // working memory
+    len = sizeof(__m128i) * __vsw16_batch_mem(vsw_query->query16->slen) + 15;
+    if(batch_mem_len < len) {
+        batch_mem_len = len;
+        tmap_roundup32(batch_mem_len);
+        free(batch_mem);
+        batch_mem = (uint8_t*)tmap_malloc(sizeof(uint8_t) * batch_mem_len, "batch_mem");
+    }
+
+    // one target per lane
+    for(i=0;i<num;i+=j) {
+        for(j=0;j<vsw16_values_per_128_bits && i+j<num;j++) {
+            if(INT16_MAX < n[i+j]) break;
+        }
+        if(0 == j) { // too long for the lanes
+            process(b[i], n[i], a, m, qsc, qec, mm, mi, o, e, dir, _opt + i, _te + i, _qe + i, _n_best + i);
+            j = 1;
+            continue;
+        }
+        vsw16_sse2_forward_batch(vsw_query->query16, query,
+                                 b + i, n + i, j,
+                                 qsc, qec, vsw_opt, dir, SCORE_THR,
+                                 (__m128i*)__vsw_16((size_t)batch_mem),
+                                 _opt + i, query_ends, target_ends, overflows, _n_best + i);
+        for(k=0;k<j;k++) {
+            _te[i+k] = target_ends[k];
+            _qe[i+k] = query_ends[k];
+        }
+    }
+}
+
 /*
    vsw_opt_t *vsw_opt = NULL;
    vsw_query_t* vsw_query = NULL;
@@ -118,13 +180,3 @@ int Solution1::process(const string& b, const string& a, int qsc, int qec,
    uint8_t target[T_MAX];
    uint32_t target_len = 0;
    */
-
-int32_t Solution1::query_cmp(string q, int n, uint8_t *query, int32_t query_len) {
-    int i;
-    if(NULL == query) return 0;
-    if(query_len != n) return 0;
-    for(i=0;i<n;i++) {
-        if(q[i] != "ACGTN"[query[i]]) return 0;
-    }
-    return 1;
-}
@@ -23,14 +23,26 @@ public:
                  int mm, int mi, int o, int e, int dir,
                  int *opt, int *te, int *qe, int *n_best);
 
-  int32_t query_cmp(string q, int n, uint8_t *query, int32_t query_len);
+  virtual int process(const uint8_t *b, int32_t n, const uint8_t *a, int32_t m, int qsc, int qec,
+                 int mm, int mi, int o, int e, int dir,
+                 int *opt, int *te, int *qe, int *n_best);
+
+  virtual void processBatch(const uint8_t **b, const int32_t *n, int32_t num,
+                 const uint8_t *a, int32_t m, int qsc, int qec,
+                 int mm, int mi, int o, int e, int dir,
+                 int *opt, int *te, int *qe, int *n_best);
 private:
-  int32_t q_max, t_max;
+  void initQuery(const uint8_t *a, int32_t m, int qsc, int qec, int mm, int mi, int o, int e);
+  int32_t q_max, t_max, a_max;
   vsw_opt_t *vsw_opt;
   vsw_query_t* vsw_query;
   uint8_t *query;
   int32_t query_len;
+  int32_t query_qsc, query_qec;
   uint8_t *target;
   int32_t target_len;
+  uint8_t *a_int;
+  uint8_t *batch_mem;
+  int32_t batch_mem_len;
 };
 #endif
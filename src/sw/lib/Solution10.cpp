@@ -41,28 +41,22 @@ using namespace std;
 const int DNA_VALUE[20] = {
     0, -1,  1, -1, -1, 
     -1, 2, -1, -1, -1, 
-    -1, -1, -1, -1, -1,
+    -1, -1, -1, 4, -1,
     -1, -1, -1, -1, 3
 };
 
-int flag = 1;
-unsigned short gapOpen=0, gapExtend=0;
-signed char * matrix;        
-unsigned char querySeq[512], targetSeq[1024];
-
-void buildMatrix (int match, int mismatch)
+void buildMatrix (signed char *matrix, int match, int mismatch)
 {
-  matrix = (signed char *) malloc (16);
   int offset;
 
-  for (int i = 0; i < 4; ++i) {
-      offset = (i << 2);
-      for (int j = 0; j < 4; ++j) 
+  for (int i = 0; i < SW_ALPHABET_SIZE; ++i) {
+      offset = i * SW_ALPHABET_SIZE;
+      for (int j = 0; j < SW_ALPHABET_SIZE; ++j) 
         matrix[offset+j] = (j==i) ? match : mismatch;
   }                
 }
 
-typedef struct {
+typedef struct SwStripedData {
     __m128i        *pvbQueryProf;
     __m128i        *pvsQueryProf;
     __m128i        *pvH1;
@@ -107,8 +101,8 @@ SwStripedData * swStripedInitByte(unsigned char   *querySeq,
   }
 
   nCount = 64 +                             /* slack bytes */
-    (lenQryByte << 2) +        /* query profile byte */
-    (lenQryShort << 2) +       /* query profile short */
+    (lenQryByte * SW_ALPHABET_SIZE) +        /* query profile byte */
+    (lenQryShort * SW_ALPHABET_SIZE) +       /* query profile short */
     (lenQryShort * 3);               /* vH1, vH2 and vE */
 
   pSwData->pData = (unsigned char *) calloc (nCount, sizeof (__m128i));
@@ -122,9 +116,9 @@ SwStripedData * swStripedInitByte(unsigned char   *querySeq,
   aligned = ((size_t) pSwData->pData + 15) & ~(0x0f);
 
   pSwData->pvbQueryProf = (__m128i *) aligned;
-  pSwData->pvsQueryProf = pSwData->pvbQueryProf + (lenQryByte << 2);
+  pSwData->pvsQueryProf = pSwData->pvbQueryProf + (lenQryByte * SW_ALPHABET_SIZE);
 
-  pSwData->pvH1 = pSwData->pvsQueryProf + (lenQryShort << 2);
+  pSwData->pvH1 = pSwData->pvsQueryProf + (lenQryShort * SW_ALPHABET_SIZE);
   pSwData->pvH2 = pSwData->pvH1 + lenQryShort;
   pSwData->pvE  = pSwData->pvH2 + lenQryShort;
 
@@ -135,8 +129,8 @@ SwStripedData * swStripedInitByte(unsigned char   *querySeq,
   pc = (char *) pSwData->pvbQueryProf;
   segSize = (queryLength + 15) >> 4;
   nCount = (segSize << 4);
-  for (i = 0; i < 4; ++i) {
-      matrixRow = matrix + (i << 2);
+  for (i = 0; i < SW_ALPHABET_SIZE; ++i) {
+      matrixRow = matrix + i * SW_ALPHABET_SIZE;
       for (j = 0; j < segSize; ++j) {
           for (k = j; k < nCount; k += segSize) {
               if (k >= queryLength) 
@@ -181,7 +175,7 @@ SwStripedData * swStripedInitWord(unsigned char   *querySeq,
   }
 
   nCount = 64 +                             /* slack bytes */
-    (lenQryShort << 2) +       /* query profile short */
+    (lenQryShort * SW_ALPHABET_SIZE) +       /* query profile short */
     (lenQryShort * 3);               /* vH1, vH2 and vE */
 
   pSwData->pData = (unsigned char *) calloc (nCount, sizeof (__m128i));
@@ -195,7 +189,7 @@ SwStripedData * swStripedInitWord(unsigned char   *querySeq,
   aligned = ((size_t) pSwData->pData + 15) & ~(0x0f);
 
   pSwData->pvsQueryProf = (__m128i *) aligned;
-  pSwData->pvH1 = pSwData->pvsQueryProf + (lenQryShort << 2);
+  pSwData->pvH1 = pSwData->pvsQueryProf + (lenQryShort * SW_ALPHABET_SIZE);
   pSwData->pvH2 = pSwData->pvH1 + lenQryShort;
   pSwData->pvE  = pSwData->pvH2 + lenQryShort;
 
@@ -203,8 +197,8 @@ SwStripedData * swStripedInitWord(unsigned char   *querySeq,
   ps = (short *) pSwData->pvsQueryProf;
   segSize = ((queryLength + 7) >> 3);
   nCount = (segSize << 3);
-  for (i = 0; i < 4; ++i) {
-      matrixRow = (matrix + (i << 2));
+  for (i = 0; i < SW_ALPHABET_SIZE; ++i) {
+      matrixRow = (matrix + i * SW_ALPHABET_SIZE);
       for (j = 0; j < segSize; ++j) {
           for (k = j; k < nCount; k += segSize) {
               if (k >= queryLength) 
@@ -237,8 +231,8 @@ void swStripedInitWordAfterByte( SwStripedData *pSwData,
   ps = (short *) pSwData->pvsQueryProf;
   segSize = ((queryLength + 7) >> 3);
   nCount = (segSize << 3);
-  for (i = 0; i < 4; ++i) {
-      matrixRow = (matrix + (i << 2));
+  for (i = 0; i < SW_ALPHABET_SIZE; ++i) {
+      matrixRow = (matrix + i * SW_ALPHABET_SIZE);
       for (j = 0; j < segSize; ++j) {
           for (k = j; k < nCount; k += segSize) {
               if (k >= queryLength) 
@@ -380,7 +374,10 @@ int swStripedByte3(int              queryLength,
                       temp = k * iter + j;
                       if (temp < queryLength) {
                           ++n_best;                                        
-                          if (dir == 1 && temp >= query_end) {
+                          // ties: the smallest query end for dir 0, otherwise the
+                          // largest, and then the largest target end
+                          if ((dir == 0 && temp < query_end) || (dir == 1 && temp > query_end)
+                              || temp == query_end) {
                               query_end = temp;
                               target_end = i;
                           }
@@ -593,7 +590,9 @@ void swStripedWord3(int              queryLength,
                       temp = k * iter + j;
                       if (temp < queryLength) {
                           ++n_best;                                        
-                          if (dir == 1 && temp >= query_end) {
+                          // ties as in swStripedByte3()
+                          if ((dir == 0 && temp < query_end) || (dir == 1 && temp > query_end)
+                              || temp == query_end) {
                               query_end = temp;
                               target_end = i;
                           }
@@ -675,28 +674,19 @@ void swStripedWord3(int              queryLength,
   (*_n_best) = n_best;
 }
 
-SwStripedData *        swData3;
-
-void swStripedScan3 (unsigned char* querySeq,
+void swStripedScan3 (SwStripedData  *swData3,
+                     unsigned char* querySeq,
                      int              queryLength,
                      unsigned char   *targetSeq,
                      int                targetLength,    
+                     signed char *    matrix,
                      unsigned short    gapOpen,
                      unsigned short    gapExtend,        
                      int                dir,
-                     int *opt, int *te, int *qe, int *n_best,
-                     int            buildProfile)
+                     int *opt, int *te, int *qe, int *n_best)
 {
   int score;              
 
-  if (buildProfile == 1)    {
-      if (swData3)
-        {
-          free(swData3->pData);
-          free(swData3);
-        }
-      swData3 = swStripedInitByte(querySeq, queryLength, matrix);
-  }
   score = swStripedByte3 (queryLength, 
                           targetSeq, targetLength,
                           gapOpen, gapExtend,
@@ -880,7 +870,7 @@ void swStripedWord2(int              queryLength,
           if (score == temp) 
             {
               ++n_best;
-              if (dir == 1 && j >= query_end) 
+              if (j > query_end) // ties: the largest target end
                 query_end = j;
             }
           else if (score < temp) 
@@ -1026,10 +1016,7 @@ void swStripedWord1(int              queryLength,
                       temp = k * iter + j;
                       if (temp < queryLength) {
                           ++n_best;
-                          if ( dir == 0 && query_end == -1) 
-                            query_end = temp;            
-                          if (dir == 1)
-                            query_end = temp;            
+                          query_end = temp; // the largest target end
                       }
                   }
                 }                
@@ -1042,7 +1029,8 @@ void swStripedWord1(int              queryLength,
                       temp = k * iter + j;
                       if (temp < queryLength) {
                           ++n_best;                                        
-                          if (dir == 1 && temp >= query_end) {
+                          // ties as in swStripedByte3(), but here i is the query end
+                          if ((dir == 1 && i > target_end) || (i == target_end && temp > query_end)) {
                               query_end = temp;
                               target_end = i;
                           }
@@ -1281,7 +1269,7 @@ void swStripedWord0(int              queryLength,
           if (score == temp) 
             {
               ++n_best;
-              if (dir == 1 && j >= query_end) 
+              if (j > query_end) // ties: the largest target end
                 query_end = j;
             }
           else if (score < temp) 
@@ -1301,14 +1289,16 @@ void swStripedWord0(int              queryLength,
   (*_n_best) = n_best;
 }
 
-string currentQuery="";
-
-Solution10::Solution10() {
+Solution10::Solution10() : scoreMatch(0), scoreMismatch(0), scoreGapOpen(0), scoreGapExtend(0), gapOpen(0), gapExtend(0), swData3(NULL) {
+    max_qlen = 512;
+    max_tlen = 1024;
 }
   
 Solution10::~Solution10() {
-    max_qlen = 512;
-    max_tlen = 1024;
+    if (swData3) {
+        free(swData3->pData);
+        free(swData3);
+    }
 }
 
 // b: target (1-1024), a: query (1-512)
@@ -1327,11 +1317,12 @@ int Solution10::process(const string& b, const string& a, int qsc, int qec,
 
     SwStripedData *swData=NULL;    
 
-    if (unlikely(flag)) {                
+    if (unlikely(scoreMatch != mm || scoreMismatch != mi || scoreGapOpen != o || scoreGapExtend != e)) {
+        scoreMatch = mm; scoreMismatch = mi; scoreGapOpen = o; scoreGapExtend = e;
         gapOpen = -(o+e);
         gapExtend = -e;
-        buildMatrix(mm,mi);
-        flag=0;
+        buildMatrix(matrix, mm, mi);
+        currentQuery.clear(); // the profile was built with the old matrix
     }
 
     for (i = 0; i < m; ++i)
@@ -1339,17 +1330,20 @@ int Solution10::process(const string& b, const string& a, int qsc, int qec,
     for (i = 0; i < n; ++i)
       targetSeq[i] = DNA_VALUE[b[i]-65];            
     if (id == 3) {    
-        int buildProfile = 0;
         if (a!=currentQuery) {
-            buildProfile = 1;
+            if (swData3) {
+                free(swData3->pData);
+                free(swData3);
+            }
+            swData3 = swStripedInitByte(querySeq, m, matrix);
             currentQuery = a;
         }
-        else
-          buildProfile = 0;
-        swStripedScan3 (querySeq, m, targetSeq, n, 
+        swStripedScan3 (swData3, querySeq, m, targetSeq, n, matrix,
                         gapOpen, gapExtend,
-                        dir, opt, te, qe, n_best, buildProfile);                  
+                        dir, opt, te, qe, n_best);                  
     } else if (id == 2) {
+        // NB: the profile is of the target, so the query and target ends
+        // come back swapped
         swData = swStripedInitWord(targetSeq, n, matrix);        
         swStripedWord2(n, querySeq, m ,
                        gapOpen, gapExtend,
@@ -1357,7 +1351,7 @@ int Solution10::process(const string& b, const string& a, int qsc, int qec,
                        swData->pvH1,
                        swData->pvH2,
                        swData->pvE,
-                       dir, opt, te, qe, n_best);                    
+                       dir, opt, qe, te, n_best);                    
     } else if (id == 1) {
         swData = swStripedInitWord(targetSeq, n, matrix);    
         swStripedWord1 (n, querySeq, m,
@@ -1366,7 +1360,7 @@ int Solution10::process(const string& b, const string& a, int qsc, int qec,
                         swData->pvH1,
                         swData->pvH2,
                         swData->pvE,
-                        dir, opt, te, qe, n_best);                    
+                        dir, opt, qe, te, n_best);                    
     } else if (id == 0) {
         swData = swStripedInitWord(targetSeq, n, matrix);    
         swStripedWord0 (n, querySeq, m ,
@@ -1375,7 +1369,7 @@ int Solution10::process(const string& b, const string& a, int qsc, int qec,
                         swData->pvH1,
                         swData->pvH2,
                         swData->pvE,
-                        dir, opt, te, qe, n_best);                
+                        dir, opt, qe, te, n_best);                
     }
 
     if (id != 3) {
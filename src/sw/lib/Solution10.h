@@ -11,6 +11,11 @@
 
 using namespace std;
 
+// A, C, G, T, and N, which matches only N, as in Solution1
+#define SW_ALPHABET_SIZE 5
+
+struct SwStripedData;
+
 class Solution10 : public Solution {
 public:
   Solution10();
@@ -20,6 +25,12 @@ public:
                  int mm, int mi, int o, int e, int dir,
                  int *opt, int *te, int *qe, int *n_best);
 private:
+  int scoreMatch, scoreMismatch, scoreGapOpen, scoreGapExtend; // the scores the matrix and gap penalties were built for
+  unsigned short gapOpen, gapExtend;
+  signed char matrix[SW_ALPHABET_SIZE * SW_ALPHABET_SIZE];
+  unsigned char querySeq[512], targetSeq[1024];
+  string currentQuery; // the query of the profile below
+  SwStripedData *swData3;
 };
 
 #endif
@@ -32,7 +32,11 @@
 #include <limits.h>
 #include "../../util/tmap_definitions.h"
 #include "../../util/tmap_alloc.h"
+#include "../../util/tmap_cpu.h"
 #include "Solution4.h"
+#ifdef TMAP_CPU_X86
+#include <immintrin.h>
+#endif
 
 using namespace std;
 
@@ -77,50 +81,64 @@ VS splt(string s, char c = ' ') {VS rv; int p = 0, np; while (np = s.find(c, p),
 const int INF = (1<<14);
 const int MIN_VAL = -(1<<15);
 
-INLINE int16_t Solution4::findMax16(const __m128i &mMax) {
-    __m128i mshift = _mm_srli_si128(mMax, 2);
-    __m128i m = _mm_max_epi16(mshift, mMax);
+// The vector operations of each instruction set used by the kernels.  The
+// lanes are shifted across the whole vector: by one element (v_shl*), or by B
+// bytes with the bytes of fill shifted in (v_shlb).  The wider vectors carry
+// the gaps across the lanes with a scan (V_SCAN, see Solution4Kernel.h).
+
+namespace solution4_sse2 {
+
+typedef __m128i vec;
+enum { V_LANES16 = 8, V_LANES8 = 16, V_SCAN = 0 };
+
+static INLINE vec v_load(const vec *p) { return _mm_load_si128(p); }
+static INLINE void v_store(vec *p, vec a) { _mm_store_si128(p, a); }
+static INLINE vec v_zero() { return _mm_setzero_si128(); }
+static INLINE vec v_set1_16(short x) { return _mm_set1_epi16(x); }
+static INLINE vec v_set1_8(char x) { return _mm_set1_epi8(x); }
+static INLINE vec v_and(vec a, vec b) { return _mm_and_si128(a, b); }
+static INLINE vec v_or(vec a, vec b) { return _mm_or_si128(a, b); }
+static INLINE vec v_add16(vec a, vec b) { return _mm_add_epi16(a, b); }
+static INLINE vec v_adds16(vec a, vec b) { return _mm_adds_epi16(a, b); }
+static INLINE vec v_max16(vec a, vec b) { return _mm_max_epi16(a, b); }
+static INLINE vec v_min16(vec a, vec b) { return _mm_min_epi16(a, b); }
+static INLINE vec v_cmpeq16(vec a, vec b) { return _mm_cmpeq_epi16(a, b); }
+static INLINE vec v_srli16(vec a, int n) { return _mm_srli_epi16(a, n); }
+static INLINE vec v_adds8u(vec a, vec b) { return _mm_adds_epu8(a, b); }
+static INLINE vec v_subs8u(vec a, vec b) { return _mm_subs_epu8(a, b); }
+static INLINE vec v_max8u(vec a, vec b) { return _mm_max_epu8(a, b); }
+static INLINE vec v_min8u(vec a, vec b) { return _mm_min_epu8(a, b); }
+static INLINE vec v_cmpeq8(vec a, vec b) { return _mm_cmpeq_epi8(a, b); }
+static INLINE vec v_shl16(vec a) { return _mm_slli_si128(a, 2); }
+static INLINE vec v_shl8(vec a) { return _mm_slli_si128(a, 1); }
+static INLINE vec v_insert0_16(vec a, short x) { return _mm_insert_epi16(a, x, 0); }
+template <int B> static INLINE vec v_shlb(vec a, const vec &fill) {
+    if (B < 16) return _mm_or_si128(_mm_slli_si128(a, B & 15), _mm_srli_si128(fill, (16 - B) & 15));
+    return fill;
+}
+static INLINE bool v_any_gt16(vec a, vec b) { return 0 != _mm_movemask_epi8(_mm_cmpgt_epi16(a, b)); }
+static INLINE bool v_any_eq8(vec a, vec b) { return 0 != _mm_movemask_epi8(_mm_cmpeq_epi8(a, b)); }
+static INLINE bool v_any_gt8(vec a, vec b) { return 0 != _mm_movemask_epi8(_mm_cmpgt_epi8(a, b)); }
+
+static INLINE int16_t findMax16(const vec &mMax) {
+    vec mshift = _mm_srli_si128(mMax, 2);
+    vec m = _mm_max_epi16(mshift, mMax);
     mshift = _mm_srli_si128(m, 4);
     m = _mm_max_epi16(mshift, m);
     return max(_mm_extract_epi16(m, 0), _mm_extract_epi16(m, 4));
-    /*
-    int16_t* p = (int16_t*)&m;
-    return max(p[0], p[4]);
-    */
 }
 
-INLINE int16_t Solution4::findMax16Simple(const __m128i &mMax) {
-    __m128i m = mMax;
+static INLINE int16_t findMax16Simple(const vec &mMax) {
+    vec m = mMax;
     m = _mm_max_epi16(m, _mm_srli_si128(m, 8)); 
     m = _mm_max_epi16(m, _mm_srli_si128(m, 4)); 
     m = _mm_max_epi16(m, _mm_srli_si128(m, 2)); 
     return (int16_t)(_mm_extract_epi16(m, 0) & 0xffff); 
-    /*
-    int16_t* p = (int16_t*)&mMax;
-    int16_t mx = p[0];
-    mx = max(mx, p[1]);
-    mx = max(mx, p[2]);
-    mx = max(mx, p[3]);
-    mx = max(mx, p[4]);
-    mx = max(mx, p[5]);
-    mx = max(mx, p[6]);
-    mx = max(mx, p[7]);
-    return mx;    
-    */
 }
 
-/*
-   INLINE uint8_t findMax8(const __m128i &mMax) {
-   __m128i mshift = _mm_srli_si128(mMax, 1);
-   __m128i m = _mm_max_epu8(mshift, mMax);
-   uint8_t* p = (uint8_t*)&m;
-   return max(max(max(p[0], p[2]), max(p[4], p[6])), max(max(p[8], p[10]), max(p[12], p[14])));    
-   }
-   */
-
-INLINE uint8_t Solution4::findMax8(const __m128i &mMax) {
-    __m128i mshift = _mm_srli_si128(mMax, 1);
-    __m128i m = _mm_max_epu8(mshift, mMax);
+static INLINE uint8_t findMax8(const vec &mMax) {
+    vec mshift = _mm_srli_si128(mMax, 1);
+    vec m = _mm_max_epu8(mshift, mMax);
     mshift = _mm_srli_si128(m, 2);
     m = _mm_max_epu8(mshift, m);
     uint8_t* p = (uint8_t*)&m;
@@ -131,1096 +149,211 @@ INLINE uint8_t Solution4::findMax8(const __m128i &mMax) {
     return mx;    
 }
 
-/*
-void show8(const __m128i &m) {
-    uint8_t* p = (uint8_t*)&m;
-    print(VI(p, p + 16));
-}
+#include "Solution4Kernel.h"
 
-void show16(const __m128i &m) {
-    int16_t* p = (int16_t*)&m;
-    print(VI(p, p + 8));
 }
-*/
-
-NOINLINE uint64_t Solution4::hashDNA(const string &s, const int len) {
-    uint64_t h = 1;
-    if (len < 16) {
-        REP(j, len) h = h * 1337 + s[j];
-        return h;
-    }
-
-    __m128i mhash = _mm_set1_epi16(1);
-    __m128i mmul = _mm_set1_epi16(13);
-    __m128i mzero = _mm_setzero_si128();
-    __m128i m0, m1a, m1b;
-    int i = 0;
-    while (i + 16 < len) {
-        m0 = _mm_loadu_si128((__m128i*)&s[i]);
-        m1a = _mm_unpacklo_epi8(m0, mzero);
-        m1b = _mm_unpackhi_epi8(m0, mzero);
-        mhash = _mm_mullo_epi16(mhash, mmul);
-        mhash = _mm_add_epi16(mhash, m1a);
-        mhash = _mm_mullo_epi16(mhash, mmul);
-        mhash = _mm_add_epi16(mhash, m1b);
-        i += 16;
-    }
-    m0 = _mm_loadu_si128((__m128i*)&s[len - 16]);
-    m1a = _mm_unpacklo_epi8(m0, mzero);
-    m1b = _mm_unpackhi_epi8(m0, mzero);
-    mhash = _mm_mullo_epi16(mhash, mmul);
-    mhash = _mm_add_epi16(mhash, m1a);
-    mhash = _mm_mullo_epi16(mhash, mmul);
-    mhash = _mm_add_epi16(mhash, m1b);
 
-    /*
-    uint32_t* p = (uint32_t*)&mhash;
-    h = h * 1337 + p[0];
-    h = h * 1337 + p[1];
-    h = h * 1337 + p[2];
-    h = h * 1337 + p[3];
-    */
-    h = h * 1337 + (uint64_t)_mm_extract_epi16(mhash, 0);
-    h = h * 1337 + (uint64_t)_mm_extract_epi16(mhash, 1);
-    h = h * 1337 + (uint64_t)_mm_extract_epi16(mhash, 2);
-    h = h * 1337 + (uint64_t)_mm_extract_epi16(mhash, 3);
-    h = h * 1337 + (uint64_t)_mm_extract_epi16(mhash, 4);
-    h = h * 1337 + (uint64_t)_mm_extract_epi16(mhash, 5);
-    h = h * 1337 + (uint64_t)_mm_extract_epi16(mhash, 6);
-    h = h * 1337 + (uint64_t)_mm_extract_epi16(mhash, 7);
-    return h;
+#ifdef TMAP_CPU_X86
+
+// the maximum of the eight 16-bit and sixteen 8-bit lanes of the reduced vectors
+#define __solution4_max16_128(m) do { \
+    (m) = _mm_max_epi16((m), _mm_srli_si128((m), 8)); \
+    (m) = _mm_max_epi16((m), _mm_srli_si128((m), 4)); \
+    (m) = _mm_max_epi16((m), _mm_srli_si128((m), 2)); \
+} while(0)
+#define __solution4_max8_128(m) do { \
+    (m) = _mm_max_epu8((m), _mm_srli_si128((m), 8)); \
+    (m) = _mm_max_epu8((m), _mm_srli_si128((m), 4)); \
+    (m) = _mm_max_epu8((m), _mm_srli_si128((m), 2)); \
+    (m) = _mm_max_epu8((m), _mm_srli_si128((m), 1)); \
+} while(0)
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+namespace solution4_avx2 {
+
+typedef __m256i vec;
+enum { V_LANES16 = 16, V_LANES8 = 32, V_SCAN = 1 };
+
+static INLINE vec v_load(const vec *p) { return _mm256_load_si256(p); }
+static INLINE void v_store(vec *p, vec a) { _mm256_store_si256(p, a); }
+static INLINE vec v_zero() { return _mm256_setzero_si256(); }
+static INLINE vec v_set1_16(short x) { return _mm256_set1_epi16(x); }
+static INLINE vec v_set1_8(char x) { return _mm256_set1_epi8(x); }
+static INLINE vec v_and(vec a, vec b) { return _mm256_and_si256(a, b); }
+static INLINE vec v_or(vec a, vec b) { return _mm256_or_si256(a, b); }
+static INLINE vec v_add16(vec a, vec b) { return _mm256_add_epi16(a, b); }
+static INLINE vec v_adds16(vec a, vec b) { return _mm256_adds_epi16(a, b); }
+static INLINE vec v_max16(vec a, vec b) { return _mm256_max_epi16(a, b); }
+static INLINE vec v_min16(vec a, vec b) { return _mm256_min_epi16(a, b); }
+static INLINE vec v_cmpeq16(vec a, vec b) { return _mm256_cmpeq_epi16(a, b); }
+static INLINE vec v_srli16(vec a, int n) { return _mm256_srli_epi16(a, n); }
+static INLINE vec v_adds8u(vec a, vec b) { return _mm256_adds_epu8(a, b); }
+static INLINE vec v_subs8u(vec a, vec b) { return _mm256_subs_epu8(a, b); }
+static INLINE vec v_max8u(vec a, vec b) { return _mm256_max_epu8(a, b); }
+static INLINE vec v_min8u(vec a, vec b) { return _mm256_min_epu8(a, b); }
+static INLINE vec v_cmpeq8(vec a, vec b) { return _mm256_cmpeq_epi8(a, b); }
+// the upper half receives the last bytes of the lower half
+static INLINE vec v_shl16(vec a) { return _mm256_alignr_epi8(a, _mm256_permute2x128_si256(a, a, 0x08), 14); }
+static INLINE vec v_shl8(vec a) { return _mm256_alignr_epi8(a, _mm256_permute2x128_si256(a, a, 0x08), 15); }
+static INLINE vec v_insert0_16(vec a, short x) { return _mm256_inserti128_si256(a, _mm_insert_epi16(_mm256_castsi256_si128(a), x, 0), 0); }
+template <int B> static INLINE vec v_shlb(vec a, const vec &fill) {
+    vec t = _mm256_permute2x128_si256(a, fill, 0x02);
+    if (B < 16) return _mm256_alignr_epi8(a, t, (16 - B) & 15);
+    if (B == 16) return t;
+    return fill;
 }
-
-int Solution4::resize(int a, int b) {
-    if(MAX_DIMB < b) {
-        MAX_DIMB = b;
-        tmap_roundup32(MAX_DIMB);
-        free(mem); mem = NULL;
-        mem = (uint8_t*)tmap_malloc(64 + ((MAX_DIMB + 64) * 9 * sizeof(int16_t)), "mem");
-        BUFFER = (int16_t*)(((uintptr_t)mem+64) & ~ 0x3F);
-    }
-    if(MAX_DIMA < a) {
-        MAX_DIMA = a;
-        tmap_roundup32(MAX_DIMA);
-        HTDATA_l = MAX_DIMA;
-#ifdef USE_HASHING
-        free(HTDATA); HTDATA = NULL;
-        HTDATA = (qres_t*)tmap_malloc((HTDATA_l + 64) * sizeof(qres_t), "HTDATA"); 
-        for(int i=0;i<HTDATA_l;i++) {
-            HTDATA[i].hash = -1;
-        }
-#endif
-    }
-    return 1;
+static INLINE bool v_any_gt16(vec a, vec b) { return 0 != _mm256_movemask_epi8(_mm256_cmpgt_epi16(a, b)); }
+static INLINE bool v_any_eq8(vec a, vec b) { return 0 != _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b)); }
+static INLINE bool v_any_gt8(vec a, vec b) { return 0 != _mm256_movemask_epi8(_mm256_cmpgt_epi8(a, b)); }
+
+static INLINE int16_t findMax16(const vec &mMax) {
+    __m128i m = _mm_max_epi16(_mm256_castsi256_si128(mMax), _mm256_extracti128_si256(mMax, 1));
+    __solution4_max16_128(m);
+    return (int16_t)_mm_extract_epi16(m, 0);
 }
 
-Solution4::Solution4() {
-    // Nullify
-    mem = NULL;
-    BUFFER = NULL;
-    HTDATA = NULL;
-    // Initial dimentions 
-    MAX_DIMA = MAX_DIMB = 0;
-    /*
-    MAX_DIMA = 512;
-    MAX_DIMB = 1024; 
-    */
-    HTDATA_l = MAX_DIMA;
-    // memory 
-    /*
-    BUFFER = (int16_t*)tmap_malloc((MAX_DIMB + 64) * 9 * sizeof(int16_t), "BUFFER");
-    HTDATA_l = 0x4000; // 2^14
-    tmap_roundup32(HTDATA_l);
-    */
-    resize(MAX_DIMA, MAX_DIMB);
-    // set max
-    /*
-    max_qlen = MAX_DIMA;
-    max_tlen = MAX_DIMB;
-    */
-    max_qlen = INT_MAX;
-    max_tlen = INT_MAX;
-}
+static INLINE int16_t findMax16Simple(const vec &mMax) { return findMax16(mMax); }
 
-Solution4::~Solution4() {
-    free(mem);
-    free(HTDATA);
+static INLINE uint8_t findMax8(const vec &mMax) {
+    __m128i m = _mm_max_epu8(_mm256_castsi256_si128(mMax), _mm256_extracti128_si256(mMax, 1));
+    __solution4_max8_128(m);
+    return (uint8_t)_mm_cvtsi128_si32(m);
 }
 
-template <class T, bool BYTE> INLINE void Solution4::updateResult(int i, int curMax) {
-    if (lastMax >= curMax && lastMax >= opt) {
-        T* MM = (T*)M1;
-        if (lastMax > opt) {
-            opt = lastMax;
-            n_best = 0;
-            //res_min_pos = INT64_MAX; // 1 << 30;
-            res_max_pos = 0;
-        }
+#include "Solution4Kernel.h"
 
-#ifdef FAST_UPDATE
-        if (!BYTE) {
-#endif
-            REP(j, len) {
-                if (MM[j] == opt) {
-                    n_best++;
-                    int64_t p = ((int64_t)i << 32) + POS[j];
-                    //res_min_pos = min(res_min_pos, p);
-                    res_max_pos = max(res_max_pos, p);
-                }
-            }
-#ifdef FAST_UPDATE
-        } else {
-            __m128i mopt = _mm_set1_epi8(opt);
-            for (int k = 0; k < len; k += 16) if (_mm_movemask_epi8(_mm_cmpeq_epi8(*(__m128i*)&((uint8_t*)M1)[k], mopt))) {
-                FOR(j, k, k + 16) {
-                    if (MM[j] == opt) {
-                        n_best++;
-                        int64_t p = ((int64_t)i << 32) + POS[j];
-                        //res_min_pos = min(res_min_pos, p);
-                        res_max_pos = max(res_max_pos, p);
-                    }
-                }
-            }
-        }
-#endif
-    }
-    lastMax = curMax;
 }
 
-template <class T, int DEFAULT_VALUE> INLINE void Solution4::updateResultLast() {
-    swap(M0, M1);
-    T* MM = (T*)M1;
-    REP(j, INVALID_POS_NO) MM[INVALID_POS[j]] = DEFAULT_VALUE;
-    REP(j, len) {
-        if (MM[j] > opt) {
-            opt = MM[j];
-            n_best = 1;
-            //res_min_pos = res_max_pos = ((int64_t)m << 32) + POS[j];
-            res_max_pos = ((int64_t)m << 32) + POS[j];
-        } else if (MM[j] == opt) {
-            n_best++;
-            int64_t p = ((int64_t)m << 32) + POS[j];
-            //res_min_pos = min(res_min_pos, p);
-            res_max_pos = max(res_max_pos, p);
-        }
-    }
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512bw")
+
+namespace solution4_avx512 {
+
+typedef __m512i vec;
+enum { V_LANES16 = 32, V_LANES8 = 64, V_SCAN = 1 };
+
+static INLINE vec v_load(const vec *p) { return _mm512_load_si512(p); }
+static INLINE void v_store(vec *p, vec a) { _mm512_store_si512(p, a); }
+static INLINE vec v_zero() { return _mm512_setzero_si512(); }
+static INLINE vec v_set1_16(short x) { return _mm512_set1_epi16(x); }
+static INLINE vec v_set1_8(char x) { return _mm512_set1_epi8(x); }
+static INLINE vec v_and(vec a, vec b) { return _mm512_and_si512(a, b); }
+static INLINE vec v_or(vec a, vec b) { return _mm512_or_si512(a, b); }
+static INLINE vec v_add16(vec a, vec b) { return _mm512_add_epi16(a, b); }
+static INLINE vec v_adds16(vec a, vec b) { return _mm512_adds_epi16(a, b); }
+static INLINE vec v_max16(vec a, vec b) { return _mm512_max_epi16(a, b); }
+static INLINE vec v_min16(vec a, vec b) { return _mm512_min_epi16(a, b); }
+static INLINE vec v_cmpeq16(vec a, vec b) { return _mm512_movm_epi16(_mm512_cmpeq_epi16_mask(a, b)); }
+static INLINE vec v_srli16(vec a, int n) { return _mm512_srli_epi16(a, n); }
+static INLINE vec v_adds8u(vec a, vec b) { return _mm512_adds_epu8(a, b); }
+static INLINE vec v_subs8u(vec a, vec b) { return _mm512_subs_epu8(a, b); }
+static INLINE vec v_max8u(vec a, vec b) { return _mm512_max_epu8(a, b); }
+static INLINE vec v_min8u(vec a, vec b) { return _mm512_min_epu8(a, b); }
+static INLINE vec v_cmpeq8(vec a, vec b) { return _mm512_movm_epi8(_mm512_cmpeq_epi8_mask(a, b)); }
+// each 128-bit lane receives the last bytes of the one below it
+static INLINE vec v_shl16(vec a) { return _mm512_alignr_epi8(a, _mm512_alignr_epi32(a, _mm512_setzero_si512(), 12), 14); }
+static INLINE vec v_shl8(vec a) { return _mm512_alignr_epi8(a, _mm512_alignr_epi32(a, _mm512_setzero_si512(), 12), 15); }
+static INLINE vec v_insert0_16(vec a, short x) { return _mm512_mask_set1_epi16(a, 1, x); }
+template <int B> static INLINE vec v_shlb(vec a, const vec &fill) {
+    if (B < 16) return _mm512_alignr_epi8(a, _mm512_alignr_epi32(a, fill, 12), (16 - B) & 15);
+    if (B == 16) return _mm512_alignr_epi32(a, fill, 12);
+    if (B == 32) return _mm512_alignr_epi32(a, fill, 8);
+    return fill;
 }
-
-template <int qec> NOINLINE void Solution4::processFastVariantB16BitA(const string &a, int mm, int mi, int o, int e) {
-
-    __m128i mo = _mm_set1_epi16(o + e);
-    __m128i me = _mm_set1_epi16(e);
-    __m128i minf = _mm_set1_epi16(-INF);
-
-
-    REP(i, segNo) M0[i] = _mm_setzero_si128();
-    REP(i, segNo) V[i] = minf;
-
-    REP(i, m) {
-        __m128i mmin;            
-        if (qec) {
-            mmin = _mm_set1_epi16(max(max(lastMax, opt) - (m - i) * mm, o + e + e * i));
-        } else {
-            //mmin = _mm_set1_epi16(max(max(lastMax, opt) - (m - i) * (mm - e) + o, o + e + e * i));
-            mmin = _mm_set1_epi16(o + e + e * i);
-        }
-
-        __m128i mM = _mm_load_si128(&M0[segNo - 1]);
-        mM = _mm_slli_si128(mM, 2);
-        if (i) mM = _mm_insert_epi16(mM, o + e * i    , 0);
-
-        __m128i mH = _mm_set1_epi16(o + e + e * i);
-
-        __m128i mMax;
-        if (qec) 
-          mMax = _mm_setzero_si128();
-
-        __m128i *P = XP[(int)a[i]];
-
-        REP(j, segNo) {
-            __m128i mP = _mm_load_si128(&P[j]);
-            __m128i mV = _mm_load_si128(&V[j]);
-
-            mM = _mm_add_epi16(mM, mP);
-
-            if (qec)
-              mMax = _mm_max_epi16(mMax, mM);
-
-            mM = _mm_max_epi16(mM, mV);
-            mM = _mm_max_epi16(mM, mH);
-            mM = _mm_max_epi16(mM, mmin);
-
-            _mm_store_si128(&M1[j], mM);
-
-            mM = _mm_add_epi16(mM, mo);
-            mV = _mm_add_epi16(mV, me);
-            mH = _mm_add_epi16(mH, me);
-            mV = _mm_max_epi16(mV, mM);
-            mH = _mm_max_epi16(mH, mM);
-
-            mM  = _mm_load_si128(&M0[j]);
-
-            _mm_store_si128(&V[j], mV);
-        }
-
-        while (true) {
-            mH = _mm_slli_si128(mH, 2);
-            mH = _mm_insert_epi16(mH, -INF, 0);
-
-            REP(j, segNo) {
-                mM = _mm_load_si128(&M1[j]);
-
-                __m128i mtmp = _mm_add_epi16(mM, mo);
-                __m128i mcmp = _mm_cmpgt_epi16(mH, mtmp);
-                if (_mm_movemask_epi8(mcmp) == 0) goto outB11;
-
-                mM = _mm_max_epi16(mM, mH);
-                _mm_store_si128(&M1[j], mM);
-
-                mH = _mm_add_epi16(mH, me);
-            }
-        }
-outB11:
-
-        swap(M0, M1);
-        if (qec) {
-            int curMax = findMax16(mMax);
-            updateResult<int16_t, false>(i, curMax);
-            if (curMax + (m - i) * mm < opt) return;
-        } else {
-            //lastMax = findMax16(mMax);
-        }
-
-    }
-
-    if (qec == 0 || lastMax >= opt) {
-        updateResultLast<int16_t, 0>();
-    }
-
+static INLINE bool v_any_gt16(vec a, vec b) { return 0 != _mm512_cmpgt_epi16_mask(a, b); }
+static INLINE bool v_any_eq8(vec a, vec b) { return 0 != _mm512_cmpeq_epi8_mask(a, b); }
+static INLINE bool v_any_gt8(vec a, vec b) { return 0 != _mm512_cmpgt_epi8_mask(a, b); }
+
+static INLINE int16_t findMax16(const vec &mMax) {
+    __m256i h = _mm256_max_epi16(_mm512_castsi512_si256(mMax), _mm512_extracti64x4_epi64(mMax, 1));
+    __m128i m = _mm_max_epi16(_mm256_castsi256_si128(h), _mm256_extracti128_si256(h, 1));
+    __solution4_max16_128(m);
+    return (int16_t)_mm_extract_epi16(m, 0);
 }
 
-template <int qec> NOINLINE void Solution4::processFastVariantB16BitB(const string &a, int mm, int mi, int o, int e) {
-
-    __m128i mo = _mm_set1_epi16(o + e);
-    __m128i me = _mm_set1_epi16(e);
-    __m128i minf = _mm_set1_epi16(-INF);
-
-    REP(i, segNo) M0[i] = _mm_setzero_si128();
-    REP(i, segNo) V[i] = minf;
-
-    int midstep = qec ? m : m * 4 / 5;
-    REP(i, midstep) {
-        __m128i mmin;            
-        if (qec) {
-            mmin = _mm_set1_epi16(max(max(lastMax, opt) - (m - i) * mm, o + e + e * i));
-        } else {
-            //mmin = _mm_set1_epi16(max(max(lastMax, opt) - (m - i) * (mm - e) + o, o + e + e * i));
-            mmin = _mm_set1_epi16(o + e + e * i);
-        }
-
-        __m128i mM = _mm_load_si128(&M0[segNo - 1]);
-        mM = _mm_slli_si128(mM, 2);
-        if (i) mM = _mm_insert_epi16(mM, o + e * i    , 0);
-
-        __m128i mH = _mm_set1_epi16(o + e + e * i);
-
-        __m128i mMax;
-        if (qec) 
-          mMax = _mm_setzero_si128();
-
-        __m128i *P = XP[(int)a[i]];
-
-        REP(j, segNo) {
-            __m128i mP = _mm_load_si128(&P[j]);
-            __m128i mV = _mm_load_si128(&V[j]);
-
-            mM = _mm_add_epi16(mM, mP);
-
-            if (qec)
-              mMax = _mm_max_epi16(mMax, mM);
-
-            mM = _mm_max_epi16(mM, mV);
-            mM = _mm_max_epi16(mM, mH);
-            mM = _mm_max_epi16(mM, mmin);
-
-            _mm_store_si128(&M1[j], mM);
-
-            mM = _mm_add_epi16(mM, mo);
-            mV = _mm_add_epi16(mV, me);
-            mH = _mm_add_epi16(mH, me);
-            mV = _mm_max_epi16(mV, mM);
-            mH = _mm_max_epi16(mH, mM);
-
-            mM  = _mm_load_si128(&M0[j]);
-
-            _mm_store_si128(&V[j], mV);
-        }
-
-        while (true) {
-            mH = _mm_slli_si128(mH, 2);
-            mH = _mm_insert_epi16(mH, -INF, 0);
-
-            REP(j, segNo) {
-                mM = _mm_load_si128(&M1[j]);
-
-                __m128i mtmp = _mm_add_epi16(mM, mo);
-                __m128i mcmp = _mm_cmpgt_epi16(mH, mtmp);
-                if (_mm_movemask_epi8(mcmp) == 0) goto outB12;
-
-                mM = _mm_max_epi16(mM, mH);
-                _mm_store_si128(&M1[j], mM);
-
-                mH = _mm_add_epi16(mH, me);
-            }
-        }
-outB12:
-
-        swap(M0, M1);
-        if (qec) {
-            int curMax = findMax16(mMax);
-            updateResult<int16_t, false>(i, curMax);
-            if (curMax + (m - i) * mm < opt) return;
-        } else {
-            //lastMax = findMax16(mMax);
-        }
-
-    }
-
-    if (!qec) {
-        FOR(i, midstep, m) {
-            __m128i mmin;            
-            if (qec) {
-                mmin = _mm_set1_epi16(max(max(lastMax, opt) - (m - i) * mm, o + e + e * i));
-            } else {
-                mmin = _mm_set1_epi16(max(max(lastMax, opt) - (m - i) * (mm - e) + o, o + e + e * i));
-                //mmin = _mm_set1_epi16(o + e + e * i);
-            }
-
-            __m128i mM = _mm_load_si128(&M0[segNo - 1]);
-            mM = _mm_slli_si128(mM, 2);
-            if (i) mM = _mm_insert_epi16(mM, o + e * i    , 0);
-
-            __m128i mH = _mm_set1_epi16(o + e + e * i);
-
-            __m128i mMax;
-            //if (qec) 
-            mMax = _mm_setzero_si128();
-
-            __m128i *P = XP[(int)a[i]];
-
-            REP(j, segNo) {
-                __m128i mP = _mm_load_si128(&P[j]);
-                __m128i mV = _mm_load_si128(&V[j]);
-
-                mM = _mm_add_epi16(mM, mP);
-
-                //if (qec)
-                mMax = _mm_max_epi16(mMax, mM);
-
-                mM = _mm_max_epi16(mM, mV);
-                mM = _mm_max_epi16(mM, mH);
-                mM = _mm_max_epi16(mM, mmin);
-
-                _mm_store_si128(&M1[j], mM);
-
-                mM = _mm_add_epi16(mM, mo);
-                mV = _mm_add_epi16(mV, me);
-                mH = _mm_add_epi16(mH, me);
-                mV = _mm_max_epi16(mV, mM);
-                mH = _mm_max_epi16(mH, mM);
-
-                mM  = _mm_load_si128(&M0[j]);
-
-                _mm_store_si128(&V[j], mV);
-            }
-
-            while (true) {
-                mH = _mm_slli_si128(mH, 2);
-                mH = _mm_insert_epi16(mH, -INF, 0);
-
-                REP(j, segNo) {
-                    mM = _mm_load_si128(&M1[j]);
-
-                    __m128i mtmp = _mm_add_epi16(mM, mo);
-                    __m128i mcmp = _mm_cmpgt_epi16(mH, mtmp);
-                    if (_mm_movemask_epi8(mcmp) == 0) goto outB22;
-
-                    mM = _mm_max_epi16(mM, mH);
-                    _mm_store_si128(&M1[j], mM);
-
-                    mH = _mm_add_epi16(mH, me);
-                }
-            }
-outB22:
-
-            swap(M0, M1);
-            if (qec) {
-                int curMax = findMax16(mMax);
-                updateResult<int16_t, false>(i, curMax);
-                if (curMax + (m - i) * mm < opt) return;
-            } else {
-                lastMax = findMax16(mMax);
-            }
-
-        }
-    }
-
-    if (qec == 0 || lastMax >= opt) {
-        updateResultLast<int16_t, 0>();
-    }
+static INLINE int16_t findMax16Simple(const vec &mMax) { return findMax16(mMax); }
 
+static INLINE uint8_t findMax8(const vec &mMax) {
+    __m256i h = _mm256_max_epu8(_mm512_castsi512_si256(mMax), _mm512_extracti64x4_epi64(mMax, 1));
+    __m128i m = _mm_max_epu8(_mm256_castsi256_si128(h), _mm256_extracti128_si256(h, 1));
+    __solution4_max8_128(m);
+    return (uint8_t)_mm_cvtsi128_si32(m);
 }
 
-template <int qec> NOINLINE void Solution4::processFastVariantA16Bit(const string &a, int mm, int mi, int o, int e, int iter) {
-    __m128i mo = _mm_set1_epi16(o + e);
-    __m128i me = _mm_set1_epi16(e);
-    __m128i mmin = _mm_set1_epi16(MIN_VAL);
-    __m128i mmin0 = _mm_setr_epi16(MIN_VAL, 0, 0, 0, 0, 0, 0, 0);
-
-    if (iter == -1) {
-        REP(i, segNo) M0[i] = mmin;
-        REP(i, segNo) V[i] = mmin;
-    }
-
-    FOR(i, iter + 1, m) {
-        __m128i mH = mmin;
-
-        __m128i mco;
-        if (qec) {
-            mco = _mm_set1_epi16(max(max(lastMax, opt) - (m - i) * mm, MIN_VAL));
-        } else {
-            //mco = _mm_set1_epi16(max(max(lastMax, opt) - (m - i) * (mm - e) + o, MIN_VAL));
-        }
-
-        __m128i mM = _mm_load_si128(&M0[segNo - 1]);
-        mM = _mm_slli_si128(mM, 2);
-        mM = _mm_or_si128(mM, mmin0);
-        //mM = _mm_insert_epi16(mM, MIN_VAL, 0);
-
-        __m128i *P = XP[(int)a[i]];
-        __m128i mMax;
-        if (qec) 
-          mMax = mmin;
-
-        REP(j, segNo) {
-            __m128i mV = _mm_load_si128(&V[j]);
-
-            mM = _mm_adds_epi16(mM, P[j]);
-
-            if (qec) 
-              mMax = _mm_max_epi16(mMax, mM);
-
-            mM = _mm_max_epi16(mM, mH);
-            mM = _mm_max_epi16(mM, mV);
-
-            _mm_store_si128(&M1[j], mM);
-
-            mM = _mm_adds_epi16(mM, mo);
-            mV = _mm_adds_epi16(mV, me);
-            mV = _mm_max_epi16(mV, mM);
-            mH = _mm_adds_epi16(mH, me);
-            mH = _mm_max_epi16(mH, mM);
-
-            mM = _mm_load_si128(&M0[j]);
-
-            _mm_store_si128(&V[j], mV);
-            ADD(count0);
-        }
-
-
-        while (true) {
-            mH = _mm_slli_si128(mH, 2);
-            mH = _mm_or_si128(mH, mmin0);
-            //mH = _mm_insert_epi16(mH, MIN_VAL, 0);
-            REP(j, segNo) {
-                ADD(count1);
-                mM = _mm_load_si128(&M1[j]);
-
-                __m128i mtmp = _mm_adds_epi16(mM, mo);
-                if (qec) 
-                  mtmp = _mm_max_epi16(mtmp, mco);
-                __m128i mcmp = _mm_cmpgt_epi16(mH, mtmp);
-                if (_mm_movemask_epi8(mcmp) == 0) goto outA16;
-
-                mM = _mm_max_epi16(mM, mH);
-                _mm_store_si128(&M1[j], mM);
-
-                mH = _mm_adds_epi16(mH, me);
-            }
-        }
-outA16:
-
-
-        swap(M0, M1);
-        if (qec) {
-            int curMax = findMax16Simple(mMax);
-            updateResult<int16_t, false>(i, curMax);
-            if (curMax + (m - i) * mm < opt) {
-                opt -= MIN_VAL;
-                return;
-            }
-        } else {
-            //lastMax = findMax16Simple(mMax);
-        }
-
-    }
-
-    if (qec == 0 || lastMax >= opt) {
-        updateResultLast<int16_t, MIN_VAL>();
-    }
-
-    opt -= MIN_VAL;
+#include "Solution4Kernel.h"
 
 }
 
-template <int qec> NOINLINE int Solution4::processFastVariantA8Bit(const string &a, const int mm, const int mi, const int o, const int e) {
-    const __m128i mo = _mm_set1_epi8(-(o + e));
-    const __m128i me = _mm_set1_epi8(-e);
-    const __m128i m1 = _mm_set1_epi8(1);
-    //const __m128i m128 = _mm_set1_epi8(128);
-    const __m128i mmaxrange = _mm_set1_epi8(255 + mi - mm);
-    const __m128i mmi = _mm_set1_epi8(-mi);
-    const __m128i mzero = _mm_setzero_si128();
-
-    REP(i, segNo) M0[i] = mzero;
-    REP(i, segNo) V[i] = mzero;
-
-    int midstep = qec ? m : m * 4 / 5;
-    REP(i, midstep) {
-        __m128i mco;
-        if (qec) mco = _mm_set1_epi8(max(max(lastMax, opt) - (m - i) * mm, 0));
-
-        __m128i mH = mzero;
-
-        __m128i mM = _mm_load_si128(&M0[segNo - 1]);
-        mM = _mm_slli_si128(mM, 1);
-
-        __m128i *P = XP[(int)a[i]];
-        __m128i mMax = mzero;
-
-        REP(j, segNo) {
-            __m128i mV = _mm_load_si128(&V[j]);
-
-            mM = _mm_adds_epu8(mM, P[j]);
-            mM = _mm_subs_epu8(mM, mmi);
-
-            mMax = _mm_max_epu8(mMax, mM);
-
-            mM = _mm_max_epu8(mM, mH);
-            mM = _mm_max_epu8(mM, mV);
-
-            _mm_store_si128(&M1[j], mM);
-
-            mM = _mm_subs_epu8(mM, mo);
-            mV = _mm_subs_epu8(mV, me);
-            mV = _mm_max_epu8(mV, mM);
-            mH = _mm_subs_epu8(mH, me);
-            mH = _mm_max_epu8(mH, mM);
-
-            mM = _mm_load_si128(&M0[j]);
-
-            _mm_store_si128(&V[j], mV);
-            ADD(count0);
-        }
-
-
-
-        while (true) {
-            mH = _mm_slli_si128(mH, 1);
-            REP(j, segNo) {
-                ADD(count1);
-                mM = _mm_load_si128(&M1[j]);
-
-                __m128i mtmp = _mm_subs_epu8(mM, mo);
-                mtmp = _mm_adds_epu8(mtmp, m1);
-                if (qec) mtmp = _mm_max_epu8(mtmp, mco);
-                mtmp = _mm_max_epu8(mtmp, mH);
-                __m128i mcmp = _mm_cmpeq_epi8(mH, mtmp);
-                if (_mm_movemask_epi8(mcmp) == 0) goto outA81;
-
-                mM = _mm_max_epu8(mM, mH);
-                _mm_store_si128(&M1[j], mM);
-
-                mH = _mm_subs_epu8(mH, me);
-            }
-        }
-outA81:
-
-        swap(M0, M1);
-        if (qec) {
-            int curMax = findMax8(mMax);
-            updateResult<uint8_t, true>(i, curMax);
-            if (curMax > 255 + mi - mm) return i;
-
+#pragma GCC pop_options
 
-            /*
-               if (curMax > 255 + mi - mm) {
-               int c0 = (m - i) * mm;
-               int c1 = (m - i) * -e + o;
-            //if (c0 + c1 > curMax - 10) return i;
-            c0 = min(24, c0);
-            __m128i mshift = _mm_set1_epi8(c0);
-            REP(j, segNo) {
-            M0[j] = _mm_subs_epu8(M0[j], mshift);
-            V[j] = _mm_subs_epu8(V[j], mshift);
-            }
-            shift += c0;
-            opt -= c0;
-            lastMax -= c0;
-            curMax -= c0;
-            }
-            */
-
-            if (curMax + (m - i) * mm < opt) {
-                return -1;
-            }
-        } else {
-            mMax = _mm_max_epu8(mMax, mmaxrange);
-            __m128i mcmp = _mm_cmpgt_epi8(mMax, mmaxrange);
-            if (_mm_movemask_epi8(mcmp)) return i;
-        }
-
-    }
-
-    if (!qec) {
-        FOR(i, midstep, m) {
-            __m128i mco;
-            if (qec) 
-              mco = _mm_set1_epi8(max(max(lastMax, opt) - (m - i) * mm, 0));
-            else
-              mco = _mm_set1_epi8(max(max(lastMax, opt) - (m - i) * (mm - e) + o, 0));
-
-            __m128i mH = mzero;
-
-            __m128i mM = _mm_load_si128(&M0[segNo - 1]);
-            mM = _mm_slli_si128(mM, 1);
-
-            __m128i *P = XP[(int)a[i]];
-            __m128i mMax = mzero;
-
-            REP(j, segNo) {
-                __m128i mV = _mm_load_si128(&V[j]);
-
-                mM = _mm_adds_epu8(mM, P[j]);
-                mM = _mm_subs_epu8(mM, mmi);
-
-                mMax = _mm_max_epu8(mMax, mM);
-
-                mM = _mm_max_epu8(mM, mH);
-                mM = _mm_max_epu8(mM, mV);
-
-                _mm_store_si128(&M1[j], mM);
-
-                mM = _mm_subs_epu8(mM, mo);
-                mV = _mm_subs_epu8(mV, me);
-                mV = _mm_max_epu8(mV, mM);
-                mH = _mm_subs_epu8(mH, me);
-                mH = _mm_max_epu8(mH, mM);
-
-                mM = _mm_load_si128(&M0[j]);
-
-                _mm_store_si128(&V[j], mV);
-                ADD(count0);
-            }
-
-
-
-            while (true) {
-                mH = _mm_slli_si128(mH, 1);
-                REP(j, segNo) {
-                    ADD(count1);
-                    mM = _mm_load_si128(&M1[j]);
-
-                    __m128i mtmp = _mm_subs_epu8(mM, mo);
-                    mtmp = _mm_adds_epu8(mtmp, m1);
-                    //if (qec) 
-                    mtmp = _mm_max_epu8(mtmp, mco);
-                    mtmp = _mm_max_epu8(mtmp, mH);
-                    __m128i mcmp = _mm_cmpeq_epi8(mH, mtmp);
-                    if (_mm_movemask_epi8(mcmp) == 0) goto outA82;
-
-                    mM = _mm_max_epu8(mM, mH);
-                    _mm_store_si128(&M1[j], mM);
-
-                    mH = _mm_subs_epu8(mH, me);
-                }
-            }
-outA82:
-
-            swap(M0, M1);
-            if (qec) {
-                int curMax = findMax8(mMax);
-                updateResult<uint8_t, true>(i, curMax);
-                if (curMax > 255 + mi - mm) return i;
-
-
-                /*
-                   if (curMax > 255 + mi - mm) {
-                   int c0 = (m - i) * mm;
-                   int c1 = (m - i) * -e + o;
-                //if (c0 + c1 > curMax - 10) return i;
-                c0 = min(24, c0);
-                __m128i mshift = _mm_set1_epi8(c0);
-                REP(j, segNo) {
-                M0[j] = _mm_subs_epu8(M0[j], mshift);
-                V[j] = _mm_subs_epu8(V[j], mshift);
-                }
-                shift += c0;
-                opt -= c0;
-                lastMax -= c0;
-                curMax -= c0;
-                }
-                */
-
-                if (curMax + (m - i) * mm < opt) {
-                    return -1;
-                }
-            } else {
-                lastMax = findMax8(mMax);
-                if (lastMax > 255 + mi - mm) return i;
-            }
-
-        }
-    }
+#endif
 
-    if (qec == 0 || lastMax >= opt) {
-        updateResultLast<uint8_t, 0>();
+Solution4::Solution4(int simd) {
+    if (simd < 0) simd = getBest();
+    switch (simd) {
+#ifdef TMAP_CPU_X86
+      case TMAP_VSW_SIMD_AVX2:
+        kernel = new solution4_avx2::Solution4Kernel();
+        break;
+      case TMAP_VSW_SIMD_AVX512:
+        kernel = new solution4_avx512::Solution4Kernel();
+        break;
+#endif
+      default:
+        kernel = new solution4_sse2::Solution4Kernel();
+        break;
     }
-
-    return -1;
+    max_qlen = kernel->getMaxQlen();
+    max_tlen = kernel->getMaxTlen();
 }
 
-NOINLINE  void Solution4::convertTable(__m128i *T0, __m128i *T1) {
-    const int segNoX = segNo / 2;
-    const __m128i mlo = _mm_set1_epi16(0x00FF);
-    const __m128i mminval = _mm_set1_epi16(MIN_VAL);
-    __m128i *T2 = &T1[segNoX];
-    REP(i, segNoX) {
-        __m128i m0 = _mm_load_si128(&T0[i]);
-        __m128i m1 = _mm_srli_si128(m0, 1);
-        m0 = _mm_and_si128(m0, mlo);
-        m0 = _mm_add_epi16(m0, mminval);
-        m1 = _mm_and_si128(m1, mlo);
-        m1 = _mm_add_epi16(m1, mminval);
-        _mm_store_si128(&T1[i], m0);
-        _mm_store_si128(&T2[i], m1);
-    }
+Solution4::~Solution4() {
+    delete kernel;
 }
 
-template <class T, int SIZE> NOINLINE  void Solution4::calcInvalidPos(int value) {
-    INVALID_POS_NO = len - n;
-    if (INVALID_POS_NO <= segNo) {
-        REP(i, INVALID_POS_NO) {
-            INVALID_POS[i] = len - 1 - i * SIZE;
-            ((T)XP[0])[INVALID_POS[i]] = value;
-            ((T)XP[1])[INVALID_POS[i]] = value;
-            ((T)XP[2])[INVALID_POS[i]] = value;
-            ((T)XP[3])[INVALID_POS[i]] = value;
-        }
-    } else {
-        INVALID_POS_NO = 0;
-        REP(i, len) if (POS[i] >= n) {
-            INVALID_POS[INVALID_POS_NO] = i;
-            ((T)XP[0])[i] = value;
-            ((T)XP[1])[i] = value;
-            ((T)XP[2])[i] = value;
-            ((T)XP[3])[i] = value;
-            INVALID_POS_NO++;
-        }
+int Solution4::isSupported(int simd) {
+    switch (simd) {
+      case TMAP_VSW_SIMD_SSE2:
+        return 1;
+#ifdef TMAP_CPU_X86
+      case TMAP_VSW_SIMD_AVX2:
+        return (tmap_cpu_features() & TMAP_CPU_AVX2) ? 1 : 0;
+      case TMAP_VSW_SIMD_AVX512:
+        return (tmap_cpu_features() & TMAP_CPU_AVX512BW) ? 1 : 0;
+#endif
+      default:
+        return 0;
     }
 }
 
-NOINLINE void Solution4::convert16Bit(const string &b, int qsc, int mm, int mi) {
-
-    segNo *= 2;
-    int len64 = len;
-
-    int ptr = 0;
-    __m128i *XM0 = (__m128i*)&BUFFER[ptr]; ptr += len64;
-    __m128i *XM1 = (__m128i*)&BUFFER[ptr]; ptr += len64;
-    __m128i *XV = (__m128i*)&BUFFER[ptr]; ptr += len64;
-    XP[0] = (__m128i*)&BUFFER[ptr]; ptr += len64;
-    XP[1] = (__m128i*)&BUFFER[ptr]; ptr += len64;
-    XP[2] = (__m128i*)&BUFFER[ptr]; ptr += len64;
-    XP[3] = (__m128i*)&BUFFER[ptr]; ptr += len64;
-    POS = &BUFFER[ptr]; ptr += len64;
-    int16_t* STARG = &BUFFER[ptr];
-
-    if (M0 > M1) swap(XM0, XM1);
-
-    convertTable(V, XV);
-    convertTable(M0, XM0);
-
-    M0 = XM0;
-    M1 = XM1;
-    V = XV;
-
-    __m128i mPos = _mm_setr_epi16(0, segNo, segNo * 2, segNo * 3, segNo * 4, segNo * 5, segNo * 6, segNo * 7);
-    __m128i mOne = _mm_set1_epi16(1);
-    REP(k, segNo) {
-        _mm_store_si128((__m128i*)&POS[k * 8], mPos);
-        mPos = _mm_add_epi16(mPos, mOne);
-    }
-
-    const int16_t SCHAR[4] = {'A', 'C', 'G', 'T'};
-    __m128i mmul = _mm_set1_epi16(mm - mi);
-    __m128i madd = _mm_set1_epi16(mi);
-    REP(i, len) {
-        if(n <= POS[i]) STARG[i] = 0;
-        else STARG[i] = b[POS[i]];
+int Solution4::getBest() {
+    int simd;
+    for (simd = TMAP_VSW_SIMD_NUM - 1; TMAP_VSW_SIMD_SSE2 < simd; simd--) {
+        if (isSupported(simd)) break;
     }
-    REP(c, 4) {
-        __m128i mChar = _mm_set1_epi16(SCHAR[c]);
-        REP(k, segNo) {
-            __m128i mTarg = _mm_load_si128((__m128i*)&STARG[k * 8]);
-            __m128i mnew = _mm_cmpeq_epi16(mTarg, mChar);
-            mnew = _mm_srli_epi16(mnew, 1);
-            mnew = _mm_min_epi16(mnew, mmul);
-            mnew = _mm_add_epi16(mnew, madd);
-            _mm_store_si128(&XP[c][k], mnew);
-        }
-    }
-
-    calcInvalidPos<int16_t*, 8>(mi);
-
+    return simd;
 }
 
-NOINLINE void Solution4::preprocess16Bit(const string &b, int qsc, int mm, int mi) {
-    segNo = (n + 7) / 8;
-    len = segNo * 8;
-    int len64 = len;
-
-    int ptr = 0;
-    M0 = (__m128i*)&BUFFER[ptr]; ptr += len64;
-    M1 = (__m128i*)&BUFFER[ptr]; ptr += len64;
-    V = (__m128i*)&BUFFER[ptr]; ptr += len64;
-    XP[0] = (__m128i*)&BUFFER[ptr]; ptr += len64;
-    XP[1] = (__m128i*)&BUFFER[ptr]; ptr += len64;
-    XP[2] = (__m128i*)&BUFFER[ptr]; ptr += len64;
-    XP[3] = (__m128i*)&BUFFER[ptr]; ptr += len64;
-    POS = &BUFFER[ptr]; ptr += len64;
-    int16_t* STARG = &BUFFER[ptr];
-
-      {
-        __m128i mPos = _mm_setr_epi16(0, segNo, segNo * 2, segNo * 3, segNo * 4, segNo * 5, segNo * 6, segNo * 7);
-        __m128i mOne = _mm_set1_epi16(1);
-        REP(k, segNo) {
-            _mm_store_si128((__m128i*)&POS[k * 8], mPos);
-            mPos = _mm_add_epi16(mPos, mOne);
-        }
-
-        const int16_t SCHAR[4] = {'A', 'C', 'G', 'T'};
-        __m128i mmul = _mm_set1_epi16(mm - mi);
-        __m128i madd = _mm_set1_epi16(mi);
-        REP(i, len) {
-            if(n <= POS[i]) STARG[i] = 0;
-            else STARG[i] = b[POS[i]];
-        }
-        REP(c, 4) {
-            __m128i mChar = _mm_set1_epi16(SCHAR[c]);
-            REP(k, segNo) {
-                __m128i mTarg = _mm_load_si128((__m128i*)&STARG[k * 8]);
-                __m128i mnew = _mm_cmpeq_epi16(mTarg, mChar);
-                mnew = _mm_srli_epi16(mnew, 1);
-                mnew = _mm_min_epi16(mnew, mmul);
-                mnew = _mm_add_epi16(mnew, madd);
-                _mm_store_si128(&XP[c][k], mnew);
-            }
-        }
-      }
-
-    calcInvalidPos<int16_t*, 8>(mi);        
+int Solution4::process(const string &b, const string &a, int qsc, int qec, 
+                       int mm, int mi, int o, int e, int dir,
+                       int *_opt, int *_te, int *_qe, int *_n_best) {
+    return kernel->process(b, a, qsc, qec, mm, mi, o, e, dir, _opt, _te, _qe, _n_best);
 }
 
-void Solution4::preprocess8Bit(const string &b, int qsc, int mm, int mi) {
-    segNo = (n + 15) / 16;
-    len = segNo * 16;
-    int len64 = len / 2;
-
-    int ptr = 0;
-    M0 = (__m128i*)&BUFFER[ptr]; ptr += len64;
-    M1 = (__m128i*)&BUFFER[ptr]; ptr += len64;
-    V = (__m128i*)&BUFFER[ptr]; ptr += len64;
-    XP[0] = (__m128i*)&BUFFER[ptr]; ptr += len64;
-    XP[1] = (__m128i*)&BUFFER[ptr]; ptr += len64;
-    XP[2] = (__m128i*)&BUFFER[ptr]; ptr += len64;
-    XP[3] = (__m128i*)&BUFFER[ptr]; ptr += len64;
-    POS = &BUFFER[ptr]; ptr += len64 * 2;
-    int8_t* STARG = (int8_t*)&BUFFER[ptr];
-
-      {
-        __m128i mPos0 = _mm_setr_epi16(0, segNo, segNo * 2, segNo * 3, segNo * 4, segNo * 5, segNo * 6, segNo * 7);
-        __m128i mPos1 = _mm_setr_epi16(segNo * 8, segNo * 9, segNo * 10, segNo * 11, segNo * 12, segNo * 13, segNo * 14, segNo * 15);
-        __m128i mOne = _mm_set1_epi16(1);
-        REP(k, segNo) {
-            _mm_store_si128((__m128i*)&POS[k * 16 + 0], mPos0);
-            _mm_store_si128((__m128i*)&POS[k * 16 + 8], mPos1);
-            mPos0 = _mm_add_epi16(mPos0, mOne);
-            mPos1 = _mm_add_epi16(mPos1, mOne);
-        }
-
-        const int8_t SCHAR[4] = {'A', 'C', 'G', 'T'};
-        __m128i mmul = _mm_set1_epi8(mm - mi);
-        REP(i, len) {
-            if(n <= POS[i]) STARG[i] = 0;
-            else STARG[i] = b[POS[i]];
-        }
-        REP(c, 4) {
-            __m128i mChar = _mm_set1_epi8(SCHAR[c]);
-            REP(k, segNo) {
-                __m128i mTarg = _mm_load_si128((__m128i*)&STARG[k * 16]);
-                __m128i mnew = _mm_cmpeq_epi8(mTarg, mChar);
-                mnew = _mm_min_epu8(mnew, mmul);
-                _mm_store_si128(&XP[c][k], mnew);
-            }
-        }
-      }
-
-    calcInvalidPos<int8_t*, 16>(0);
-
+int Solution4::process(const uint8_t *b, int32_t _n, const uint8_t *_a, int32_t _m, int qsc, int qec, 
+                       int mm, int mi, int o, int e, int dir,
+                       int *_opt, int *_te, int *_qe, int *_n_best) {
+    return kernel->process(b, _n, _a, _m, qsc, qec, mm, mi, o, e, dir, _opt, _te, _qe, _n_best);
 }
 
-NOINLINE int Solution4::process(const string &b, const string &a, int qsc, int qec, 
-                                int mm, int mi, int o, int e, int dir,
-                                int *_opt, int *_te, int *_qe, int *_n_best) {
-    string _a = a;
-    n = b.S;
-    m = _a.S;
-
-    resize(m, n);
-
-    //opt = n_best = res_min_pos = res_max_pos = 0;
-    opt = n_best = res_max_pos = 0;
-
-
-    int iter = -1;
-
-#ifdef USE_HASHING
-    uint64_t curHashA = hashDNA(_a, m);
-    uint64_t curHashB = hashDNA(b, n);
-
-    uint64_t hash = curHashA ^ curHashB;
-    if (qsc) hash ^= 0x5555555555555555ULL;
-    if (qec) hash ^= 0xCCCCCCCCCCCCCCCCULL;
-    uint32_t hh = hash >> 8;
-    int htpos = hash & (HTDATA_l - 1); // HTDATA_l must be a power of two
-
-    if (HTDATA[htpos].hash == hh) {
-        qres_t &res = HTDATA[htpos];
-        opt = res.opt;
-        n_best = res.n_best;
-        //res_min_pos = res.res_min_pos;
-        res_max_pos = res.res_max_pos;
-        goto similar;
-    }
-#endif
-
-#ifdef FULL_HEURISTIC
-    if (qsc == 0) {
-        int corr = 0;
-        int c0 = 0;
-        int c1 = 0;
-        int offs = n - m + 1;
-        //uint32_t h = 0;
-        REP(i, offs) {
-            REP(j, m) if (_a[j] != b[i+j]) {
-                goto next;
-            }
-            if (corr == 0) c0 = i;
-            c1 = i;
-            corr++;
-next: ;
-        }
-        if (corr) {
-            n_best = corr;
-            opt = mm * m;
-            //res_min_pos = ((int64_t)m << 32) + c0 + m - 1 - ((int64_t)1 << 32);
-            res_max_pos = ((int64_t)m << 32) + c1 + m - 1 - ((int64_t)1 << 32);
-            goto similar;
-        }
-    }
-#endif
-
-    // To integers
-    REP(i, m) _a[i] = tmap_nt_char_to_int[(int)_a[i]];
-
-    opt = MIN_VAL;
-    lastMax = MIN_VAL;
-
-    if (qsc == 0) goto process16bit; 
-
-//process8bit:        
-
-
-    preprocess8Bit(b, qsc, mm, mi);
-
-
-    if (qsc) {
-        if (qec) {
-            iter = processFastVariantA8Bit<1>(_a, mm, mi, o, e);
-        } else {
-            iter = processFastVariantA8Bit<0>(_a, mm, mi, o, e);
-        }
-    } else {
-    }
-
-    if (iter < 0) goto finish;
-#ifdef CONVERT
-    convert16Bit(b, qsc, mm, mi);
-    opt += MIN_VAL;
-    lastMax += MIN_VAL;
-    goto go16bit;
-#else
-    opt = MIN_VAL;
-    lastMax = MIN_VAL;
-    iter = -1;
-#endif
-
-process16bit:        
-    preprocess16Bit(b, qsc, mm, mi);
-
-go16bit:
-
-    if (qsc) {
-        if (qec) {
-            processFastVariantA16Bit<1>(_a, mm, mi, o, e, iter);
-        } else {
-            processFastVariantA16Bit<0>(_a, mm, mi, o, e, iter);
-        }
-    } else {
-        if (qec) {
-            processFastVariantB16BitA<1>(_a, mm, mi, o, e);
-        } else {
-            processFastVariantB16BitB<0>(_a, mm, mi, o, e);
-        }
-    }
-
-finish:
-    //res_min_pos -= (int64_t)1 << 32;
-    res_max_pos -= (int64_t)1 << 32;
-
-#ifdef USE_HASHING
-      {
-        qres_t &res = HTDATA[htpos];
-        res.hash = hh;
-        res.opt = opt;
-        res.n_best = n_best;
-        //res.res_min_pos = res_min_pos;
-        res.res_max_pos = res_max_pos;
-      }
-#endif
-
-similar:
-    //int64_t pos = dir == 0 ? res_min_pos : res_max_pos;
-    int64_t pos = res_max_pos;
-
-    int target_end = pos & (MAX_DIMB-1); //1023;
-    int query_end = pos >> 32;
+void Solution4::getEscalations(int64_t *started, int64_t *escalated) {
+    kernel->getEscalations(started, escalated);
+}
 
-    (*_opt) = opt;
-    (*_te) = target_end;
-    (*_qe) = query_end;
-    (*_n_best) = n_best;
-    
-    return opt;
+void Solution4::set8Bit(bool enable) {
+    kernel->set8Bit(enable);
 }
@@ -0,0 +1,1337 @@
+// The Solution4 kernels, written against the vector operations (v_*) and
+// the vector type (vec) of one instruction set.  This is included once per
+// instruction set by Solution4.cpp, each time in its own namespace, so there
+// is deliberately no include guard.
+
+// The gap along the target (mH) that enters each lane after the first pass
+// over a row, taken from all the lanes below it at once: c holds the gap that
+// leaves the lane below, and step is the (negative) cost of passing through a
+// lane.  The values below the first lane are fill.  With this, one more pass
+// completes the row, where the lazy loop may need a pass per lane.  The costs
+// must not reach INF so that they cannot saturate.
+static INLINE vec scan16(vec c, int step, const vec &fill) {
+    c = v_max16(c, v_adds16(v_shlb<2>(c, fill), v_set1_16(step)));
+    c = v_max16(c, v_adds16(v_shlb<4>(c, fill), v_set1_16(step * 2)));
+    c = v_max16(c, v_adds16(v_shlb<8>(c, fill), v_set1_16(step * 4)));
+    if (16 < sizeof(vec)) c = v_max16(c, v_adds16(v_shlb<16>(c, fill), v_set1_16(step * 8)));
+    if (32 < sizeof(vec)) c = v_max16(c, v_adds16(v_shlb<32>(c, fill), v_set1_16(step * 16)));
+    return c;
+}
+
+// as scan16, for the unsigned 8-bit lanes, where step is the (positive) cost.
+// With the many byte lanes the lazy loop of processFastVariantB8Bit takes too
+// many passes, so it scans with every instruction set.
+static INLINE vec scan8(vec c, int step) {
+    const vec zero = v_zero();
+    c = v_max8u(c, v_subs8u(v_shlb<1>(c, zero), v_set1_8(min(step, 255))));
+    c = v_max8u(c, v_subs8u(v_shlb<2>(c, zero), v_set1_8(min(step * 2, 255))));
+    c = v_max8u(c, v_subs8u(v_shlb<4>(c, zero), v_set1_8(min(step * 4, 255))));
+    c = v_max8u(c, v_subs8u(v_shlb<8>(c, zero), v_set1_8(min(step * 8, 255))));
+    if (16 < sizeof(vec)) c = v_max8u(c, v_subs8u(v_shlb<16>(c, zero), v_set1_8(min(step * 16, 255))));
+    if (32 < sizeof(vec)) c = v_max8u(c, v_subs8u(v_shlb<32>(c, zero), v_set1_8(min(step * 32, 255))));
+    return c;
+}
+
+class Solution4Kernel : public Solution {
+public:
+  Solution4Kernel();
+  ~Solution4Kernel();
+
+  virtual int process(const string& b, const string& a, int qsc, int qec, 
+                      int mm, int mi, int o, int e, int dir,
+                      int *opt, int *te, int *qe, int *n_best);
+
+  virtual int process(const uint8_t *b, int32_t n, const uint8_t *a, int32_t m, int qsc, int qec, 
+                      int mm, int mi, int o, int e, int dir,
+                      int *opt, int *te, int *qe, int *n_best);
+
+  virtual void getEscalations(int64_t *started, int64_t *escalated);
+  virtual void set8Bit(bool enable);
+private:
+  int MAX_DIMA;
+  int MAX_DIMB;
+  void *mem __attribute__((aligned(64)));
+  int16_t *BUFFER;
+  int n, m;
+  int segNo;
+  int len;
+  vec* XP[5]; // the profile of each query base; N (4) matches only N, as in Solution1
+  vec* M0;
+  vec* M1;
+  vec* V;
+  int16_t* POS;
+  int16_t INVALID_POS[V_LANES8];
+  int INVALID_POS_NO;
+  int lastMax;
+  int opt, n_best;
+  int64_t res_min_pos, res_max_pos;
+  qres_t *HTDATA;
+  int32_t HTDATA_l;
+  int64_t count0, count1;
+  int64_t num8Bit, num16Bit; // problems started with 8-bit lanes, and those of them finished with 16-bit lanes
+  int base; // the score of 0 in the 8-bit rows of processFastVariantB8Bit
+  bool use8Bit; // false to score every problem with 16-bit lanes
+  string b_int, a_int;
+
+  // Utility functions
+  uint64_t hashDNA(const uint8_t *s, const int len);
+  int resize(int a, int b);
+  template <class T, bool BYTE> void updateResult(int i, int curMax, int base = 0);
+  template <class T, int DEFAULT_VALUE> void updateResultLast(int base = 0);
+  template <int qec> void processFastVariantB16BitA(const uint8_t *a, int mm, int mi, int o, int e, int iter);
+  template <int qec> void processFastVariantB16BitB(const uint8_t *a, int mm, int mi, int o, int e);
+  template <int qec> void processFastVariantA16Bit(const uint8_t *a, int mm, int mi, int o, int e, int iter);
+  template <int qec> int processFastVariantA8Bit(const uint8_t *a, const int mm, const int mi, const int o, const int e);
+  int processFastVariantB8Bit(const uint8_t *a, const int mm, const int mi, const int o, const int e);
+  void setPositions(int lanes);
+  void convertTable(vec *T0, vec *T1, int base);
+  template <class T, int SIZE> void calcInvalidPos(int value);
+  void convert16Bit(const uint8_t *b, int qsc, int mm, int mi, int baseM, int baseV);
+  void preprocess16Bit(const uint8_t *b, int qsc, int mm, int mi);
+  void preprocess8Bit(const uint8_t *b, int qsc, int mm, int mi, int bias);
+};
+
+NOINLINE uint64_t Solution4Kernel::hashDNA(const uint8_t *s, const int len) {
+    uint64_t h = 1;
+    if (len < 16) {
+        REP(j, len) h = h * 1337 + s[j];
+        return h;
+    }
+
+    __m128i mhash = _mm_set1_epi16(1);
+    __m128i mmul = _mm_set1_epi16(13);
+    __m128i mzero = _mm_setzero_si128();
+    __m128i m0, m1a, m1b;
+    int i = 0;
+    while (i + 16 < len) {
+        m0 = _mm_loadu_si128((__m128i*)&s[i]);
+        m1a = _mm_unpacklo_epi8(m0, mzero);
+        m1b = _mm_unpackhi_epi8(m0, mzero);
+        mhash = _mm_mullo_epi16(mhash, mmul);
+        mhash = _mm_add_epi16(mhash, m1a);
+        mhash = _mm_mullo_epi16(mhash, mmul);
+        mhash = _mm_add_epi16(mhash, m1b);
+        i += 16;
+    }
+    m0 = _mm_loadu_si128((__m128i*)&s[len - 16]);
+    m1a = _mm_unpacklo_epi8(m0, mzero);
+    m1b = _mm_unpackhi_epi8(m0, mzero);
+    mhash = _mm_mullo_epi16(mhash, mmul);
+    mhash = _mm_add_epi16(mhash, m1a);
+    mhash = _mm_mullo_epi16(mhash, mmul);
+    mhash = _mm_add_epi16(mhash, m1b);
+
+    /*
+    uint32_t* p = (uint32_t*)&mhash;
+    h = h * 1337 + p[0];
+    h = h * 1337 + p[1];
+    h = h * 1337 + p[2];
+    h = h * 1337 + p[3];
+    */
+    h = h * 1337 + (uint64_t)_mm_extract_epi16(mhash, 0);
+    h = h * 1337 + (uint64_t)_mm_extract_epi16(mhash, 1);
+    h = h * 1337 + (uint64_t)_mm_extract_epi16(mhash, 2);
+    h = h * 1337 + (uint64_t)_mm_extract_epi16(mhash, 3);
+    h = h * 1337 + (uint64_t)_mm_extract_epi16(mhash, 4);
+    h = h * 1337 + (uint64_t)_mm_extract_epi16(mhash, 5);
+    h = h * 1337 + (uint64_t)_mm_extract_epi16(mhash, 6);
+    h = h * 1337 + (uint64_t)_mm_extract_epi16(mhash, 7);
+    return h;
+}
+
+int Solution4Kernel::resize(int a, int b) {
+    if(MAX_DIMB < b) {
+        MAX_DIMB = b;
+        tmap_roundup32(MAX_DIMB);
+        free(mem); mem = NULL;
+        mem = (uint8_t*)tmap_malloc(64 + ((MAX_DIMB + 64) * 10 * sizeof(int16_t)), "mem");
+        BUFFER = (int16_t*)(((uintptr_t)mem+64) & ~ 0x3F);
+    }
+    if(MAX_DIMA < a) {
+        MAX_DIMA = a;
+        tmap_roundup32(MAX_DIMA);
+        HTDATA_l = MAX_DIMA;
+#ifdef USE_HASHING
+        free(HTDATA); HTDATA = NULL;
+        HTDATA = (qres_t*)tmap_malloc((HTDATA_l + 64) * sizeof(qres_t), "HTDATA"); 
+        for(int i=0;i<HTDATA_l;i++) {
+            HTDATA[i].hash = -1;
+        }
+#endif
+    }
+    return 1;
+}
+
+Solution4Kernel::Solution4Kernel() {
+    // Nullify
+    mem = NULL;
+    BUFFER = NULL;
+    HTDATA = NULL;
+    num8Bit = num16Bit = 0;
+    use8Bit = true;
+    // Initial dimentions 
+    MAX_DIMA = MAX_DIMB = 0;
+    /*
+    MAX_DIMA = 512;
+    MAX_DIMB = 1024; 
+    */
+    HTDATA_l = MAX_DIMA;
+    // memory 
+    /*
+    BUFFER = (int16_t*)tmap_malloc((MAX_DIMB + 64) * 9 * sizeof(int16_t), "BUFFER");
+    HTDATA_l = 0x4000; // 2^14
+    tmap_roundup32(HTDATA_l);
+    */
+    resize(MAX_DIMA, MAX_DIMB);
+    // set max
+    /*
+    max_qlen = MAX_DIMA;
+    max_tlen = MAX_DIMB;
+    */
+    max_qlen = INT_MAX;
+    max_tlen = INT_MAX;
+}
+
+Solution4Kernel::~Solution4Kernel() {
+    free(mem);
+    free(HTDATA);
+}
+
+// the rows hold scores less base
+template <class T, bool BYTE> INLINE void Solution4Kernel::updateResult(int i, int curMax, int base) {
+    if (lastMax >= curMax && lastMax >= opt) {
+        T* MM = (T*)M1;
+        if (lastMax > opt) {
+            opt = lastMax;
+            n_best = 0;
+            //res_min_pos = INT64_MAX; // 1 << 30;
+            res_max_pos = 0;
+        }
+
+#ifdef FAST_UPDATE
+        if (!BYTE) {
+#endif
+            REP(j, len) {
+                if (MM[j] + base == opt && POS[j] < n) { // not the padding after the target
+                    n_best++;
+                    int64_t p = ((int64_t)i << 32) + POS[j];
+                    //res_min_pos = min(res_min_pos, p);
+                    res_max_pos = max(res_max_pos, p);
+                }
+            }
+#ifdef FAST_UPDATE
+        } else {
+            vec mopt = v_set1_8(opt - base);
+            REP(k, segNo) if (v_any_eq8(v_load(&M1[k]), mopt)) {
+                FOR(j, k * V_LANES8, (k + 1) * V_LANES8) {
+                    if (MM[j] + base == opt && POS[j] < n) {
+                        n_best++;
+                        int64_t p = ((int64_t)i << 32) + POS[j];
+                        //res_min_pos = min(res_min_pos, p);
+                        res_max_pos = max(res_max_pos, p);
+                    }
+                }
+            }
+        }
+#endif
+    }
+    lastMax = curMax;
+}
+
+template <class T, int DEFAULT_VALUE> INLINE void Solution4Kernel::updateResultLast(int base) {
+    swap(M0, M1);
+    T* MM = (T*)M1;
+    REP(j, INVALID_POS_NO) MM[INVALID_POS[j]] = DEFAULT_VALUE;
+    REP(j, len) {
+        if (n <= POS[j]) continue; // the padding after the target
+        if (MM[j] + base > opt) {
+            opt = MM[j] + base;
+            n_best = 1;
+            //res_min_pos = res_max_pos = ((int64_t)m << 32) + POS[j];
+            res_max_pos = ((int64_t)m << 32) + POS[j];
+        } else if (MM[j] + base == opt) {
+            n_best++;
+            int64_t p = ((int64_t)m << 32) + POS[j];
+            //res_min_pos = min(res_min_pos, p);
+            res_max_pos = max(res_max_pos, p);
+        }
+    }
+}
+
+// continues after the row iter when processFastVariantB8Bit ran out of range
+template <int qec> NOINLINE void Solution4Kernel::processFastVariantB16BitA(const uint8_t *a, int mm, int mi, int o, int e, int iter) {
+    const bool scan = V_SCAN && -e * len < INF; // see scan16
+
+    vec mo = v_set1_16(o + e);
+    vec me = v_set1_16(e);
+    vec minf = v_set1_16(-INF);
+
+
+    if (iter == -1) {
+        REP(i, segNo) M0[i] = v_zero();
+        REP(i, segNo) V[i] = minf;
+    }
+
+    FOR(i, iter + 1, m) {
+        vec mmin;            
+        if (qec) {
+            mmin = v_set1_16(max(max(lastMax, opt) - (m - i) * mm, o + e + e * i));
+        } else {
+            //mmin = v_set1_16(max(max(lastMax, opt) - (m - i) * (mm - e) + o, o + e + e * i));
+            mmin = v_set1_16(o + e + e * i);
+        }
+
+        vec mM = v_load(&M0[segNo - 1]);
+        mM = v_shl16(mM);
+        if (i) mM = v_insert0_16(mM, o + e * i    );
+
+        vec mH = v_set1_16(o + e + e * i);
+
+        vec mMax;
+        if (qec) 
+          mMax = v_zero();
+
+        vec *P = XP[(int)a[i]];
+
+        REP(j, segNo) {
+            vec mP = v_load(&P[j]);
+            vec mV = v_load(&V[j]);
+
+            mM = v_add16(mM, mP);
+
+            if (qec)
+              mMax = v_max16(mMax, mM);
+
+            mM = v_max16(mM, mV);
+            mM = v_max16(mM, mH);
+            mM = v_max16(mM, mmin);
+
+            v_store(&M1[j], mM);
+
+            mM = v_add16(mM, mo);
+            mV = v_add16(mV, me);
+            mH = v_add16(mH, me);
+            mV = v_max16(mV, mM);
+            mH = v_max16(mH, mM);
+
+            mM  = v_load(&M0[j]);
+
+            v_store(&V[j], mV);
+        }
+
+        mH = v_shl16(mH);
+        mH = v_insert0_16(mH, -INF);
+        if (scan) mH = scan16(mH, e * segNo, minf);
+        while (true) {
+            REP(j, segNo) {
+                mM = v_load(&M1[j]);
+
+                vec mtmp = v_add16(mM, mo);
+                if (!v_any_gt16(mH, mtmp)) goto outB11;
+
+                mM = v_max16(mM, mH);
+                v_store(&M1[j], mM);
+
+                mH = v_add16(mH, me);
+            }
+            if (scan) break;
+            mH = v_shl16(mH);
+            mH = v_insert0_16(mH, -INF);
+        }
+outB11:
+
+        swap(M0, M1);
+        if (qec) {
+            int curMax = findMax16(mMax);
+            updateResult<int16_t, false>(i, curMax);
+            if (curMax + (m - i) * mm < opt) return;
+        } else {
+            //lastMax = findMax16(mMax);
+        }
+
+    }
+
+    if (qec == 0 || lastMax >= opt) {
+        updateResultLast<int16_t, MIN_VAL>();
+    }
+
+}
+
+template <int qec> NOINLINE void Solution4Kernel::processFastVariantB16BitB(const uint8_t *a, int mm, int mi, int o, int e) {
+    const bool scan = V_SCAN && -e * len < INF; // see scan16
+
+    vec mo = v_set1_16(o + e);
+    vec me = v_set1_16(e);
+    vec minf = v_set1_16(-INF);
+
+    REP(i, segNo) M0[i] = v_zero();
+    REP(i, segNo) V[i] = minf;
+
+    int midstep = qec ? m : m * 4 / 5;
+    REP(i, midstep) {
+        vec mmin;            
+        if (qec) {
+            mmin = v_set1_16(max(max(lastMax, opt) - (m - i) * mm, o + e + e * i));
+        } else {
+            //mmin = v_set1_16(max(max(lastMax, opt) - (m - i) * (mm - e) + o, o + e + e * i));
+            mmin = v_set1_16(o + e + e * i);
+        }
+
+        vec mM = v_load(&M0[segNo - 1]);
+        mM = v_shl16(mM);
+        if (i) mM = v_insert0_16(mM, o + e * i    );
+
+        vec mH = v_set1_16(o + e + e * i);
+
+        vec mMax;
+        if (qec) 
+          mMax = v_zero();
+
+        vec *P = XP[(int)a[i]];
+
+        REP(j, segNo) {
+            vec mP = v_load(&P[j]);
+            vec mV = v_load(&V[j]);
+
+            mM = v_add16(mM, mP);
+
+            if (qec)
+              mMax = v_max16(mMax, mM);
+
+            mM = v_max16(mM, mV);
+            mM = v_max16(mM, mH);
+            mM = v_max16(mM, mmin);
+
+            v_store(&M1[j], mM);
+
+            mM = v_add16(mM, mo);
+            mV = v_add16(mV, me);
+            mH = v_add16(mH, me);
+            mV = v_max16(mV, mM);
+            mH = v_max16(mH, mM);
+
+            mM  = v_load(&M0[j]);
+
+            v_store(&V[j], mV);
+        }
+
+        mH = v_shl16(mH);
+        mH = v_insert0_16(mH, -INF);
+        if (scan) mH = scan16(mH, e * segNo, minf);
+        while (true) {
+            REP(j, segNo) {
+                mM = v_load(&M1[j]);
+
+                vec mtmp = v_add16(mM, mo);
+                if (!v_any_gt16(mH, mtmp)) goto outB12;
+
+                mM = v_max16(mM, mH);
+                v_store(&M1[j], mM);
+
+                mH = v_add16(mH, me);
+            }
+            if (scan) break;
+            mH = v_shl16(mH);
+            mH = v_insert0_16(mH, -INF);
+        }
+outB12:
+
+        swap(M0, M1);
+        if (qec) {
+            int curMax = findMax16(mMax);
+            updateResult<int16_t, false>(i, curMax);
+            if (curMax + (m - i) * mm < opt) return;
+        } else {
+            //lastMax = findMax16(mMax);
+        }
+
+    }
+
+    if (!qec) {
+        FOR(i, midstep, m) {
+            vec mmin;            
+            if (qec) {
+                mmin = v_set1_16(max(max(lastMax, opt) - (m - i) * mm, o + e + e * i));
+            } else {
+                mmin = v_set1_16(max(max(lastMax, opt) - (m - i) * (mm - e) + o, o + e + e * i));
+                //mmin = v_set1_16(o + e + e * i);
+            }
+
+            vec mM = v_load(&M0[segNo - 1]);
+            mM = v_shl16(mM);
+            if (i) mM = v_insert0_16(mM, o + e * i    );
+
+            vec mH = v_set1_16(o + e + e * i);
+
+            vec mMax;
+            //if (qec) 
+            mMax = v_zero();
+
+            vec *P = XP[(int)a[i]];
+
+            REP(j, segNo) {
+                vec mP = v_load(&P[j]);
+                vec mV = v_load(&V[j]);
+
+                mM = v_add16(mM, mP);
+
+                //if (qec)
+                mMax = v_max16(mMax, mM);
+
+                mM = v_max16(mM, mV);
+                mM = v_max16(mM, mH);
+                mM = v_max16(mM, mmin);
+
+                v_store(&M1[j], mM);
+
+                mM = v_add16(mM, mo);
+                mV = v_add16(mV, me);
+                mH = v_add16(mH, me);
+                mV = v_max16(mV, mM);
+                mH = v_max16(mH, mM);
+
+                mM  = v_load(&M0[j]);
+
+                v_store(&V[j], mV);
+            }
+
+            mH = v_shl16(mH);
+            mH = v_insert0_16(mH, -INF);
+            if (scan) mH = scan16(mH, e * segNo, minf);
+            while (true) {
+                REP(j, segNo) {
+                    mM = v_load(&M1[j]);
+
+                    vec mtmp = v_add16(mM, mo);
+                    if (!v_any_gt16(mH, mtmp)) goto outB22;
+
+                    mM = v_max16(mM, mH);
+                    v_store(&M1[j], mM);
+
+                    mH = v_add16(mH, me);
+                }
+                if (scan) break;
+                mH = v_shl16(mH);
+                mH = v_insert0_16(mH, -INF);
+            }
+outB22:
+
+            swap(M0, M1);
+            if (qec) {
+                int curMax = findMax16(mMax);
+                updateResult<int16_t, false>(i, curMax);
+                if (curMax + (m - i) * mm < opt) return;
+            } else {
+                lastMax = findMax16(mMax);
+            }
+
+        }
+    }
+
+    if (qec == 0 || lastMax >= opt) {
+        updateResultLast<int16_t, MIN_VAL>();
+    }
+
+}
+
+template <int qec> NOINLINE void Solution4Kernel::processFastVariantA16Bit(const uint8_t *a, int mm, int mi, int o, int e, int iter) {
+    const bool scan = V_SCAN && -e * len < INF; // see scan16
+    vec mo = v_set1_16(o + e);
+    vec me = v_set1_16(e);
+    vec mmin = v_set1_16(MIN_VAL);
+    vec mmin0 = v_insert0_16(v_zero(), MIN_VAL);
+
+    if (iter == -1) {
+        REP(i, segNo) M0[i] = mmin;
+        REP(i, segNo) V[i] = mmin;
+    }
+
+    FOR(i, iter + 1, m) {
+        vec mH = mmin;
+
+        vec mco;
+        if (qec) {
+            mco = v_set1_16(max(max(lastMax, opt) - (m - i) * mm, MIN_VAL));
+        } else {
+            //mco = v_set1_16(max(max(lastMax, opt) - (m - i) * (mm - e) + o, MIN_VAL));
+        }
+
+        vec mM = v_load(&M0[segNo - 1]);
+        mM = v_shl16(mM);
+        mM = v_or(mM, mmin0);
+        //mM = v_insert0_16(mM, MIN_VAL);
+
+        vec *P = XP[(int)a[i]];
+        vec mMax;
+        if (qec) 
+          mMax = mmin;
+
+        REP(j, segNo) {
+            vec mV = v_load(&V[j]);
+
+            mM = v_adds16(mM, P[j]);
+
+            if (qec) 
+              mMax = v_max16(mMax, mM);
+
+            mM = v_max16(mM, mH);
+            mM = v_max16(mM, mV);
+
+            v_store(&M1[j], mM);
+
+            mM = v_adds16(mM, mo);
+            mV = v_adds16(mV, me);
+            mV = v_max16(mV, mM);
+            mH = v_adds16(mH, me);
+            mH = v_max16(mH, mM);
+
+            mM = v_load(&M0[j]);
+
+            v_store(&V[j], mV);
+            ADD(count0);
+        }
+
+
+        mH = v_shl16(mH);
+        mH = v_or(mH, mmin0);
+        //mH = v_insert0_16(mH, MIN_VAL);
+        if (scan) mH = scan16(mH, e * segNo, mmin);
+        while (true) {
+            REP(j, segNo) {
+                ADD(count1);
+                mM = v_load(&M1[j]);
+
+                vec mtmp = v_adds16(mM, mo);
+                if (qec) 
+                  mtmp = v_max16(mtmp, mco);
+                if (!v_any_gt16(mH, mtmp)) goto outA16;
+
+                mM = v_max16(mM, mH);
+                v_store(&M1[j], mM);
+
+                mH = v_adds16(mH, me);
+            }
+            if (scan) break;
+            mH = v_shl16(mH);
+            mH = v_or(mH, mmin0);
+        }
+outA16:
+
+
+        swap(M0, M1);
+        if (qec) {
+            int curMax = findMax16Simple(mMax);
+            updateResult<int16_t, false>(i, curMax);
+            if (curMax + (m - i) * mm < opt) {
+                opt -= MIN_VAL;
+                return;
+            }
+        } else {
+            //lastMax = findMax16Simple(mMax);
+        }
+
+    }
+
+    if (qec == 0 || lastMax >= opt) {
+        updateResultLast<int16_t, MIN_VAL>();
+    }
+
+    opt -= MIN_VAL;
+
+}
+
+template <int qec> NOINLINE int Solution4Kernel::processFastVariantA8Bit(const uint8_t *a, const int mm, const int mi, const int o, const int e) {
+    const bool scan = V_SCAN;
+    const vec mo = v_set1_8(-(o + e));
+    const vec me = v_set1_8(-e);
+    const vec m1 = v_set1_8(1);
+    //const vec m128 = v_set1_8(128);
+    const vec mmaxrange = v_set1_8(255 + mi - mm);
+    const vec mmi = v_set1_8(-mi);
+    const vec mzero = v_zero();
+
+    REP(i, segNo) M0[i] = mzero;
+    REP(i, segNo) V[i] = mzero;
+
+    int midstep = qec ? m : m * 4 / 5;
+    REP(i, midstep) {
+        vec mco;
+        if (qec) mco = v_set1_8(max(max(lastMax, opt) - (m - i) * mm, 0));
+
+        vec mH = mzero;
+
+        vec mM = v_load(&M0[segNo - 1]);
+        mM = v_shl8(mM);
+
+        vec *P = XP[(int)a[i]];
+        vec mMax = mzero;
+
+        REP(j, segNo) {
+            vec mV = v_load(&V[j]);
+
+            mM = v_adds8u(mM, P[j]);
+            mM = v_subs8u(mM, mmi);
+
+            mMax = v_max8u(mMax, mM);
+
+            mM = v_max8u(mM, mH);
+            mM = v_max8u(mM, mV);
+
+            v_store(&M1[j], mM);
+
+            mM = v_subs8u(mM, mo);
+            mV = v_subs8u(mV, me);
+            mV = v_max8u(mV, mM);
+            mH = v_subs8u(mH, me);
+            mH = v_max8u(mH, mM);
+
+            mM = v_load(&M0[j]);
+
+            v_store(&V[j], mV);
+            ADD(count0);
+        }
+
+
+
+        mH = v_shl8(mH);
+        if (scan) mH = scan8(mH, -e * segNo);
+        while (true) {
+            REP(j, segNo) {
+                ADD(count1);
+                mM = v_load(&M1[j]);
+
+                vec mtmp = v_subs8u(mM, mo);
+                mtmp = v_adds8u(mtmp, m1);
+                if (qec) mtmp = v_max8u(mtmp, mco);
+                mtmp = v_max8u(mtmp, mH);
+                if (!v_any_eq8(mH, mtmp)) goto outA81;
+
+                mM = v_max8u(mM, mH);
+                v_store(&M1[j], mM);
+
+                mH = v_subs8u(mH, me);
+            }
+            if (scan) break;
+            mH = v_shl8(mH);
+        }
+outA81:
+
+        swap(M0, M1);
+        if (qec) {
+            int curMax = findMax8(mMax);
+            updateResult<uint8_t, true>(i, curMax);
+            if (curMax > 255 + mi - mm) return i;
+
+
+            /*
+               if (curMax > 255 + mi - mm) {
+               int c0 = (m - i) * mm;
+               int c1 = (m - i) * -e + o;
+            //if (c0 + c1 > curMax - 10) return i;
+            c0 = min(24, c0);
+            vec mshift = v_set1_8(c0);
+            REP(j, segNo) {
+            M0[j] = v_subs8u(M0[j], mshift);
+            V[j] = v_subs8u(V[j], mshift);
+            }
+            shift += c0;
+            opt -= c0;
+            lastMax -= c0;
+            curMax -= c0;
+            }
+            */
+
+            if (curMax + (m - i) * mm < opt) {
+                return -1;
+            }
+        } else {
+            mMax = v_max8u(mMax, mmaxrange);
+            if (v_any_gt8(mMax, mmaxrange)) return i;
+        }
+
+    }
+
+    if (!qec) {
+        FOR(i, midstep, m) {
+            vec mco;
+            if (qec) 
+              mco = v_set1_8(max(max(lastMax, opt) - (m - i) * mm, 0));
+            else
+              mco = v_set1_8(max(max(lastMax, opt) - (m - i) * (mm - e) + o, 0));
+
+            vec mH = mzero;
+
+            vec mM = v_load(&M0[segNo - 1]);
+            mM = v_shl8(mM);
+
+            vec *P = XP[(int)a[i]];
+            vec mMax = mzero;
+
+            REP(j, segNo) {
+                vec mV = v_load(&V[j]);
+
+                mM = v_adds8u(mM, P[j]);
+                mM = v_subs8u(mM, mmi);
+
+                mMax = v_max8u(mMax, mM);
+
+                mM = v_max8u(mM, mH);
+                mM = v_max8u(mM, mV);
+
+                v_store(&M1[j], mM);
+
+                mM = v_subs8u(mM, mo);
+                mV = v_subs8u(mV, me);
+                mV = v_max8u(mV, mM);
+                mH = v_subs8u(mH, me);
+                mH = v_max8u(mH, mM);
+
+                mM = v_load(&M0[j]);
+
+                v_store(&V[j], mV);
+                ADD(count0);
+            }
+
+
+
+            mH = v_shl8(mH);
+            if (scan) mH = scan8(mH, -e * segNo);
+            while (true) {
+                REP(j, segNo) {
+                    ADD(count1);
+                    mM = v_load(&M1[j]);
+
+                    vec mtmp = v_subs8u(mM, mo);
+                    mtmp = v_adds8u(mtmp, m1);
+                    //if (qec) 
+                    mtmp = v_max8u(mtmp, mco);
+                    mtmp = v_max8u(mtmp, mH);
+                    if (!v_any_eq8(mH, mtmp)) goto outA82;
+
+                    mM = v_max8u(mM, mH);
+                    v_store(&M1[j], mM);
+
+                    mH = v_subs8u(mH, me);
+                }
+                if (scan) break;
+                mH = v_shl8(mH);
+            }
+outA82:
+
+            swap(M0, M1);
+            if (qec) {
+                int curMax = findMax8(mMax);
+                updateResult<uint8_t, true>(i, curMax);
+                if (curMax > 255 + mi - mm) return i;
+
+
+                /*
+                   if (curMax > 255 + mi - mm) {
+                   int c0 = (m - i) * mm;
+                   int c1 = (m - i) * -e + o;
+                //if (c0 + c1 > curMax - 10) return i;
+                c0 = min(24, c0);
+                vec mshift = v_set1_8(c0);
+                REP(j, segNo) {
+                M0[j] = v_subs8u(M0[j], mshift);
+                V[j] = v_subs8u(V[j], mshift);
+                }
+                shift += c0;
+                opt -= c0;
+                lastMax -= c0;
+                curMax -= c0;
+                }
+                */
+
+                if (curMax + (m - i) * mm < opt) {
+                    return -1;
+                }
+            } else {
+                lastMax = findMax8(mMax);
+                if (lastMax > 255 + mi - mm) return i;
+            }
+
+        }
+    }
+
+    if (qec == 0 || lastMax >= opt) {
+        updateResultLast<uint8_t, 0>();
+    }
+
+    return -1;
+}
+
+// The 8-bit variant of processFastVariantB16BitA<1>, giving the same results.
+// Row i holds its scores less base, where base is the least of 0 and the
+// lowest score the 16-bit kernel keeps in the row (its mmin).  As that
+// rises by at least e a row, the scores below base (kept as 0) never decide
+// a cell, and the profile holds the scores less min(mi, e) so that moving to
+// the base of the next row only subtracts.  Returns -1 when done, or the last
+// row computed when the next one may not fit in 8 bits; the 16-bit kernel
+// continues from there.
+NOINLINE int Solution4Kernel::processFastVariantB8Bit(const uint8_t *a, const int mm, const int mi, const int o, const int e) {
+    const bool scan = true; // see scan8
+    const int bias = min(mi, e);
+    const vec mo = v_set1_8(-(o + e));
+    const vec mgo = v_set1_8(-o);
+    const vec me = v_set1_8(-e);
+    const vec m1 = v_set1_8(1);
+    const vec mzero = v_zero();
+    const int kpad = segNo - (len - n); // the vectors from here end with a padded lane
+    vec mvalid = v_cmpeq8(mzero, mzero);
+    ((uint8_t*)&mvalid)[V_LANES8 - 1] = 0;
+
+    // the row before the first scores 0, and the gap along the query
+    // (V) is kept less base + e
+    base = o;
+    REP(i, segNo) M0[i] = v_set1_8(-o);
+    REP(i, segNo) V[i] = mzero;
+    int top = 0; // the best score so far
+
+    REP(i, m) {
+        int low = max(max(lastMax, opt) - (m - i) * mm, o + e + e * i);
+        int next = min(low, 0);
+        // the diagonal is at most top + mm, and top - base + mm - bias before moving to next
+        if (255 < top + mm - next || 255 < top - base + mm - bias) return i - 1;
+
+        const vec mdown = v_set1_8(min(next - base - bias, 255));
+        const vec mvdown = v_set1_8(min(next - base - e, 255));
+        const vec mco = v_set1_8(low - next);
+
+        // the score before the first target base is below base unless it
+        // is the gap along the whole query, so take its diagonal exactly
+        int left = i ? o + e * i : 0;
+        int first = left + ((uint8_t*)XP[(int)a[i]])[0] + bias - next;
+        vec mfirst = v_insert0_16(v_cmpeq8(mzero, mzero), (short)(0xFF00 | max(first, 0)));
+
+        vec mH = mzero;
+
+        vec mM = v_load(&M0[segNo - 1]);
+        mM = v_shl8(mM);
+        mM = v_or(mM, v_insert0_16(mzero, (short)max(left - base, 0)));
+
+        vec *P = XP[(int)a[i]];
+        vec mMax = mzero;
+
+        REP(j, segNo) {
+            vec mV = v_load(&V[j]);
+            mV = v_subs8u(mV, mvdown);
+
+            mM = v_adds8u(mM, P[j]);
+            mM = v_subs8u(mM, mdown);
+            if (j == 0) mM = v_min8u(mM, mfirst);
+            if (kpad <= j) mM = v_and(mM, mvalid);
+
+            mMax = v_max8u(mMax, mM);
+
+            mM = v_max8u(mM, mH);
+            mM = v_max8u(mM, mV);
+            mM = v_max8u(mM, mco);
+
+            v_store(&M1[j], mM);
+
+            mV = v_max8u(mV, v_subs8u(mM, mgo));
+            mH = v_subs8u(mH, me);
+            mH = v_max8u(mH, v_subs8u(mM, mo));
+
+            mM = v_load(&M0[j]);
+
+            v_store(&V[j], mV);
+            ADD(count0);
+        }
+
+        mH = v_shl8(mH);
+        if (scan) mH = scan8(mH, -e * segNo);
+        while (true) {
+            REP(j, segNo) {
+                ADD(count1);
+                mM = v_load(&M1[j]);
+
+                vec mtmp = v_subs8u(mM, mo);
+                mtmp = v_adds8u(mtmp, m1);
+                mtmp = v_max8u(mtmp, mco);
+                mtmp = v_max8u(mtmp, mH);
+                if (!v_any_eq8(mH, mtmp)) goto outB81;
+
+                mM = v_max8u(mM, mH);
+                v_store(&M1[j], mM);
+
+                mH = v_subs8u(mH, me);
+            }
+            if (scan) break;
+            mH = v_shl8(mH);
+        }
+outB81:
+
+        swap(M0, M1);
+        int curMax = max(findMax8(mMax) + next, 0);
+        updateResult<uint8_t, true>(i, curMax, base);
+        base = next;
+        top = max(top, curMax);
+        if (curMax + (m - i) * mm < opt) return -1;
+    }
+
+    if (lastMax >= opt) {
+        updateResultLast<uint8_t, 0>(base);
+    }
+
+    return -1;
+}
+
+// element l of the k-th vector of the striped profile holds target position l * segNo + k
+INLINE void Solution4Kernel::setPositions(int lanes) {
+    REP(k, segNo) REP(l, lanes) POS[k * lanes + l] = l * segNo + k;
+}
+
+// widens the 8-bit rows to 16-bit ones, adding base
+NOINLINE  void Solution4Kernel::convertTable(vec *T0, vec *T1, int base) {
+    const int segNoX = segNo / 2;
+    const vec mlo = v_set1_16(0x00FF);
+    const vec mminval = v_set1_16(base);
+    vec *T2 = &T1[segNoX];
+    REP(i, segNoX) {
+        vec m0 = v_load(&T0[i]);
+        vec m1 = v_srli16(m0, 8);
+        m0 = v_and(m0, mlo);
+        m0 = v_add16(m0, mminval);
+        m1 = v_add16(m1, mminval);
+        v_store(&T1[i], m0);
+        v_store(&T2[i], m1);
+    }
+}
+
+template <class T, int SIZE> NOINLINE  void Solution4Kernel::calcInvalidPos(int value) {
+    INVALID_POS_NO = len - n;
+    if (INVALID_POS_NO <= segNo) {
+        REP(i, INVALID_POS_NO) {
+            INVALID_POS[i] = len - 1 - i * SIZE;
+            ((T)XP[0])[INVALID_POS[i]] = value;
+            ((T)XP[1])[INVALID_POS[i]] = value;
+            ((T)XP[2])[INVALID_POS[i]] = value;
+            ((T)XP[3])[INVALID_POS[i]] = value;
+            ((T)XP[4])[INVALID_POS[i]] = value;
+        }
+    } else {
+        INVALID_POS_NO = 0;
+        REP(i, len) if (POS[i] >= n) {
+            INVALID_POS[INVALID_POS_NO] = i;
+            ((T)XP[0])[i] = value;
+            ((T)XP[1])[i] = value;
+            ((T)XP[2])[i] = value;
+            ((T)XP[3])[i] = value;
+            ((T)XP[4])[i] = value;
+            INVALID_POS_NO++;
+        }
+    }
+}
+
+NOINLINE void Solution4Kernel::convert16Bit(const uint8_t *b, int qsc, int mm, int mi, int baseM, int baseV) {
+
+    segNo *= 2;
+    int len64 = len;
+
+    int ptr = 0;
+    vec *XM0 = (vec*)&BUFFER[ptr]; ptr += len64;
+    vec *XM1 = (vec*)&BUFFER[ptr]; ptr += len64;
+    vec *XV = (vec*)&BUFFER[ptr]; ptr += len64;
+    XP[0] = (vec*)&BUFFER[ptr]; ptr += len64;
+    XP[1] = (vec*)&BUFFER[ptr]; ptr += len64;
+    XP[2] = (vec*)&BUFFER[ptr]; ptr += len64;
+    XP[3] = (vec*)&BUFFER[ptr]; ptr += len64;
+    XP[4] = (vec*)&BUFFER[ptr]; ptr += len64;
+    POS = &BUFFER[ptr]; ptr += len64;
+    int16_t* STARG = &BUFFER[ptr];
+
+    if (M0 > M1) swap(XM0, XM1);
+
+    convertTable(V, XV, baseV);
+    convertTable(M0, XM0, baseM);
+
+    M0 = XM0;
+    M1 = XM1;
+    V = XV;
+
+    setPositions(V_LANES16);
+
+    const int16_t SCHAR[5] = {0, 1, 2, 3, 4};
+    vec mmul = v_set1_16(mm - mi);
+    vec madd = v_set1_16(mi);
+    REP(i, len) {
+        if(n <= POS[i]) STARG[i] = 4; // N
+        else STARG[i] = b[POS[i]];
+    }
+    REP(c, 5) {
+        vec mChar = v_set1_16(SCHAR[c]);
+        REP(k, segNo) {
+            vec mTarg = v_load((vec*)&STARG[k * V_LANES16]);
+            vec mnew = v_cmpeq16(mTarg, mChar);
+            mnew = v_srli16(mnew, 1);
+            mnew = v_min16(mnew, mmul);
+            mnew = v_add16(mnew, madd);
+            v_store(&XP[c][k], mnew);
+        }
+    }
+
+    calcInvalidPos<int16_t*, V_LANES16>(-INF); // keep the padding out of the row maxima
+
+}
+
+NOINLINE void Solution4Kernel::preprocess16Bit(const uint8_t *b, int qsc, int mm, int mi) {
+    segNo = (n + V_LANES16 - 1) / V_LANES16;
+    len = segNo * V_LANES16;
+    int len64 = len;
+
+    int ptr = 0;
+    M0 = (vec*)&BUFFER[ptr]; ptr += len64;
+    M1 = (vec*)&BUFFER[ptr]; ptr += len64;
+    V = (vec*)&BUFFER[ptr]; ptr += len64;
+    XP[0] = (vec*)&BUFFER[ptr]; ptr += len64;
+    XP[1] = (vec*)&BUFFER[ptr]; ptr += len64;
+    XP[2] = (vec*)&BUFFER[ptr]; ptr += len64;
+    XP[3] = (vec*)&BUFFER[ptr]; ptr += len64;
+    XP[4] = (vec*)&BUFFER[ptr]; ptr += len64;
+    POS = &BUFFER[ptr]; ptr += len64;
+    int16_t* STARG = &BUFFER[ptr];
+
+      {
+        setPositions(V_LANES16);
+
+        const int16_t SCHAR[5] = {0, 1, 2, 3, 4};
+        vec mmul = v_set1_16(mm - mi);
+        vec madd = v_set1_16(mi);
+        REP(i, len) {
+            if(n <= POS[i]) STARG[i] = 4; // N
+            else STARG[i] = b[POS[i]];
+        }
+        REP(c, 5) {
+            vec mChar = v_set1_16(SCHAR[c]);
+            REP(k, segNo) {
+                vec mTarg = v_load((vec*)&STARG[k * V_LANES16]);
+                vec mnew = v_cmpeq16(mTarg, mChar);
+                mnew = v_srli16(mnew, 1);
+                mnew = v_min16(mnew, mmul);
+                mnew = v_add16(mnew, madd);
+                v_store(&XP[c][k], mnew);
+            }
+        }
+      }
+
+    calcInvalidPos<int16_t*, V_LANES16>(-INF); // keep the padding out of the row maxima
+}
+
+// the profile holds the scores less bias
+void Solution4Kernel::preprocess8Bit(const uint8_t *b, int qsc, int mm, int mi, int bias) {
+    segNo = (n + V_LANES8 - 1) / V_LANES8;
+    len = segNo * V_LANES8;
+    int len64 = len / 2;
+
+    int ptr = 0;
+    M0 = (vec*)&BUFFER[ptr]; ptr += len64;
+    M1 = (vec*)&BUFFER[ptr]; ptr += len64;
+    V = (vec*)&BUFFER[ptr]; ptr += len64;
+    XP[0] = (vec*)&BUFFER[ptr]; ptr += len64;
+    XP[1] = (vec*)&BUFFER[ptr]; ptr += len64;
+    XP[2] = (vec*)&BUFFER[ptr]; ptr += len64;
+    XP[3] = (vec*)&BUFFER[ptr]; ptr += len64;
+    XP[4] = (vec*)&BUFFER[ptr]; ptr += len64;
+    POS = &BUFFER[ptr]; ptr += len64 * 2;
+    int8_t* STARG = (int8_t*)&BUFFER[ptr];
+
+      {
+        setPositions(V_LANES8);
+
+        const int8_t SCHAR[5] = {0, 1, 2, 3, 4};
+        vec mmul = v_set1_8(mm - mi);
+        vec madd = v_set1_8(mi - bias);
+        REP(i, len) {
+            if(n <= POS[i]) STARG[i] = 4; // N
+            else STARG[i] = b[POS[i]];
+        }
+        REP(c, 5) {
+            vec mChar = v_set1_8(SCHAR[c]);
+            REP(k, segNo) {
+                vec mTarg = v_load((vec*)&STARG[k * V_LANES8]);
+                vec mnew = v_cmpeq8(mTarg, mChar);
+                mnew = v_min8u(mnew, mmul);
+                mnew = v_adds8u(mnew, madd);
+                v_store(&XP[c][k], mnew);
+            }
+        }
+      }
+
+    calcInvalidPos<int8_t*, V_LANES8>(0);
+
+}
+
+int Solution4Kernel::process(const string &b, const string &a, int qsc, int qec, 
+                       int mm, int mi, int o, int e, int dir,
+                       int *_opt, int *_te, int *_qe, int *_n_best) {
+    // To integers
+    b_int.resize(b.S);
+    a_int.resize(a.S);
+    REP(i, (int)b.S) b_int[i] = tmap_nt_char_to_int[(int)b[i]];
+    REP(i, (int)a.S) a_int[i] = tmap_nt_char_to_int[(int)a[i]];
+    return process((const uint8_t*)b_int.data(), b.S, (const uint8_t*)a_int.data(), a.S, 
+                   qsc, qec, mm, mi, o, e, dir, _opt, _te, _qe, _n_best);
+}
+
+NOINLINE int Solution4Kernel::process(const uint8_t *b, int32_t _n, const uint8_t *_a, int32_t _m, int qsc, int qec, 
+                                int mm, int mi, int o, int e, int dir,
+                                int *_opt, int *_te, int *_qe, int *_n_best) {
+    n = _n;
+    m = _m;
+
+    resize(m, n);
+
+    //opt = n_best = res_min_pos = res_max_pos = 0;
+    opt = n_best = res_max_pos = 0;
+
+
+    int iter = -1;
+
+#ifdef USE_HASHING
+    uint64_t curHashA = hashDNA(_a, m);
+    uint64_t curHashB = hashDNA(b, n);
+
+    uint64_t hash = curHashA ^ curHashB;
+    if (qsc) hash ^= 0x5555555555555555ULL;
+    if (qec) hash ^= 0xCCCCCCCCCCCCCCCCULL;
+    uint32_t hh = hash >> 8;
+    int htpos = hash & (HTDATA_l - 1); // HTDATA_l must be a power of two
+
+    if (HTDATA[htpos].hash == hh) {
+        qres_t &res = HTDATA[htpos];
+        opt = res.opt;
+        n_best = res.n_best;
+        //res_min_pos = res.res_min_pos;
+        res_max_pos = res.res_max_pos;
+        goto similar;
+    }
+#endif
+
+#ifdef FULL_HEURISTIC
+    if (qsc == 0) {
+        int corr = 0;
+        int c0 = 0;
+        int c1 = 0;
+        int offs = n - m + 1;
+        //uint32_t h = 0;
+        REP(i, offs) {
+            REP(j, m) if (_a[j] != b[i+j]) {
+                goto next;
+            }
+            if (corr == 0) c0 = i;
+            c1 = i;
+            corr++;
+next: ;
+        }
+        if (corr) {
+            n_best = corr;
+            opt = mm * m;
+            //res_min_pos = ((int64_t)m << 32) + c0 + m - 1 - ((int64_t)1 << 32);
+            res_max_pos = ((int64_t)m << 32) + c1 + m - 1 - ((int64_t)1 << 32);
+            goto similar;
+        }
+    }
+#endif
+
+    opt = MIN_VAL;
+    lastMax = MIN_VAL;
+
+    // without clipping the end of the query the scores fall with the
+    // length of the query, and so do not fit in 8 bits
+    if (qsc == 0 && (qec == 0 || 255 < mm - o - e)) goto process16bit; 
+    if (255 < mm - (qsc ? mi : min(mi, e))) goto process16bit;
+    if (!use8Bit) goto process16bit;
+
+//process8bit:        
+
+
+    preprocess8Bit(b, qsc, mm, mi, qsc ? mi : min(mi, e));
+    num8Bit++;
+
+
+    if (qsc) {
+        if (qec) {
+            iter = processFastVariantA8Bit<1>(_a, mm, mi, o, e);
+        } else {
+            iter = processFastVariantA8Bit<0>(_a, mm, mi, o, e);
+        }
+    } else {
+        iter = processFastVariantB8Bit(_a, mm, mi, o, e);
+    }
+
+    if (iter < 0) goto finish;
+    num16Bit++;
+#ifdef CONVERT
+    if (qsc) {
+        convert16Bit(b, qsc, mm, mi, MIN_VAL, MIN_VAL);
+        opt += MIN_VAL;
+        lastMax += MIN_VAL;
+    } else {
+        convert16Bit(b, qsc, mm, mi, base, base + e);
+    }
+    goto go16bit;
+#else
+    opt = MIN_VAL;
+    lastMax = MIN_VAL;
+    iter = -1;
+#endif
+
+process16bit:        
+    preprocess16Bit(b, qsc, mm, mi);
+
+go16bit:
+
+    if (qsc) {
+        if (qec) {
+            processFastVariantA16Bit<1>(_a, mm, mi, o, e, iter);
+        } else {
+            processFastVariantA16Bit<0>(_a, mm, mi, o, e, iter);
+        }
+    } else {
+        if (qec) {
+            processFastVariantB16BitA<1>(_a, mm, mi, o, e, iter);
+        } else {
+            processFastVariantB16BitB<0>(_a, mm, mi, o, e);
+        }
+    }
+
+finish:
+    //res_min_pos -= (int64_t)1 << 32;
+    res_max_pos -= (int64_t)1 << 32;
+
+#ifdef USE_HASHING
+      {
+        qres_t &res = HTDATA[htpos];
+        res.hash = hh;
+        res.opt = opt;
+        res.n_best = n_best;
+        //res.res_min_pos = res_min_pos;
+        res.res_max_pos = res_max_pos;
+      }
+#endif
+
+similar:
+    //int64_t pos = dir == 0 ? res_min_pos : res_max_pos;
+    int64_t pos = res_max_pos;
+
+    int target_end = pos & (MAX_DIMB-1); //1023;
+    int query_end = pos >> 32;
+
+    (*_opt) = opt;
+    (*_te) = target_end;
+    (*_qe) = query_end;
+    (*_n_best) = n_best;
+    
+    return opt;
+}
+
+void Solution4Kernel::getEscalations(int64_t *started, int64_t *escalated) {
+    (*started) = num8Bit;
+    (*escalated) = num16Bit;
+}
+
+void Solution4Kernel::set8Bit(bool enable) {
+    use8Bit = enable;
+}
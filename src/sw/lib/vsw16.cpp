@@ -463,3 +463,202 @@ end_loop:
   }
   return best + sum - zero;
 }
+
+void
+vsw16_sse2_forward_batch(vsw16_query_t *query, const uint8_t *query_seq,
+                         const uint8_t **targets, const int32_t *tlens, int32_t n,
+                         int32_t query_start_clip, int32_t query_end_clip,
+                         vsw_opt_t *opt, int32_t direction, int32_t score_thr,
+                         __m128i *mem, int32_t *scores, int16_t *query_ends, int16_t *target_ends,
+                         int32_t *overflows, int32_t *n_bests)
+{
+  int32_t slen, qlen, npos, i, j, k, l, tlen_max;
+  int32_t best[vsw16_values_per_128_bits], done[vsw16_values_per_128_bits];
+  vsw16_int_t zero, tb[vsw16_values_per_128_bits];
+  vsw16_int_t rmax[vsw16_values_per_128_bits], rpos[vsw16_values_per_128_bits], rcnt[vsw16_values_per_128_bits];
+  __m128i zero_mm, negative_infinity_mm, pen_gapoe, pen_gape, match_mm, mismatch_mm, min_edit_mm, one_mm;
+  __m128i *H, *E, *G, *Q;
+
+  // NB: the cells are computed in the same order, and with the same saturated
+  // arithmetic, as vsw16_sse2_forward, with one target per lane instead of
+  // one stripe of the query per lane.  The striped layout leaks into the
+  // result in two places, which we emulate: E(i+1,j) only sees F(i,j) from
+  // within the same stripe segment of the query, and the padding at the end
+  // of the last stripes is part of the scoring matrix.
+  zero = query->zero_aln_score;
+  score_thr += zero;
+  qlen = query->qlen;
+  slen = query->slen;
+  npos = slen << vsw16_values_per_128_bits_log2;
+  zero_mm = __vsw16_mm_set1_epi16(zero);
+  negative_infinity_mm = __vsw16_mm_set1_epi16(query->min_aln_score);
+  pen_gapoe = __vsw16_mm_set1_epi16(opt->pen_gapo + opt->pen_gape);
+  pen_gape = __vsw16_mm_set1_epi16(opt->pen_gape);
+  match_mm = __vsw16_mm_set1_epi16(opt->score_match);
+  mismatch_mm = __vsw16_mm_set1_epi16(-opt->pen_mm);
+  min_edit_mm = __vsw16_mm_set1_epi16(query->min_edit_score);
+  one_mm = __vsw16_mm_set1_epi16(1);
+  H = mem;
+  E = H + npos;
+  G = E + npos;
+  Q = G + npos;
+
+  // initialize the first row, the leading insertions, and the query
+  for(j = 0; j < npos; j++) {
+      if(0 == query_start_clip) {
+          // NB: the starting values are truncated to 16-bits before the gap
+          // extensions are subtracted, as in the striped layout
+          k = (j + 1) / slen; // the lane holding H(-1,j)
+          int32_t h = (vsw16_int_t)(-opt->pen_gapo - opt->pen_gape - (opt->pen_gape * slen * k) + zero);
+          h -= opt->pen_gape * (((j + 1) % slen) + 1);
+          k = j / slen; // the lane holding the leading insertion for j
+          int32_t g = (0 == k) ? (vsw16_int_t)(-opt->pen_gapo + opt->pen_gape + zero) 
+            : (vsw16_int_t)(-opt->pen_gapo + (-opt->pen_gape * (k * slen - 1)) + zero);
+          g -= opt->pen_gape * ((j % slen) + 1);
+          __vsw_mm_store_si128(H + j, __vsw16_mm_set1_epi16((h < query->min_aln_score) ? query->min_aln_score : h));
+          __vsw_mm_store_si128(E + j, negative_infinity_mm);
+          __vsw_mm_store_si128(G + j, __vsw16_mm_set1_epi16((g < vsw16_min_value) ? vsw16_min_value : g));
+      }
+      else {
+          __vsw_mm_store_si128(H + j, zero_mm);
+          __vsw_mm_store_si128(E + j, zero_mm);
+      }
+      if(j < qlen) {
+          __vsw_mm_store_si128(Q + j, __vsw16_mm_set1_epi16(query_seq[j]));
+      }
+  }
+  tlen_max = 0;
+  for(l = 0; l < vsw16_values_per_128_bits; l++) {
+      best[l] = vsw16_min_value;
+      done[l] = (l < n) ? 0 : 1;
+      if(l < n) {
+          overflows[l] = n_bests[l] = 0;
+          query_ends[l] = target_ends[l] = 0;
+          if(tlen_max < tlens[l]) tlen_max = tlens[l];
+      }
+  }
+
+  for(i = 0; i < tlen_max; i++) { // for each base in the targets
+      __m128i t, e, h, hg, d, s, m, f, f_full, max, pos, cnt, idx;
+
+      for(l = 0; l < vsw16_values_per_128_bits; l++) {
+          tb[l] = (0 == done[l] && i < tlens[l]) ? targets[l][i] : 0;
+      }
+      t = _mm_loadu_si128((__m128i*)tb);
+
+      max = __vsw16_mm_set1_epi16(vsw16_min_value);
+      pos = cnt = _mm_setzero_si128();
+      idx = _mm_setzero_si128();
+      f = f_full = negative_infinity_mm;
+      d = zero_mm; // H(i-1,-1)
+      for(j = k = 0; LIKELY(j < npos); j++) { // for each base in the query
+          __m128i h_prev = __vsw_mm_load_si128(H + j); // H(i-1,j)
+          if(1 == query_start_clip) {
+              d = __vsw16_mm_max_epi16(d, zero_mm);
+          }
+          else {
+              d = __vsw16_mm_max_epi16(d, __vsw_mm_load_si128(G + j)); // leading insertion
+          }
+          if(LIKELY(j < qlen)) {
+              m = __vsw16_mm_cmpeq_epi16(t, __vsw_mm_load_si128(Q + j));
+              s = _mm_or_si128(_mm_and_si128(m, match_mm), _mm_andnot_si128(m, mismatch_mm));
+          }
+          else {
+              s = min_edit_mm;
+          }
+          h = __vsw16_mm_adds_epi16(d, s); // h=H(i-1,j-1)+S(i,j)
+          e = __vsw_mm_load_si128(E + j); // e=E(i,j)
+          h = __vsw16_mm_max_epi16(h, e);
+          h = __vsw16_mm_max_epi16(h, f); // F(i,j) from within this segment
+          h = __vsw16_mm_max_epi16(h, negative_infinity_mm); // bound with -inf
+          hg = __vsw16_mm_subs_epi16(h, pen_gapoe);
+          // E(i+1,j)
+          e = __vsw16_mm_subs_epi16(e, pen_gape);
+          e = __vsw16_mm_max_epi16(e, hg);
+          e = __vsw16_mm_max_epi16(e, negative_infinity_mm);
+          __vsw_mm_store_si128(E + j, e);
+          // F(i,j+1) within this segment
+          if(UNLIKELY(++k == slen)) {
+              f = negative_infinity_mm;
+              k = 0;
+          }
+          else {
+              f = __vsw16_mm_subs_epi16(f, pen_gape);
+              f = __vsw16_mm_max_epi16(f, hg);
+              f = __vsw16_mm_max_epi16(f, negative_infinity_mm);
+          }
+          // H(i,j) with F(i,j) across segments, and F(i,j+1)
+          h = __vsw16_mm_max_epi16(h, f_full);
+          __vsw_mm_store_si128(H + j, h);
+          f_full = __vsw16_mm_subs_epi16(f_full, pen_gape);
+          f_full = __vsw16_mm_max_epi16(f_full, negative_infinity_mm);
+          f_full = __vsw16_mm_max_epi16(f_full, __vsw16_mm_subs_epi16(h, pen_gapoe));
+          // the best cell in this row, and the number of cells with its score
+          if(0 == query_end_clip) {
+              max = __vsw16_mm_max_epi16(max, h);
+          }
+          else {
+              __m128i gt = __vsw16_mm_cmpgt_epi16(h, max);
+              __m128i eq = __vsw16_mm_cmpeq_epi16(h, max);
+              max = __vsw16_mm_max_epi16(max, h);
+              cnt = _mm_or_si128(_mm_and_si128(gt, one_mm), _mm_andnot_si128(gt, _mm_sub_epi16(cnt, eq)));
+              m = (0 == direction) ? gt : _mm_or_si128(gt, eq);
+              pos = _mm_or_si128(_mm_and_si128(m, idx), _mm_andnot_si128(m, pos));
+              idx = _mm_add_epi16(idx, one_mm);
+          }
+          d = h_prev;
+      }
+      _mm_storeu_si128((__m128i*)rmax, max);
+      if(0 == query_end_clip) {
+          _mm_storeu_si128((__m128i*)rpos, __vsw_mm_load_si128(H + qlen - 1));
+      }
+      else {
+          _mm_storeu_si128((__m128i*)rpos, pos);
+          _mm_storeu_si128((__m128i*)rcnt, cnt);
+      }
+
+      for(l = 0; l < vsw16_values_per_128_bits; l++) {
+          int32_t imax = rmax[l];
+          if(1 == done[l] || tlens[l] <= i) continue;
+          if(query->max_aln_score - query->max_edit_score < imax) { // overflow
+              overflows[l] = 1;
+              done[l] = 1;
+              continue;
+          }
+          if(score_thr <= imax && best[l] <= imax) { // potential best score
+              if(0 == query_end_clip) { // check the last
+                  int32_t t_last = rpos[l];
+                  if(best[l] == t_last) n_bests[l]++;
+                  else if(best[l] < t_last) n_bests[l] = 1;
+                  if(1 == vsw16_sse2_dir_cmp(best[l], query_ends[l], target_ends[l], t_last, qlen-1, i, direction)) {
+                      query_ends[l] = qlen-1;
+                      target_ends[l] = i;
+                      best[l] = t_last;
+                  }
+              }
+              else { // check all
+                  if(best[l] == imax) n_bests[l] += rcnt[l];
+                  else n_bests[l] = rcnt[l];
+                  if(1 == vsw16_sse2_dir_cmp(best[l], query_ends[l], target_ends[l], imax, rpos[l], i, direction)) {
+                      query_ends[l] = rpos[l];
+                      target_ends[l] = i;
+                      best[l] = imax;
+                  }
+              }
+          }
+      }
+  }
+
+  for(l = 0; l < n; l++) {
+      if(1 == overflows[l]) {
+          scores[l] = vsw16_min_value;
+      }
+      else if(vsw16_min_value == best[l]) {
+          query_ends[l] = target_ends[l] = -1;
+          scores[l] = vsw16_min_value;
+      }
+      else {
+          scores[l] = best[l] - zero;
+      }
+  }
+}
@@ -85,4 +85,35 @@ vsw16_sse2_forward(vsw16_query_t *query, const uint8_t *target, int32_t tlen,
                         int32_t query_start_clip, int32_t query_end_clip,
                         vsw_opt_t *opt, int16_t *query_end, int16_t *target_end,
                         int32_t direction, int32_t *overflow, int32_t *n_best, int32_t score_thr);
+
+// the number of 128-bit vectors of working memory needed by vsw16_sse2_forward_batch
+#define __vsw16_batch_mem(_slen) (((_slen) << vsw16_values_per_128_bits_log2) << 2)
+
+/*!
+  aligns the query to up to eight targets at once, with one target in each lane
+  @param  query             the query sequence in vectorized form
+  @param  query_seq         the query sequence
+  @param  targets           the target sequences
+  @param  tlens             the target sequence lengths
+  @param  n                 the number of targets (at most vsw16_values_per_128_bits)
+  @param  query_start_clip  1 if we are to clip the start of the query, 0 otherwise
+  @param  query_end_clip    1 if we are to clip the end of the query, 0 otherwise
+  @param  opt               the alignment parameters
+  @param  direction         1 if we are performing forward alignment, 0 otherwise
+  @param  score_thr         the minimum scoring threshold (inclusive)
+  @param  mem               working memory of __vsw16_batch_mem(query->slen) aligned vectors
+  @param  scores            the alignment score for each target
+  @param  query_ends        the query end position for each target (0-based)
+  @param  target_ends       the target end position for each target (0-based)
+  @param  overflows         returns 1 for each target where overflow occurs, 0 otherwise
+  @param  n_bests           the number of best scoring alignments for each target
+  @details  the results are identical to calling vsw16_sse2_forward on each target
+  */
+void
+vsw16_sse2_forward_batch(vsw16_query_t *query, const uint8_t *query_seq,
+                         const uint8_t **targets, const int32_t *tlens, int32_t n,
+                         int32_t query_start_clip, int32_t query_end_clip,
+                         vsw_opt_t *opt, int32_t direction, int32_t score_thr,
+                         __m128i *mem, int32_t *scores, int16_t *query_ends, int16_t *target_ends,
+                         int32_t *overflows, int32_t *n_bests);
 #endif
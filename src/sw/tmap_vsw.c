@@ -29,6 +29,7 @@
 #include <emmintrin.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <string.h>
 #include <config.h>
 #include "../util/tmap_alloc.h"
 #include "../util/tmap_error.h"
@@ -54,6 +55,33 @@ tmap_vsw_init(const uint8_t *query, int32_t qlen,
   return vsw;
 }
 
+tmap_vsw_t*
+tmap_vsw_reuse(tmap_vsw_t *vsw,
+               int32_t query_start_clip, int32_t query_end_clip,
+               int32_t type,
+               tmap_vsw_opt_t *opt)
+{
+  uint64_t num_8bit = 0, num_16bit = 0;
+
+  // the algorithms keep the parameters they were first given
+  if(NULL != vsw 
+     && (type != vsw->type || 0 != memcmp(&vsw->opt_reuse, opt, sizeof(tmap_vsw_opt_t)))) {
+      tmap_vsw_count_escalations(vsw, &num_8bit, &num_16bit);
+      tmap_vsw_destroy(vsw);
+      vsw = NULL;
+  }
+  if(NULL == vsw) {
+      vsw = tmap_vsw_init(NULL, 0, query_start_clip, query_end_clip, type, opt);
+      vsw->num_8bit = num_8bit;
+      vsw->num_16bit = num_16bit;
+  }
+  vsw->query_start_clip = query_start_clip;
+  vsw->query_end_clip = query_end_clip;
+  vsw->opt_reuse = (*opt);
+  vsw->opt = &vsw->opt_reuse;
+  return vsw;
+}
+
 void
 tmap_vsw_destroy(tmap_vsw_t *vsw)
 {
@@ -63,6 +91,16 @@ tmap_vsw_destroy(tmap_vsw_t *vsw)
   free(vsw);
 }
 
+void
+tmap_vsw_count_escalations(tmap_vsw_t *vsw, uint64_t *num_8bit, uint64_t *num_16bit)
+{
+  int64_t started, escalated;
+  if(NULL == vsw) return;
+  tmap_vsw_wrapper_get_escalations(vsw->algorithm, &started, &escalated);
+  (*num_8bit) += vsw->num_8bit + started;
+  (*num_16bit) += vsw->num_16bit + escalated;
+}
+
 #ifdef TMAP_VSW_DEBUG_CMP
 static void
 tmap_vsw_process_compare(tmap_vsw_t *vsw,
@@ -225,6 +263,70 @@ tmap_vsw_process_compare(tmap_vsw_t *vsw,
 }
 #endif
 
+// ignores alignments below the scoring threshold
+static inline void
+tmap_vsw_process_filter(int32_t *score, int32_t *query_end, int32_t *target_end, int32_t *n_best, int32_t score_thr)
+{
+  if((*score) < score_thr || 0 == (*n_best)) {
+      (*query_end) = (*target_end) = -1;
+      (*n_best) = 0;
+      (*score) = INT32_MIN;
+  }
+}
+
+// stores the results of an alignment in the sequencing direction
+static int32_t
+tmap_vsw_process_fwd_result(tmap_vsw_result_t *result, int32_t *overflow, int32_t score_thr,
+                            int32_t score, int32_t query_end, int32_t target_end, int32_t n_best)
+{
+  int32_t found_forward = 1;
+
+  result->query_end = query_end;
+  result->target_end = target_end;
+  result->n_best = n_best;
+  result->score_fwd = score;
+
+  // check forward results
+  if(NULL != overflow && 1 == (*overflow)) {
+      found_forward = 0;
+  }
+  else if(result->score_fwd <- score_thr) {
+      found_forward = 0;
+  }
+  else if((result->query_end == result->query_start || result->target_end == result->target_start)
+          && result->score_fwd <= 0) {
+      found_forward = 0;
+  }
+  else if(n_best <= 0) {
+      found_forward = 0;
+  }
+  else if(-1 == result->query_end) {
+      tmap_bug();
+  }
+
+  // return if we found no legal/good forward results
+  if(0 == found_forward) {
+      result->query_end = result->query_start = 0;
+      result->target_end = result->target_start = 0;
+      result->score_fwd = result->score_rev = INT16_MIN;
+      result->n_best = 0;
+      return INT32_MIN;
+  }
+
+  result->query_start = result->target_start = 0;
+  result->score_rev = INT16_MIN;
+
+#ifdef TMAP_VSW_DEBUG
+  fprintf(stderr, "result->score_fwd=%d result->score_rev=%d\n",
+          result->score_fwd, result->score_rev);
+  fprintf(stderr, "{?-%d] {?-%d}\n",
+          result->query_end,
+          result->target_end);
+#endif
+
+  return result->score_fwd;
+}
+
 static int32_t
 tmap_vsw_process(tmap_vsw_t *vsw,
               const uint8_t *query, int32_t qlen,
@@ -233,7 +335,7 @@ tmap_vsw_process(tmap_vsw_t *vsw,
               int32_t *overflow, int32_t score_thr, 
               int32_t is_rev, int32_t direction)
 {
-  int32_t found_forward = 1, query_end, target_end, n_best, score = INT32_MIN;
+  int32_t query_end, target_end, n_best, score = INT32_MIN;
 #ifdef TMAP_VSW_DEBUG
   int32_t i;
 #endif
@@ -297,58 +399,10 @@ tmap_vsw_process(tmap_vsw_t *vsw,
                                    &score, &target_end, &query_end, &n_best);
       }
   }
-  if(score < score_thr || 0 == n_best) {
-      query_end = target_end = -1;
-      n_best = 0;
-      score = INT32_MIN;
-  }
+  tmap_vsw_process_filter(&score, &query_end, &target_end, &n_best, score_thr);
   
   if(0 == is_rev) {
-
-      result->query_end = query_end;
-      result->target_end = target_end;
-      result->n_best = n_best;
-      result->score_fwd = score;
-
-      // check forward results
-      if(NULL != overflow && 1 == (*overflow)) {
-          found_forward = 0;
-      }
-      else if(result->score_fwd <- score_thr) {
-          found_forward = 0;
-      }
-      else if((result->query_end == result->query_start || result->target_end == result->target_start)
-              && result->score_fwd <= 0) {
-          found_forward = 0;
-      }
-      else if(n_best <= 0) {
-          found_forward = 0;
-      }
-      else if(-1 == result->query_end) {
-          tmap_bug();
-      }
-
-      // return if we found no legal/good forward results
-      if(0 == found_forward) {
-          result->query_end = result->query_start = 0;
-          result->target_end = result->target_start = 0;
-          result->score_fwd = result->score_rev = INT16_MIN;
-          result->n_best = 0;
-          return INT32_MIN;
-      }
-
-      result->query_start = result->target_start = 0;
-      result->score_rev = INT16_MIN;
-
-#ifdef TMAP_VSW_DEBUG
-      fprintf(stderr, "result->score_fwd=%d result->score_rev=%d\n",
-              result->score_fwd, result->score_rev);
-      fprintf(stderr, "{?-%d] {?-%d}\n",
-              result->query_end,
-              result->target_end);
-#endif
-
-      return result->score_fwd;
+      return tmap_vsw_process_fwd_result(result, overflow, score_thr, score, query_end, target_end, n_best);
   }
   else {
 
@@ -439,6 +493,53 @@ tmap_vsw_process_fwd(tmap_vsw_t *vsw,
   return tmap_vsw_process(vsw, query, qlen, target, tlen, result, overflow, score_thr, 0, direction);
 }
 
+void
+tmap_vsw_process_fwd_batch(tmap_vsw_t *vsw,
+                           const uint8_t *query, int32_t qlen,
+                           uint8_t **targets, int32_t *tlens, int32_t n,
+                           tmap_vsw_result_t *results, int32_t *scores,
+                           int32_t *overflows, int32_t score_thr, int32_t direction)
+{
+  int32_t i, j, m;
+  int32_t query_ends[TMAP_VSW_BATCH_SIZE];
+  int32_t target_ends[TMAP_VSW_BATCH_SIZE], n_bests[TMAP_VSW_BATCH_SIZE];
+
+  // check that all fit the main algorithm
+  if(tmap_vsw_wrapper_get_max_qlen(vsw->algorithm) < qlen) m = 0;
+  else {
+      for(m = 0; m < n; m++) {
+          if(tmap_vsw_wrapper_get_max_tlen(vsw->algorithm) < tlens[m]) break;
+      }
+  }
+  if(m < n) { // one at a time, as some may need the default
+      for(i = 0; i < n; i++) {
+          scores[i] = tmap_vsw_process_fwd(vsw, query, qlen, targets[i], tlens[i], &results[i], 
+                                           (NULL == overflows) ? NULL : &overflows[i], score_thr, direction);
+      }
+      return;
+  }
+
+  for(i = 0; i < n; i += m) {
+      m = (n - i < TMAP_VSW_BATCH_SIZE) ? (n - i) : TMAP_VSW_BATCH_SIZE;
+      tmap_vsw_wrapper_process_batch(vsw->algorithm,
+                                     (const uint8_t**)(targets + i), tlens + i, m,
+                                     query, qlen, 
+                                     vsw->opt->score_match,
+                                     -vsw->opt->pen_mm,
+                                     -vsw->opt->pen_gapo,
+                                     -vsw->opt->pen_gape,
+                                     direction, 
+                                     vsw->query_start_clip, vsw->query_end_clip, 
+                                     scores + i, target_ends, query_ends, n_bests);
+      for(j = 0; j < m; j++) {
+          if(NULL != overflows) overflows[i+j] = 0;
+          tmap_vsw_process_filter(&scores[i+j], &query_ends[j], &target_ends[j], &n_bests[j], score_thr);
+          scores[i+j] = tmap_vsw_process_fwd_result(&results[i+j], (NULL == overflows) ? NULL : &overflows[i+j], score_thr, 
+                                                    scores[i+j], query_ends[j], target_ends[j], n_bests[j]);
+      }
+  }
+}
+
 int32_t
 tmap_vsw_process_rev(tmap_vsw_t *vsw,
               const uint8_t *query, int32_t qlen,
@@ -36,6 +36,11 @@
 #include <unistd.h>
 #include "tmap_vsw_definitions.h"
 #include "lib/AffineSWOptimizationWrapper.h"
+
+/*! 
+  the number of targets passed to the underlying algorithm at once in tmap_vsw_process_fwd_batch
+  */
+#define TMAP_VSW_BATCH_SIZE 64
   
 /*!
   Used to run the underlying vectorized smith waterman (VSW) types
@@ -47,6 +52,9 @@ typedef struct {
     int32_t query_start_clip; /*!< 1 if we are to clip the start of the query, 0 otherwise */
     int32_t query_end_clip; /*!< 1 if we are to clip the end of the query, 0 otherwise */
     tmap_vsw_opt_t *opt; /*!< the alignment parameters */
+    tmap_vsw_opt_t opt_reuse; /*!< the alignment parameters when re-used (see tmap_vsw_reuse) */
+    uint64_t num_8bit; /*!< the problems started with 8-bit lanes by the algorithms replaced in tmap_vsw_reuse */
+    uint64_t num_16bit; /*!< of those, the problems that needed 16-bit lanes to finish */
 } tmap_vsw_t;
 
 /*!
@@ -64,12 +72,40 @@ tmap_vsw_init(const uint8_t *query, int32_t qlen,
               int32_t type,
               tmap_vsw_opt_t *opt);
 
+/*!
+  prepares a vectorized smith waterman for re-use with the given clipping and parameters
+  @param  vsw               the structure to re-use, NULL to create one
+  @param  query_start_clip  1 if we are to clip the start of the query, 0 otherwise
+  @param  query_end_clip    1 if we are to clip the end of the query, 0 otherwise
+  @param  type              the VSW type
+  @param  opt               the alignment parameters, which are copied
+  @return                   the structure to use
+  @details  the underlying algorithms, and so their query profiles, are kept unless the type or
+  the alignment parameters have changed; a query profile is then only re-built when the query or
+  the clipping changes
+  */
+tmap_vsw_t*
+tmap_vsw_reuse(tmap_vsw_t *vsw,
+               int32_t query_start_clip, int32_t query_end_clip,
+               int32_t type,
+               tmap_vsw_opt_t *opt);
+
 /*!
   @param  vsw  the structure to destroy
   */
 void
 tmap_vsw_destroy(tmap_vsw_t *vsw);
 
+/*!
+  adds how often the main algorithm escalated from 8-bit to 16-bit lanes
+  @param  vsw        the structure to query, may be NULL
+  @param  num_8bit   the number of problems started with 8-bit lanes, to which to add
+  @param  num_16bit  the number of those problems that needed 16-bit lanes to finish, to which to add
+  @details  the counts are kept from the creation of the structure, including across tmap_vsw_reuse
+  */
+void
+tmap_vsw_count_escalations(tmap_vsw_t *vsw, uint64_t *num_8bit, uint64_t *num_16bit);
+
 /*!
   Performs alignment in the sequencing direction.  This will update query_end and target_end
   in the results.
@@ -95,6 +131,30 @@ tmap_vsw_process_fwd(tmap_vsw_t *vsw,
                  tmap_vsw_result_t *result,
                  int32_t *overflow, int32_t score_thr, int32_t direction);
 
+/*!
+  Performs alignment in the sequencing direction of one query against many targets.  This is 
+  equivalent to calling tmap_vsw_process_fwd on each target in turn.
+  @param  vsw               the query in its vectorized form
+  @param  query             the query sequence
+  @param  qlen              the query sequence length
+  @param  targets           the target sequences
+  @param  tlens             the target sequence lengths
+  @param  n                 the number of targets
+  @param  results           the structures in which to store the results, one per target
+  @param  scores            the alignment score of each target, as returned by tmap_vsw_process_fwd
+  @param  overflows         returns 1 if overflow occurs, 0 otherwise, one per target (may be NULL)
+  @param  score_thr         the minimum scoring threshold (inclusive)
+  @param  direction         how to break ties
+  @details  algorithms that support it align the targets together, with one target in each 
+  vector lane, otherwise the targets are aligned one at a time
+  */
+void
+tmap_vsw_process_fwd_batch(tmap_vsw_t *vsw,
+                           const uint8_t *query, int32_t qlen,
+                           uint8_t **targets, int32_t *tlens, int32_t n,
+                           tmap_vsw_result_t *results, int32_t *scores,
+                           int32_t *overflows, int32_t score_thr, int32_t direction);
+
 /*!
   Performs alignment in the reverse of the sequencing direction.  This will update query_start 
   and target_start in the results.
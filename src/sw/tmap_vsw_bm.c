@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <math.h>
+#include <string.h>
 #include <config.h>
 #include "../util/tmap_alloc.h"
 #include "../util/tmap_error.h"
@@ -10,6 +11,7 @@
 #include "../util/tmap_sort.h"
 #include "../util/tmap_definitions.h"
 #include "../util/tmap_rand.h"
+#include "../util/tmap_time.h"
 #include "../seq/tmap_seq.h"
 #include "../index/tmap_refseq.h"
 #include "../index/tmap_bwt.h"
@@ -100,6 +102,125 @@ tmap_vsw_bm_core(int32_t seq_len, int32_t tlen, int32_t n_iter,
   tmap_rand_destroy(rand);
 }
 
+// a random base, with N one time in a hundred
+static inline uint8_t
+tmap_vsw_bm_check_base(tmap_rand_t *rand)
+{
+  if(tmap_rand_get(rand) < 0.01) return 4;
+  return (uint8_t)(4*tmap_rand_get(rand));
+}
+
+// a random query of up to seq_len bases, and a target of up to tlen bases holding a copy of the
+// query with substitutions and indels
+static void
+tmap_vsw_bm_check_gen(tmap_rand_t *rand, int32_t seq_len, int32_t tlen,
+                      uint8_t *query, int32_t *qlen, uint8_t *target, int32_t *tl)
+{
+  int32_t i, j, k;
+  double r;
+
+  (*qlen) = 1 + (tmap_rand_int(rand) % seq_len);
+  (*tl) = (*qlen) + (tmap_rand_int(rand) % (tlen - (*qlen) + 1));
+  for(i=0;i<(*qlen);i++) {
+      query[i] = tmap_vsw_bm_check_base(rand);
+  }
+  for(i=0;i<(*tl);i++) {
+      target[i] = tmap_vsw_bm_check_base(rand);
+  }
+  k = tmap_rand_int(rand) % ((*tl) - (*qlen) + 1);
+  for(j=0;j<(*qlen) && k<(*tl);j++) {
+      r = tmap_rand_get(rand);
+      if(r < 0.05) target[k++] = (query[j] + 1 + (tmap_rand_int(rand) % 3)) & 3; // substitution
+      else if(r < 0.07) continue; // deletion
+      else if(r < 0.09) { target[k++] = tmap_vsw_bm_check_base(rand); j--; } // insertion
+      else target[k++] = query[j];
+  }
+}
+
+// checks the default algorithm for each instruction set against SSE2, and against itself with
+// only 16-bit lanes, and times each of them
+static void
+tmap_vsw_bm_check(int32_t seq_len, int32_t tlen, int32_t n_iter, int32_t n_sub_iter)
+{
+  int32_t i, j, simd, best;
+  int32_t qlen, tl, qsc, qec, res[4], res16[4];
+  int64_t num_8bit, num_16bit;
+  int32_t *ref = NULL;
+  uint8_t *query = NULL, *target = NULL;
+  tmap_vsw_wrapper_t *algorithm = NULL, *algorithm16 = NULL;
+  tmap_map_opt_t *opt = tmap_map_opt_init(TMAP_MAP_ALGO_NONE);
+  tmap_rand_t *rand = tmap_rand_init(13);
+  double t;
+
+  query = tmap_malloc(sizeof(uint8_t) * seq_len, "query");
+  target = tmap_malloc(sizeof(uint8_t) * tlen, "target");
+  ref = tmap_malloc(sizeof(int32_t) * 4 * n_iter, "ref");
+
+  for(best=TMAP_VSW_SIMD_NUM-1;TMAP_VSW_SIMD_SSE2<best;best--) {
+      if(tmap_vsw_wrapper_simd_supported(best)) break;
+  }
+  tmap_progress_print2("checking VSW type %d against %s (%s was chosen)", opt->vsw_type,
+                       tmap_vsw_wrapper_simd_name(TMAP_VSW_SIMD_SSE2), tmap_vsw_wrapper_simd_name(best));
+
+  for(simd=TMAP_VSW_SIMD_SSE2;simd<TMAP_VSW_SIMD_NUM;simd++) {
+      if(!tmap_vsw_wrapper_simd_supported(simd)) {
+          tmap_progress_print2("%s not supported on this host", tmap_vsw_wrapper_simd_name(simd));
+          continue;
+      }
+      algorithm = tmap_vsw_wrapper_init_simd(opt->vsw_type, simd);
+      algorithm16 = tmap_vsw_wrapper_init_simd(opt->vsw_type, simd);
+      tmap_vsw_wrapper_set_8bit(algorithm16, 0);
+      // the same problems for each instruction set
+      tmap_rand_reinit(rand, 13);
+      t = 0.0;
+      for(i=0;i<n_iter;i++) {
+          tmap_vsw_bm_check_gen(rand, seq_len, tlen, query, &qlen, target, &tl);
+          qsc = (i >> 1) & 1;
+          qec = i & 1;
+          t -= tmap_time_cputime();
+          for(j=0;j<n_sub_iter;j++) {
+              tmap_vsw_wrapper_process(algorithm, target, tl, query, qlen,
+                                       opt->score_match, -opt->pen_mm, -opt->pen_gapo, -opt->pen_gape, 0,
+                                       qsc, qec, &res[0], &res[1], &res[2], &res[3]);
+          }
+          t += tmap_time_cputime();
+          tmap_vsw_wrapper_process(algorithm16, target, tl, query, qlen,
+                                   opt->score_match, -opt->pen_mm, -opt->pen_gapo, -opt->pen_gape, 0,
+                                   qsc, qec, &res16[0], &res16[1], &res16[2], &res16[3]);
+          if(0 != memcmp(res16, res, 4 * sizeof(int32_t))) {
+              tmap_progress_print2("%s did not match with only 16-bit lanes on problem %d (qlen=%d tlen=%d qsc=%d qec=%d):"
+                                   " score %d/%d target end %d/%d query end %d/%d n_best %d/%d",
+                                   tmap_vsw_wrapper_simd_name(simd), i, qlen, tl, qsc, qec,
+                                   res[0], res16[0], res[1], res16[1], res[2], res16[2], res[3], res16[3]);
+              tmap_error("inconsistency found in the VSW kernel", Exit, OutOfRange);
+          }
+          if(TMAP_VSW_SIMD_SSE2 == simd) {
+              memcpy(ref + 4*i, res, 4 * sizeof(int32_t));
+          }
+          else if(0 != memcmp(ref + 4*i, res, 4 * sizeof(int32_t))) {
+              tmap_progress_print2("%s did not match on problem %d (qlen=%d tlen=%d qsc=%d qec=%d):"
+                                   " score %d/%d target end %d/%d query end %d/%d n_best %d/%d",
+                                   tmap_vsw_wrapper_simd_name(simd), i, qlen, tl, qsc, qec,
+                                   res[0], ref[4*i], res[1], ref[4*i+1], res[2], ref[4*i+2], res[3], ref[4*i+3]);
+              tmap_error("inconsistency found in the VSW kernel", Exit, OutOfRange);
+          }
+      }
+      tmap_vsw_wrapper_get_escalations(algorithm, &num_8bit, &num_16bit);
+      tmap_progress_print2("%s: %.2f seconds, matched %s on all %d problems (%lld of the %lld started with 8-bit lanes needed 16-bit lanes)", 
+                           tmap_vsw_wrapper_simd_name(simd), t, 
+                           (TMAP_VSW_SIMD_SSE2 == simd) ? "only 16-bit lanes" : "SSE2 and only 16-bit lanes", n_iter,
+                           (long long int)num_16bit, (long long int)num_8bit);
+      tmap_vsw_wrapper_destroy(algorithm);
+      tmap_vsw_wrapper_destroy(algorithm16);
+  }
+
+  free(ref);
+  free(target);
+  free(query);
+  tmap_map_opt_destroy(opt);
+  tmap_rand_destroy(rand);
+}
+
 static int
 usage(int32_t seq_len, int32_t tlen, int32_t n_iter, 
       int32_t n_sub_iter, int32_t vsw_type)
@@ -114,6 +235,9 @@ usage(int32_t seq_len, int32_t tlen, int32_t n_iter,
   tmap_file_fprintf(tmap_file_stderr, "         -N INT      the number of re-evaluations of the same query/target combination [%d]\n", n_sub_iter);
   tmap_file_fprintf(tmap_file_stderr, "         -H INT      smith waterman algorithm [%d]\n", vsw_type);
   tmap_file_fprintf(tmap_file_stderr, "Options (optional):\n");
+  tmap_file_fprintf(tmap_file_stderr, "         -C          check the default algorithm for each instruction set against SSE2 instead,\n");
+  tmap_file_fprintf(tmap_file_stderr, "                     and against itself with only 16-bit lanes, with random query and\n");
+  tmap_file_fprintf(tmap_file_stderr, "                     target lengths up to -q and -t\n");
   tmap_file_fprintf(tmap_file_stderr, "         -h          print this message\n");
   tmap_file_fprintf(tmap_file_stderr, "\n");
   return 1;
@@ -128,9 +252,10 @@ tmap_vswbm_main(int argc, char *argv[])
   int32_t n_iter = 1000;
   int32_t n_sub_iter = 1;
   int32_t vsw_type = 0;
+  int32_t check = 0;
   int c;
 
-  while((c = getopt(argc, argv, "q:t:n:N:H:h")) >= 0) {
+  while((c = getopt(argc, argv, "q:t:n:N:H:Ch")) >= 0) {
       switch(c) {
         case 'q':
           seq_len = atoi(optarg); break;
@@ -142,19 +267,26 @@ tmap_vswbm_main(int argc, char *argv[])
           n_sub_iter = atoi(optarg); break;
         case 'H':
           vsw_type = atoi(optarg); break;
+        case 'C':
+          check = 1; break;
         case 'h':
         default:
           return usage(seq_len, tlen, n_iter, n_sub_iter, vsw_type);
       }
   }
-  if(argc != optind || seq_len > tlen) {
+  if(argc != optind || seq_len > tlen || seq_len <= 0) {
       return usage(seq_len, tlen, n_iter, n_sub_iter, vsw_type);
   }
 
   tmap_progress_set_verbosity(1);
   tmap_progress_print2("starting benchmark");
 
-  tmap_vsw_bm_core(seq_len, tlen, n_iter, n_sub_iter, vsw_type);
+  if(1 == check) {
+      tmap_vsw_bm_check(seq_len, tlen, n_iter, n_sub_iter);
+  }
+  else {
+      tmap_vsw_bm_core(seq_len, tlen, n_iter, n_sub_iter, vsw_type);
+  }
   
   tmap_progress_print2("ending benchmark");
 
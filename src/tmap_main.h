@@ -53,6 +53,8 @@ tmap_bwt_pac2bwt_main(int argc, char *argv[]);
 extern int
 tmap_sa_bwt2sa_main(int argc, char *argv[]);
 extern int
+tmap_index_mmap_main(int argc, char *argv[]);
+extern int
 tmap_seq_io_sff2fq_main(int argc, char *argv[]);
 extern int
 tmap_seqs_io_sff2sam_main(int argc, char *argv[]);
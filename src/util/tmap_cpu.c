@@ -0,0 +1,67 @@
+/* Copyright (C) 2010 Ion Torrent Systems, Inc. All Rights Reserved */
+#include <config.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "tmap_cpu.h"
+#ifdef TMAP_CPU_X86
+#include <cpuid.h>
+#endif
+
+// NB: -1 until detected
+static int64_t tmap_cpu_features_cache = -1;
+
+#ifdef TMAP_CPU_X86
+// the register state the operating system saves (XCR0)
+static uint64_t
+tmap_cpu_xgetbv()
+{
+  uint32_t eax, edx;
+  __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return ((uint64_t)edx << 32) | eax;
+}
+
+static uint32_t
+tmap_cpu_detect()
+{
+  uint32_t eax, ebx, ecx, edx, max_leaf;
+  uint32_t features = 0;
+  uint64_t xcr0 = 0;
+
+  max_leaf = __get_cpuid_max(0, NULL);
+  if(max_leaf < 1) return 0;
+
+  __cpuid(1, eax, ebx, ecx, edx);
+  if(ecx & bit_POPCNT) features |= TMAP_CPU_POPCNT;
+  if(!(ecx & bit_OSXSAVE) || !(ecx & bit_AVX)) return features;
+  xcr0 = tmap_cpu_xgetbv();
+  if(0x6 != (xcr0 & 0x6)) return features; // the XMM and YMM state
+  if(max_leaf < 7) return features;
+
+  __cpuid_count(7, 0, eax, ebx, ecx, edx);
+  if(ebx & (1u << 5)) features |= TMAP_CPU_AVX2;
+  if(0xe6 == (xcr0 & 0xe6) // the opmask and ZMM state
+     && (ebx & (1u << 16)) // AVX512F
+     && (ebx & (1u << 30))) { // AVX512BW
+      features |= TMAP_CPU_AVX512BW;
+      if((ebx & (1u << 31)) // AVX512VL
+         && (ecx & (1u << 14))) { // AVX512_VPOPCNTDQ
+          features |= TMAP_CPU_AVX512;
+      }
+  }
+
+  return features;
+}
+#endif
+
+uint32_t
+tmap_cpu_features()
+{
+  if(tmap_cpu_features_cache < 0) {
+#ifdef TMAP_CPU_X86
+      tmap_cpu_features_cache = tmap_cpu_detect();
+#else
+      tmap_cpu_features_cache = 0;
+#endif
+  }
+  return (uint32_t)tmap_cpu_features_cache;
+}
@@ -0,0 +1,45 @@
+/* Copyright (C) 2010 Ion Torrent Systems, Inc. All Rights Reserved */
+#ifndef TMAP_CPU_H
+#define TMAP_CPU_H
+
+#include <stdint.h>
+
+/*!
+  Run-time CPU Feature Detection
+  @details  The vector kernels are compiled for each instruction set with
+  function target attributes, and chosen at run time with the CPUID
+  instruction, so that one binary uses the best kernel the host supports.
+  */
+
+/*!
+  @details  the CPU features used by the kernels
+  */
+enum {
+    TMAP_CPU_POPCNT = 0x1, /*!< the SSE4.2 population count instruction */
+    TMAP_CPU_AVX2   = 0x2, /*!< AVX2 with operating system support */
+    TMAP_CPU_AVX512 = 0x4, /*!< AVX-512 F, BW, VL and VPOPCNTDQ with operating system support */
+    TMAP_CPU_AVX512BW = 0x8 /*!< AVX-512 F and BW with operating system support */
+};
+
+/*! d TMAP_CPU_X86
+  defined if the x86 vector kernels can be compiled
+  */
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) || 7 <= __GNUC__)
+#define TMAP_CPU_X86 1
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+  @return  the features of this CPU (TMAP_CPU_*), detected once
+  */
+uint32_t
+tmap_cpu_features();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
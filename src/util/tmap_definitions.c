@@ -219,12 +219,30 @@ tmap_get_file_name(const char *prefix, int32_t type)
       strcpy(fn, prefix);
       strcat(fn, TMAP_SA_FILE_EXTENSION);
       break;
+    case TMAP_MMAP_FILE:
+      fn = tmap_malloc(sizeof(char)*(1+strlen(prefix)+strlen(TMAP_MMAP_FILE_EXTENSION)), "fn");
+      strcpy(fn, prefix);
+      strcat(fn, TMAP_MMAP_FILE_EXTENSION);
+      break;
+    case TMAP_DSA_FILE:
+      fn = tmap_malloc(sizeof(char)*(1+strlen(prefix)+strlen(TMAP_DSA_FILE_EXTENSION)), "fn");
+      strcpy(fn, prefix);
+      strcat(fn, TMAP_DSA_FILE_EXTENSION);
+      break;
     default:
       return NULL;
   }
   return fn;
 }
 
+uint8_t *
+tmap_packed_pad(uint8_t *start, uint8_t *buf)
+{
+  size_t n = buf - start;
+  memset(buf, 0, __tmap_packed_align(n) - n);
+  return start + __tmap_packed_align(n);
+}
+
 int
 tmap_get_reads_file_format_int(char *optarg)
 {
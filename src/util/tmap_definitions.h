@@ -33,6 +33,14 @@
   the file extension for the SA structure
   */
 #define TMAP_SA_FILE_EXTENSION ".tmap.sa"
+/*! d TMAP_MMAP_FILE_EXTENSION
+  the file extension for the memory-mapped index
+  */
+#define TMAP_MMAP_FILE_EXTENSION ".tmap.mmap"
+/*! d TMAP_DSA_FILE_EXTENSION
+  the file extension for the fully stored SA intervals of frequent k-mers
+  */
+#define TMAP_DSA_FILE_EXTENSION ".tmap.dsa"
 
 // The default compression types for each file
 // Note: the implementation relies on no compression
@@ -72,8 +80,22 @@ enum {
     TMAP_PAC_FILE      = 1, /*!< the packed forward reference sequence file */
     TMAP_BWT_FILE      = 2, /*!< the packed BWT file */
     TMAP_SA_FILE       = 3, /*!< the packed SA file */
+    TMAP_MMAP_FILE     = 4, /*!< the memory-mapped index file */
+    TMAP_DSA_FILE      = 5, /*!< the fully stored SA intervals file (optional) */
 };
 
+/*! d TMAP_PACKED_ALIGNMENT
+  the alignment, in bytes, of the large arrays when the index is packed into
+  shared memory or a memory-mapped file (one page)
+  */
+#define TMAP_PACKED_ALIGNMENT 4096
+
+/*! 
+  @param  n  the number of bytes
+  @return    the number of bytes rounded up to a multiple of TMAP_PACKED_ALIGNMENT
+  */
+#define __tmap_packed_align(n) (((size_t)(n) + TMAP_PACKED_ALIGNMENT - 1) & ~((size_t)TMAP_PACKED_ALIGNMENT - 1))
+
 /*! 
 */
 enum {
@@ -261,6 +283,15 @@ tmap_log2(uint32_t v);
 inline char *
 tmap_get_file_name(const char *prefix, int32_t type);
 
+/*! 
+  pads a packed buffer with zeros up to the next aligned position
+  @param  start  the start of the packed buffer, which is itself aligned
+  @param  buf    the current position in the packed buffer
+  @return        the next position aligned to TMAP_PACKED_ALIGNMENT from the start
+  */
+uint8_t *
+tmap_packed_pad(uint8_t *start, uint8_t *buf);
+
 /*! 
   @param  optarg  the string of the file format
   @return         the format type
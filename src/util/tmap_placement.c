@@ -0,0 +1,189 @@
+/* Copyright (C) 2010 Ion Torrent Systems, Inc. All Rights Reserved */
+#include <config.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "tmap_error.h"
+#include "tmap_placement.h"
+
+// NB: from <linux/mman.h> and <numaif.h>, which may not be installed
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+#ifndef MPOL_INTERLEAVE
+#define MPOL_INTERLEAVE 3
+#endif
+
+#define TMAP_PLACEMENT_NODE_DIR "/sys/devices/system/node"
+
+// only warn once when falling back from huge pages
+static int32_t tmap_placement_warned = 0;
+
+size_t
+tmap_placement_page_size(int32_t huge_pages)
+{
+  switch(huge_pages) {
+    case TMAP_PLACEMENT_HUGE_PAGES_2MB:
+      return ((size_t)1) << 21;
+    case TMAP_PLACEMENT_HUGE_PAGES_1GB:
+      return ((size_t)1) << 30;
+    case TMAP_PLACEMENT_HUGE_PAGES_NONE:
+    default:
+      return (size_t)sysconf(_SC_PAGESIZE);
+  }
+}
+
+int32_t
+tmap_placement_num_nodes()
+{
+  int32_t n;
+  char path[256];
+  struct stat st;
+
+  for(n=0;n<TMAP_PLACEMENT_MAX_NODES;n++) {
+      sprintf(path, "%s/node%d", TMAP_PLACEMENT_NODE_DIR, n);
+      if(0 != stat(path, &st)) break;
+  }
+  return (0 == n) ? 1 : n;
+}
+
+// rounds up to a multiple of the page size
+static size_t
+tmap_placement_round(size_t size, int32_t huge_pages)
+{
+  size_t page_size = tmap_placement_page_size(huge_pages);
+  if(0 == size) size = 1;
+  return ((size + page_size - 1) / page_size) * page_size;
+}
+
+int32_t
+tmap_placement_bind(void *ptr, size_t size, int32_t numa, int32_t node)
+{
+#ifdef SYS_mbind
+  int32_t i, num_nodes, mode;
+  unsigned long mask = 0;
+
+  num_nodes = tmap_placement_num_nodes();
+  if(num_nodes <= 1) return 0; // nothing to do
+
+  switch(numa) {
+    case TMAP_PLACEMENT_NUMA_INTERLEAVE:
+      for(i=0;i<num_nodes;i++) {
+          mask |= 1UL << i;
+      }
+      mode = MPOL_INTERLEAVE;
+      break;
+    case TMAP_PLACEMENT_NUMA_REPLICATE:
+      // NB: preferred rather than bound, so that a full node does not fail
+      mask = 1UL << (node % num_nodes);
+      mode = MPOL_PREFERRED;
+      break;
+    case TMAP_PLACEMENT_NUMA_NONE:
+    default:
+      return 0;
+  }
+  if(0 != syscall(SYS_mbind, ptr, size, mode, &mask, (unsigned long)(sizeof(unsigned long) << 3), 0)) {
+      tmap_error("could not set the NUMA placement", Warn, OutOfRange);
+      return 0;
+  }
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+void *
+tmap_placement_alloc(size_t size, int32_t huge_pages, int32_t numa, int32_t node)
+{
+  void *ptr = MAP_FAILED;
+  int32_t flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+  size = tmap_placement_round(size, huge_pages);
+
+#ifdef MAP_HUGETLB
+  if(TMAP_PLACEMENT_HUGE_PAGES_NONE != huge_pages) {
+      ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                 flags | MAP_HUGETLB | ((TMAP_PLACEMENT_HUGE_PAGES_1GB == huge_pages) ? MAP_HUGE_1GB : MAP_HUGE_2MB),
+                 -1, 0);
+  }
+#endif
+  if(MAP_FAILED == ptr) {
+      if(TMAP_PLACEMENT_HUGE_PAGES_NONE != huge_pages && 0 == tmap_placement_warned) {
+          tmap_error("could not reserve huge pages, falling back to transparent huge pages", Warn, MallocMemory);
+          tmap_placement_warned = 1;
+      }
+      ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+      if(MAP_FAILED == ptr) {
+          tmap_error("mmap", Exit, MallocMemory);
+      }
+#ifdef MADV_HUGEPAGE
+      if(TMAP_PLACEMENT_HUGE_PAGES_NONE != huge_pages) {
+          madvise(ptr, size, MADV_HUGEPAGE); // a hint only
+      }
+#endif
+  }
+
+  // NB: before the pages are touched
+  tmap_placement_bind(ptr, size, numa, node);
+
+  return ptr;
+}
+
+void
+tmap_placement_free(void *ptr, size_t size, int32_t huge_pages)
+{
+  if(NULL == ptr) return;
+  munmap(ptr, tmap_placement_round(size, huge_pages));
+}
+
+int32_t
+tmap_placement_pin_thread(int32_t node)
+{
+#ifdef CPU_SET
+  FILE *fp = NULL;
+  char path[256];
+  int32_t low, high, n, c;
+  cpu_set_t set;
+
+  sprintf(path, "%s/node%d/cpulist", TMAP_PLACEMENT_NODE_DIR, node);
+  if(NULL == (fp = fopen(path, "r"))) return 0;
+
+  // parse a list such as "0-7,16-23"
+  CPU_ZERO(&set);
+  n = 0;
+  while(1 == fscanf(fp, "%d", &low)) {
+      high = low;
+      c = fgetc(fp);
+      if('-' == c) {
+          if(1 != fscanf(fp, "%d", &high)) break;
+          c = fgetc(fp);
+      }
+      for(;low<=high && low<CPU_SETSIZE;low++) {
+          CPU_SET(low, &set);
+          n++;
+      }
+      if(',' != c) break;
+  }
+  fclose(fp);
+
+  // NB: zero is the calling thread
+  if(0 == n || 0 != sched_setaffinity(0, sizeof(cpu_set_t), &set)) return 0;
+  return 1;
+#else
+  return 0;
+#endif
+}
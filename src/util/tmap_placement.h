@@ -0,0 +1,95 @@
+/* Copyright (C) 2010 Ion Torrent Systems, Inc. All Rights Reserved */
+#ifndef TMAP_PLACEMENT_H
+#define TMAP_PLACEMENT_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/*!
+  Huge Page and NUMA Placement of Large Arrays
+  @details  Random access into the BWT and SA is dominated by TLB misses on
+  large genomes, so these arrays may be placed on huge pages.  On hosts with
+  multiple NUMA nodes, their pages may be interleaved across the nodes, or a
+  copy placed on each node with the threads pinned to the node whose copy
+  they use.  No NUMA library is required; the kernel interface is used
+  directly, and the NUMA options have no effect on a single node.
+  */
+
+/*!
+  @details  the page size to use
+  */
+enum {
+    TMAP_PLACEMENT_HUGE_PAGES_NONE = 0, /*!< the default page size */
+    TMAP_PLACEMENT_HUGE_PAGES_2MB  = 1, /*!< 2MB huge pages */
+    TMAP_PLACEMENT_HUGE_PAGES_1GB  = 2 /*!< 1GB huge pages */
+};
+
+/*!
+  @details  the placement across the NUMA nodes
+  */
+enum {
+    TMAP_PLACEMENT_NUMA_NONE       = 0, /*!< the default (first touch) placement */
+    TMAP_PLACEMENT_NUMA_INTERLEAVE = 1, /*!< interleave the pages across the nodes */
+    TMAP_PLACEMENT_NUMA_REPLICATE  = 2 /*!< a copy on each node, with the threads pinned to match */
+};
+
+/*!
+  the maximum number of NUMA nodes supported
+  */
+#define TMAP_PLACEMENT_MAX_NODES 64
+
+/*!
+  @param  huge_pages  the page size to use (TMAP_PLACEMENT_HUGE_PAGES_*)
+  @return             the number of bytes in a page
+  */
+size_t
+tmap_placement_page_size(int32_t huge_pages);
+
+/*!
+  @return  the number of NUMA nodes on this host (at least one)
+  */
+int32_t
+tmap_placement_num_nodes();
+
+/*!
+  Allocates memory with the given placement
+  @param  size        the number of bytes to allocate
+  @param  huge_pages  the page size to use (TMAP_PLACEMENT_HUGE_PAGES_*)
+  @param  numa        the NUMA placement (TMAP_PLACEMENT_NUMA_*)
+  @param  node        the node to place the memory on when replicating
+  @return             the allocated memory, aligned to a page
+  @details            falls back to transparent huge pages, with a warning, if
+  the huge pages could not be reserved (see /proc/sys/vm/nr_hugepages)
+  */
+void *
+tmap_placement_alloc(size_t size, int32_t huge_pages, int32_t numa, int32_t node);
+
+/*!
+  Frees memory allocated with tmap_placement_alloc
+  @param  ptr         the memory to free
+  @param  size        the number of bytes allocated
+  @param  huge_pages  the page size used to allocate
+  */
+void
+tmap_placement_free(void *ptr, size_t size, int32_t huge_pages);
+
+/*!
+  Applies the NUMA placement to memory whose pages have not yet been touched
+  @param  ptr   the memory, aligned to a page
+  @param  size  the number of bytes
+  @param  numa  the NUMA placement (TMAP_PLACEMENT_NUMA_*)
+  @param  node  the node to place the memory on when replicating
+  @return       1 if the placement was applied, 0 otherwise
+  */
+int32_t
+tmap_placement_bind(void *ptr, size_t size, int32_t numa, int32_t node);
+
+/*!
+  Pins the calling thread to the CPUs of the given node
+  @param  node  the NUMA node
+  @return       1 if the thread was pinned, 0 otherwise
+  */
+int32_t
+tmap_placement_pin_thread(int32_t node);
+
+#endif
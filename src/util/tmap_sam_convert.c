@@ -328,6 +328,9 @@ tmap_sam_convert_add_optional(bam1_t *b, const char *format, va_list ap, tmap_sa
   }
 }
 
+// the longest reference window decoded on the stack when computing the MD tag
+#define TMAP_SAM_MD_BUFFER_LENGTH 1024
+
 static inline tmap_string_t *
 tmap_sam_md(tmap_refseq_t *refseq, char *read_bases, // read bases are characters
             uint32_t seqid, uint32_t pos, // seqid and pos are 0-based
@@ -338,7 +341,8 @@ tmap_sam_md(tmap_refseq_t *refseq, char *read_bases, // read bases are character
   int32_t l = 0; // the length of the last md op
   uint8_t read_base, ref_base;
   tmap_string_t *md=NULL;
-  uint8_t *target = NULL;;
+  uint8_t *target = NULL;
+  uint8_t buffer[TMAP_SAM_MD_BUFFER_LENGTH];
 
   md = tmap_string_init(32);
   (*nm) = 0;
@@ -358,7 +362,10 @@ tmap_sam_md(tmap_refseq_t *refseq, char *read_bases, // read bases are character
   }
   ref_end--;
       
-  target = tmap_refseq_subseq2(refseq, seqid+1, ref_start, ref_end, NULL, 0, NULL);
+  // decode short windows into the stack buffer
+  target = tmap_refseq_subseq2(refseq, seqid+1, ref_start, ref_end, 
+                               (ref_start <= ref_end && ref_end - ref_start + 1 <= TMAP_SAM_MD_BUFFER_LENGTH) ? buffer : NULL, 
+                               0, NULL);
   if(NULL == target) {
       tmap_bug();
   }
@@ -441,7 +448,7 @@ tmap_sam_md(tmap_refseq_t *refseq, char *read_bases, // read bases are character
   tmap_string_lsprintf(md, md->l, "%d", l);
   if(NULL != bases_eq) bases_eq[read_i] = '\0';
 
-  free(target);
+  if(target != buffer) free(target);
 
   return md;
 }